@@ -0,0 +1,384 @@
+/**
+ * Microbenchmarks of the pipeline's hot paths:
+ * - PCQueue: queue_add/queue_remove with 1, 2 and 4 producer-consumer pairs.
+ * - JSON parsing: json_callback (through lejp_parse) on trade frames.
+ * - Calculator: add_trade_to_buffers and write_and_reset_buffers at various
+ *   symbol counts.
+ *
+ * Each benchmark runs once for warmup and then for a number of repetitions,
+ * reporting ns/op and ops/sec (of the median repetition) and the best ns/op.
+ *
+ * Usage: ./bench [-r repetitions] [-s scale] [-b trades_per_frame]
+ *                [-f trade_logs_folder] [filter]
+ *
+ * Frames are built from the recorded trades of -f, or synthetic ones.
+ * Only benchmarks whose name contains filter are run.
+*/
+#include <libwebsockets.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Generator.h"
+#include "JSONParsing.h"
+#include "PCQueue.h"
+#include "Replay.h"
+#include "Symbols.h"
+#include "TradeProcessing.h"
+
+#define BENCH_MAX_REPETITIONS 100
+#define BENCH_NAME_LENGTH 64
+#define BENCH_FRAMES 1000 // Distinct frames parsed in cycles
+#define BENCH_MAX_SYMBOLS 4096
+
+// Symbol list used by the JSON parser's lookups
+const char (*symbols_list)[SYMBOLS_MAX_LENGTH];
+
+/**
+ * @brief Runs ops operations of a benchmark.
+ */
+typedef void (*BenchFunction)(void *arg,long ops);
+
+/**
+ * @brief Arguments of the queue benchmark.
+ */
+typedef struct{
+  PCQueue queue; //< The queue under test.
+  int pairs; //< Number of producers (and consumers).
+  long ops; //< Items added by each producer.
+} QueueBench;
+
+/**
+ * @brief Arguments of the JSON parsing benchmark.
+ */
+typedef struct{
+  char **frames; //< Pre-formatted frames.
+  size_t *lengths; //< Length of each frame.
+  int frame_count; //< Number of frames.
+  int trades_per_frame; //< Trades in each frame.
+  PCQueue *queue; //< Queue the parser adds to (drained by a thread).
+} JSONBench;
+
+/**
+ * @brief Arguments of the calculator benchmarks.
+ */
+typedef struct{
+  CalculatorBuffer *buffers; //< Buffers of all symbols.
+  Trade *trades; //< Pre-generated trades.
+  int trade_count; //< Number of pre-generated trades.
+  int symbol_count; //< Number of symbols.
+  FILE **files; //< symbol_count handlers of /dev/null.
+  FILE *null_file; //< /dev/null, for the delay log.
+} CalculatorBench;
+
+
+static int repetitions=10;
+static const char *filter=NULL;
+
+
+static double now_seconds(){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return now.tv_sec+now.tv_nsec/1e9;
+}
+
+static int compare_doubles(const void *a,const void *b){
+  double x=*(const double*)a,y=*(const double*)b;
+  return (x>y)-(x<y);
+}
+
+// Runs warmup and repetitions of a benchmark and prints its results
+static void run_benchmark(const char *name,BenchFunction function,void *arg,
+                          long ops){
+  double ns_per_op[BENCH_MAX_REPETITIONS];
+  double start;
+  if(filter!=NULL && strstr(name,filter)==NULL)
+    return;
+  function(arg,ops);
+  for(int r=0;r<repetitions;r++){
+    start=now_seconds();
+    function(arg,ops);
+    ns_per_op[r]=(now_seconds()-start)*1e9/ops;
+  }
+  qsort(ns_per_op,repetitions,sizeof(double),compare_doubles);
+  printf("%-44s %10.1f ns/op %14.0f ops/s  (best %.1f ns/op)\n",name,
+         ns_per_op[repetitions/2],1e9/ns_per_op[repetitions/2],ns_per_op[0]);
+  return;
+}
+
+
+// PCQueue benchmark
+
+static void* queue_producer(void *arg){
+  QueueBench *bench=(QueueBench*)arg;
+  WorkItem item;
+  memset(&item,0,sizeof(item));
+  for(long i=0;i<bench->ops;i++){
+    item.t=i;
+    queue_add(&bench->queue,&item);
+  }
+  return NULL;
+}
+
+static void* queue_consumer(void *arg){
+  QueueBench *bench=(QueueBench*)arg;
+  WorkItem item;
+  while(queue_remove(&bench->queue,&item)==0);
+  return NULL;
+}
+
+// One op is one item passing through the queue
+static void bench_queue(void *arg,long ops){
+  QueueBench *bench=(QueueBench*)arg;
+  pthread_t producers[4],consumers[4];
+  queue_init(&bench->queue,QUEUE_DEFAULT_CAPACITY,false);
+  bench->ops=ops/bench->pairs;
+  for(int i=0;i<bench->pairs;i++){
+    pthread_create(&consumers[i],NULL,queue_consumer,bench);
+    pthread_create(&producers[i],NULL,queue_producer,bench);
+  }
+  for(int i=0;i<bench->pairs;i++)
+    pthread_join(producers[i],NULL);
+  // Let the consumers drain the queue and exit
+  pthread_mutex_lock(bench->queue.mut);
+  bench->queue.exit_flag=1;
+  pthread_cond_broadcast(bench->queue.not_empty);
+  pthread_mutex_unlock(bench->queue.mut);
+  for(int i=0;i<bench->pairs;i++)
+    pthread_join(consumers[i],NULL);
+  queue_destory(&bench->queue);
+  return;
+}
+
+
+// JSON parsing benchmark
+
+static void* queue_drainer(void *arg){
+  PCQueue *queue=(PCQueue*)arg;
+  WorkItem item;
+  while(queue_remove(queue,&item)==0);
+  return NULL;
+}
+
+// One op is one parsed trade
+static void bench_json(void *arg,long ops){
+  JSONBench *bench=(JSONBench*)arg;
+  TradeParser parser;
+  long frames=ops/bench->trades_per_frame;
+  int i;
+  for(long k=0;k<frames;k++){
+    i=k%bench->frame_count;
+    // Same sequence as the LWS_CALLBACK_CLIENT_RECEIVE handling
+    construct_parser(bench->queue,NULL,&parser);
+    lejp_parse(&parser.ctx,(unsigned char*)bench->frames[i],
+               bench->lengths[i]);
+    lejp_destruct(&parser.ctx);
+  }
+  return;
+}
+
+
+// Calculator benchmarks
+
+// One op is one trade added to the buffers
+static void bench_add_trade(void *arg,long ops){
+  CalculatorBench *bench=(CalculatorBench*)arg;
+  for(long k=0;k<ops;k++){
+    add_trade_to_buffers(&bench->trades[k%bench->trade_count],bench->buffers);
+  }
+  return;
+}
+
+// One op is one symbol written and reset at a minute directive
+static void bench_write_and_reset(void *arg,long ops){
+  CalculatorBench *bench=(CalculatorBench*)arg;
+  struct timeval event_time;
+  Trade trade;
+  long minutes=ops/bench->symbol_count;
+  for(long m=0;m<minutes;m++){
+    // Give every symbol a non empty candlestick, as in a busy minute
+    for(int i=0;i<bench->symbol_count;i++){
+      trade=bench->trades[i%bench->trade_count];
+      trade.s_index=i;
+      add_trade_to_buffers(&trade,bench->buffers);
+    }
+    gettimeofday(&event_time,NULL);
+    write_and_reset_buffers(m,arrival_stamp(event_time),bench->symbol_count,
+                            bench->files,bench->files,bench->null_file,
+                            bench->buffers,NULL);
+  }
+  return;
+}
+
+
+// Fills trades from the recorded logs of a folder, or the generator
+static int load_trades(const char *folder_path,Trade *trades,int count,
+                       int symbol_count){
+  ReplayMerger merger;
+  TradeGenerator generator;
+  GeneratorConfig config;
+  int loaded=0;
+  if(folder_path!=NULL){
+    if(replay_open(folder_path,symbols_list,symbol_count,&merger)!=0)
+      return -1;
+    while(loaded<count && replay_next(&merger,&trades[loaded])==0)
+      loaded++;
+    replay_close(&merger);
+    // Cycle the recorded trades if they're fewer than needed
+    for(int i=loaded;i<count && loaded>0;i++)
+      trades[i]=trades[i%loaded];
+    return loaded>0?0:-1;
+  }
+  generator_default_config(&config);
+  if(generator_init(&generator,&config,symbol_count,1700000000000ULL)!=0)
+    return -1;
+  for(int i=0;i<count;i++)
+    generator_next(&generator,&trades[i]);
+  generator_destroy(&generator);
+  return 0;
+}
+
+
+int main(int argc,char **argv){
+  const char *folder_path=NULL;
+  long scale=1000000;
+  int trades_per_frame=10;
+  int option,symbol_count;
+  long minutes;
+  char name[BENCH_NAME_LENGTH];
+
+  while((option=getopt(argc,argv,"r:s:b:f:h"))!=-1){
+    switch(option){
+    case 'r':
+      repetitions=atoi(optarg);
+      break;
+    case 's':
+      scale=atol(optarg);
+      break;
+    case 'b':
+      trades_per_frame=atoi(optarg);
+      break;
+    case 'f':
+      folder_path=optarg;
+      break;
+    default:
+      printf("Usage: %s [-r repetitions] [-s scale] [-b trades_per_frame] "
+             "[-f trade_logs_folder] [filter]\n",argv[0]);
+      return -1;
+    }
+  }
+  if(optind<argc)
+    filter=argv[optind];
+  if(repetitions<1 || repetitions>BENCH_MAX_REPETITIONS || scale<1000 ||
+     trades_per_frame<1){
+    printf("Invalid arguments\n");
+    return -1;
+  }
+
+  // Symbols: those of the recorded logs, or synthetic ones
+  if(folder_path!=NULL)
+    symbols_list=list_folder_symbols(folder_path,&symbol_count);
+  else{
+    symbol_count=BENCH_MAX_SYMBOLS;
+    symbols_list=create_synthetic_symbols(symbol_count);
+  }
+  if(symbols_list==NULL || symbol_count==0 ||
+     build_symbol_index(symbol_count)!=0){
+    printf("Error in symbols setup\n");
+    return -1;
+  }
+  printf("%d repetitions, %d symbols, %s trades\n\n",repetitions,
+         symbol_count,folder_path!=NULL?"recorded":"synthetic");
+
+  // PCQueue
+  QueueBench queue_bench;
+  for(int pairs=1;pairs<=4;pairs*=2){
+    queue_bench.pairs=pairs;
+    snprintf(name,BENCH_NAME_LENGTH,"queue_add+queue_remove %dP/%dC",pairs,
+             pairs);
+    run_benchmark(name,bench_queue,&queue_bench,scale);
+  }
+
+  // JSON parsing
+  JSONBench json_bench;
+  Trade *trades=(Trade*)malloc(BENCH_FRAMES*trades_per_frame*sizeof(Trade));
+  PCQueue json_queue;
+  pthread_t drainer;
+  json_bench.frame_count=BENCH_FRAMES;
+  json_bench.trades_per_frame=trades_per_frame;
+  queue_init(&json_queue,QUEUE_DEFAULT_CAPACITY,false);
+  json_bench.queue=&json_queue;
+  json_bench.frames=(char**)malloc(BENCH_FRAMES*sizeof(char*));
+  json_bench.lengths=(size_t*)malloc(BENCH_FRAMES*sizeof(size_t));
+  if(trades==NULL || json_bench.frames==NULL || json_bench.lengths==NULL ||
+     load_trades(folder_path,trades,BENCH_FRAMES*trades_per_frame,
+                 symbol_count)!=0){
+    printf("Error in frames setup\n");
+    return -1;
+  }
+  for(int i=0;i<BENCH_FRAMES;i++){
+    json_bench.frames[i]=(char*)malloc(FRAME_JSON_OVERHEAD+
+                                       trades_per_frame*TRADE_JSON_MAX_LENGTH);
+    json_bench.lengths[i]=format_trade_frame(&trades[i*trades_per_frame],
+                                             trades_per_frame,symbols_list,
+                                             json_bench.frames[i]);
+  }
+  pthread_create(&drainer,NULL,queue_drainer,&json_queue);
+  snprintf(name,BENCH_NAME_LENGTH,"json_callback (%d trades/frame)",
+           trades_per_frame);
+  run_benchmark(name,bench_json,&json_bench,scale);
+  pthread_mutex_lock(json_queue.mut);
+  json_queue.exit_flag=1;
+  pthread_cond_broadcast(json_queue.not_empty);
+  pthread_mutex_unlock(json_queue.mut);
+  pthread_join(drainer,NULL);
+  queue_destory(&json_queue);
+  for(int i=0;i<BENCH_FRAMES;i++)
+    free(json_bench.frames[i]);
+  free(json_bench.frames);
+  free(json_bench.lengths);
+  free(trades);
+
+  // Calculator
+  CalculatorBench calc_bench;
+  int calc_trades=BENCH_FRAMES*10;
+  // Sized by the symbols of the run (recorded folders can exceed the
+  // synthetic BENCH_MAX_SYMBOLS)
+  calc_bench.buffers=(CalculatorBuffer*)malloc(symbol_count*
+                                               sizeof(CalculatorBuffer));
+  calc_bench.trades=(Trade*)malloc(calc_trades*sizeof(Trade));
+  calc_bench.files=(FILE**)malloc(symbol_count*sizeof(FILE*));
+  calc_bench.null_file=fopen("/dev/null","w");
+  calc_bench.trade_count=calc_trades;
+  if(calc_bench.buffers==NULL || calc_bench.trades==NULL ||
+     calc_bench.files==NULL || calc_bench.null_file==NULL){
+    printf("Error in calculator setup\n");
+    return -1;
+  }
+  for(int i=0;i<symbol_count;i++)
+    calc_bench.files[i]=calc_bench.null_file;
+  // Recorded trades run with their own symbols, synthetic ones at 16/256/4096
+  for(int count=folder_path!=NULL?symbol_count:16;count<=symbol_count;
+      count*=16){
+    calc_bench.symbol_count=count;
+    init_calculator_buffers(calc_bench.buffers,count);
+    if(load_trades(folder_path,calc_bench.trades,calc_trades,count)!=0)
+      return -1;
+    snprintf(name,BENCH_NAME_LENGTH,"add_trade_to_buffers %d symbols",count);
+    run_benchmark(name,bench_add_trade,&calc_bench,scale);
+    snprintf(name,BENCH_NAME_LENGTH,"write_and_reset_buffers %d symbols",
+             count);
+    minutes=scale/10/count;
+    if(minutes<10)
+      minutes=10;
+    run_benchmark(name,bench_write_and_reset,&calc_bench,minutes*count);
+  }
+  fclose(calc_bench.null_file);
+  free(calc_bench.files);
+  free(calc_bench.trades);
+  free(calc_bench.buffers);
+  return 0;
+}
@@ -0,0 +1,417 @@
+/**
+ * End-to-end throughput and latency benchmark of the whole pipeline:
+ * source (generator or replay) -> api queue -> writers -> calculation queue
+ * -> calculator -> files, run in-process at increasing offered loads.
+ *
+ * For each load the pipeline runs for a fixed wall-clock duration and then
+ * drains. Reported per load: offered and achieved throughput, the high
+ * water marks of both queues and the percentiles of each stage's delay
+ * (see StageLatencies). Results are written as csv, one row per load, and
+ * can be compared against a stored baseline: the benchmark exits with 1 if
+ * any load lost throughput or gained p99 latency beyond the tolerance.
+ *
+ * Usage: ./e2e_bench [-r replay_folder] [-l loads] [-d seconds] [-y symbols]
+ *                    [-G poisson|hawkes] [-w writers] [-q capacity] [-F]
+ *                    [-O output_folder]
+ *                    [-o results.csv] [-b baseline.csv] [-t tolerance]
+ *
+ * Loads are generator rates (trades/s), or replay speed multipliers with -r.
+ * A load of 0 is max speed. Output files are appended to, under
+ * output_folder/load_<i>.
+*/
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Generator.h"
+#include "Metrics.h"
+#include "PCQueue.h"
+#include "Pipeline.h"
+#include "Replay.h"
+#include "Symbols.h"
+#include "SystemHandling.h"
+
+#define E2E_MAX_LOADS 32
+#define E2E_LINE_LENGTH 512
+#define E2E_LATENCY_FLOOR_US 50 // p99 changes below this are noise
+#define E2E_DEADLINE_CHECK_MASK 63 // Check the clock every 64 trades
+
+// Symbol list of the run (synthetic or of the replayed logs)
+const char (*symbols_list)[SYMBOLS_MAX_LENGTH];
+// Globals of the live WSS client, which shares the library; the api queue
+// is the one the benchmark's sources feed.
+PCQueue api_queue;
+bool exit_wss_connection=false;
+
+/**
+ * @brief A TradeSource that counts trades and ends at a deadline.
+ */
+typedef struct{
+  TradeSource next_trade; //< The wrapped source.
+  void *source; //< State of the wrapped source.
+  double deadline; //< Monotonic time (s) when the source ends.
+  long trades_count; //< Trades produced.
+} BoundedSource;
+
+/**
+ * @brief Arguments of the producer thread.
+ */
+typedef struct{
+  BoundedSource bounded; //< The source that is fed.
+  PCQueue *queue; //< The api queue.
+  double speed; //< Speed multiplier of event time (0 for max speed).
+  double elapsed; //< Time spent feeding (s).
+} ProducerArgs;
+
+/**
+ * @brief Results of one load.
+ */
+typedef struct{
+  double load; //< Rate or speed multiplier (0 for max).
+  double offered_tps; //< Trades fed per second.
+  double achieved_tps; //< Trades calculated per second, including drain.
+  long trades; //< Trades calculated.
+  int api_queue_hwm; //< High water mark of the api queue.
+  int calculation_queue_hwm; //< High water mark of the calculation queue.
+  double dequeue_p50,dequeue_p99; //< Api queue delay (us).
+  double write_p50,write_p99,write_p999; //< Logging delay (us).
+  double calculate_p50,calculate_p99,calculate_p999; //< Calculation (us).
+  double minute_p99; //< Minute directive delay (us).
+} LoadResult;
+
+static const char *results_header=
+  "load,offered_tps,achieved_tps,trades,api_queue_hwm,calculation_queue_hwm,"
+  "dequeue_p50_us,dequeue_p99_us,write_p50_us,write_p99_us,write_p999_us,"
+  "calculate_p50_us,calculate_p99_us,calculate_p999_us,minute_p99_us";
+
+
+static double now_seconds(){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return now.tv_sec+now.tv_nsec/1e9;
+}
+
+static int bounded_next(void *source,Trade *trade){
+  BoundedSource *bounded=(BoundedSource*)source;
+  if((bounded->trades_count&E2E_DEADLINE_CHECK_MASK)==0 &&
+     now_seconds()>=bounded->deadline)
+    return -1;
+  if(bounded->next_trade(bounded->source,trade)!=0)
+    return -1;
+  bounded->trades_count++;
+  return 0;
+}
+
+static int merger_next(void *source,Trade *trade){
+  return replay_next((ReplayMerger*)source,trade);
+}
+
+// Feeds the source, then orders the pipeline to exit
+static void* producer_routine(void *arg){
+  ProducerArgs *args=(ProducerArgs*)arg;
+  double start=now_seconds();
+  feed_queue(bounded_next,&args->bounded,args->queue,args->speed);
+  args->elapsed=now_seconds()-start;
+  pthread_mutex_lock(args->queue->mut);
+  args->queue->exit_flag=1;
+  pthread_cond_broadcast(args->queue->not_empty);
+  pthread_mutex_unlock(args->queue->mut);
+  return NULL;
+}
+
+
+// Runs the pipeline at one load and fills its results
+static int run_load(int index,double load,const char *replay_folder,
+                    GeneratorConfig *generator_config,int symbol_count,
+                    int writers_count,int queue_capacity,double duration,
+                    const char *output_folder,LoadResult *result){
+  char path[FILEPATH_BUFFER_LENGTH];
+  Pipeline pipeline;
+  ProducerArgs producer_args;
+  pthread_t producer;
+  TradeGenerator generator;
+  ReplayMerger merger;
+  StageLatencies latencies;
+  struct timeval now;
+  double start,elapsed;
+
+  snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/load_%d",output_folder,index);
+  if(queue_init(&api_queue,queue_capacity,false)!=0)
+    return -1;
+  if(pipeline_open(&pipeline,&api_queue,symbol_count,writers_count,path)!=0)
+    return -1;
+
+  // The source: replay at speed load, or generator at rate load
+  memset(&producer_args,0,sizeof(ProducerArgs));
+  producer_args.queue=&api_queue;
+  if(replay_folder!=NULL){
+    if(replay_open(replay_folder,symbols_list,symbol_count,&merger)!=0)
+      return -1;
+    producer_args.bounded.next_trade=merger_next;
+    producer_args.bounded.source=&merger;
+    producer_args.speed=load;
+  }
+  else{
+    gettimeofday(&now,NULL);
+    // Max speed still needs a rate, for the spacing of event times
+    generator_config->rate=load>0?load:1000;
+    if(generator_init(&generator,generator_config,symbol_count,
+                      (uint64_t)now.tv_sec*1000+now.tv_usec/1000)!=0)
+      return -1;
+    producer_args.bounded.next_trade=generator_next;
+    producer_args.bounded.source=&generator;
+    producer_args.speed=load>0?1:0;
+  }
+
+  start=now_seconds();
+  producer_args.bounded.deadline=start+duration;
+  pipeline_start(&pipeline);
+  pthread_create(&producer,NULL,producer_routine,&producer_args);
+  pthread_join(producer,NULL);
+  pipeline_join(&pipeline);
+  elapsed=now_seconds()-start;
+
+  // Gather the results
+  pipeline_latencies(&pipeline,&latencies);
+  result->load=load;
+  result->offered_tps=producer_args.bounded.trades_count/
+                      producer_args.elapsed;
+  result->trades=latencies.calculate.total;
+  result->achieved_tps=result->trades/elapsed;
+  result->api_queue_hwm=api_queue.high_water_mark;
+  result->calculation_queue_hwm=pipeline.calculation_queue.high_water_mark;
+  result->dequeue_p50=histogram_percentile(&latencies.dequeue,50);
+  result->dequeue_p99=histogram_percentile(&latencies.dequeue,99);
+  result->write_p50=histogram_percentile(&latencies.write,50);
+  result->write_p99=histogram_percentile(&latencies.write,99);
+  result->write_p999=histogram_percentile(&latencies.write,99.9);
+  result->calculate_p50=histogram_percentile(&latencies.calculate,50);
+  result->calculate_p99=histogram_percentile(&latencies.calculate,99);
+  result->calculate_p999=histogram_percentile(&latencies.calculate,99.9);
+  result->minute_p99=histogram_percentile(&latencies.minute,99);
+
+  if(replay_folder!=NULL)
+    replay_close(&merger);
+  else
+    generator_destroy(&generator);
+  pipeline_close(&pipeline);
+  queue_destory(&api_queue);
+  return 0;
+}
+
+
+static void write_result(FILE *file,const LoadResult *r){
+  fprintf(file,"%g,%.1f,%.1f,%ld,%d,%d,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,"
+          "%.0f,%.0f\n",r->load,r->offered_tps,r->achieved_tps,r->trades,
+          r->api_queue_hwm,r->calculation_queue_hwm,r->dequeue_p50,
+          r->dequeue_p99,r->write_p50,r->write_p99,r->write_p999,
+          r->calculate_p50,r->calculate_p99,r->calculate_p999,r->minute_p99);
+  return;
+}
+
+static int read_result(const char *line,LoadResult *r){
+  return sscanf(line,"%lf,%lf,%lf,%ld,%d,%d,%lf,%lf,%lf,%lf,%lf,%lf,%lf,"
+                "%lf,%lf",&r->load,&r->offered_tps,&r->achieved_tps,
+                &r->trades,&r->api_queue_hwm,&r->calculation_queue_hwm,
+                &r->dequeue_p50,&r->dequeue_p99,&r->write_p50,&r->write_p99,
+                &r->write_p999,&r->calculate_p50,&r->calculate_p99,
+                &r->calculate_p999,&r->minute_p99)==15?0:-1;
+}
+
+// Compares the results with the baseline's rows of the same load
+// Returns the number of regressions, or -1 if the baseline can't be read
+static int compare_baseline(const char *baseline_path,
+                            const LoadResult *results,int load_count,
+                            double tolerance){
+  char line[E2E_LINE_LENGTH];
+  LoadResult baseline;
+  int regressions=0;
+  bool throughput_lost,latency_gained;
+  FILE *file=fopen(baseline_path,"r");
+  if(file==NULL){
+    printf("Error in opening baseline: %s\n",baseline_path);
+    return -1;
+  }
+  printf("\nComparison with %s (tolerance %.0f%%):\n",baseline_path,
+         tolerance*100);
+  while(fgets(line,E2E_LINE_LENGTH,file)!=NULL){
+    // Skip the header (and anything that isn't a result)
+    if(read_result(line,&baseline)!=0)
+      continue;
+    for(int i=0;i<load_count;i++){
+      if(results[i].load!=baseline.load)
+        continue;
+      throughput_lost=results[i].achieved_tps<
+                      baseline.achieved_tps*(1-tolerance);
+      latency_gained=results[i].calculate_p99>
+                     baseline.calculate_p99*(1+tolerance) &&
+                     results[i].calculate_p99-baseline.calculate_p99>
+                     E2E_LATENCY_FLOOR_US;
+      printf("load %-8g achieved %12.1f vs %12.1f trades/s, "
+             "calculate p99 %8.0f vs %8.0f us %s\n",baseline.load,
+             results[i].achieved_tps,baseline.achieved_tps,
+             results[i].calculate_p99,baseline.calculate_p99,
+             throughput_lost || latency_gained?"REGRESSION":"ok");
+      if(throughput_lost || latency_gained)
+        regressions++;
+    }
+  }
+  fclose(file);
+  return regressions;
+}
+
+// Parses a comma separated list of loads
+static int parse_loads(char *list,double *loads){
+  int count=0;
+  char *conversion_ptr;
+  for(char *token=strtok(list,",");token!=NULL;token=strtok(NULL,",")){
+    if(count==E2E_MAX_LOADS)
+      return -1;
+    loads[count]=strtod(token,&conversion_ptr);
+    if(*conversion_ptr!='\0' || loads[count]<0)
+      return -1;
+    count++;
+  }
+  return count;
+}
+
+
+int main(int argc,char **argv){
+  const char *replay_folder=NULL;
+  const char *output_folder="./e2e_output";
+  const char *results_path="e2e_results.csv";
+  const char *baseline_path=NULL;
+  char *loads_list=NULL;
+  double loads[E2E_MAX_LOADS];
+  LoadResult results[E2E_MAX_LOADS];
+  int load_count,symbol_count=100,writers_count=2;
+  int queue_capacity=QUEUE_DEFAULT_CAPACITY;
+  double duration=5,tolerance=0.1;
+  int option,regressions=0;
+  bool fixed_point=false;
+  GeneratorConfig generator_config;
+  FILE *results_file;
+
+  generator_default_config(&generator_config);
+  while((option=getopt(argc,argv,"r:l:d:y:G:w:q:FO:o:b:t:"))!=-1){
+    switch(option){
+    case 'r':
+      replay_folder=optarg;
+      break;
+    case 'l':
+      loads_list=optarg;
+      break;
+    case 'd':
+      duration=atof(optarg);
+      break;
+    case 'y':
+      symbol_count=atoi(optarg);
+      break;
+    case 'G':
+      generator_config.process=strcmp(optarg,"hawkes")==0?ARRIVALS_HAWKES:
+                                                          ARRIVALS_POISSON;
+      break;
+    case 'w':
+      writers_count=atoi(optarg);
+      break;
+    case 'q':
+      queue_capacity=atoi(optarg);
+      break;
+    case 'F':
+      fixed_point=true;
+      break;
+    case 'O':
+      output_folder=optarg;
+      break;
+    case 'o':
+      results_path=optarg;
+      break;
+    case 'b':
+      baseline_path=optarg;
+      break;
+    case 't':
+      tolerance=atof(optarg);
+      break;
+    default:
+      printf("Usage: %s [-r replay_folder] [-l loads] [-d seconds] "
+             "[-y symbols] [-G poisson|hawkes] [-w writers] [-q capacity] "
+             "[-F] [-O output_folder] [-o results.csv] [-b baseline.csv] "
+             "[-t tolerance]\n",argv[0]);
+      return -1;
+    }
+  }
+  // Default loads: rates for the generator, speed multipliers for replay
+  if(loads_list==NULL)
+    loads_list=strdup(replay_folder!=NULL?"1,10,100,0":
+                                          "1000,10000,100000,0");
+  load_count=parse_loads(loads_list,loads);
+  if(load_count<=0 || duration<=0 || symbol_count<1 || writers_count<1 ||
+     tolerance<0){
+    printf("Invalid arguments\n");
+    return -1;
+  }
+
+  // Symbols: those of the recorded logs, or synthetic ones
+  if(replay_folder!=NULL)
+    symbols_list=list_folder_symbols(replay_folder,&symbol_count);
+  else
+    symbols_list=create_synthetic_symbols(symbol_count);
+  if(symbols_list==NULL || symbol_count==0){
+    printf("Error in symbols setup\n");
+    return -1;
+  }
+  // Fixed point prices, with the scales of TICK_SCALES_PATH
+  if(fixed_point && (build_symbol_index(symbol_count)!=0 ||
+                     tick_scales_load(TICK_SCALES_PATH,symbol_count)!=0)){
+    printf("Error in tick scales setup\n");
+    return -1;
+  }
+  if(ensure_open_files_limit(3*symbol_count+writers_count+64)!=0 ||
+     ensure_directory_exists(output_folder)!=0){
+    printf("Error in output setup\n");
+    return -1;
+  }
+  printf("%d symbols, %d writers, %s source, %g s per load\n\n",
+         symbol_count,writers_count,
+         replay_folder!=NULL?"replay":"generator",duration);
+
+  // Run all loads
+  for(int i=0;i<load_count;i++){
+    if(run_load(i,loads[i],replay_folder,&generator_config,symbol_count,
+                writers_count,queue_capacity,duration,output_folder,
+                &results[i])!=0){
+      printf("Error in run of load %g\n",loads[i]);
+      return -1;
+    }
+    printf("load %-8g offered %12.1f achieved %12.1f trades/s, "
+           "hwm %4d/%4d, calculate p50 %6.0f p99 %8.0f p99.9 %8.0f us\n",
+           loads[i],results[i].offered_tps,results[i].achieved_tps,
+           results[i].api_queue_hwm,results[i].calculation_queue_hwm,
+           results[i].calculate_p50,results[i].calculate_p99,
+           results[i].calculate_p999);
+  }
+
+  // Store the results
+  results_file=fopen(results_path,"w");
+  if(results_file==NULL){
+    printf("Error in opening results: %s\n",results_path);
+    return -1;
+  }
+  fprintf(results_file,"%s\n",results_header);
+  for(int i=0;i<load_count;i++)
+    write_result(results_file,&results[i]);
+  fclose(results_file);
+  printf("\nResults written to %s\n",results_path);
+
+  if(baseline_path!=NULL){
+    regressions=compare_baseline(baseline_path,results,load_count,tolerance);
+    if(regressions<0)
+      return -1;
+    printf("%d regressions\n",regressions);
+  }
+  return regressions>0?1:0;
+}
@@ -0,0 +1,108 @@
+/**
+ * Snapshots of the calculator's state, so a restart continues the moving
+ * averages instead of starting them from zero.
+ *
+ * After each minute is closed the calculator saves every symbol's
+ * CalculatorBuffer (or FixedCalculatorBuffer) and the next minute to be
+ * closed. The snapshot is written to a temporary file, synced and renamed
+ * over the previous one, so a crash leaves either the old or the new
+ * snapshot, never a partial one. Entries are keyed by symbol name, so the
+ * symbol list may change between runs.
+ *
+ * Without a snapshot, the window is rebuilt from the output files of the
+ * previous run instead, reading only their ends: the last rows of
+ * candlesticks/X.csv give the last closed minute and close price, and the
+ * trades of trade_logs/X.csv in the 15 minutes up to it are added again,
+ * minute by minute. Without a trade log, each candlestick row counts as
+ * one trade at its typical price (high+low+close)/3, an approximation.
+*/
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+
+#include "FixedPoint.h"
+#include "TradeProcessing.h"
+
+#define CHECKPOINT_PATH "./calculator.checkpoint"
+#define CHECKPOINT_MAGIC 0x54504B43 // "CKPT"
+#define CHECKPOINT_VERSION 1
+// Older snapshots have no minute of the moving average window left
+#define CHECKPOINT_MAX_AGE_MINUTES 15
+// First read from the end of a file, doubled until it has the wanted rows
+#define TAIL_CHUNK_LENGTH (64*1024)
+
+/**
+ * @brief Header of a snapshot file, followed by symbol_count entries.
+ *
+ * Each entry is the symbol's name (SYMBOLS_MAX_LENGTH bytes), then its
+ * TickScale and FixedCalculatorBuffer if fixed_point, else its
+ * CalculatorBuffer.
+ */
+typedef struct{
+  uint32_t magic; //< CHECKPOINT_MAGIC.
+  uint32_t version; //< CHECKPOINT_VERSION.
+  uint32_t symbol_count; //< Number of entries.
+  uint32_t fixed_point; //< 1 if the buffers are fixed point.
+  uint64_t next_minute; //< First minute (since Epoch) not closed yet.
+  uint64_t checksum; //< FNV-1a of the entries.
+} CheckpointHeader;
+
+/**
+ * @brief Saves the calculator's state, replacing the previous snapshot.
+ *
+ * @param[in] path The snapshot file.
+ * @param[in] next_minute First minute (since Epoch) not closed yet.
+ * @param[in] symbol_count Number of symbols (of symbols_list).
+ * @param[in] buffers The buffers, or NULL with fixed point prices.
+ * @param[in] fixed_buffers The fixed point buffers, or NULL.
+ *
+ * @return 0 on success, -1 on failure (the previous snapshot is kept).
+ */
+int checkpoint_save(const char *path,uint64_t next_minute,int symbol_count,
+                    const CalculatorBuffer *buffers,
+                    const FixedCalculatorBuffer *fixed_buffers);
+
+/**
+ * @brief Restores the calculator's state, from a recent snapshot.
+ *
+ * Symbols of the snapshot that aren't tracked anymore (or whose tick
+ * scale changed) are skipped, new ones keep their initialized buffers.
+ * The index of symbols_list must be built.
+ *
+ * @param[in]  path The snapshot file.
+ * @param[in]  current_minute The current minute (since Epoch).
+ * @param[in]  symbol_count Number of symbols (of symbols_list).
+ * @param[out] buffers The buffers, or NULL with fixed point prices.
+ * @param[out] fixed_buffers The fixed point buffers, or NULL.
+ * @param[out] next_minute First minute the snapshot didn't close.
+ *
+ * @return 1 if restored, 0 if there's no usable snapshot (missing, stale,
+ * corrupt or of the other representation).
+ */
+int checkpoint_load(const char *path,uint64_t current_minute,int symbol_count,
+                    CalculatorBuffer *buffers,
+                    FixedCalculatorBuffer *fixed_buffers,
+                    uint64_t *next_minute);
+
+/**
+ * @brief Rebuilds the moving average windows from the previous run's files.
+ *
+ * Reads only the tails of the files, however large they are. Symbols
+ * without recent rows keep their initialized buffers.
+ *
+ * @param[in]  output_folder Folder of the candlesticks and trade_logs.
+ * @param[in]  current_minute The current minute (since Epoch).
+ * @param[in]  symbol_count Number of symbols (of symbols_list).
+ * @param[out] buffers The buffers, or NULL with fixed point prices.
+ * @param[out] fixed_buffers The fixed point buffers, or NULL.
+ * @param[out] next_minute First minute after the last closed one.
+ *
+ * @return 1 if rebuilt, 0 if no symbol has a recent candlestick.
+ */
+int checkpoint_rebuild(const char *output_folder,uint64_t current_minute,
+                       int symbol_count,CalculatorBuffer *buffers,
+                       FixedCalculatorBuffer *fixed_buffers,
+                       uint64_t *next_minute);
+
+#endif
@@ -0,0 +1,148 @@
+/**
+ * Columnar storage of the closed minutes (MinuteBar) of each symbol, in
+ * per-day partitions, so a time range is read without scanning the csv
+ * files from their start.
+ *
+ * Each symbol has a folder (output_folder/columns/X/) with a file per UTC
+ * day. The open day is X/YYYY-MM-DD.rows, whole bars appended each minute.
+ * Once a day is over it's sealed into X/YYYY-MM-DD.col: the 8 columns of
+ * the bars (t, open, high, low, close, volume, vwap, vwap_volume), each a
+ * contiguous array of 8 byte values in minute order, then a ColumnFooter
+ * with the offset of each column. A range is found with a binary search of
+ * the timestamp column and read with one sequential read per column.
+ * Partitions are replaced by renames. A day with both files (a crash while
+ * sealing, or minutes added to a sealed day) is read merged, the rows'
+ * bars replacing the partition's of the same minute.
+ *
+ * Only minutes with a candlestick are stored (not those before a symbol's
+ * first trade).
+*/
+#ifndef COLUMN_STORE_H
+#define COLUMN_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "TradeProcessing.h"
+
+#define COLUMN_STORE_FOLDER "columns"
+#define COLUMN_ROWS_SUFFIX ".rows"
+#define COLUMN_PARTITION_SUFFIX ".col"
+#define COLUMN_MAGIC 0x4C4F4354 // "TCOL"
+#define COLUMN_VERSION 1
+// Columns of a partition: the fields of MinuteBar
+#define COLUMN_COUNT (sizeof(MinuteBar)/sizeof(uint64_t))
+#define MINUTES_PER_DAY 1440
+
+/**
+ * @brief Index of each column, in MinuteBar order.
+ */
+typedef enum{
+  COLUMN_TIMESTAMP,COLUMN_OPEN,COLUMN_HIGH,COLUMN_LOW,COLUMN_CLOSE,
+  COLUMN_VOLUME,COLUMN_VWAP,COLUMN_VWAP_VOLUME
+} ColumnIndex;
+
+/**
+ * @brief Last bytes of a partition, after its columns.
+ */
+typedef struct{
+  uint32_t magic; //< COLUMN_MAGIC.
+  uint32_t version; //< COLUMN_VERSION.
+  uint64_t row_count; //< Bars in the partition.
+  uint64_t first_minute; //< Timestamp of the first bar.
+  uint64_t last_minute; //< Timestamp of the last bar.
+  uint64_t column_offsets[COLUMN_COUNT]; //< File offset of each column.
+  uint64_t checksum; //< FNV-1a of the columns and the fields above.
+} ColumnFooter;
+
+/**
+ * @brief The open day's rows files of all symbols, appended to by the
+ * calculator.
+ */
+typedef struct{
+  const char *output_folder; //< Folder of the pipeline's files.
+  int symbol_count; //< Number of symbols.
+  FILE **rows_files; //< Open day's rows of each symbol (NULL until used).
+  uint64_t day; //< Open day (days since Epoch), UINT64_MAX before any.
+} ColumnStore;
+
+
+/**
+ * @brief Creates the folder of each symbol (of symbols_list).
+ *
+ * @param[out] store The store.
+ * @param[in]  output_folder Folder of the pipeline's files.
+ * @param[in]  symbol_count Number of symbols.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int column_store_open(ColumnStore *store,const char *output_folder,
+                      int symbol_count);
+
+/**
+ * @brief Stores a closed minute of all symbols.
+ *
+ * On the first minute of a day, the rows of earlier days are sealed into
+ * partitions (on the first minute of all, those left by previous runs).
+ *
+ * @param[in] store The store.
+ * @param[in] bars The bar of each symbol, all of the same minute.
+ *
+ * @return 0 on success, -1 if a symbol's bar couldn't be stored.
+ */
+int column_store_append(ColumnStore *store,const MinuteBar *bars);
+
+/**
+ * @brief Closes the rows files (the open day stays unsealed).
+ *
+ * @param[in] store The store.
+ */
+void column_store_close(ColumnStore *store);
+
+/**
+ * @brief Merges bars into a symbol's day and seals it: the day's partition
+ * is rewritten with its bars, those of its rows file and the given ones
+ * (later ones replacing earlier ones of the same minute), and the rows
+ * file is removed.
+ *
+ * @param[in] output_folder Folder of the pipeline's files.
+ * @param[in] symbol The symbol.
+ * @param[in] day Days since Epoch.
+ * @param[in] bars Bars of the day (in any order).
+ * @param[in] count Number of bars.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int column_store_merge(const char *output_folder,const char *symbol,
+                       uint64_t day,const MinuteBar *bars,size_t count);
+
+/**
+ * @brief Gets the path of a symbol's file of a day.
+ *
+ * @param[out] path The path (FILEPATH_BUFFER_LENGTH bytes).
+ * @param[in]  output_folder Folder of the pipeline's files.
+ * @param[in]  symbol The symbol.
+ * @param[in]  day Days since Epoch.
+ * @param[in]  suffix COLUMN_ROWS_SUFFIX or COLUMN_PARTITION_SUFFIX.
+ */
+void column_store_path(char *path,const char *output_folder,
+                       const char *symbol,uint64_t day,const char *suffix);
+
+/**
+ * @brief Reads a symbol's bars of a range of minutes.
+ *
+ * @param[in]  output_folder Folder of the pipeline's files.
+ * @param[in]  symbol The symbol.
+ * @param[in]  from_minute First minute of the range (since Epoch).
+ * @param[in]  to_minute Last minute of the range (included).
+ * @param[out] bars The bars, in minute order (to free).
+ * @param[out] count Number of bars.
+ *
+ * @return 0 on success (days without files have no bars), -1 on failure.
+ */
+int column_store_read(const char *output_folder,const char *symbol,
+                      uint64_t from_minute,uint64_t to_minute,
+                      MinuteBar **bars,size_t *count);
+
+#endif
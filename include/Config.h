@@ -0,0 +1,68 @@
+/**
+ * Runtime configuration of the program, built from the command line.
+ * Anything not given on the command line falls back to the hardcoded
+ * defaults of main.c.
+*/
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+#include "WSSHandling.h"
+#include "Generator.h"
+
+#define API_KEY_MAX_LENGTH 60
+// Where OVERFLOW_SPILL appends the api_queue's overflow
+#define SPILL_FILE_PATH "./api_queue.spill"
+
+/**
+ * @brief Represents all runtime configuration parameters.
+ */
+typedef struct{
+  char api_key[API_KEY_MAX_LENGTH]; //< API key of user
+  WSSEndpoint endpoint; //< Server of the live connection.
+  int connections; //< Number of parallel live connections.
+  int parsers; //< Number of parser threads of each connection.
+  const char *replay_folder; //< If not NULL, replay trade logs from here.
+  double replay_speed; //< Offline source speed multiplier (0 for max).
+  bool generator_enabled; //< Use the synthetic trade generator as source.
+  GeneratorConfig generator; //< Parameters of the trade generator.
+  int synthetic_symbols; //< If >0, track this many synthetic symbols.
+  OverflowPolicy overflow_policy; //< What producers do on a full api_queue.
+  int queue_capacity; //< Capacity of the queues (a power of 2).
+  bool huge_pages; //< Try to back the queues with huge pages.
+  bool fixed_point; //< Fixed point prices (scales of TICK_SCALES_PATH).
+  int journal_sync_ms; //< Group commit interval of the journal (-1: none).
+  bool column_store; //< Also store the minutes in per-day columns.
+  int history_minutes; //< Minutes kept in memory and served (0: none).
+  bool shared_state; //< Publish live state in shared memory.
+  bool publisher; //< Fan out trades and minutes to local subscribers.
+} ProgramConfig;
+
+/**
+ * @brief Fills the configuration from the program's arguments.
+ *
+ * Usage: ./main [-H host] [-p port] [-n] [-k] [-z] [-c connections]
+ *               [-P parsers] [-r replay_folder]
+ *               [-g rate [-G poisson|hawkes] [-d duration]] [-x speed]
+ *               [-y symbols] [-o policy] [-Q capacity] [-u] [-F]
+ *               [-j sync_ms] [-S] [-R minutes] [-m]
+ *               [-f] [api_key]
+ *
+ * @param[in]  argc Argument count of main.
+ * @param[in]  argv Argument vector of main.
+ * @param[in]  default_api_key Key used when none is given.
+ * @param[out] config The configuration that is filled.
+ *
+ * @return 0 on success, -1 on invalid arguments.
+ */
+int parse_arguments(int argc,char **argv,const char *default_api_key,
+                    ProgramConfig *config);
+
+/**
+ * @brief Prints the program's usage message.
+ *
+ * @param[in] program_name Name of the executable (argv[0]).
+ */
+void print_usage(const char *program_name);
+
+#endif
@@ -0,0 +1,130 @@
+/**
+ * Fast reader of the numeric csv files of the project (trade logs,
+ * candlesticks, moving averages, delays), for the offline tools.
+ *
+ * Files are memory mapped a window at a time (so any size fits a 32 bit
+ * address space), lines are split with memchr and fields are parsed with
+ * integer routines: decimals of up to 15 digits are a single exact
+ * division (the result strtod gives), anything else falls back to
+ * strto*. Rows are read one at a time, or a batch of them into columnar
+ * arrays.
+ *
+ * A row starts with a digit or '-', other lines (headers) are skipped.
+ * Each field but the last must end at its comma, the last one may be
+ * followed by anything (as with strtod), extra fields are ignored. Lines
+ * that don't parse are counted and skipped.
+*/
+#ifndef CSV_READER_H
+#define CSV_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CSV_MAX_COLUMNS 8
+// Bytes of the file mapped at once
+#define CSV_WINDOW_LENGTH (64*1024*1024)
+// Fields parsed by the fallback on the stack (longer ones are allocated)
+#define CSV_FIELD_LENGTH 64
+
+/**
+ * @brief Type of a column.
+ */
+typedef enum{
+  CSV_INTEGER, //< uint64_t (e.g. timestamps).
+  CSV_REAL //< double.
+} CsvColumnType;
+
+/**
+ * @brief A field of a row.
+ */
+typedef union{
+  uint64_t integer; //< Value of a CSV_INTEGER column.
+  double real; //< Value of a CSV_REAL column.
+} CsvValue;
+
+/**
+ * @brief An open csv file and its read position.
+ */
+typedef struct{
+  int fd; //< The file.
+  uint64_t size; //< Bytes of the file.
+  const char *window; //< Mapped part of the file (NULL if none).
+  uint64_t window_offset; //< File offset of the window (page aligned).
+  size_t window_length; //< Bytes of the window.
+  uint64_t position; //< File offset of the next line.
+  int column_count; //< Columns of each row.
+  CsvColumnType types[CSV_MAX_COLUMNS]; //< Type of each column.
+  uint64_t skipped; //< Lines that weren't rows.
+} CsvReader;
+
+/**
+ * @brief A batch of rows, column by column.
+ */
+typedef struct{
+  size_t rows; //< Rows in the batch.
+  size_t capacity; //< Rows each column can hold.
+  uint64_t *integers[CSV_MAX_COLUMNS]; //< CSV_INTEGER columns, else NULL.
+  double *reals[CSV_MAX_COLUMNS]; //< CSV_REAL columns, else NULL.
+} CsvColumns;
+
+
+/**
+ * @brief Opens a csv file.
+ *
+ * @param[out] reader The reader.
+ * @param[in]  path The csv file.
+ * @param[in]  column_count Columns read of each row (up to CSV_MAX_COLUMNS).
+ * @param[in]  types Type of each column.
+ *
+ * @return 0 on success, -1 if the file can't be opened.
+ */
+int csv_open(CsvReader *reader,const char *path,int column_count,
+             const CsvColumnType *types);
+
+/**
+ * @brief Reads the next row.
+ *
+ * @param[in]  reader The reader.
+ * @param[out] values The row's fields (column_count of them).
+ *
+ * @return 0 on success, -1 at end of file (or if the file can't be mapped).
+ */
+int csv_next(CsvReader *reader,CsvValue *values);
+
+/**
+ * @brief Allocates columns for batches of a reader's rows.
+ *
+ * @param[out] columns The columns.
+ * @param[in]  reader The reader (for the column types).
+ * @param[in]  capacity Rows of a batch.
+ *
+ * @return 0 on success, -1 on allocation failure.
+ */
+int csv_columns_init(CsvColumns *columns,const CsvReader *reader,
+                     size_t capacity);
+
+/**
+ * @brief Reads the next batch of rows into the columns.
+ *
+ * @param[in]  reader The reader.
+ * @param[out] columns The columns (of csv_columns_init).
+ *
+ * @return Rows read, 0 at end of file.
+ */
+size_t csv_read_columns(CsvReader *reader,CsvColumns *columns);
+
+/**
+ * @brief Frees the columns.
+ *
+ * @param[in] columns The columns.
+ */
+void csv_columns_free(CsvColumns *columns);
+
+/**
+ * @brief Unmaps and closes the file.
+ *
+ * @param[in] reader The reader.
+ */
+void csv_close(CsvReader *reader);
+
+#endif
@@ -0,0 +1,243 @@
+/**
+ * Fixed point representation of prices and volumes, an alternative to
+ * doubles (-F). Each symbol has a tick scale: its prices are counted in
+ * 10^-price_decimals ticks and its volumes in 10^-volume_decimals ticks,
+ * as int64. Trades are converted once, when they enter the pipeline, so
+ * the calculator only adds integers: candlesticks and moving averages are
+ * exact and don't depend on the order of floating point operations.
+ * Outputs are formatted from the integers, with each symbol's decimals.
+ *
+ * Tick scales are read from TICK_SCALES_PATH, with lines
+ * symbol,price_decimals,volume_decimals (symbol * sets the default).
+ * Symbols without a line use the default scale.
+*/
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "TradeProcessing.h"
+
+#define TICK_SCALES_PATH "./tick_scales.csv"
+#define FIXED_DEFAULT_PRICE_DECIMALS 6
+#define FIXED_DEFAULT_VOLUME_DECIMALS 4
+#define FIXED_MAX_DECIMALS 12
+// Upper bound of a formatted value's length (sign, 19 digits, point, null)
+#define FIXED_FORMAT_LENGTH 24
+
+/**
+ * @brief Decimals of a symbol's prices and volumes.
+ */
+typedef struct{
+  int price_decimals; //< Price tick is 10^-price_decimals.
+  int volume_decimals; //< Volume tick is 10^-volume_decimals.
+} TickScale;
+
+// Scale of each symbol of symbols_list, NULL while prices are doubles
+extern const TickScale *tick_scales;
+
+/**
+ * @brief A 128 bit two's complement integer, for sums of price*volume.
+ *
+ * The target has no native 128 bit type, and a 64 bit sum of products
+ * overflows at realistic scales (e.g. 8 volume decimals).
+ */
+typedef struct{
+  uint64_t high; //< Upper 64 bits (sign included).
+  uint64_t low; //< Lower 64 bits.
+} FixedWide;
+
+/**
+ * @brief Represents a trade with fixed point price and volume.
+ */
+typedef struct{
+  int64_t p; //< Price of trade (price ticks).
+  uint32_t s_index; //< Index of the symbol (on symbols_list).
+  uint64_t t; //< Timestamp of trade (ms since Epoch).
+  int64_t v; //< Volume traded (volume ticks).
+} FixedTrade;
+
+/**
+ * @brief Candlestick of a minute, in ticks.
+ */
+typedef struct{
+  int64_t max; //< Max price of interval.
+  int64_t min; //< Min price of interval.
+  int64_t open; //< Opening price of interval.
+  int64_t close; //< Closing price of interval.
+  int64_t volume; //< Total volume traded on interval.
+  FixedWide weighted_price; //< Sum of p[i]*v[i] (price*volume ticks).
+} FixedCandlestick;
+
+/**
+ * @brief The 15 minute moving average info, in ticks.
+ *
+ * Same queue like structure as MovingAverageInfo.
+ */
+typedef struct{
+  int64_t total_15min_volume; //< Volume of the past 15 minutes.
+  int64_t minute_volumes[15]; //< Each minute volume separate.
+  FixedWide total_15min_weighted_price; //< Weighted price of 15 minutes.
+  FixedWide weighted_prices[15]; //< Each minute weighted price separate.
+  int oldest_index; //< Pointer to the oldest element of the 15.
+} FixedMovingAverageInfo;
+
+/**
+ * @brief Calculator state of a symbol, in ticks.
+ */
+typedef struct{
+  FixedCandlestick candlestick; //< The latest minute's candlestick.
+  FixedMovingAverageInfo avg_info; //< The moving avg info of 15 minutes.
+} FixedCalculatorBuffer;
+
+
+/**
+ * @brief Enables fixed point prices, with the scales of a file.
+ *
+ * symbols_list and its index must be set. A missing file leaves every
+ * symbol on the default scale. Unknown symbols of the file are skipped.
+ *
+ * @param[in] path The tick scales file.
+ * @param[in] symbol_count Number of symbols in symbols_list.
+ *
+ * @return 0 on success, -1 on allocation failure or invalid lines.
+ */
+int tick_scales_load(const char *path,int symbol_count);
+
+/**
+ * @brief Frees the tick scales, going back to double prices.
+ */
+void tick_scales_free();
+
+/**
+ * @brief Rounds a value to a number of decimals, in ticks.
+ *
+ * Exact for decimal inputs of up to 15 significant digits (such as
+ * parsed ones), since rounding recovers the digits lost to binary. Values
+ * out of the range of ticks saturate at +-INT64_MAX (NaN is 0).
+ *
+ * @param[in] value The value.
+ * @param[in] decimals Decimals of the tick (up to FIXED_MAX_DECIMALS).
+ *
+ * @return The value in ticks.
+ */
+int64_t fixed_from_double(double value,int decimals);
+
+/**
+ * @brief Converts ticks back to a value (fixed_from_double recovers them).
+ *
+ * @param[in] value The value in ticks.
+ * @param[in] decimals Decimals of the tick.
+ *
+ * @return The value.
+ */
+double fixed_to_double(int64_t value,int decimals);
+
+/**
+ * @brief Formats ticks as a decimal number, with integer operations only.
+ *
+ * @param[out] buffer Output of at least FIXED_FORMAT_LENGTH bytes.
+ * @param[in]  value The value in ticks.
+ * @param[in]  decimals Decimals of the tick.
+ *
+ * @return Length of the output.
+ */
+int fixed_format(char *buffer,int64_t value,int decimals);
+
+/**
+ * @brief Fixed point version of write_trade_to_file.
+ *
+ * @param[in] trade Pointer to trade structure to be logged.
+ * @param[in] handlers Array of csv file handlers (one per symbol).
+ * @param[in] file_mutexes Array of mutex vars (one per file).
+ * @param[in,out] file_lengths Bytes written to each file (NULL: not
+ * tracked).
+ * @param[out] line_offset Where the trade's line starts in its file, if
+ * file_lengths isn't NULL.
+ * @param[in] event_stamp Time of json objet's arrival (arrival_stamp()).
+ * @param[in] delay_file File handler for delay log of writer.
+ *
+ * @return The delay (us) from the event time to the trade being logged.
+ */
+double write_fixed_trade_to_file(FixedTrade *trade,FILE **handlers,
+                                 pthread_mutex_t *file_mutexes,
+                                 uint64_t *file_lengths,uint64_t *line_offset,
+                                 uint32_t event_stamp,FILE *delay_file);
+
+/**
+ * @brief Fixed point version of init_calculator_buffers.
+ *
+ * @param[in] buffers The array of buffers
+ * @param[in] symbol_count The number of symbols
+ */
+void init_fixed_calculator_buffers(FixedCalculatorBuffer *buffers,
+                                   int symbol_count);
+
+/**
+ * @brief Fixed point version of add_trade_to_buffers.
+ *
+ * @param[in]   trade Pointer to the trade that is added.
+ * @param[out]  buffers The array of FixedCalculatorBuffers that is modified.
+ */
+void add_fixed_trade_to_buffers(FixedTrade *trade,
+                                FixedCalculatorBuffer *buffers);
+
+/**
+ * @brief Fixed point version of roll_moving_average.
+ *
+ * @param[in/out] buffer The symbol's buffer.
+ */
+void roll_fixed_moving_average(FixedCalculatorBuffer *buffer);
+
+/**
+ * @brief Fixed point version of reset_candlestick.
+ *
+ * @param[in/out] buffer The symbol's buffer.
+ */
+void reset_fixed_candlestick(FixedCalculatorBuffer *buffer);
+
+/**
+ * @brief Fixed point version of write_minute_entries.
+ *
+ * @param[in] timestamp_minutes Minutes since Epoch of the minute to be stored.
+ * @param[in] event_stamp Timestamp of minute event arrival (arrival_stamp()).
+ * @param[in] scale The symbol's tick scale.
+ * @param[in] candlestick_file File handler for the candlestick entry.
+ * @param[in] avg_file File handler for the moving avg entry.
+ * @param[in] delay_file File handler for the delay log (NULL for none).
+ * @param[in/out] buffer The symbol's buffer.
+ * @param[out] bar The values that are written, as doubles (if not NULL).
+ */
+void write_fixed_minute_entries(uint64_t timestamp_minutes,
+                                uint32_t event_stamp,const TickScale *scale,
+                                FILE *candlestick_file,FILE *avg_file,
+                                FILE *delay_file,
+                                FixedCalculatorBuffer *buffer,MinuteBar *bar);
+
+/**
+ * @brief Fixed point version of write_and_reset_buffers.
+ *
+ * The entries have the same format, with each symbol's decimals. The
+ * moving average is rounded half away from zero to a price tick.
+ *
+ * @param[in] timestamp_minutes Minutes since Epoch of the minute to be stored.
+ * @param[in] event_stamp Timestamp of minute event arrival (arrival_stamp()).
+ * @param[in] symbol_count Number of symbols.
+ * @param[in] candlestick_files The array of file handlers for the candlestick
+ * entries.
+ * @param[in] avg_files The array of file handlers for the movign avg entries.
+ * @param[in] delay_file File handler for the delay log of calculator.
+ * @param[in/out] buffers The array of FixedCalculatorBuffers that are stored
+ * and reset.
+ * @param[out] bars The bar of each symbol (if not NULL).
+ */
+void write_and_reset_fixed_buffers(uint64_t timestamp_minutes,
+                                   uint32_t event_stamp,int symbol_count,
+                                   FILE **candlestick_files,FILE **avg_files,
+                                   FILE *delay_file,
+                                   FixedCalculatorBuffer *buffers,
+                                   MinuteBar *bars);
+
+#endif
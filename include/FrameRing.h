@@ -0,0 +1,124 @@
+/**
+ * Byte ring of raw WebSocket messages, which decouples the network thread
+ * (TLS receive) from JSON parsing. The receiving thread appends message
+ * fragments and never blocks: if the ring can't hold a message, the whole
+ * message is dropped and counted. Parser threads take complete messages in
+ * arrival order and parse them concurrently.
+ *
+ * Each record is a FrameHeader followed by the message bytes, both of which
+ * may wrap around the end of the buffer.
+*/
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#define FRAME_RING_SIZE (1<<20) // Bytes of each connection's ring
+// Flag of a message whose payload is compressed (permessage-deflate)
+#define FRAME_FLAG_COMPRESSED 0x1
+
+/**
+ * @brief Represents the header of a record.
+ */
+typedef struct{
+  uint32_t length; //< Length of the message.
+  uint32_t flags; //< FRAME_FLAG_ bits of the message.
+  struct timeval arrival_time; //< Arrival time of its first fragment.
+} FrameHeader;
+
+/**
+ * @brief Represents the ring (single producer, multiple consumers).
+ */
+typedef struct{
+  char *buffer; //< The ring's bytes.
+  uint64_t size; //< Size of buffer (power of 2).
+  uint64_t read; //< Total bytes consumed (start of the oldest record).
+  uint64_t write; //< Total bytes committed (end of the newest record).
+  // Producer only state of the message being received
+  bool receiving; //< A message has started and isn't complete.
+  bool dropping; //< The message being received didn't fit.
+  uint64_t pending_length; //< Bytes of the message written so far.
+  uint32_t pending_flags; //< Flags of the message.
+  struct timeval pending_arrival; //< Arrival of the message's 1st fragment.
+  // Statistics
+  uint64_t frames; //< Messages committed.
+  uint64_t dropped_frames; //< Messages that didn't fit.
+  uint64_t high_water_mark; //< Largest number of committed bytes.
+  // Synchronization
+  bool closed; //< When asserted, consumers exit once the ring is drained.
+  pthread_mutex_t mut; //< For mutual exclusion of the cursors.
+  pthread_cond_t not_empty; //< For waking up consumers.
+} FrameRing;
+
+/**
+ * @brief Initializes an empty ring.
+ *
+ * @param[out] ring The ring that is initialized.
+ * @param[in]  size Size of the ring in bytes (power of 2).
+ *
+ * @return 0 on success, -1 on invalid size or allocation failure.
+ */
+int frame_ring_init(FrameRing *ring,uint64_t size);
+
+/**
+ * @brief Appends a fragment of a message.
+ *
+ * Called by the receiving thread only, never blocks. The message becomes
+ * visible to consumers with its final fragment.
+ *
+ * @param[in] ring The ring that is modified.
+ * @param[in] data The fragment's bytes.
+ * @param[in] length Number of bytes.
+ * @param[in] final Whether this is the message's last fragment.
+ * @param[in] flags FRAME_FLAG_ bits of the message (only those passed with
+ * its first fragment are kept).
+ *
+ * @return 0 on success, -1 if the message is dropped for lack of space.
+ */
+int frame_ring_write(FrameRing *ring,const void *data,size_t length,
+                     bool final,uint32_t flags);
+
+/**
+ * @brief Discards a partially received message (on connection loss).
+ *
+ * @param[in] ring The ring that is modified.
+ */
+void frame_ring_abort(FrameRing *ring);
+
+/**
+ * @brief Takes the oldest message, waiting until there is one.
+ *
+ * The message is copied out, so parsing doesn't hold the ring's space.
+ *
+ * @param[in]     ring The ring that is accessed.
+ * @param[in,out] frame Buffer of the message (malloc'd, grown as needed).
+ * @param[in,out] capacity Size of frame.
+ * @param[out]    length Length of the message.
+ * @param[out]    arrival_time Arrival time of the message.
+ * @param[out]    flags FRAME_FLAG_ bits of the message.
+ *
+ * @return 0 on success, -1 when the ring is closed and drained.
+ */
+int frame_ring_read(FrameRing *ring,char **frame,size_t *capacity,
+                    size_t *length,struct timeval *arrival_time,
+                    uint32_t *flags);
+
+/**
+ * @brief Orders consumers to exit once the ring is drained.
+ *
+ * @param[in] ring The ring that is closed.
+ */
+void frame_ring_close(FrameRing *ring);
+
+/**
+ * @brief Frees the ring.
+ *
+ * @param[in] ring The ring that is destroyed.
+ */
+void frame_ring_destroy(FrameRing *ring);
+
+#endif
@@ -0,0 +1,109 @@
+/**
+ * Synthetic trade generator for load testing beyond what the live feed
+ * delivers. Trades of all symbols arrive as one point process, either
+ * Poisson (constant rate) or Hawkes (self-exciting, for bursty clustering),
+ * and are spread over the symbols with Zipf popularity. Prices follow a
+ * per-symbol geometric random walk and volumes a heavy-tailed Pareto law.
+ *
+ * The generator is a TradeSource, so it can feed the pipeline in-process
+ * (feed_queue) or be the frame source of the mock server.
+*/
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <stdint.h>
+#include "TradeProcessing.h"
+
+/**
+ * @brief The arrival process of trades.
+ */
+typedef enum{
+  ARRIVALS_POISSON, //< Independent arrivals at a constant rate.
+  ARRIVALS_HAWKES //< Each arrival excites the rate, causing bursts.
+} ArrivalProcess;
+
+/**
+ * @brief Represents all parameters of the generator.
+ */
+typedef struct{
+  ArrivalProcess process; //< Arrival process of trades.
+  double rate; //< Base rate of all symbols (trades/s of event time).
+  double hawkes_alpha; //< Rate increase per arrival (1/s), alpha<beta.
+  double hawkes_beta; //< Decay of the excitation (1/s).
+  double zipf_exponent; //< Popularity skew of symbols (0 for uniform).
+  double volatility; //< Relative price volatility per sqrt(second).
+  double volume_min; //< Minimum (scale) of the volume's Pareto law.
+  double volume_tail; //< Tail index of the volume's Pareto law.
+  double duration; //< Event time length in seconds (0 for endless).
+  uint64_t seed; //< Random seed, for reproducible runs.
+} GeneratorConfig;
+
+/**
+ * @brief Represents the state of the generator.
+ */
+typedef struct{
+  GeneratorConfig config; //< The generator's parameters.
+  int symbol_count; //< Number of symbols trades are spread over.
+  double *prices; //< Last price of each symbol.
+  double *last_times; //< Event time of each symbol's last trade (s).
+  double *popularity; //< Cumulative Zipf weights of the symbols.
+  double time; //< Event time of the last arrival (s since start).
+  double excitation; //< Hawkes excitation over the base rate at time.
+  uint64_t start_ms; //< Timestamp of event time 0 (ms since Epoch).
+  uint64_t rng_state; //< State of the random number generator.
+} TradeGenerator;
+
+/**
+ * @brief Fills a configuration with the default parameters.
+ *
+ * Defaults are a 1000 trades/s Poisson process over Zipf(1) symbols.
+ *
+ * @param[out] config The configuration that is filled.
+ */
+void generator_default_config(GeneratorConfig *config);
+
+/**
+ * @brief Initializes a generator.
+ *
+ * @param[out] generator The generator that is initialized.
+ * @param[in]  config The generator's parameters.
+ * @param[in]  symbol_count Number of symbols.
+ * @param[in]  start_ms Timestamp of the first event (ms since Epoch).
+ *
+ * @return 0 on success, -1 on invalid parameters or allocation failure.
+ */
+int generator_init(TradeGenerator *generator,const GeneratorConfig *config,
+                   int symbol_count,uint64_t start_ms);
+
+/**
+ * @brief Changes the number of symbols trades are spread over.
+ *
+ * Existing symbols keep their prices, new symbols get a random one.
+ *
+ * @param[in] generator The generator that is modified.
+ * @param[in] symbol_count The new number of symbols.
+ *
+ * @return 0 on success, -1 on allocation failure.
+ */
+int generator_resize(TradeGenerator *generator,int symbol_count);
+
+/**
+ * @brief Produces the next trade, in event time order.
+ *
+ * Matches the TradeSource signature (source is the TradeGenerator).
+ *
+ * @param[in]  source Pointer to the generator.
+ * @param[out] trade The next trade (s_index is in [0,symbol_count)).
+ *
+ * @return 0 on success, -1 when the configured duration is over.
+ */
+int generator_next(void *source,Trade *trade);
+
+/**
+ * @brief Frees the generator's buffers.
+ *
+ * @param[in] generator The generator that is destroyed.
+ */
+void generator_destroy(TradeGenerator *generator);
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * Inflation of permessage-deflate (RFC 7692) messages, done by the parser
+ * threads so the network thread only copies compressed bytes.
+ *
+ * The client offers server_no_context_takeover, so every message is a
+ * self-contained raw deflate stream: messages of a connection can be
+ * inflated by any parser, in any order.
+ *
+ * Compiled with zlib when WITH_PERMESSAGE_DEFLATE is defined (see
+ * CMakeLists.txt); otherwise inflation always fails and the client doesn't
+ * offer the extension.
+*/
+#ifndef INFLATER_H
+#define INFLATER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Upper bound of an inflated message, against decompression bombs
+#define INFLATE_MAX_MESSAGE_LENGTH (16<<20)
+
+/**
+ * @brief Represents the inflate state of one parser thread.
+ */
+typedef struct{
+  void *stream; //< The zlib stream (z_stream), reset for each message.
+  char *output; //< Inflated message (malloc'd, grown as needed).
+  size_t capacity; //< Size of output.
+} Inflater;
+
+/**
+ * @brief Whether this build can inflate messages.
+ *
+ * @return true if compiled with WITH_PERMESSAGE_DEFLATE.
+ */
+bool inflater_supported();
+
+/**
+ * @brief Initializes an inflater.
+ *
+ * @param[out] inflater The inflater that is initialized.
+ *
+ * @return 0 on success, -1 on failure (or if not supported).
+ */
+int inflater_init(Inflater *inflater);
+
+/**
+ * @brief Inflates a message.
+ *
+ * @param[in]  inflater The inflater that is used.
+ * @param[in]  message The compressed payload of the message.
+ * @param[in]  length Length of message.
+ * @param[out] output The inflated message, null terminated (owned by the
+ * inflater, valid until its next call).
+ * @param[out] output_length Length of the inflated message.
+ *
+ * @return 0 on success, -1 on corrupt or oversized messages.
+ */
+int inflater_inflate(Inflater *inflater,const char *message,size_t length,
+                     char **output,size_t *output_length);
+
+/**
+ * @brief Frees an inflater.
+ *
+ * @param[in] inflater The inflater that is destroyed.
+ */
+void inflater_destroy(Inflater *inflater);
+
+#endif
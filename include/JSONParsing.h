@@ -6,27 +6,58 @@
 #define JSONPARSING_H 
 
 #include <libwebsockets.h>
+#include <stdbool.h>
 #include "PCQueue.h"
+#include "RecentTrades.h"
 
 #define JSON_PATHS_MAX_LENGTH 10
+// Trades that are parsed before being added to the queue together
+#define PARSER_BATCH_SIZE 64
+// Upper bound of a single trade object's length in a formatted frame
+#define TRADE_JSON_MAX_LENGTH 128
+// Upper bound of a frame's length without its trades
+#define FRAME_JSON_OVERHEAD 64
 
 /**
- * @brief Constructs a json parser's context.
+ * @brief Represents one parser of the trade stream.
  *
- * Also passes the 1st stage's PCQueue pointer to ctx->user,
+ * All parse state lives here, so each connection (or parser thread) can
+ * parse concurrently with its own TradeParser.
+ */
+typedef struct{
+  struct lejp_ctx ctx; //< The lejp context (its user points to the parser).
+  PCQueue *api_queue; //< Queue of the 1st stage pipeline.
+  RecentTrades *recent_trades; //< Duplicate filter (NULL for none).
+  Trade current_trade; //< The trade being parsed.
+  struct timeval arrival_time; //< Arrival of the frame.
+  bool trade_is_valid; //< Cleared if any field of the trade is invalid.
+  WorkItem batch[PARSER_BATCH_SIZE]; //< Parsed trades not yet queued.
+  int batch_count; //< Number of trades in batch.
+} TradeParser;
+
+/**
+ * @brief Constructs a json parser's context, for a new frame.
+ *
+ * Also passes the 1st stage's PCQueue pointer to the parser,
  * for the parse to be able to add items to the 1st stage.
+ * The frame's arrival time is set to now; callers that buffered the frame
+ * overwrite arrival_time with its actual arrival.
  *
  * @param[in]  api_queue Pointer to the queue of the 1st stage pipeline.
- * @param[out] ctx The JSON Parser context that is initialized.
+ * @param[in]  recent_trades The connection's recently received trades, to
+ * drop duplicates (NULL to keep every trade).
+ * @param[out] parser The parser that is initialized.
  */
-void construct_parser(PCQueue *api_queue,struct lejp_ctx *ctx);
+void construct_parser(PCQueue *api_queue,RecentTrades *recent_trades,
+                      TradeParser *parser);
 
 
 /**
  * @brief Main callback function of the parse procedure.
  *
- * As the stream is parsed, each trade object found is added
- * to the 1st stage pipeline queue.
+ * As the stream is parsed, the trade objects found are batched, and the
+ * batch is added to the 1st stage pipeline queue at once (when it's full
+ * and when the frame ends), so a frame costs few queue lock acquisitions.
  *
  * @param[in] ctx The JSON Parser ctx.
  * @param[in] reason The reason the callback function was called.
@@ -34,5 +65,24 @@ void construct_parser(PCQueue *api_queue,struct lejp_ctx *ctx);
 signed char json_callback(struct lejp_ctx *ctx, char reason);
 
 
+/**
+ * @brief Formats trades as a frame of Finnhub's trade stream.
+ *
+ * Used by the mock server and the benchmarks to produce the frames
+ * that json_callback parses. The output is null terminated.
+ *
+ * @param[in]  trades The trades of the frame.
+ * @param[in]  trades_count Number of trades.
+ * @param[in]  symbols Names of the symbols that s_index refers to.
+ * @param[out] frame Output buffer, of at least
+ * FRAME_JSON_OVERHEAD+trades_count*TRADE_JSON_MAX_LENGTH bytes.
+ *
+ * @return The frame's length.
+ */
+size_t format_trade_frame(const Trade *trades,int trades_count,
+                          const char symbols[][SYMBOLS_MAX_LENGTH],
+                          char *frame);
+
+
 
 #endif
@@ -0,0 +1,161 @@
+/**
+ * Write-ahead journal of the incoming trades, so a crash or power cut
+ * loses neither the trades still in the trade logs' stdio buffers nor the
+ * calculator's open minute.
+ *
+ * Writers append each trade to the journal as they log it, with the
+ * offset where its line starts in the trade log. Records are copied to an
+ * in-memory buffer and a flusher thread writes and syncs them as a group,
+ * every sync interval, so one fdatasync covers all the trades of the
+ * interval. Each record is length prefixed and checksummed:
+ *   uint32 length, uint32 checksum (FNV-1a of the payload),
+ *   payload: uint64 t, double p, double v, uint64 log offset, then the
+ *   symbol's name.
+ * After each snapshot of the calculator (see Checkpoint.h), on a clean
+ * shutdown and past JOURNAL_MAX_LENGTH, the flusher syncs the trade logs
+ * and renames the journal to JOURNAL_PATH.old, replacing the previous one,
+ * and starts a new one. So the two files hold the trades since the
+ * snapshot before the latest one, which the trade logs no longer need.
+ *
+ * At startup journal_recover cuts each trade log after its last complete
+ * line and appends the journaled trades whose lines start at or past that
+ * point (a log's missing lines are decided by position, not timestamp, as
+ * trades are logged in arrival order). It then rewrites the journal with
+ * where those lines start now and returns the journaled trades, so the
+ * minutes that weren't closed are replayed into the calculator.
+*/
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "TradeProcessing.h"
+
+#define JOURNAL_PATH "./trades.journal"
+#define JOURNAL_OLD_SUFFIX ".old"
+// Records buffered between syncs (writers wait for the flusher past it)
+#define JOURNAL_BUFFER_LENGTH (256*1024)
+// Size at which the journal is rotated, even without a snapshot
+#define JOURNAL_MAX_LENGTH (64*1024*1024)
+
+/**
+ * @brief Header of a journal record, followed by its payload.
+ */
+typedef struct{
+  uint32_t length; //< Bytes of the payload.
+  uint32_t checksum; //< FNV-1a of the payload.
+} JournalRecordHeader;
+
+/**
+ * @brief Fixed part of a record's payload, followed by the symbol's name
+ * (without its null terminator).
+ */
+typedef struct{
+  uint64_t t; //< Timestamp of trade (ms since Epoch).
+  double p; //< Price of trade.
+  double v; //< Volume traded.
+  uint64_t log_offset; //< Where the trade's line starts in its trade log.
+} JournalTrade;
+
+/**
+ * @brief An open journal, appended to by the writers.
+ */
+typedef struct{
+  char path[FILENAME_MAX]; //< The journal file.
+  int fd; //< Descriptor of the journal file.
+  uint64_t size; //< Bytes in the journal file.
+  char *buffers[2]; //< Filled by the writers, written by the flusher.
+  int active; //< Buffer that's being filled.
+  size_t length; //< Bytes in the active buffer.
+  bool full; //< A writer waits for the active buffer to be written.
+  bool checkpointed; //< A snapshot was saved, rotate after the group.
+  bool closing; //< The flusher writes what's left and exits.
+  int sync_interval_ms; //< Time between group commits.
+  FILE **logs; //< Trade log of each symbol, synced before each rotation.
+  pthread_mutex_t *log_mutexes; //< Mutex of each trade log.
+  int log_count; //< Number of trade logs.
+  pthread_mutex_t mutex; //< Guards all of the above.
+  pthread_cond_t wake; //< Wakes the flusher.
+  pthread_cond_t swapped; //< Wakes writers waiting for space.
+  pthread_t flusher; //< Thread that writes and syncs the records.
+  uint64_t records; //< Records appended.
+  uint64_t syncs; //< Group commits.
+} Journal;
+
+
+/**
+ * @brief Opens (or creates) the journal and starts its flusher thread.
+ *
+ * @param[out] journal The journal.
+ * @param[in]  path The journal file.
+ * @param[in]  sync_interval_ms Time between group commits (0: as soon as
+ * there are records).
+ * @param[in]  logs The trade log of each symbol.
+ * @param[in]  log_mutexes The mutex of each trade log.
+ * @param[in]  log_count Number of trade logs.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int journal_open(Journal *journal,const char *path,int sync_interval_ms,
+                 FILE **logs,pthread_mutex_t *log_mutexes,int log_count);
+
+/**
+ * @brief Appends a logged trade to the journal (durable at the next group
+ * commit).
+ *
+ * Safe to call from any number of threads.
+ *
+ * @param[in] journal The journal.
+ * @param[in] trade The trade.
+ * @param[in] log_offset Where the trade's line starts in its trade log.
+ */
+void journal_append(Journal *journal,const Trade *trade,uint64_t log_offset);
+
+/**
+ * @brief Notes that a snapshot of the calculator was saved.
+ *
+ * After its next group commit, the flusher syncs the trade logs and
+ * rotates the journal, dropping the trades of the previous rotated file.
+ *
+ * @param[in] journal The journal.
+ */
+void journal_checkpoint(Journal *journal);
+
+/**
+ * @brief Commits the remaining records, stops the flusher, rotates the
+ * journal (the trade logs are complete) and closes it.
+ *
+ * Called while the trade logs are still open.
+ *
+ * @param[in] journal The journal.
+ */
+void journal_close(Journal *journal);
+
+/**
+ * @brief Recovers the journal of the previous run.
+ *
+ * Reads the rotated journal and then the current one, up to their first
+ * invalid record. Each trade log is cut after its last complete line and
+ * the journaled trades whose lines start at or past that point are
+ * appended to it, in the order they were logged. Both files are then
+ * replaced by one journal of the recovered trades, at the offsets their
+ * lines have now, so a repair is never repeated and the trades are kept
+ * for a crash before the next snapshot. Trades of symbols that aren't
+ * tracked are dropped. The index of symbols_list must be built, and the
+ * trade logs not open.
+ *
+ * @param[in]  path The journal file.
+ * @param[in]  output_folder Folder of the trade_logs.
+ * @param[out] trades The journaled trades, in timestamp order (to free).
+ * @param[out] count Number of trades.
+ *
+ * @return 0 on success (no journal is no trades), -1 on failure.
+ */
+int journal_recover(const char *path,const char *output_folder,
+                    Trade **trades,size_t *count);
+
+#endif
@@ -0,0 +1,192 @@
+/**
+ * Latency metrics of the pipeline. Delays are recorded in log-linear
+ * histograms (HDR style: 32 sub-buckets per power of 2, so any value is
+ * within ~3% of its bucket), which take constant memory and time per sample
+ * and give percentiles without keeping the samples.
+*/
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#define HISTOGRAM_SUB_BUCKET_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1<<HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_MAX_MAGNITUDE 40 // Values up to 2^40 us (~12 days)
+#define HISTOGRAM_BUCKETS \
+  ((HISTOGRAM_MAX_MAGNITUDE-HISTOGRAM_SUB_BUCKET_BITS+2)*HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * @brief Represents the distribution of a delay (in us).
+ */
+typedef struct{
+  uint64_t counts[HISTOGRAM_BUCKETS]; //< Samples of each bucket.
+  uint64_t total; //< Number of samples.
+  uint64_t min; //< Smallest sample.
+  uint64_t max; //< Largest sample.
+  double sum; //< Sum of samples, for the mean.
+} LatencyHistogram;
+
+/**
+ * @brief Represents the delays of each pipeline stage, all measured from
+ * the arrival of the trade (or directive) at the 1st stage queue.
+ *
+ * Each thread records to its own StageLatencies, merged when reporting.
+ */
+typedef struct{
+  LatencyHistogram dequeue; //< Until removed from the api queue.
+  LatencyHistogram write; //< Until logged by a writer.
+  LatencyHistogram calculate; //< Until added to its candlestick.
+  LatencyHistogram minute; //< Until a minute directive stored all symbols.
+} StageLatencies;
+
+/**
+ * @brief Represents the payload counters of a connection's parser thread,
+ * to weigh the bandwidth that compression saves against the inflate time.
+ */
+typedef struct{
+  uint64_t compressed_messages; //< Messages received compressed.
+  uint64_t compressed_bytes; //< Their payload bytes, as received.
+  uint64_t inflated_bytes; //< Their bytes after inflation.
+  uint64_t plain_bytes; //< Payload bytes of uncompressed messages.
+  LatencyHistogram inflate_times; //< Inflate time of each message.
+} InflateMetrics;
+
+/**
+ * @brief Represents the resilience counters of a WSS connection.
+ *
+ * Only the connection's service thread modifies it.
+ */
+typedef struct{
+  uint64_t connects; //< Connections established.
+  uint64_t failed_attempts; //< Connection attempts that failed.
+  uint64_t gaps; //< Disconnections that were recovered from.
+  uint64_t duplicates; //< Trades suppressed as duplicates after reconnects.
+  uint64_t resumed_sessions; //< Connections that resumed a TLS session.
+  LatencyHistogram gap_durations; //< From disconnection to reconnection.
+  LatencyHistogram handshakes; //< From attempt to established, full TLS.
+  LatencyHistogram resumed_handshakes; //< Same, for resumed TLS sessions.
+  InflateMetrics inflate; //< Received payload, merged from the parsers.
+} ConnectionMetrics;
+
+/**
+ * @brief Initializes an empty histogram.
+ *
+ * @param[out] histogram The histogram that is initialized.
+ */
+void histogram_init(LatencyHistogram *histogram);
+
+/**
+ * @brief Records a sample.
+ *
+ * Not thread safe, each thread should record to its own histogram.
+ *
+ * @param[in] histogram The histogram that is modified.
+ * @param[in] value_us The sample (negative values count as 0).
+ */
+void histogram_record(LatencyHistogram *histogram,double value_us);
+
+/**
+ * @brief Adds all samples of a histogram to another.
+ *
+ * @param[in,out] into The histogram that is modified.
+ * @param[in]     from The histogram that is added.
+ */
+void histogram_merge(LatencyHistogram *into,const LatencyHistogram *from);
+
+/**
+ * @brief Gets a percentile of the samples.
+ *
+ * @param[in] histogram The histogram that is accessed.
+ * @param[in] percentile The percentile in [0,100].
+ *
+ * @return The percentile's value (us), or 0 if there are no samples.
+ */
+double histogram_percentile(const LatencyHistogram *histogram,
+                            double percentile);
+
+/**
+ * @brief Gets the smallest value of a bucket, e.g. to export the counts.
+ *
+ * @param[in] index The bucket's index in counts.
+ *
+ * @return The bucket's smallest value (us).
+ */
+uint64_t histogram_bucket_lower_bound(int index);
+
+/**
+ * @brief Initializes empty histograms for all stages.
+ *
+ * @param[out] latencies The stage histograms that are initialized.
+ */
+void stage_latencies_init(StageLatencies *latencies);
+
+/**
+ * @brief Adds all samples of each stage to another.
+ *
+ * @param[in,out] into The stage histograms that are modified.
+ * @param[in]     from The stage histograms that are added.
+ */
+void stage_latencies_merge(StageLatencies *into,const StageLatencies *from);
+
+/**
+ * @brief Initializes zeroed payload counters.
+ *
+ * @param[out] metrics The counters that are initialized.
+ */
+void inflate_metrics_init(InflateMetrics *metrics);
+
+/**
+ * @brief Adds the payload counters of a parser to another.
+ *
+ * @param[in,out] into The counters that are modified.
+ * @param[in]     from The counters that are added.
+ */
+void inflate_metrics_merge(InflateMetrics *into,const InflateMetrics *from);
+
+/**
+ * @brief Initializes zeroed connection counters.
+ *
+ * @param[out] metrics The counters that are initialized.
+ */
+void connection_metrics_init(ConnectionMetrics *metrics);
+
+/**
+ * @brief Adds the counters of a connection to another.
+ *
+ * @param[in,out] into The counters that are modified.
+ * @param[in]     from The counters that are added.
+ */
+void connection_metrics_merge(ConnectionMetrics *into,
+                              const ConnectionMetrics *from);
+
+/**
+ * @brief Prints the counters, the gap durations, the handshake times and
+ * the compression of the payload.
+ *
+ * @param[in] file Where the summary is printed.
+ * @param[in] metrics The counters that are summarized.
+ */
+void connection_metrics_print(FILE *file,const ConnectionMetrics *metrics);
+
+/**
+ * @brief Gets the time elapsed since an event.
+ *
+ * @param[in] event_time Time of the event.
+ *
+ * @return The elapsed time in us.
+ */
+double microseconds_since(struct timeval event_time);
+
+/**
+ * @brief Prints a one line summary (count, mean, percentiles, max).
+ *
+ * @param[in] file Where the summary is printed.
+ * @param[in] name Name of the measured delay.
+ * @param[in] histogram The histogram that is summarized.
+ */
+void histogram_print(FILE *file,const char *name,
+                     const LatencyHistogram *histogram);
+
+#endif
@@ -1,24 +1,72 @@
 /**
  * Definition of the PCQueue (Producer-Consumer Queue) Class. 
- * QUEUE_SIZE is hardcoded and the methods are self explanatory.
+ * The capacity is set at initialization (a power of 2, so indexes wrap
+ * with a mask) and the methods are self explanatory.
 */
 #ifndef PCQUEUE_H
 #define PCQUEUE_H 
 
 #include <libwebsockets.h>
 #include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <sys/time.h>
+#include <time.h>
 
+#include "FixedPoint.h"
 #include "TradeProcessing.h"
 
-#define QUEUE_SIZE 2000
+#define QUEUE_DEFAULT_CAPACITY 2048
+#define QUEUE_MAX_CAPACITY (1<<24)
+// Alignment of the item buffer
+#define CACHE_LINE_SIZE 64
+// Items read back from the spill file at once (once the queue is half empty)
+#define SPILL_REFILL_CHUNK 256
+// Size of a huge page, the unit of huge page mappings
+#define HUGE_PAGE_SIZE (1<<21)
+
+/**
+ * @brief What a producer does when the queue is full.
+ *
+ * Minute directives are never dropped: when a policy would drop one, its
+ * producer waits for space instead.
+ */
+typedef enum{
+  OVERFLOW_BLOCK, //< Wait for space (the default).
+  OVERFLOW_DROP_OLDEST, //< Drop the oldest queued trade for the new item.
+  OVERFLOW_DROP_NEWEST, //< Drop the new trade.
+  OVERFLOW_SPILL //< Append items to a file, read back as the queue drains.
+} OverflowPolicy;
+
+// Kinds of work items
+#define WORK_ITEM_TRADE 0
+#define WORK_ITEM_CALCULATE_MINUTE 1
+// Symbols a work item can refer to (s_index has 24 bits)
+#define WORK_ITEM_MAX_SYMBOLS (1<<24)
 
 /**
  * @brief Represents the basic element of the queue.
+ *
+ * Packed to 32 bytes, 2 per cache line, so the queues move fewer lines per
+ * item than with a Trade and a timeval (48 bytes). Trades are converted at
+ * the edges (parsing, logging) with work_item_from_trade/work_item_to_trade.
+ * With fixed point prices (tick_scales set) price and volume are in ticks.
  */
 typedef struct{
-  Trade trade; //< The trade that's being processed
-  struct timeval event_time; //< The arrival time of the element
+  union{
+    double p; //< Price of the trade
+    int64_t p_ticks; //< Price in ticks, with fixed point prices
+  };
+  union{
+    double v; //< Volume of the trade
+    int64_t v_ticks; //< Volume in ticks, with fixed point prices
+  };
+  uint64_t t; //< Timestamp of the trade (ms since Epoch), or the minute
+              //< (since Epoch) that a directive closes
+  uint32_t arrival_stamp; //< Arrival time, see arrival_stamp()
+  uint32_t s_index:24; //< Index of the symbol (on symbols_list)
+  uint32_t type:8; //< WORK_ITEM_TRADE or WORK_ITEM_CALCULATE_MINUTE
 } WorkItem;
 
 /**
@@ -26,23 +74,121 @@ typedef struct{
  */
 typedef struct{
   // Standard Prod-Cons Queue Members
-  WorkItem buffer[QUEUE_SIZE]; //< Standard buffer
+  WorkItem *buffer; //< Standard buffer (cache line aligned)
+  int capacity; //< Length of buffer (power of 2)
+  int mask; //< capacity-1, wraps the indexes
+  bool huge_pages; //< Whether buffer was mapped on huge pages
   int head,tail; //< Standard head tail
   int full,empty; //< Bools for empty and full queue states
+  int count; //< Number of items in the queue
+  int high_water_mark; //< Largest count reached
+  // Occupancy over time (CLOCK_MONOTONIC)
+  struct timespec created; //< When the queue was initialized
+  struct timespec full_since,empty_since; //< Start of the current state
+  uint64_t full_ns,empty_ns; //< Time spent full/empty in past states
   pthread_mutex_t *mut; //< For mutual exclusion of queue access
   pthread_cond_t *not_full,*not_empty; //< For waking up producers/consumers
   
   // Additional flags/locks
   int exit_flag; // When asserted, changes return value of queue_remove
   pthread_mutex_t *producer_lock; // For exclusive access to production end
+
+  // Overflow handling (see queue_set_overflow_policy)
+  OverflowPolicy policy; //< What producers do when the queue is full.
+  uint64_t dropped; //< Trades dropped by the policy.
+  uint64_t *symbol_drops; //< Trades dropped of each symbol (or NULL).
+  int symbol_count; //< Length of symbol_drops.
+  FILE *spill_file; //< Overflow items, when spilling (or NULL).
+  char *spill_path; //< Path of spill_file, removed when destroyed.
+  uint64_t spill_read,spill_write; //< Items read back and written.
+  uint64_t spilled; //< Items ever spilled.
 } PCQueue;
 
+/**
+ * @brief Packs a trade into a work item.
+ *
+ * With fixed point prices, its price and volume are converted to ticks.
+ *
+ * @param[out] item The work item.
+ * @param[in]  trade The trade (s_index below WORK_ITEM_MAX_SYMBOLS).
+ * @param[in]  arrival_time Arrival time of the trade.
+ */
+void work_item_from_trade(WorkItem *item,const Trade *trade,
+                          struct timeval arrival_time);
+
+/**
+ * @brief Unpacks the trade of a work item.
+ *
+ * @param[in]  item The work item (of type WORK_ITEM_TRADE).
+ * @param[out] trade The trade.
+ */
+void work_item_to_trade(const WorkItem *item,Trade *trade);
+
+/**
+ * @brief Unpacks the trade of a work item, with fixed point prices.
+ *
+ * @param[in]  item The work item (of type WORK_ITEM_TRADE).
+ * @param[out] trade The trade, in ticks.
+ */
+void work_item_to_fixed_trade(const WorkItem *item,FixedTrade *trade);
+
+/**
+ * @brief Makes a directive that closes a minute.
+ *
+ * @param[out] item The work item.
+ * @param[in]  timestamp_minutes Minutes since Epoch of the closed minute.
+ * @param[in]  arrival_time When the directive was issued.
+ */
+void work_item_directive(WorkItem *item,uint64_t timestamp_minutes,
+                         struct timeval arrival_time);
+
 /**
  * @brief Initializes a new queue.
  *
- * @return a new PCQueue struct.
+ * @param[out] queue The queue that is initialized.
+ * @param[in]  capacity Number of items (power of 2).
+ * @param[in]  huge_pages Try to map the buffer on huge pages, falling back
+ * to the heap if none are available.
+ *
+ * @return 0 on success, -1 on invalid capacity or allocation failure.
+ */
+int queue_init(PCQueue *queue,int capacity,bool huge_pages);
+
+/**
+ * @brief Sets what producers do when the queue is full.
+ *
+ * While spilled items wait to be read back, new items are spilled too, so
+ * the queue stays in order. Call before any producer or consumer starts.
+ *
+ * @param[in] queue Pointer to queue.
+ * @param[in] policy The overflow policy.
+ * @param[in] symbol_count Number of symbols, for the per symbol drops.
+ * @param[in] spill_path File of spilled items (OVERFLOW_SPILL only).
+ *
+ * @return 0 on success, -1 on allocation or spill file failure.
+ */
+int queue_set_overflow_policy(PCQueue *queue,OverflowPolicy policy,
+                              int symbol_count,const char *spill_path);
+
+/**
+ * @brief Prints the queue's occupancy: high water mark and the share of
+ * its lifetime spent full and empty.
+ *
+ * @param[in] queue Pointer to queue.
+ * @param[in] file Where the summary is printed.
+ * @param[in] name Name of the queue.
  */
-PCQueue queue_init();
+void queue_print_occupancy(PCQueue *queue,FILE *file,const char *name);
+
+/**
+ * @brief Prints the items that overflowed: totals and drops per symbol.
+ *
+ * @param[in] queue Pointer to queue.
+ * @param[in] file Where the summary is printed.
+ * @param[in] symbols Names of the symbols.
+ */
+void queue_print_overflow(PCQueue *queue,FILE *file,
+                          const char (*symbols)[SYMBOLS_MAX_LENGTH]);
 
 /**
  * @brief Destroys a queue. 
@@ -56,15 +202,33 @@ void queue_destory(PCQueue *queue);
  *
  * Copys full item by value.
  * Exclusive access to queue is embedded in the function.
+ * If the queue is full, applies its overflow policy.
  *
  * @param[in] queue  Pointer to queue.
  * @param[in] item   Pointer to item to be added.
  * 
- * @return 0 on success.
+ * @return 0 on success (including dropped or spilled items).
  */
 int queue_add(PCQueue *queue, WorkItem *item);
 
 
+/**
+ * @brief Adds multiple items to the queue, in order.
+ *
+ * Multi-producer path: items are added with one lock acquisition
+ * (or one per wait when the queue fills up), so concurrent producers
+ * contend less and items of the same batch stay adjacent unless the
+ * queue fills up.
+ *
+ * @param[in] queue  Pointer to queue.
+ * @param[in] items  Array of items to be added.
+ * @param[in] count  Number of items.
+ * 
+ * @return 0 on success, -1 if exit was ordered (remaining items dropped).
+ */
+int queue_add_batch(PCQueue *queue, WorkItem *items, int count);
+
+
 /**
  * @brief Removes an item from the queue.
  *
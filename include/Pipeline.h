@@ -0,0 +1,210 @@
+/**
+ * The consumer side of the pipeline: the writers, the calculator, the queue
+ * between them and all of their files. The producer (WSS client, replayer
+ * or generator) is started separately and feeds the given api queue, so
+ * the same pipeline serves the live program and the end-to-end benchmark.
+ *
+ * All files are created under an output folder:
+ * trade_logs/, candlesticks/, moving_avg/ (one csv per symbol) and delays/,
+ * and columns/ with the column store.
+*/
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ColumnStore.h"
+#include "Journal.h"
+#include "RecentHistory.h"
+#include "SharedState.h"
+#include "Publisher.h"
+#include "Metrics.h"
+#include "PCQueue.h"
+#include "ThreadRoutines.h"
+#include "TradeProcessing.h"
+
+/**
+ * @brief Represents all threads, queues and files of the consumer stages.
+ */
+typedef struct{
+  PCQueue *api_queue; //< 1st stage queue, fed by the producer.
+  PCQueue calculation_queue; //< 2nd stage queue.
+  int symbol_count; //< Number of symbols.
+  int writers_count; //< Number of writer threads.
+  const char *output_folder; //< Folder of all files.
+  FILE **transaction_files; //< Trade log of each symbol.
+  FILE **candlestick_files; //< Candlestick log of each symbol.
+  FILE **avg_files; //< Moving average log of each symbol.
+  FILE **delay_writer_logs; //< Delay log of each writer.
+  FILE *delay_calculator_log; //< Delay log of the calculator.
+  pthread_mutex_t *writing_mutexes; //< Mutex of each trade log.
+  uint64_t *trade_log_lengths; //< Bytes in each trade log (NULL if not
+                               //< journaled).
+  CalculatorBuffer *calculator_buffers; //< Calculator state of each symbol.
+  FixedCalculatorBuffer *fixed_calculator_buffers; //< Instead, with fixed
+                                                   //< point prices.
+  MinuteBar *bars; //< Closed minute of each symbol (NULL if not kept).
+  ColumnStore column_store; //< Per-day columns of the bars, if enabled.
+  StageLatencies *latencies; //< Delays of each writer, then the calculator.
+  pthread_t *writers; //< Writer threads.
+  pthread_t calculator; //< Calculator thread.
+  WriterArgs *writer_args; //< Arguments of each writer.
+  CalculatorArgs calculator_args; //< Arguments of the calculator.
+} Pipeline;
+
+/**
+ * @brief Creates the queue, files and buffers of the consumer stages.
+ *
+ * The calculator keeps fixed point buffers if tick_scales is set.
+ *
+ * @param[out] pipeline The pipeline that is initialized.
+ * @param[in]  api_queue The 1st stage queue (initialized by the caller,
+ * the calculation queue gets the same capacity).
+ * @param[in]  symbol_count Number of symbols (of symbols_list).
+ * @param[in]  writers_count Number of writer threads.
+ * @param[in]  output_folder Folder where all files are created.
+ *
+ * @return 0 on success, -1 on any failed allocation or open.
+ */
+int pipeline_open(Pipeline *pipeline,PCQueue *api_queue,int symbol_count,
+                  int writers_count,const char *output_folder);
+
+/**
+ * @brief Snapshots the calculator's state after each minute, and restores
+ * it from the previous run's snapshot if that's recent (see Checkpoint.h).
+ * Without one, it's rebuilt from the tails of the previous run's files.
+ *
+ * Called between pipeline_open and pipeline_start.
+ *
+ * @param[in]  pipeline The pipeline.
+ * @param[in]  path The snapshot file.
+ * @param[in]  current_minute The current minute (since Epoch).
+ * @param[out] next_minute First minute the restored state didn't close.
+ *
+ * @return 1 if the state was restored or rebuilt, 0 if it starts empty.
+ */
+int pipeline_enable_checkpoints(Pipeline *pipeline,const char *path,
+                                uint64_t current_minute,
+                                uint64_t *next_minute);
+
+/**
+ * @brief Opens the journal on the trade logs and makes the writers journal
+ * each trade as they log it (see Journal.h). The calculator rotates it
+ * after each snapshot.
+ *
+ * Called between pipeline_open and pipeline_start, after
+ * pipeline_enable_checkpoints. The journal is closed with journal_close,
+ * after pipeline_join.
+ *
+ * @param[in]  pipeline The pipeline.
+ * @param[out] journal The journal.
+ * @param[in]  path The journal file.
+ * @param[in]  sync_interval_ms Time between the journal's group commits.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int pipeline_enable_journal(Pipeline *pipeline,Journal *journal,
+                            const char *path,int sync_interval_ms);
+
+/**
+ * @brief Makes the calculator also store each closed minute in per-day
+ * columns, under output_folder/columns (see ColumnStore.h).
+ *
+ * Called between pipeline_open and pipeline_start.
+ *
+ * @param[in] pipeline The pipeline.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int pipeline_enable_column_store(Pipeline *pipeline);
+
+/**
+ * @brief Makes the calculator also push each closed minute to a history.
+ *
+ * Called between pipeline_open and pipeline_start.
+ *
+ * @param[in] pipeline The pipeline.
+ * @param[in] history The history (of the pipeline's symbol count).
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int pipeline_enable_history(Pipeline *pipeline,RecentHistory *history);
+
+/**
+ * @brief Makes the calculator publish each trade and closed minute to a
+ * shared memory segment.
+ *
+ * Called between pipeline_open and pipeline_start.
+ *
+ * @param[in] pipeline The pipeline.
+ * @param[in] state The created segment (of the pipeline's symbol count).
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int pipeline_enable_shared_state(Pipeline *pipeline,SharedState *state);
+
+/**
+ * @brief Makes the writers publish each logged trade, and the calculator
+ * each closed minute, to the subscribers of a publisher.
+ *
+ * Called between pipeline_open and pipeline_start.
+ *
+ * @param[in] pipeline The pipeline.
+ * @param[in] publisher The started publisher.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int pipeline_enable_publisher(Pipeline *pipeline,Publisher *publisher);
+
+/**
+ * @brief Replays journaled trades of the minutes that weren't closed into
+ * the calculator, closing each minute but the last one.
+ *
+ * Called after pipeline_start, before the producers start. The trades
+ * were logged already, so they skip the writers.
+ *
+ * @param[in] pipeline The pipeline.
+ * @param[in] trades The journaled trades, in timestamp order.
+ * @param[in] count Number of trades.
+ * @param[in] from_minute First minute that wasn't closed.
+ * @param[in] current_minute The current minute (since Epoch).
+ *
+ * @return The first minute left open, where the directives resume.
+ */
+uint64_t pipeline_replay(Pipeline *pipeline,const Trade *trades,size_t count,
+                         uint64_t from_minute,uint64_t current_minute);
+
+/**
+ * @brief Starts the writer and calculator threads.
+ *
+ * @param[in] pipeline The pipeline that is started.
+ */
+void pipeline_start(Pipeline *pipeline);
+
+/**
+ * @brief Waits until all threads exit.
+ *
+ * Threads exit once the api queue's exit flag is set and it's drained.
+ *
+ * @param[in] pipeline The pipeline that is joined.
+ */
+void pipeline_join(Pipeline *pipeline);
+
+/**
+ * @brief Gets the delays of all threads, merged per stage.
+ *
+ * @param[in]  pipeline The pipeline that is accessed (after joining).
+ * @param[out] total The merged stage histograms.
+ */
+void pipeline_latencies(const Pipeline *pipeline,StageLatencies *total);
+
+/**
+ * @brief Closes all files and frees all resources of the pipeline.
+ *
+ * @param[in] pipeline The pipeline that is closed.
+ */
+void pipeline_close(Pipeline *pipeline);
+
+#endif
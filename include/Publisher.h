@@ -0,0 +1,119 @@
+/**
+ * Fan-out of the pipeline's trades and closed minutes to local subscriber
+ * processes over a Unix socket, so one Finnhub connection feeds any number
+ * of them.
+ *
+ * Each message is a csv line:
+ *   T,symbol,t_ms,price,volume  for a trade (once it's logged),
+ *   C,symbol,minute,open,high,low,close,volume,vwap,vwap_volume  for a
+ *   closed minute of a symbol (none before the symbol's first trade).
+ * Subscribers connect to the socket and read; they get the messages
+ * published from then on. Anything they send is ignored.
+ *
+ * Producers (writers and calculator) append whole lines to a ring of
+ * PUBLISHER_RING_LENGTH bytes and never wait for subscribers. Each
+ * subscriber has its cursor on the ring and a buffer of
+ * PUBLISHER_CHUNK_LENGTH bytes: a publisher thread copies the next chunk of
+ * its backlog to the buffer under the ring's lock, and sends it with non
+ * blocking writes. So a subscriber's backlog is bounded by the ring: one
+ * that falls further behind (its lines were overwritten before they were
+ * copied) is disconnected as a slow consumer, and the others are
+ * unaffected.
+*/
+#ifndef PUBLISHER_H
+#define PUBLISHER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "FixedPoint.h"
+#include "TradeProcessing.h"
+
+#define PUBLISHER_SOCKET_PATH "./feed.sock"
+#define PUBLISHER_MAX_SUBSCRIBERS 64
+// Bytes of published lines kept for the subscribers
+#define PUBLISHER_RING_LENGTH (4*1024*1024)
+// Bytes of a subscriber's backlog copied out of the ring at a time
+#define PUBLISHER_CHUNK_LENGTH (16*1024)
+
+/**
+ * @brief A connected subscriber.
+ */
+typedef struct{
+  int fd; //< The subscriber's socket (-1: free slot).
+  uint64_t cursor; //< Position of the next byte copied to the chunk.
+  char *chunk; //< Copied backlog being sent (PUBLISHER_CHUNK_LENGTH bytes).
+  size_t chunk_length; //< Bytes in the chunk.
+  size_t chunk_sent; //< Bytes of the chunk already sent.
+} Subscriber;
+
+/**
+ * @brief The ring of published lines and the thread that sends it.
+ */
+typedef struct{
+  char path[FILENAME_MAX]; //< Path of the socket.
+  int listen_fd; //< Listening socket.
+  int wake_fds[2]; //< Pipe that wakes the thread.
+  char *ring; //< Published lines (PUBLISHER_RING_LENGTH bytes).
+  uint64_t head; //< Bytes published since the start.
+  bool waiting; //< The thread waits for lines to send.
+  bool closing; //< The thread exits.
+  pthread_mutex_t mutex; //< Guards the ring, head, waiting and closing.
+  atomic_int subscriber_count; //< Connected subscribers.
+  Subscriber subscribers[PUBLISHER_MAX_SUBSCRIBERS]; //< Used by the thread.
+  pthread_t thread; //< Thread that accepts and sends to subscribers.
+  uint64_t messages; //< Lines published.
+  uint64_t subscriptions; //< Subscribers accepted.
+  uint64_t slow_disconnects; //< Subscribers dropped for falling behind.
+} Publisher;
+
+
+/**
+ * @brief Binds the socket (replacing a stale one) and starts the thread.
+ *
+ * @param[out] publisher The publisher.
+ * @param[in]  path Path of the socket.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int publisher_start(Publisher *publisher,const char *path);
+
+/**
+ * @brief Publishes a trade. Safe from any thread.
+ *
+ * @param[in] publisher The publisher.
+ * @param[in] trade The trade.
+ */
+void publisher_trade(Publisher *publisher,const Trade *trade);
+
+/**
+ * @brief Fixed point version of publisher_trade (printed with the
+ * symbol's decimals).
+ *
+ * @param[in] publisher The publisher.
+ * @param[in] trade The trade.
+ */
+void publisher_fixed_trade(Publisher *publisher,const FixedTrade *trade);
+
+/**
+ * @brief Publishes a closed minute of all symbols. Safe from any thread.
+ *
+ * @param[in] publisher The publisher.
+ * @param[in] bars The bar of each symbol.
+ * @param[in] symbol_count Number of symbols.
+ */
+void publisher_minute(Publisher *publisher,const MinuteBar *bars,
+                      int symbol_count);
+
+/**
+ * @brief Stops the thread, disconnects the subscribers and removes the
+ * socket.
+ *
+ * @param[in] publisher The publisher.
+ */
+void publisher_stop(Publisher *publisher);
+
+#endif
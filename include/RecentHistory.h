@@ -0,0 +1,131 @@
+/**
+ * In-memory history of the last closed minutes (MinuteBar) of each symbol,
+ * so other threads and local processes get recent candlesticks and moving
+ * averages without parsing the csv files.
+ *
+ * Each symbol has a ring of the last capacity bars, allocated once. The
+ * calculator is the only writer: it pushes each closed minute's bars under
+ * the symbol's sequence lock (the sequence is odd while a bar is written).
+ * Readers never block it, they copy the bars they want and retry if the
+ * sequence changed meanwhile.
+ *
+ * A HistoryServer answers queries on a Unix socket: each request is a line
+ * "SYMBOL COUNT", each reply the symbol's last COUNT bars (oldest first) as
+ * csv lines t,open,high,low,close,volume,vwap,vwap_volume, then an empty
+ * line. A request that can't be answered gets "ERROR reason" and the empty
+ * line. Clients may send any number of requests on a connection.
+*/
+#ifndef RECENT_HISTORY_H
+#define RECENT_HISTORY_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "PCQueue.h"
+#include "TradeProcessing.h"
+
+#define RECENT_HISTORY_SOCKET_PATH "./history.sock"
+// Clients connected to the server at once
+#define HISTORY_MAX_CLIENTS 16
+// Longest request line
+#define HISTORY_REQUEST_LENGTH 64
+
+/**
+ * @brief Sequence lock and fill of a symbol's ring, alone in its cache line.
+ */
+typedef struct{
+  _Alignas(CACHE_LINE_SIZE) atomic_uint sequence; //< Odd during a push.
+  uint64_t pushed; //< Bars pushed since the start.
+} HistoryRing;
+
+/**
+ * @brief The rings of all symbols.
+ */
+typedef struct{
+  int symbol_count; //< Number of symbols.
+  size_t capacity; //< Bars kept per symbol.
+  HistoryRing *rings; //< Lock and fill of each symbol's ring.
+  MinuteBar *bars; //< capacity bars of each symbol, symbol after symbol.
+} RecentHistory;
+
+/**
+ * @brief Thread that answers queries of a RecentHistory on a Unix socket.
+ */
+typedef struct{
+  RecentHistory *history; //< The history queried.
+  char path[FILENAME_MAX]; //< Path of the socket.
+  int listen_fd; //< Listening socket.
+  int wake_fds[2]; //< Pipe that wakes the thread to exit.
+  int client_fds[HISTORY_MAX_CLIENTS]; //< Connected clients (-1: free).
+  char requests[HISTORY_MAX_CLIENTS][HISTORY_REQUEST_LENGTH]; //< Partial
+                                                   //< request of each client.
+  size_t request_lengths[HISTORY_MAX_CLIENTS]; //< Bytes of each request.
+  pthread_t thread; //< The server thread.
+  uint64_t queries; //< Requests answered.
+} HistoryServer;
+
+
+/**
+ * @brief Allocates the rings.
+ *
+ * @param[out] history The history.
+ * @param[in]  symbol_count Number of symbols.
+ * @param[in]  capacity Bars kept per symbol.
+ *
+ * @return 0 on success, -1 on allocation failure.
+ */
+int recent_history_init(RecentHistory *history,int symbol_count,
+                        size_t capacity);
+
+/**
+ * @brief Adds a closed minute of all symbols (those without a candlestick
+ * yet are skipped). Only one thread may push.
+ *
+ * @param[in] history The history.
+ * @param[in] bars The bar of each symbol.
+ */
+void recent_history_push(RecentHistory *history,const MinuteBar *bars);
+
+/**
+ * @brief Copies a symbol's last bars. Safe from any thread.
+ *
+ * @param[in]  history The history.
+ * @param[in]  symbol Index of the symbol.
+ * @param[in]  count Bars wanted (at most capacity are kept).
+ * @param[out] bars The bars, oldest first.
+ *
+ * @return Number of bars copied.
+ */
+size_t recent_history_read(RecentHistory *history,int symbol,size_t count,
+                           MinuteBar *bars);
+
+/**
+ * @brief Frees the rings.
+ *
+ * @param[in] history The history.
+ */
+void recent_history_destroy(RecentHistory *history);
+
+/**
+ * @brief Binds the socket (replacing a stale one) and starts the server.
+ *
+ * @param[out] server The server.
+ * @param[in]  history The history queried.
+ * @param[in]  path Path of the socket.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int history_server_start(HistoryServer *server,RecentHistory *history,
+                         const char *path);
+
+/**
+ * @brief Stops the server, closes its clients and removes the socket.
+ *
+ * @param[in] server The server.
+ */
+void history_server_stop(HistoryServer *server);
+
+#endif
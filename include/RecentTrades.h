@@ -0,0 +1,77 @@
+/**
+ * Bounded set of the fingerprints of recently received trades, used to
+ * suppress the duplicates a server may deliver around a reconnect.
+ *
+ * A fingerprint is a hash of (symbol, t, p, v). The set has two
+ * generations of open addressing tables: inserts go to the current one and
+ * when it's full the older one is cleared and becomes current, so the last
+ * capacity to 2*capacity trades are remembered in constant memory.
+ *
+ * Identical trades are legitimate (same symbol, millisecond, price and
+ * volume), so duplicates are only suppressed for a window after each
+ * reconnect; otherwise trades are only remembered.
+*/
+#ifndef RECENT_TRADES_H
+#define RECENT_TRADES_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "TradeProcessing.h"
+
+#define RECENT_TRADES_CAPACITY (1<<15) // Trades remembered per generation
+
+/**
+ * @brief Represents the set (shared by the parsers of a connection).
+ */
+typedef struct{
+  uint64_t *generations[2]; //< Tables of fingerprints (0 is an empty slot).
+  uint64_t slots; //< Slots of each table (power of 2, 2*capacity).
+  uint64_t capacity; //< Fingerprints of a generation before it's retired.
+  uint64_t count; //< Fingerprints in the current generation.
+  int current; //< Index of the current generation.
+  uint64_t suppress_until_ms; //< End of the suppression window.
+  uint64_t duplicates; //< Trades suppressed.
+  pthread_mutex_t mut; //< For mutual exclusion of the parsers.
+} RecentTrades;
+
+/**
+ * @brief Initializes an empty set.
+ *
+ * @param[out] recent The set that is initialized.
+ * @param[in]  capacity Trades remembered per generation (power of 2).
+ *
+ * @return 0 on success, -1 on allocation failure.
+ */
+int recent_trades_init(RecentTrades *recent,uint64_t capacity);
+
+/**
+ * @brief Starts suppressing duplicates until a time.
+ *
+ * @param[in] recent The set that is modified.
+ * @param[in] until_ms End of the window (ms since Epoch, arrival time).
+ */
+void recent_trades_suppress_until(RecentTrades *recent,uint64_t until_ms);
+
+/**
+ * @brief Remembers a trade and checks whether it must be suppressed.
+ *
+ * @param[in] recent The set that is modified.
+ * @param[in] trade The received trade.
+ * @param[in] arrival_time Arrival time of the trade's frame.
+ *
+ * @return true if the trade was seen already and arrived in the window.
+ */
+bool recent_trades_is_duplicate(RecentTrades *recent,const Trade *trade,
+                                struct timeval arrival_time);
+
+/**
+ * @brief Frees the set.
+ *
+ * @param[in] recent The set that is destroyed.
+ */
+void recent_trades_destroy(RecentTrades *recent);
+
+#endif
@@ -0,0 +1,110 @@
+/**
+ * Offline replay of recorded trade logs. Each symbol's trade log is read
+ * sequentially (with the CsvReader) and all logs are merged in timestamp
+ * order using a k-way min-heap, so the pipeline can be fed without a live
+ * connection. Trades that were logged late (out of order within a log) are
+ * replayed at the position they were logged, the same way the live feed
+ * delivered them.
+*/
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include "CsvReader.h"
+#include "PCQueue.h"
+#include "TradeProcessing.h"
+
+/**
+ * @brief Represents the read position on a single symbol's log.
+ */
+typedef struct{
+  CsvReader reader; //< Trade log of the symbol.
+  Trade next; //< Next trade of the log that hasn't been merged yet.
+} ReplayCursor;
+
+/**
+ * @brief Represents the k-way merge of all symbol logs.
+ *
+ * The heap holds indexes of cursors, ordered by the timestamp
+ * of their next trade.
+ */
+typedef struct{
+  ReplayCursor *cursors; //< One cursor per symbol.
+  int *heap; //< Min-heap of cursor indexes.
+  int heap_size; //< Number of cursors that aren't exhausted.
+  int symbol_count; //< Number of symbols.
+} ReplayMerger;
+
+/**
+ * @brief Opens folder_path/X.csv for each symbol X and primes the heap.
+ *
+ * Symbols without a log file are skipped. The s_index of each replayed
+ * trade is the symbol's index in symbols.
+ *
+ * @param[in]  folder_path Folder of the recorded trade logs.
+ * @param[in]  symbols Array of symbol names.
+ * @param[in]  symbol_count Number of symbols.
+ * @param[out] merger The merger that is initialized.
+ *
+ * @return 0 on success, -1 if no log could be opened.
+ */
+int replay_open(const char *folder_path,
+                const char symbols[][SYMBOLS_MAX_LENGTH],int symbol_count,
+                ReplayMerger *merger);
+
+/**
+ * @brief Gets the next trade (in timestamp order) of all logs.
+ *
+ * @param[in]  merger The merger that is accessed.
+ * @param[out] trade The next trade.
+ *
+ * @return 0 on success, -1 when all logs are exhausted.
+ */
+int replay_next(ReplayMerger *merger,Trade *trade);
+
+/**
+ * @brief Closes all files and frees the merger.
+ *
+ * @param[in] merger The merger that is destroyed.
+ */
+void replay_close(ReplayMerger *merger);
+
+/**
+ * @brief Produces the next trade of an offline source (merger, generator).
+ *
+ * @param[in]  source The source's state.
+ * @param[out] trade The next trade.
+ *
+ * @return 0 on success, -1 when the source is exhausted.
+ */
+typedef int (*TradeSource)(void *source,Trade *trade);
+
+/**
+ * @brief Feeds all trades of an offline source to the queue.
+ *
+ * Trades are paced by their timestamps, divided by speed (0 for no pacing).
+ * Each time a minute boundary is crossed in event time, a minute directive
+ * is added the same way the live timer does.
+ *
+ * @param[in] next_trade The source's trade producing function.
+ * @param[in] source The source's state.
+ * @param[in] queue The 1st stage pipeline queue.
+ * @param[in] speed Speed multiplier (1 is real-time, 0 is max speed).
+ *
+ * @return Number of trades added, or -1 if the queue was closed early.
+ */
+long feed_queue(TradeSource next_trade,void *source,PCQueue *queue,
+                double speed);
+
+/**
+ * @brief Feeds all trades of the merger to the queue (see feed_queue).
+ *
+ * @param[in] merger The merger that is consumed.
+ * @param[in] queue The 1st stage pipeline queue.
+ * @param[in] speed Replay speed multiplier (1 is real-time, 0 is max speed).
+ *
+ * @return Number of trades added, or -1 if the queue was closed early.
+ */
+long replay_to_queue(ReplayMerger *merger,PCQueue *queue,double speed);
+
+#endif
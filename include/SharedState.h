@@ -0,0 +1,131 @@
+/**
+ * Publication of each symbol's live state in POSIX shared memory, so other
+ * processes of the box read it without syscalls instead of tailing the csv
+ * files (see SharedStateReader.h for the reader side).
+ *
+ * The segment (SHARED_STATE_NAME) starts with a SharedStateHeader, then
+ * the symbols' names (SYMBOLS_MAX_LENGTH bytes each, in index order), then
+ * a SharedSymbol per symbol, each in its own cache lines. The calculator
+ * is the only writer: after each trade it publishes the symbol's last
+ * trade and its in-progress candlestick, and after each closed minute the
+ * moving average of every symbol, each time under the symbol's sequence
+ * lock (odd while it's written). Readers copy a symbol and retry if the
+ * sequence changed meanwhile, so they never block the calculator.
+ *
+ * The segment is removed when the program exits, after live is cleared.
+ * A new run creates a new segment: readers reattach when live is 0.
+*/
+#ifndef SHARED_STATE_H
+#define SHARED_STATE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FixedPoint.h"
+#include "TradeProcessing.h"
+
+#define SHARED_STATE_NAME "/stockestimator_state"
+#define SHARED_STATE_MAGIC 0x45544154 // "TATE"
+#define SHARED_STATE_VERSION 1
+#define SHARED_STATE_ALIGNMENT 64
+
+/**
+ * @brief Start of the segment.
+ */
+typedef struct{
+  uint32_t magic; //< SHARED_STATE_MAGIC.
+  uint32_t version; //< SHARED_STATE_VERSION.
+  uint32_t symbol_count; //< Number of symbols.
+  uint32_t record_size; //< sizeof(SharedSymbol).
+  uint64_t names_offset; //< Offset of the symbols' names.
+  uint64_t records_offset; //< Offset of the first SharedSymbol.
+  uint64_t segment_size; //< Bytes of the segment.
+  atomic_uint live; //< 1 while the writer runs.
+} SharedStateHeader;
+
+/**
+ * @brief What is published of a symbol.
+ */
+typedef struct{
+  // In-progress minute (t, open, high, low, close, volume) and the moving
+  // average of the last closed one (vwap, vwap_volume). open is
+  // CANDLESTICK_IS_EMPTY until the minute's first trade, when close is the
+  // last close; all prices are until the symbol's first trade.
+  MinuteBar candle;
+  uint64_t trade_t; //< Timestamp of the last trade (ms since Epoch).
+  double trade_p; //< Price of the last trade.
+  double trade_v; //< Volume of the last trade.
+  uint64_t trades; //< Trades since the writer started.
+} SharedSymbolState;
+
+/**
+ * @brief A symbol's record in the segment.
+ */
+typedef struct{
+  _Alignas(SHARED_STATE_ALIGNMENT) atomic_uint sequence; //< Odd while
+                                                         //< written.
+  SharedSymbolState state; //< The published state.
+} SharedSymbol;
+
+/**
+ * @brief The writer's mapping of the segment.
+ */
+typedef struct{
+  SharedStateHeader *header; //< The mapped segment.
+  SharedSymbol *symbols; //< The symbols' records.
+  int symbol_count; //< Number of symbols.
+} SharedState;
+
+
+/**
+ * @brief Creates the segment (replacing one left by a previous run) with
+ * the names of symbols_list.
+ *
+ * @param[out] state The writer's mapping.
+ * @param[in]  name Name of the segment (e.g. SHARED_STATE_NAME).
+ * @param[in]  symbol_count Number of symbols.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int shared_state_create(SharedState *state,const char *name,int symbol_count);
+
+/**
+ * @brief Publishes a trade and its symbol's candlestick (after the trade
+ * was added to it).
+ *
+ * @param[in] state The writer's mapping.
+ * @param[in] trade The trade.
+ * @param[in] candlestick The symbol's candlestick.
+ */
+void shared_state_trade(SharedState *state,const Trade *trade,
+                        const Candlestick *candlestick);
+
+/**
+ * @brief Fixed point version of shared_state_trade (published as doubles).
+ *
+ * @param[in] state The writer's mapping.
+ * @param[in] trade The trade.
+ * @param[in] candlestick The symbol's candlestick.
+ */
+void shared_state_fixed_trade(SharedState *state,const FixedTrade *trade,
+                              const FixedCandlestick *candlestick);
+
+/**
+ * @brief Publishes a closed minute: the moving average of each symbol, and
+ * the start of the next minute's candlestick.
+ *
+ * @param[in] state The writer's mapping.
+ * @param[in] bars The closed minute's bar of each symbol.
+ */
+void shared_state_minute(SharedState *state,const MinuteBar *bars);
+
+/**
+ * @brief Clears live, unmaps and removes the segment.
+ *
+ * @param[in] state The writer's mapping.
+ * @param[in] name Name of the segment.
+ */
+void shared_state_close(SharedState *state,const char *name);
+
+#endif
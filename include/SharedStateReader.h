@@ -0,0 +1,85 @@
+/**
+ * Reader of the live state that ./main -m publishes in shared memory (see
+ * SharedState.h), for strategy processes of the same box. It's its own
+ * small library (sharedstate_reader), without the rest of the project.
+ *
+ * Attaching maps the segment read only; reading a symbol is a copy of its
+ * record under the sequence lock, with no syscall. When the writer exits
+ * live is cleared, and a reader reattaches to the next run's segment.
+ *
+ *   SharedStateReader reader;
+ *   SharedSymbolState state;
+ *   if(shared_state_attach(&reader,SHARED_STATE_NAME)==0){
+ *     int index=shared_state_find(&reader,"NVDA");
+ *     if(index>=0 && shared_state_read(&reader,index,&state)==0)
+ *       printf("%f\n",state.trade_p);
+ *   }
+*/
+#ifndef SHARED_STATE_READER_H
+#define SHARED_STATE_READER_H
+
+#include <stdbool.h>
+
+#include "SharedState.h"
+
+/**
+ * @brief A reader's mapping of the segment.
+ */
+typedef struct{
+  const SharedStateHeader *header; //< The mapped segment (NULL: detached).
+  const char *names; //< Names of the symbols.
+  SharedSymbol *symbols; //< The symbols' records.
+  int symbol_count; //< Number of symbols.
+  size_t size; //< Bytes mapped.
+} SharedStateReader;
+
+
+/**
+ * @brief Maps the segment and checks its layout.
+ *
+ * @param[out] reader The reader.
+ * @param[in]  name Name of the segment (e.g. SHARED_STATE_NAME).
+ *
+ * @return 0 on success, -1 if there's no valid segment.
+ */
+int shared_state_attach(SharedStateReader *reader,const char *name);
+
+/**
+ * @brief Finds a symbol's index on the segment.
+ *
+ * @param[in] reader The reader.
+ * @param[in] symbol Name of the symbol.
+ *
+ * @return The index, or -1 if the symbol isn't published.
+ */
+int shared_state_find(const SharedStateReader *reader,const char *symbol);
+
+/**
+ * @brief Copies a symbol's state.
+ *
+ * @param[in]  reader The reader.
+ * @param[in]  index Index of the symbol.
+ * @param[out] state The symbol's state.
+ *
+ * @return 0 on success, -1 if the index isn't on the segment.
+ */
+int shared_state_read(const SharedStateReader *reader,int index,
+                      SharedSymbolState *state);
+
+/**
+ * @brief Tells if the writer of the segment still runs.
+ *
+ * @param[in] reader The reader.
+ *
+ * @return false once the writer has exited (reattach to a new run).
+ */
+bool shared_state_live(const SharedStateReader *reader);
+
+/**
+ * @brief Unmaps the segment.
+ *
+ * @param[in] reader The reader.
+ */
+void shared_state_detach(SharedStateReader *reader);
+
+#endif
@@ -0,0 +1,68 @@
+/**
+ * Registry of the tracked symbols. The active symbol list is either the
+ * hardcoded one of main.c or a synthetic one (SYN00000, SYN00001, ...) for
+ * load testing with thousands of symbols. Symbols are looked up by name
+ * through a hash index instead of scanning the list.
+*/
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include "TradeProcessing.h"
+
+#define SYMBOL_NOT_FOUND -1
+
+// Active symbol list (null terminated) defined concretely in main.c
+extern const char (*symbols_list)[SYMBOLS_MAX_LENGTH];
+
+/**
+ * @brief Counts the symbols of a null terminated symbol list.
+ *
+ * @param[in] symbols The symbol list.
+ *
+ * @return Number of symbols before the "" entry.
+ */
+int count_symbols(const char symbols[][SYMBOLS_MAX_LENGTH]);
+
+/**
+ * @brief Creates a null terminated list of synthetic symbol names.
+ *
+ * @param[in] symbol_count Number of symbols to create.
+ *
+ * @return The allocated list, or NULL on failure.
+ */
+char (*create_synthetic_symbols(int symbol_count))[SYMBOLS_MAX_LENGTH];
+
+/**
+ * @brief Creates a null terminated list of the symbols logged in a folder.
+ *
+ * Each folder_path/X.csv (e.g. of a trade_logs folder) adds symbol X.
+ *
+ * @param[in]  folder_path The folder that is scanned.
+ * @param[out] symbol_count Number of symbols found.
+ *
+ * @return The allocated list, or NULL on failure.
+ */
+char (*list_folder_symbols(const char *folder_path,
+                           int *symbol_count))[SYMBOLS_MAX_LENGTH];
+
+/**
+ * @brief Builds the lookup index of the active symbols_list.
+ *
+ * Must be called whenever symbols_list changes, before any lookup.
+ *
+ * @param[in] symbol_count Number of symbols in symbols_list.
+ *
+ * @return 0 on success, -1 on allocation failure.
+ */
+int build_symbol_index(int symbol_count);
+
+/**
+ * @brief Finds the index of a symbol on symbols_list.
+ *
+ * @param[in] symbol Name of the symbol (null terminated).
+ *
+ * @return The symbol's index, or SYMBOL_NOT_FOUND.
+ */
+int find_symbol_index(const char *symbol);
+
+#endif
@@ -8,9 +8,12 @@
 #include "TradeProcessing.h"
 
 #define FILEPATH_BUFFER_LENGTH 100
+// FNV-1a offset bases, the start of every hash
+#define FNV1A_64_SEED 14695981039346656037ULL
+#define FNV1A_32_SEED 2166136261U
 
 // List of symbols defined concretely in main.c
-extern const char symbols_list[][SYMBOLS_MAX_LENGTH];
+extern const char (*symbols_list)[SYMBOLS_MAX_LENGTH];
 
 /**
  * @brief Creates a file batch of csv files for each symbol.
@@ -70,5 +73,70 @@ int close_delay_files(FILE **delay_writers_logs,FILE **delay_calc_logs,
 */
 int ensure_directory_exists(const char *path);
 
+/**
+* @brief Ensures the process can have at least needed open files.
+*
+* Raises the soft RLIMIT_NOFILE limit up to the hard limit if needed.
+*
+* @param[in] needed Number of file descriptors needed.
+*
+* @returns 0 on success, -1 if the hard limit is lower than needed.
+*/
+int ensure_open_files_limit(int needed);
+
+/**
+ * @brief Opens a listening unix socket and the pipe that wakes the thread
+ * polling it.
+ *
+ * A socket file left at path by a previous run is removed first. On
+ * failure everything opened is closed again.
+ *
+ * @param[in]  path      Path of the socket.
+ * @param[in]  backlog   Pending connections allowed.
+ * @param[out] listen_fd The listening socket.
+ * @param[out] wake_fds  The wake pipe.
+ *
+ * @returns 0 on success, -1 on a path too long or a failed creation.
+ */
+int open_unix_listener(const char *path,int backlog,int *listen_fd,
+                       int wake_fds[2]);
+
+/**
+ * @brief Closes what open_unix_listener opened and removes the socket file.
+ *
+ * @param[in] path      Path of the socket.
+ * @param[in] listen_fd The listening socket.
+ * @param[in] wake_fds  The wake pipe.
+ */
+void close_unix_listener(const char *path,int listen_fd,int wake_fds[2]);
+
+/**
+ * @brief FNV-1a (64 bit) of data, continued from hash.
+ *
+ * Checksums the checkpoints and the column store files. Start from
+ * FNV1A_64_SEED and pass the result on to hash more pieces.
+ *
+ * @param[in] hash   Hash so far.
+ * @param[in] data   Bytes to hash.
+ * @param[in] length Number of bytes.
+ *
+ * @returns The hash with data.
+ */
+uint64_t fnv1a_64(uint64_t hash,const void *data,size_t length);
+
+/**
+ * @brief FNV-1a (32 bit) of data, continued from hash.
+ *
+ * Checksums the journal records and hashes the symbol names. Start from
+ * FNV1A_32_SEED.
+ *
+ * @param[in] hash   Hash so far.
+ * @param[in] data   Bytes to hash.
+ * @param[in] length Number of bytes.
+ *
+ * @returns The hash with data.
+ */
+uint32_t fnv1a_32(uint32_t hash,const void *data,size_t length);
+
 
 #endif
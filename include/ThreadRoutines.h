@@ -7,16 +7,28 @@
  * - Calculator: Receives trades from writers and calculates in real time the
  *   candlesticks of each symbol. At certain trade configurations the 
  *   calculator writes the results to the corresponding files.
+ * - Replayer: Replaces the WSS Connector when replaying recorded trade logs
+ *   offline.
+ * - Generator: Replaces the WSS Connector with synthetic trades.
 */
 #ifndef THREAD_ROUTINES_H
 #define THREAD_ROUTINES_H 
 
 #include "PCQueue.h"
 #include "TradeProcessing.h"
+#include "WSSHandling.h"
+#include "Generator.h"
+#include "Metrics.h"
+#include "FrameRing.h"
+#include "Journal.h"
+#include "ColumnStore.h"
+#include "RecentHistory.h"
+#include "SharedState.h"
+#include "Publisher.h"
 #include <stdbool.h>
 
 // Symbol list that's defined concretely in main.c
-extern const char symbols_list[][SYMBOLS_MAX_LENGTH];
+extern const char (*symbols_list)[SYMBOLS_MAX_LENGTH];
 
 
 /**
@@ -24,9 +36,45 @@ extern const char symbols_list[][SYMBOLS_MAX_LENGTH];
  */
 typedef struct{
   char* api_key; //< API key of user
-  bool* connection_closed_flag; //< Flag for connection closed.
+  WSSEndpoint *endpoint; //< Server to connect to.
+  int index; //< Index of the connection (selects its symbol shard).
+  int connection_count; //< Number of parallel connections.
+  int symbol_count; //< Number of symbols.
+  int parser_count; //< Number of parser threads of the connection.
+  FILE *gaps_log; //< Where disconnection gaps are logged (NULL for none).
+  ConnectionMetrics *metrics; //< Counters of the connection.
 } WSSClientArgs;
 
+/**
+ * @brief Represents all of the FrameParser's arguments.
+ */
+typedef struct{
+  FrameRing *ring; //< Received frames of the connection.
+  RecentTrades *recent_trades; //< The connection's duplicate filter.
+  PCQueue *api_queue; //< 1st stage pipeline queue.
+  InflateMetrics metrics; //< Payload counters of this parser.
+} FrameParserArgs;
+
+/**
+ * @brief Represents all of the Replayer's arguments.
+ */
+typedef struct{
+  PCQueue *api_queue; //< 1st stage pipeline queue.
+  const char *replay_folder; //< Folder of the recorded trade logs.
+  double speed; //< Replay speed multiplier (0 for max speed).
+  int symbol_count; //< Number of symbols.
+} ReplayerArgs;
+
+/**
+ * @brief Represents all of the Generator's arguments.
+ */
+typedef struct{
+  PCQueue *api_queue; //< 1st stage pipeline queue.
+  GeneratorConfig *config; //< Parameters of the trade generator.
+  double speed; //< Speed multiplier of event time (0 for max speed).
+  int symbol_count; //< Number of symbols.
+} GeneratorArgs;
+
 /**
  * @brief Represents all of the Writer's arguments.
  */
@@ -36,7 +84,12 @@ typedef struct{
   FILE **transaction_files; //< File handlers for trade logging.
   FILE *delay_log_file; //< File handler for the delay log.
   pthread_mutex_t *transaction_file_mutexes; //< Mutex array for the files.
+  uint64_t *transaction_file_lengths; //< Bytes in each file, guarded by its
+                                      //< mutex (NULL: not tracked).
   int symbol_count; //< Number of symbols.
+  StageLatencies *latencies; //< Where dequeue and write delays are recorded.
+  Journal *journal; //< Where logged trades are journaled (NULL for none).
+  Publisher *publisher; //< Where logged trades are published (NULL: none).
 } WriterArgs;
 
 
@@ -49,25 +102,75 @@ typedef struct{
   FILE **avg_files; //< File handlers for moving average logging.
   FILE *delay_log_file; //< File handler for the delay log.
   CalculatorBuffer *calc_buffers; //< Array of buffers for each symbol.
+  FixedCalculatorBuffer *fixed_calc_buffers; //< Used instead of calc_buffers
+                                             //< with fixed point prices.
+  const char *checkpoint_path; //< Snapshot after each minute (NULL: none).
+  Journal *journal; //< Rotated after each snapshot (NULL: none).
+  MinuteBar *bars; //< Closed minute of each symbol (NULL if not needed).
+  ColumnStore *column_store; //< Also stores the bars (NULL: none).
+  RecentHistory *history; //< Also keeps the last bars (NULL: none).
+  SharedState *shared_state; //< Where live state is published (NULL: none).
+  Publisher *publisher; //< Where closed minutes are published (NULL: none).
   int symbol_count; //< Number of symbols.
+  StageLatencies *latencies; //< Where calculation delays are recorded.
 } CalculatorArgs;
 
 
 /**
  * @brief The routine for the WSS Client.
  *
- * Connects to Finnhub's API using LWS, and adds 
- * all trades received to the 1st pipeline stage queue.
+ * Connects to Finnhub's API using LWS, subscribes to its shard of the
+ * symbols and adds all trades received to the 1st pipeline stage queue,
+ * along with a minute directive at each minute start. The thread sleeps in
+ * the lws event loop between frames, timer events and exit requests.
+ * Multiple WSS Clients (one per connection) can feed the queue in parallel.
+ *
+ * Received frames are only copied to the connection's FrameRing, and
+ * parsed by parser_count FrameParser threads that the client starts.
  *
  * @param[in] arg Pointer to the thread's arguments.
  */
 void* WSSClient(void* arg);
 
+/**
+ * @brief The routine for the Frame Parser role.
+ *
+ * Takes received frames from a connection's ring, parses them and adds
+ * their trades to the 1st pipeline stage queue, until the ring is closed.
+ * With multiple parsers per connection, frames are parsed in parallel, so
+ * the trades of consecutive frames may be queued out of order.
+ *
+ * @param[in] arg Pointer to the thread's arguments.
+ */
+void* FrameParser(void* arg);
+
+/**
+ * @brief The routine for the Replayer.
+ *
+ * Merges the recorded trade logs in timestamp order and adds
+ * them to the 1st pipeline stage queue, along with the minute directives.
+ * When the logs are exhausted, the pipeline is ordered to exit.
+ *
+ * @param[in] arg Pointer to the thread's arguments.
+ */
+void* Replayer(void* arg);
+
+/**
+ * @brief The routine for the Generator.
+ *
+ * Adds synthetic trades (and their minute directives) to the 1st pipeline
+ * stage queue, until the configured duration is over or exit is ordered.
+ *
+ * @param[in] arg Pointer to the thread's arguments.
+ */
+void* Generator(void* arg);
+
 /**
  * @brief The routine for the Writer role.
  *
  * Consumes the 1st pipeline stage's queue elements,
  * Writes the trades to the log files,
+ * Journals the trades, if there's a journal,
  * Passes the data to the 2nd pipeline stage queue for further processing.
  *
  * @param[in] arg Pointer to the thread's arguments.
@@ -13,10 +13,9 @@
 
 #define SYMBOLS_MAX_LENGTH 20
 #define CANDLESTICK_IS_EMPTY -1
-#define DIRECTIVE_CALCULATE_MINUTE -1 // Is assigned to v member of trade 
 
 // List of symbols defined concretely in main.c
-extern const char symbols_list[][SYMBOLS_MAX_LENGTH];
+extern const char (*symbols_list)[SYMBOLS_MAX_LENGTH];
 
 
 /**
@@ -24,7 +23,7 @@ extern const char symbols_list[][SYMBOLS_MAX_LENGTH];
  */
 typedef struct{
   double p; //< Last price of trade.
-  char s_index; //< Pointer to the symbol of the traded stock (on symbols_list)
+  uint32_t s_index; //< Index of the traded stock's symbol (on symbols_list)
   uint64_t t; //< Timestamp of trade (ms since Epoch)
   double v; //< Volume traded.
 } Trade;
@@ -71,6 +70,57 @@ typedef struct{
 } CalculatorBuffer;
 
 
+/**
+ * @brief Represents a symbol's closed minute: its candlestick and moving
+ * average, as written to the csv files.
+ *
+ * Before the symbol's first trade there is no candlestick, and open is
+ * CANDLESTICK_IS_EMPTY. All fields are 8 bytes, so bars are stored as is.
+ */
+typedef struct{
+  uint64_t t; //< Timestamp of the minute (minutes since Epoch).
+  double open; //< Opening price of the minute.
+  double high; //< Max price of the minute.
+  double low; //< Min price of the minute.
+  double close; //< Closing price of the minute.
+  double volume; //< Total volume traded in the minute.
+  double vwap; //< 15min moving average (volume weighted price).
+  double vwap_volume; //< 15min total volume.
+} MinuteBar;
+
+
+/**
+ * @brief Compacts a time to 32 bits, for the delay of the item it stamps.
+ *
+ * The stamp is the time in us, modulo 2^32, so delays are measured
+ * correctly up to 2^31 us (about 35 minutes).
+ *
+ * @param[in] time The time that is stamped.
+ *
+ * @return The stamp.
+ */
+uint32_t arrival_stamp(struct timeval time);
+
+
+/**
+ * @brief Time passed since a stamp.
+ *
+ * @param[in] stamp A stamp of arrival_stamp().
+ *
+ * @return The delay (us) from the stamp to now.
+ */
+double microseconds_since_stamp(uint32_t stamp);
+
+
+/**
+ * @brief Logs the delay since a stamp to a delay log.
+ *
+ * @param[in] delay_file The delay log (NULL: nothing is logged).
+ * @param[in] stamp A stamp of arrival_stamp().
+ */
+void log_delay(FILE *delay_file,uint32_t stamp);
+
+
 /**
  * @brief Writes a given trade to it's corresponding file. 
  *
@@ -80,13 +130,20 @@ typedef struct{
  * @param[in] trade Pointer to trade structure to be logged.
  * @param[in] handlers Array of csv file handlers (one per symbol).
  * @param[in] file_mutexes Array of mutex vars (one per file).
- * @param[in] event_time Time of json objet's arrival.
+ * @param[in,out] file_lengths Bytes written to each file, advanced by the
+ * trade's line (NULL: not tracked).
+ * @param[out] line_offset Where the trade's line starts in its file, if
+ * file_lengths isn't NULL.
+ * @param[in] event_stamp Time of json objet's arrival (arrival_stamp()).
  * @param[in] delay_file File handler for delay log of writer.
+ *
+ * @return The delay (us) from the event time to the trade being logged.
  */
-void write_trade_to_file(Trade *trade,FILE** handlers,
-                         pthread_mutex_t *file_mutexes,
-                         struct timeval event_time,
-                         FILE* delay_file);
+double write_trade_to_file(Trade *trade,FILE** handlers,
+                           pthread_mutex_t *file_mutexes,
+                           uint64_t *file_lengths,uint64_t *line_offset,
+                           uint32_t event_stamp,
+                           FILE* delay_file);
 
 
 /**
@@ -112,6 +169,40 @@ void add_trade_to_buffers(Trade *trade,
                           CalculatorBuffer *buffers);
 
 
+/**
+ * @brief Moves the minute's candlestick into the 15 minute window.
+ *
+ * @param[in/out] buffer The symbol's buffer.
+ */
+void roll_moving_average(CalculatorBuffer *buffer);
+
+
+/**
+ * @brief Empties the candlestick for a new minute (close is kept).
+ *
+ * @param[in/out] buffer The symbol's buffer.
+ */
+void reset_candlestick(CalculatorBuffer *buffer);
+
+
+/**
+ * @brief Closes a symbol's minute: rolls its moving average and writes its
+ * entries (see write_and_reset_buffers), without resetting the candlestick.
+ * The delay of each entry is logged after it's written.
+ *
+ * @param[in] timestamp_minutes Minutes since Epoch of the minute to be stored.
+ * @param[in] event_stamp Timestamp of minute event arrival (arrival_stamp()).
+ * @param[in] candlestick_file File handler for the candlestick entry.
+ * @param[in] avg_file File handler for the moving avg entry.
+ * @param[in] delay_file File handler for the delay log (NULL for none).
+ * @param[in/out] buffer The symbol's buffer.
+ * @param[out] bar The values that are written (if not NULL).
+ */
+void write_minute_entries(uint64_t timestamp_minutes,uint32_t event_stamp,
+                          FILE *candlestick_file,FILE *avg_file,
+                          FILE *delay_file,CalculatorBuffer *buffer,
+                          MinuteBar *bar);
+
 /**
  * @brief Stores the CalculatorBuffer data and resets for new minute.
  *
@@ -123,7 +214,7 @@ void add_trade_to_buffers(Trade *trade,
  *
  *
  * @param[in] timestamp_minutes Minutes since Epoch of the minute to be stored.
- * @param[in] event_time Timestamp of minute event arrival.
+ * @param[in] event_stamp Timestamp of minute event arrival (arrival_stamp()).
  * @param[in] symbol_count Number of symbols.
  * @param[in] candlestick_files The array of file handlers for the candlestick 
  * entries.
@@ -131,11 +222,12 @@ void add_trade_to_buffers(Trade *trade,
  * @param[in] delay_file File handler for the delay log of calculator.
  * @param[in/out] buffers The array of CalculatorBuffers that are stored and 
  * reset.
+ * @param[out] bars The bar of each symbol (if not NULL).
  */
 void write_and_reset_buffers(uint64_t timestamp_minutes,
-                             struct timeval event_time,int symbol_count,
+                             uint32_t event_stamp,int symbol_count,
                              FILE **candlestick_files, FILE **avg_files,
                              FILE *delay_file,
-                             CalculatorBuffer *buffers);
+                             CalculatorBuffer *buffers,MinuteBar *bars);
 
 #endif 
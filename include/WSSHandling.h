@@ -7,53 +7,144 @@
 
 #include <libwebsockets.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include "PCQueue.h"
+#include "FrameRing.h"
+#include "Metrics.h"
+#include "RecentTrades.h"
 #include "TradeProcessing.h"
 
 // Used for snprintf on statically allocated buffers.
 #define TEMP_BUFFER_LENGTH 256
 
 #define PROGRAM_MAX_HOUR_LIMIT 48
+// The minute timer fires this late, so that it never fires before XX.00
+#define MINUTE_TIMER_SLACK_US 1000
+// Upper bound of parallel connections
+#define WSS_MAX_CONNECTIONS 16
+// Upper bound of parser threads of each connection
+#define WSS_MAX_PARSERS 8
+// Dropped frames are reported once per this many
+#define FRAME_DROP_REPORT_INTERVAL 1000
+// Reconnection delay after the 1st failure, doubled after each failure
+#define RECONNECT_BACKOFF_BASE_MS 250
+// Upper bound of the reconnection delay
+#define RECONNECT_BACKOFF_MAX_MS 30000
+// After a reconnect, repeated trades are suppressed for this long
+#define RECONNECT_DEDUP_WINDOW_MS 10000
+// Offered extension: every message is compressed on its own, so any parser
+// thread can inflate it
+#define WSS_DEFLATE_OFFER "permessage-deflate; server_no_context_takeover; " \
+                          "client_no_context_takeover"
+// Reserved bit of a compressed message, as lws_get_reserved_bits reports it
+#define WSS_RSV1_COMPRESSED 0x40
+// Certificate authorities that the server is verified with
+#define WSS_CA_STORE_PATH "./ca-certificates.crt"
+
+// Default endpoint of Finnhub's API
+#define FINNHUB_HOST "ws.finnhub.io"
+#define FINNHUB_PORT 443 // Default WSS port
 
 // List of symbols defined concretely in main.c
-extern const char symbols_list[][SYMBOLS_MAX_LENGTH];
+extern const char (*symbols_list)[SYMBOLS_MAX_LENGTH];
 
 // The 1st pipeline stage PCQueue, defined in main.c
 extern PCQueue api_queue;
 
 // Global flags for connection status defined in main.c
 extern bool exit_wss_connection; // When asserted, exit gracefully.
-extern bool connection_closed; // When asserted, connection to WSS was closed.
 
 
 /**
- * @brief Represents all objects that result from the WSS connection.
+ * @brief Represents the server endpoint that the client connects to.
+ *
+ * Defaults to Finnhub's API, but can point to a local mock server.
  */
 typedef struct{
+  const char *host; //< Address of the server.
+  int port; //< Port of the server.
+  bool use_ssl; //< When false, connects over plain WS.
+  bool allow_self_signed; //< Accept self signed certificates (mock servers).
+  bool deflate; //< Offer permessage-deflate (see Inflater.h).
+} WSSEndpoint;
+
+
+/**
+ * @brief Represents the state of one of the parallel connections.
+ *
+ * Each connection runs on its own thread with its own lws context, and
+ * subscribes to its shard of symbols_list: the symbols whose index is
+ * index modulo connection_count.
+ *
+ * The context outlives the connection: when it's lost, a new one is
+ * attempted on the same context after an exponential backoff with jitter,
+ * and the time without a connection is logged as a gap of each symbol.
+ * Reconnects resume the TLS session cached by the context, so they cost an
+ * abbreviated handshake, and verify the server with a CA store that's
+ * parsed once for all connections.
+ */
+typedef struct{
+  int index; //< Index of the connection, selects its shard.
+  int connection_count; //< Number of parallel connections.
+  int symbol_count; //< Number of symbols on symbols_list.
+  char *api_key; //< The API user's key needed for authentication.
+  WSSEndpoint *endpoint; //< The server to connect to.
+  FrameRing ring; //< Received frames, until the parser threads take them.
+  RecentTrades recent_trades; //< Suppresses trades repeated on reconnect.
   struct lws_context *ctx; //< The connection's context.
-  struct lws *wsi; //< The connection's pointer.
-} WSS_Objects;
+  lws_sorted_usec_list_t minute_timer; //< Fires at each minute start.
+  lws_sorted_usec_list_t reconnect_timer; //< Fires when backoff ends.
+  bool connecting; //< Asserted from an attempt until the connection's lost.
+  bool established; //< Asserted while subscribed.
+  bool stopping; //< Asserted while the context is destroyed.
+  bool deflate_active; //< The server accepted permessage-deflate.
+  int backoff_exponent; //< Failures since the last established connection.
+  struct timeval attempt_start; //< When the current attempt started.
+  void *tls_session; //< Last full TLS session, restored into new contexts.
+  size_t tls_session_length; //< Length of the serialized tls_session.
+  uint64_t rng_state; //< Jitter of the backoff (xorshift state).
+  struct timeval gap_start; //< When the connection was lost (0 if never).
+  FILE *gaps_log; //< Where the gaps are logged (NULL to not log).
+  ConnectionMetrics *metrics; //< Counters of the connection.
+} WSSConnection;
 
 
 /**
- * @brief Sets up the connection to Finnhub's API using LWS's WSS Client.
+ * @brief Creates the lws context of a connection.
+ *
+ * The context polls the exit event and runs the minute timer for the
+ * connection's whole lifetime, across reconnects. If a previous context
+ * negotiated a TLS session, it's loaded into the new context's cache.
  *
- * @param[in] api_key The API user's key needed for authentication.
+ * @param[in,out] connection State of the connection (the context's user
+ * data), its ctx is set.
  *
- * @return On success, WSS_Objects struct with context and connection pointer.
- * If connection was unsuccessful, returns NULL pointers.
+ * @return 0 on success, -1 on failure.
  */
-WSS_Objects finnhub_connection_setup(char* api_key);
+int wss_context_setup(WSSConnection *connection);
 
 
 /**
- * @brief Sends subscribe messages for each symbol on symbols_list 
+ * @brief Starts a connection attempt to the endpoint on the context.
+ *
+ * The attempt completes in the service loop. If it fails, or the
+ * connection is later lost, another is scheduled after a backoff.
+ *
+ * @param[in] connection State of the connection, with its context.
+ */
+void finnhub_connect(WSSConnection *connection);
+
+
+/**
+ * @brief Sends subscribe messages for each symbol of a shard of symbols_list 
  *
  * @param[in] wsi Pointer to the connection that is accessed.
+ * @param[in] connection State of the connection (selects its shard).
  *
  * @return 0 on success, -1 on failure.
  */
-int subscribe_to_symbols(struct lws *wsi);
+int subscribe_to_symbols(struct lws *wsi,const WSSConnection *connection);
 
 
 /**
@@ -88,7 +179,8 @@ int lws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *user,
 /**
  * @brief The interrupt routine that starts the program exit.
  * 
- * It's mapped to SIGINT and asserts the exit_flag for graceful exit.
+ * It's mapped to SIGINT, asserts the exit_flag for graceful exit and wakes
+ * up the service loop.
  *
  * @param sig Signal number to verify it's SIGINT
  */
@@ -96,22 +188,37 @@ void close_connection_interrupt(int sig);
 
 
 /**
- * @brief Sets up timer to send a SIGALRM at each minute start.
+ * @brief Wakes up the WSS clients' service loops, to check the exit flag.
  *
- * Not starting from program execution, sends at XX.00 minutes.
+ * Writes to an eventfd that the lws context polls, so it's async signal
+ * safe and can be called from any thread.
  */
-void setup_timer();
+void request_service_wakeup();
 
 
 /**
- * @brief Sends a directive to the api_queue to calculate minute.
+ * @brief Sets the first minute that send_due_directives closes.
+ *
+ * After a warm restart, the minutes since the restored state are closed
+ * (empty) like those missed while reconnecting.
+ *
+ * @param[in] minute Minutes since Epoch.
+ */
+void resume_directives_from(uint64_t minute);
+
+/**
+ * @brief Sends a directive to the api_queue for each minute that ended.
  *
- * It's bound to SIGALRM and every minute adds a special directive 
- * item to the 1st stage queue. (Directive item is differentiated by v<0)
+ * Called by the WSS clients' minute timers, just after each XX.00, which
+ * keep running while reconnecting, so minutes that ended without a
+ * connection are still closed. Each minute is closed once, by the first
+ * connection that calls it. (Directive items are of type
+ * WORK_ITEM_CALCULATE_MINUTE)
+ * The first call only marks the current minute.
  *
  * At PROGRAM_MAX_HOUR_LIMIT, asserts the exit flag for graceful exit.
  */
-void send_directive_to_queue(int signum);
+void send_due_directives();
 
 
 #endif
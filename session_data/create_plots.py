@@ -4,41 +4,43 @@ import os
 import glob
 
 
-def produce_data_stats(folder_path):
-    # Get file batch
-    csv_files=glob.glob(os.path.join(folder_path,'*.csv'))
-    # For each file
-    for file in csv_files:
-        basename=os.path.basename(file)
-        # Open whole file
-        data=np.genfromtxt(file,delimiter=',',skip_header=0)
-        # And keep delays only
-        print(f"For {basename}:\nMean delay(us): {np.mean(data)}")
-        print(f"Standard deviation(us): {np.std(data)}")
-        print(f"Max(us): {np.max(data)}\nMin(us): {np.min(data)}")
-        
-        create_vector_histogram(data,basename)
+def produce_data_stats(stats_folder):
+    # Statistics of ../delaystats -o stats_folder delays/*.csv
+    hist_files=glob.glob(os.path.join(stats_folder,'*_hist.csv'))
+    # For each delay log
+    for file in hist_files:
+        name=os.path.basename(file).removesuffix('_hist.csv')
+        # Histogram buckets: lower_us,upper_us,count
+        hist=np.genfromtxt(file,delimiter=',',skip_header=1,ndmin=2)
+        create_vector_histogram(hist,name)
+        # A row per window: first_sample,count,mean,p50,p99,max
+        series=np.genfromtxt(os.path.join(stats_folder,f"{name}_series.csv"),
+                             delimiter=',',skip_header=1,ndmin=2)
         plt.figure()
-        plt.plot(data)
+        plt.plot(series[:,0],series[:,2],label="Mean")
+        plt.plot(series[:,0],series[:,4],label="p99")
+        plt.plot(series[:,0],series[:,5],label="Max")
+        plt.legend()
         plt.xlabel("Work item number")
         plt.ylabel("Delay of work item (us)")
-        pure_name=basename.removesuffix('.csv')
-        pure_name=pure_name.capitalize()
-        pure_name=pure_name.replace("_"," ")
-        plt.title(f"{pure_name}: Delay sequence")
+        plt.title(f"{pretty_name(name)}: Delay sequence")
     plt.show()
     return
 
-def create_vector_histogram(vector,name):
+def pretty_name(name):
+    return name.capitalize().replace("_"," ")
+
+def create_vector_histogram(hist,name):
     plt.figure()
-    max_bin=np.percentile(vector,99)
-    plt.hist(vector,bins=30,range=(np.min(vector),max_bin),edgecolor='black',
-             density=True)
+    # Buckets up to the 99th percentile, as densities
+    counts=hist[:,2]
+    kept=np.cumsum(counts)<=0.99*np.sum(counts)
+    kept[np.argmin(kept)]=True
+    widths=hist[:,1]-hist[:,0]
+    plt.bar(hist[kept,0],counts[kept]/np.sum(counts)/widths[kept],
+            width=widths[kept],align='edge',edgecolor='black')
     plt.xlabel("Delay (us)")
     plt.ylabel("Density (%)")
-    pure_name=name.removesuffix('.csv')
-    pure_name=pure_name.capitalize()
-    pure_name=pure_name.replace("_"," ")
-    plt.title(f"{pure_name}: Histogram")
+    plt.title(f"{pretty_name(name)}: Histogram")
 
-produce_data_stats('./delays')
+produce_data_stats('./stats')
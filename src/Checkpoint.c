@@ -0,0 +1,327 @@
+#include "Checkpoint.h"
+#include "Symbols.h"
+#include "SystemHandling.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bytes of each symbol's entry
+static size_t entry_length(bool fixed_point){
+  return SYMBOLS_MAX_LENGTH+(fixed_point?sizeof(TickScale)+
+                                         sizeof(FixedCalculatorBuffer):
+                                         sizeof(CalculatorBuffer));
+}
+
+
+int checkpoint_save(const char *path,uint64_t next_minute,int symbol_count,
+                    const CalculatorBuffer *buffers,
+                    const FixedCalculatorBuffer *fixed_buffers){
+  char temporary_path[FILENAME_MAX];
+  CheckpointHeader header;
+  bool fixed_point=fixed_buffers!=NULL;
+  size_t length=entry_length(fixed_point);
+  unsigned char *entries,*entry;
+  FILE *file;
+  int result=0;
+
+  entries=(unsigned char*)calloc(symbol_count,length);
+  if(entries==NULL)
+    return -1;
+  // Entries: name, then the buffer
+  for(int i=0;i<symbol_count;i++){
+    entry=entries+i*length;
+    strncpy((char*)entry,symbols_list[i],SYMBOLS_MAX_LENGTH);
+    entry+=SYMBOLS_MAX_LENGTH;
+    if(fixed_point){
+      memcpy(entry,&tick_scales[i],sizeof(TickScale));
+      memcpy(entry+sizeof(TickScale),&fixed_buffers[i],
+             sizeof(FixedCalculatorBuffer));
+    }
+    else{
+      memcpy(entry,&buffers[i],sizeof(CalculatorBuffer));
+    }
+  }
+  header.magic=CHECKPOINT_MAGIC;
+  header.version=CHECKPOINT_VERSION;
+  header.symbol_count=symbol_count;
+  header.fixed_point=fixed_point;
+  header.next_minute=next_minute;
+  header.checksum=fnv1a_64(FNV1A_64_SEED,entries,symbol_count*length);
+
+  // Write aside, then replace the previous snapshot at once
+  snprintf(temporary_path,FILENAME_MAX,"%s.tmp",path);
+  file=fopen(temporary_path,"wb");
+  if(file==NULL){
+    free(entries);
+    return -1;
+  }
+  if(fwrite(&header,sizeof(header),1,file)!=1 ||
+     fwrite(entries,length,symbol_count,file)!=(size_t)symbol_count ||
+     fflush(file)!=0 || fsync(fileno(file))!=0){
+    result=-1;
+  }
+  if(fclose(file)!=0)
+    result=-1;
+  if(result==0 && rename(temporary_path,path)!=0)
+    result=-1;
+  if(result!=0)
+    unlink(temporary_path);
+  free(entries);
+  return result;
+}
+
+
+int checkpoint_load(const char *path,uint64_t current_minute,int symbol_count,
+                    CalculatorBuffer *buffers,
+                    FixedCalculatorBuffer *fixed_buffers,
+                    uint64_t *next_minute){
+  CheckpointHeader header;
+  bool fixed_point=fixed_buffers!=NULL;
+  size_t length=entry_length(fixed_point);
+  unsigned char *entries=NULL,*entry;
+  char name[SYMBOLS_MAX_LENGTH];
+  TickScale scale;
+  int symbol_index,restored=0;
+  FILE *file;
+
+  file=fopen(path,"rb");
+  if(file==NULL)
+    return 0;
+  if(fread(&header,sizeof(header),1,file)!=1 ||
+     header.magic!=CHECKPOINT_MAGIC || header.version!=CHECKPOINT_VERSION ||
+     header.fixed_point!=(uint32_t)fixed_point){
+    printf("Ignoring checkpoint %s: not of this build and mode\n",path);
+    goto done;
+  }
+  if(header.next_minute>current_minute ||
+     current_minute-header.next_minute>=CHECKPOINT_MAX_AGE_MINUTES){
+    printf("Ignoring checkpoint %s: not recent\n",path);
+    goto done;
+  }
+  entries=(unsigned char*)malloc(header.symbol_count*length);
+  if(entries==NULL ||
+     fread(entries,length,header.symbol_count,file)!=header.symbol_count ||
+     fnv1a_64(FNV1A_64_SEED,entries,header.symbol_count*length)!=
+     header.checksum){
+    printf("Ignoring checkpoint %s: corrupt\n",path);
+    goto done;
+  }
+
+  // Restore the symbols that are still tracked
+  for(uint32_t i=0;i<header.symbol_count;i++){
+    entry=entries+i*length;
+    memcpy(name,entry,SYMBOLS_MAX_LENGTH);
+    name[SYMBOLS_MAX_LENGTH-1]='\0';
+    entry+=SYMBOLS_MAX_LENGTH;
+    symbol_index=find_symbol_index(name);
+    if(symbol_index==SYMBOL_NOT_FOUND || symbol_index>=symbol_count)
+      continue;
+    if(fixed_point){
+      // Ticks of another scale would be misread
+      memcpy(&scale,entry,sizeof(TickScale));
+      if(scale.price_decimals!=tick_scales[symbol_index].price_decimals ||
+         scale.volume_decimals!=tick_scales[symbol_index].volume_decimals)
+        continue;
+      memcpy(&fixed_buffers[symbol_index],entry+sizeof(TickScale),
+             sizeof(FixedCalculatorBuffer));
+    }
+    else{
+      memcpy(&buffers[symbol_index],entry,sizeof(CalculatorBuffer));
+    }
+  }
+  *next_minute=header.next_minute;
+  restored=1;
+  printf("Restored calculator state, from minute %" PRIu64 "\n",
+         header.next_minute);
+
+done:
+  free(entries);
+  fclose(file);
+  return restored;
+}
+
+
+// Reads the end of a csv file, from its first line whose leading number is
+// at least from, without reading anything before that. Returns the null
+// terminated lines (NULL if the file can't be read).
+static char *read_tail(const char *path,uint64_t from){
+  struct stat info;
+  size_t chunk=TAIL_CHUNK_LENGTH,length,done;
+  off_t offset;
+  char *buffer=NULL,*resized,*start;
+  ssize_t bytes;
+  int fd=open(path,O_RDONLY);
+  if(fd<0)
+    return NULL;
+  if(fstat(fd,&info)!=0){
+    close(fd);
+    return NULL;
+  }
+  while(true){
+    offset=(size_t)info.st_size>chunk?info.st_size-chunk:0;
+    length=info.st_size-offset;
+    resized=(char*)realloc(buffer,length+1);
+    if(resized==NULL)
+      break;
+    buffer=resized;
+    for(done=0;done<length;done+=bytes){
+      bytes=pread(fd,buffer+done,length-done,offset+done);
+      if(bytes<=0)
+        break;
+    }
+    length=done;
+    buffer[length]='\0';
+    // The chunk's first line is partial, unless it's the file's start
+    start=buffer;
+    if(offset>0){
+      start=memchr(buffer,'\n',length);
+      start=start!=NULL?start+1:buffer+length;
+    }
+    if(offset==0 ||
+       (*start!='\0' && strtoull(start,NULL,10)<from)){
+      memmove(buffer,start,buffer+length-start+1);
+      close(fd);
+      return buffer;
+    }
+    chunk*=2;
+  }
+  free(buffer);
+  close(fd);
+  return NULL;
+}
+
+// Moves to the next line of a tail
+static char *next_line(char *line){
+  char *end=strchr(line,'\n');
+  return end!=NULL?end+1:line+strlen(line);
+}
+
+// Adds a trade to a symbol's buffer, in the calculator's representation
+static void add_rebuilt_trade(Trade *trade,CalculatorBuffer *buffers,
+                              FixedCalculatorBuffer *fixed_buffers){
+  FixedTrade fixed_trade;
+  if(fixed_buffers!=NULL){
+    const TickScale *scale=&tick_scales[trade->s_index];
+    fixed_trade.p=fixed_from_double(trade->p,scale->price_decimals);
+    fixed_trade.v=fixed_from_double(trade->v,scale->volume_decimals);
+    fixed_trade.t=trade->t;
+    fixed_trade.s_index=trade->s_index;
+    add_fixed_trade_to_buffers(&fixed_trade,fixed_buffers);
+  }
+  else{
+    add_trade_to_buffers(trade,buffers);
+  }
+  return;
+}
+
+// Rebuilds a symbol's window of the minutes up to last_minute
+static void rebuild_symbol(const char *output_folder,int index,
+                           uint64_t last_minute,CalculatorBuffer *buffers,
+                           FixedCalculatorBuffer *fixed_buffers){
+  char path[FILEPATH_BUFFER_LENGTH];
+  char *candlesticks,*trades,*row,*pending;
+  uint64_t first_minute=last_minute-14,minute,row_minute;
+  double open,high,low,close=CANDLESTICK_IS_EMPTY,row_close,volume;
+  Trade trade;
+
+  snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/candlesticks/%s.csv",
+           output_folder,symbols_list[index]);
+  candlesticks=read_tail(path,first_minute);
+  snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/trade_logs/%s.csv",
+           output_folder,symbols_list[index]);
+  trades=read_tail(path,first_minute*60000);
+  trade.s_index=index;
+
+  // One minute at a time, as the calculator closed them (rows are sorted)
+  row=candlesticks;
+  pending=trades;
+  for(minute=first_minute;minute<=last_minute;minute++){
+    for(;row!=NULL && *row!='\0';row=next_line(row)){
+      // Format: timestamp(min),open,high,low,close,volume
+      if(sscanf(row,"%" SCNu64 ",%lf,%lf,%lf,%lf,%lf",&row_minute,&open,
+                &high,&low,&row_close,&volume)!=6)
+        continue;
+      if(row_minute>minute)
+        break;
+      close=row_close;
+      if(row_minute==minute && trades==NULL && volume>0){
+        trade.t=minute*60000;
+        trade.p=(high+low+close)/3;
+        trade.v=volume;
+        add_rebuilt_trade(&trade,buffers,fixed_buffers);
+      }
+    }
+    for(;pending!=NULL && *pending!='\0';pending=next_line(pending)){
+      // Format: timestamp,p,v
+      if(sscanf(pending,"%" SCNu64 ",%lf,%lf",&trade.t,&trade.p,
+                &trade.v)!=3 || trade.t/60000<minute)
+        continue;
+      if(trade.t/60000>minute)
+        break;
+      add_rebuilt_trade(&trade,buffers,fixed_buffers);
+    }
+    if(fixed_buffers!=NULL){
+      roll_fixed_moving_average(&fixed_buffers[index]);
+      reset_fixed_candlestick(&fixed_buffers[index]);
+    }
+    else{
+      roll_moving_average(&buffers[index]);
+      reset_candlestick(&buffers[index]);
+    }
+  }
+  // The last close carries over to empty minutes
+  if(close>CANDLESTICK_IS_EMPTY){
+    if(fixed_buffers!=NULL)
+      fixed_buffers[index].candlestick.close=
+        fixed_from_double(close,tick_scales[index].price_decimals);
+    else
+      buffers[index].candlestick.close=close;
+  }
+  free(candlesticks);
+  free(trades);
+  return;
+}
+
+// Minute of the last candlestick row, 0 if none is at least from
+static uint64_t last_candlestick_minute(const char *path,uint64_t from){
+  char *tail=read_tail(path,from),*line;
+  uint64_t minute,last=0;
+  if(tail==NULL)
+    return 0;
+  for(line=tail;*line!='\0';line=next_line(line)){
+    if(sscanf(line,"%" SCNu64 ",",&minute)==1 && minute>=from)
+      last=minute;
+  }
+  free(tail);
+  return last;
+}
+
+
+int checkpoint_rebuild(const char *output_folder,uint64_t current_minute,
+                       int symbol_count,CalculatorBuffer *buffers,
+                       FixedCalculatorBuffer *fixed_buffers,
+                       uint64_t *next_minute){
+  char path[FILEPATH_BUFFER_LENGTH];
+  uint64_t from=current_minute-CHECKPOINT_MAX_AGE_MINUTES,last=0,minute;
+  // The last minute that was closed, by any symbol
+  for(int i=0;i<symbol_count;i++){
+    snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/candlesticks/%s.csv",
+             output_folder,symbols_list[i]);
+    minute=last_candlestick_minute(path,from+1);
+    if(minute>last && minute<current_minute)
+      last=minute;
+  }
+  if(last==0)
+    return 0;
+  for(int i=0;i<symbol_count;i++)
+    rebuild_symbol(output_folder,i,last,buffers,fixed_buffers);
+  *next_minute=last+1;
+  printf("Rebuilt moving averages from the files, up to minute %" PRIu64 "\n",
+         last);
+  return 1;
+}
@@ -0,0 +1,522 @@
+#include "ColumnStore.h"
+#include "Symbols.h"
+#include "SystemHandling.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Bars read from a rows file at a time
+#define COLUMN_ROWS_BATCH 64
+
+/**
+ * @brief A day's bars by minute of the day, for merging.
+ */
+typedef struct{
+  MinuteBar bars[MINUTES_PER_DAY]; //< Bar of each minute.
+  bool present[MINUTES_PER_DAY]; //< The minute has a bar.
+} DayTable;
+
+// A field of a bar as stored: the timestamp, or the bits of a double
+static uint64_t get_field(const MinuteBar *bar,size_t column){
+  uint64_t value;
+  memcpy(&value,(const char*)bar+column*sizeof(uint64_t),sizeof(uint64_t));
+  return value;
+}
+
+static void set_field(MinuteBar *bar,size_t column,uint64_t value){
+  memcpy((char*)bar+column*sizeof(uint64_t),&value,sizeof(uint64_t));
+  return;
+}
+
+// Adds the bars of the day to the table, replacing those of the same minute
+static void table_add(DayTable *table,uint64_t day,const MinuteBar *bars,
+                      size_t count){
+  for(size_t i=0;i<count;i++){
+    if(bars[i].t/MINUTES_PER_DAY!=day)
+      continue;
+    table->bars[bars[i].t%MINUTES_PER_DAY]=bars[i];
+    table->present[bars[i].t%MINUTES_PER_DAY]=true;
+  }
+  return;
+}
+
+// Moves the table's bars to its start, in minute order. Returns how many.
+static size_t table_compact(DayTable *table){
+  size_t count=0;
+  for(int i=0;i<MINUTES_PER_DAY;i++){
+    if(table->present[i])
+      table->bars[count++]=table->bars[i];
+  }
+  return count;
+}
+
+
+void column_store_path(char *path,const char *output_folder,
+                       const char *symbol,uint64_t day,const char *suffix){
+  time_t seconds=(time_t)(day*MINUTES_PER_DAY*60);
+  struct tm date;
+  gmtime_r(&seconds,&date);
+  snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/%s/%s/%04d-%02d-%02d%s",
+           output_folder,COLUMN_STORE_FOLDER,symbol,date.tm_year+1900,
+           date.tm_mon+1,date.tm_mday,suffix);
+  return;
+}
+
+// Day of a file name (YYYY-MM-DD then suffix). Returns -1 for other names.
+static int parse_day(const char *name,const char *suffix,uint64_t *day){
+  struct tm date;
+  int year,month,month_day;
+  if(strlen(name)!=10+strlen(suffix) || strcmp(name+10,suffix)!=0 ||
+     sscanf(name,"%4d-%2d-%2d",&year,&month,&month_day)!=3)
+    return -1;
+  memset(&date,0,sizeof(date));
+  date.tm_year=year-1900;
+  date.tm_mon=month-1;
+  date.tm_mday=month_day;
+  *day=(uint64_t)timegm(&date)/(MINUTES_PER_DAY*60);
+  return 0;
+}
+
+// Opens a partition and reads its footer. Returns the descriptor, or -1.
+static int open_partition(const char *path,ColumnFooter *footer){
+  struct stat info;
+  uint64_t data_length;
+  int fd=open(path,O_RDONLY);
+  if(fd<0){
+    printf("Error in opening: %s\n",path);
+    return -1;
+  }
+  if(fstat(fd,&info)!=0 || (uint64_t)info.st_size<sizeof(ColumnFooter) ||
+     pread(fd,footer,sizeof(ColumnFooter),
+           info.st_size-sizeof(ColumnFooter))!=sizeof(ColumnFooter) ||
+     footer->magic!=COLUMN_MAGIC || footer->version!=COLUMN_VERSION){
+    printf("Invalid partition: %s\n",path);
+    close(fd);
+    return -1;
+  }
+  data_length=info.st_size-sizeof(ColumnFooter);
+  for(size_t c=0;c<COLUMN_COUNT;c++){
+    if(footer->row_count>data_length/sizeof(uint64_t) ||
+       footer->column_offsets[c]>
+       data_length-footer->row_count*sizeof(uint64_t)){
+      printf("Invalid partition: %s\n",path);
+      close(fd);
+      return -1;
+    }
+  }
+  return fd;
+}
+
+// Reads the whole columns of a partition (checking its checksum) into bars
+static int read_partition(int fd,const ColumnFooter *footer,MinuteBar *bars){
+  size_t length=footer->row_count*sizeof(uint64_t);
+  uint64_t hash=FNV1A_64_SEED;
+  uint64_t *column=(uint64_t*)malloc(length>0?length:1);
+  if(column==NULL)
+    return -1;
+  for(size_t c=0;c<COLUMN_COUNT;c++){
+    if(pread(fd,column,length,footer->column_offsets[c])!=(ssize_t)length){
+      free(column);
+      return -1;
+    }
+    hash=fnv1a_64(hash,column,length);
+    for(size_t i=0;i<footer->row_count;i++)
+      set_field(&bars[i],c,column[i]);
+  }
+  free(column);
+  return fnv1a_64(hash,footer,offsetof(ColumnFooter,checksum))==
+         footer->checksum?0:-1;
+}
+
+// Adds the bars of a day's partition and rows file (if any) to the table
+static int load_day(const char *output_folder,const char *symbol,
+                    uint64_t day,DayTable *table){
+  char path[FILEPATH_BUFFER_LENGTH];
+  MinuteBar batch[COLUMN_ROWS_BATCH],*bars;
+  ColumnFooter footer;
+  size_t count;
+  FILE *file;
+  int fd,result;
+  column_store_path(path,output_folder,symbol,day,COLUMN_PARTITION_SUFFIX);
+  if(access(path,F_OK)==0){
+    if((fd=open_partition(path,&footer))<0)
+      return -1;
+    bars=(MinuteBar*)malloc((footer.row_count>0?footer.row_count:1)*
+                            sizeof(MinuteBar));
+    result=bars!=NULL?read_partition(fd,&footer,bars):-1;
+    close(fd);
+    if(result!=0){
+      printf("Corrupt partition: %s\n",path);
+      free(bars);
+      return -1;
+    }
+    table_add(table,day,bars,footer.row_count);
+    free(bars);
+  }
+  // Rows added later replace the partition's (a torn last bar is left out)
+  column_store_path(path,output_folder,symbol,day,COLUMN_ROWS_SUFFIX);
+  if(access(path,F_OK)==0){
+    file=fopen(path,"rb");
+    if(file==NULL){
+      printf("Error in opening: %s\n",path);
+      return -1;
+    }
+    while((count=fread(batch,sizeof(MinuteBar),COLUMN_ROWS_BATCH,file))>0)
+      table_add(table,day,batch,count);
+    fclose(file);
+  }
+  return 0;
+}
+
+// Writes bars as a partition, replacing the previous one at once
+static int write_partition(const char *path,const MinuteBar *bars,
+                           size_t count){
+  char temporary_path[FILENAME_MAX];
+  ColumnFooter footer;
+  uint64_t hash=FNV1A_64_SEED,value;
+  FILE *file;
+  int result=0;
+  memset(&footer,0,sizeof(footer));
+  footer.magic=COLUMN_MAGIC;
+  footer.version=COLUMN_VERSION;
+  footer.row_count=count;
+  footer.first_minute=count>0?bars[0].t:0;
+  footer.last_minute=count>0?bars[count-1].t:0;
+  snprintf(temporary_path,FILENAME_MAX,"%s.tmp",path);
+  file=fopen(temporary_path,"wb");
+  if(file==NULL){
+    printf("Error in opening file: %s\n",temporary_path);
+    return -1;
+  }
+  // Each column, then the footer
+  for(size_t c=0;c<COLUMN_COUNT && result==0;c++){
+    footer.column_offsets[c]=c*count*sizeof(uint64_t);
+    for(size_t i=0;i<count;i++){
+      value=get_field(&bars[i],c);
+      hash=fnv1a_64(hash,&value,sizeof(value));
+      if(fwrite(&value,sizeof(value),1,file)!=1){
+        result=-1;
+        break;
+      }
+    }
+  }
+  footer.checksum=fnv1a_64(hash,&footer,offsetof(ColumnFooter,checksum));
+  if(result!=0 || fwrite(&footer,sizeof(footer),1,file)!=1 ||
+     fflush(file)!=0 || fsync(fileno(file))!=0)
+    result=-1;
+  if(fclose(file)!=0)
+    result=-1;
+  if(result==0 && rename(temporary_path,path)!=0)
+    result=-1;
+  if(result!=0){
+    printf("Error in writing partition: %s\n",path);
+    unlink(temporary_path);
+  }
+  return result;
+}
+
+
+int column_store_merge(const char *output_folder,const char *symbol,
+                       uint64_t day,const MinuteBar *bars,size_t count){
+  char path[FILEPATH_BUFFER_LENGTH];
+  DayTable *table=(DayTable*)calloc(1,sizeof(DayTable));
+  size_t day_count;
+  if(table==NULL)
+    return -1;
+  if(load_day(output_folder,symbol,day,table)!=0){
+    free(table);
+    return -1;
+  }
+  table_add(table,day,bars,count);
+  day_count=table_compact(table);
+  column_store_path(path,output_folder,symbol,day,COLUMN_PARTITION_SUFFIX);
+  if(day_count>0 && write_partition(path,table->bars,day_count)!=0){
+    free(table);
+    return -1;
+  }
+  free(table);
+  column_store_path(path,output_folder,symbol,day,COLUMN_ROWS_SUFFIX);
+  unlink(path);
+  return 0;
+}
+
+
+int column_store_open(ColumnStore *store,const char *output_folder,
+                      int symbol_count){
+  char path[FILEPATH_BUFFER_LENGTH];
+  memset(store,0,sizeof(ColumnStore));
+  store->output_folder=output_folder;
+  store->symbol_count=symbol_count;
+  store->day=UINT64_MAX;
+  store->rows_files=(FILE**)calloc(symbol_count,sizeof(FILE*));
+  if(store->rows_files==NULL){
+    printf("Error in column store allocation\n");
+    return -1;
+  }
+  snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/%s",output_folder,
+           COLUMN_STORE_FOLDER);
+  if(ensure_directory_exists(path)!=0){
+    printf("Error in creating directory: %s\n",path);
+    return -1;
+  }
+  for(int i=0;i<symbol_count;i++){
+    snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/%s/%s",output_folder,
+             COLUMN_STORE_FOLDER,symbols_list[i]);
+    if(ensure_directory_exists(path)!=0){
+      printf("Error in creating directory: %s\n",path);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Seals the rows files of all symbols' days before day
+static int seal_days_before(ColumnStore *store,uint64_t day){
+  char folder[FILEPATH_BUFFER_LENGTH];
+  struct dirent *entry;
+  DIR *directory;
+  uint64_t file_day;
+  int errors=0;
+  for(int i=0;i<store->symbol_count;i++){
+    snprintf(folder,FILEPATH_BUFFER_LENGTH,"%s/%s/%s",store->output_folder,
+             COLUMN_STORE_FOLDER,symbols_list[i]);
+    directory=opendir(folder);
+    if(directory==NULL)
+      continue;
+    while((entry=readdir(directory))!=NULL){
+      if(parse_day(entry->d_name,COLUMN_ROWS_SUFFIX,&file_day)==0 &&
+         file_day<day &&
+         column_store_merge(store->output_folder,symbols_list[i],file_day,
+                            NULL,0)!=0)
+        errors++;
+    }
+    closedir(directory);
+  }
+  return errors>0?-1:0;
+}
+
+// Opens a rows file for appending, cutting a bar a crash left torn
+static FILE *open_rows(const char *path){
+  struct stat info;
+  FILE *file;
+  if(stat(path,&info)==0 && info.st_size%sizeof(MinuteBar)!=0 &&
+     truncate(path,info.st_size-info.st_size%sizeof(MinuteBar))!=0){
+    printf("Error in truncating: %s\n",path);
+    return NULL;
+  }
+  file=fopen(path,"ab");
+  if(file==NULL)
+    printf("Error in opening file: %s\n",path);
+  return file;
+}
+
+
+int column_store_append(ColumnStore *store,const MinuteBar *bars){
+  char path[FILEPATH_BUFFER_LENGTH];
+  uint64_t day=bars[0].t/MINUTES_PER_DAY;
+  int errors=0;
+  // A new day: the earlier ones are over
+  if(day!=store->day){
+    for(int i=0;i<store->symbol_count;i++){
+      if(store->rows_files[i]!=NULL)
+        fclose(store->rows_files[i]);
+      store->rows_files[i]=NULL;
+    }
+    if(seal_days_before(store,day)!=0)
+      errors++;
+    store->day=day;
+  }
+  for(int i=0;i<store->symbol_count;i++){
+    // No candlestick before the symbol's first trade
+    if(bars[i].open<=CANDLESTICK_IS_EMPTY)
+      continue;
+    if(store->rows_files[i]==NULL){
+      column_store_path(path,store->output_folder,symbols_list[i],day,
+                        COLUMN_ROWS_SUFFIX);
+      if((store->rows_files[i]=open_rows(path))==NULL){
+        errors++;
+        continue;
+      }
+    }
+    // Whole minutes reach the file, for readers
+    if(fwrite(&bars[i],sizeof(MinuteBar),1,store->rows_files[i])!=1 ||
+       fflush(store->rows_files[i])!=0)
+      errors++;
+  }
+  return errors>0?-1:0;
+}
+
+
+void column_store_close(ColumnStore *store){
+  for(int i=0;store->rows_files!=NULL && i<store->symbol_count;i++){
+    if(store->rows_files[i]!=NULL)
+      fclose(store->rows_files[i]);
+  }
+  free(store->rows_files);
+  store->rows_files=NULL;
+  return;
+}
+
+
+// First row of a partition whose timestamp isn't below minute
+static int search_minute(int fd,const ColumnFooter *footer,uint64_t minute,
+                         uint64_t *row){
+  uint64_t low=0,high=footer->row_count,middle,t;
+  uint64_t offset=footer->column_offsets[COLUMN_TIMESTAMP];
+  while(low<high){
+    middle=low+(high-low)/2;
+    if(pread(fd,&t,sizeof(t),offset+middle*sizeof(t))!=sizeof(t))
+      return -1;
+    if(t<minute)
+      low=middle+1;
+    else
+      high=middle;
+  }
+  *row=low;
+  return 0;
+}
+
+// Appends the bars of [from,to] of a partition
+static int read_partition_range(const char *path,uint64_t from,uint64_t to,
+                                MinuteBar **bars,size_t *count){
+  ColumnFooter footer;
+  uint64_t lower,upper,*column=NULL;
+  MinuteBar *grown;
+  size_t rows;
+  int fd=open_partition(path,&footer),result=0;
+  if(fd<0)
+    return -1;
+  upper=footer.row_count;
+  if(search_minute(fd,&footer,from,&lower)!=0 ||
+     (to<UINT64_MAX && search_minute(fd,&footer,to+1,&upper)!=0)){
+    close(fd);
+    return -1;
+  }
+  rows=upper>lower?upper-lower:0;
+  if(rows==0){
+    close(fd);
+    return 0;
+  }
+  grown=(MinuteBar*)realloc(*bars,(*count+rows)*sizeof(MinuteBar));
+  column=(uint64_t*)malloc(rows*sizeof(uint64_t));
+  if(grown!=NULL)
+    *bars=grown;
+  if(grown==NULL || column==NULL){
+    free(column);
+    close(fd);
+    return -1;
+  }
+  // One sequential read per column
+  for(size_t c=0;c<COLUMN_COUNT && result==0;c++){
+    if(pread(fd,column,rows*sizeof(uint64_t),
+             footer.column_offsets[c]+lower*sizeof(uint64_t))!=
+       (ssize_t)(rows*sizeof(uint64_t))){
+      result=-1;
+      break;
+    }
+    for(size_t i=0;i<rows;i++)
+      set_field(&(*bars)[*count+i],c,column[i]);
+  }
+  if(result==0)
+    *count+=rows;
+  free(column);
+  close(fd);
+  return result;
+}
+
+// Appends the bars of [from,to] of a day
+static int read_day(const char *output_folder,const char *symbol,
+                    uint64_t day,uint64_t from,uint64_t to,
+                    MinuteBar **bars,size_t *count){
+  char path[FILEPATH_BUFFER_LENGTH];
+  DayTable *table;
+  MinuteBar *grown;
+  size_t day_count;
+  column_store_path(path,output_folder,symbol,day,COLUMN_ROWS_SUFFIX);
+  // A sealed day alone is read by ranges of its columns
+  if(access(path,F_OK)!=0){
+    column_store_path(path,output_folder,symbol,day,COLUMN_PARTITION_SUFFIX);
+    return read_partition_range(path,from,to,bars,count);
+  }
+  table=(DayTable*)calloc(1,sizeof(DayTable));
+  if(table==NULL || load_day(output_folder,symbol,day,table)!=0){
+    free(table);
+    return -1;
+  }
+  day_count=table_compact(table);
+  grown=(MinuteBar*)realloc(*bars,(*count+day_count+1)*sizeof(MinuteBar));
+  if(grown==NULL){
+    free(table);
+    return -1;
+  }
+  *bars=grown;
+  for(size_t i=0;i<day_count;i++){
+    if(table->bars[i].t>=from && table->bars[i].t<=to)
+      (*bars)[(*count)++]=table->bars[i];
+  }
+  free(table);
+  return 0;
+}
+
+static int compare_days(const void *a,const void *b){
+  uint64_t x=*(const uint64_t*)a,y=*(const uint64_t*)b;
+  return (x>y)-(x<y);
+}
+
+
+int column_store_read(const char *output_folder,const char *symbol,
+                      uint64_t from_minute,uint64_t to_minute,
+                      MinuteBar **bars,size_t *count){
+  char folder[FILEPATH_BUFFER_LENGTH];
+  uint64_t *days=NULL,*grown,day;
+  size_t day_count=0,capacity=0;
+  struct dirent *entry;
+  DIR *directory;
+  int result=0;
+  *bars=NULL;
+  *count=0;
+  // Days of the range that have a file
+  snprintf(folder,FILEPATH_BUFFER_LENGTH,"%s/%s/%s",output_folder,
+           COLUMN_STORE_FOLDER,symbol);
+  directory=opendir(folder);
+  if(directory==NULL)
+    return 0;
+  while((entry=readdir(directory))!=NULL){
+    if((parse_day(entry->d_name,COLUMN_PARTITION_SUFFIX,&day)!=0 &&
+        parse_day(entry->d_name,COLUMN_ROWS_SUFFIX,&day)!=0) ||
+       day<from_minute/MINUTES_PER_DAY || day>to_minute/MINUTES_PER_DAY)
+      continue;
+    if(day_count==capacity){
+      capacity=capacity>0?2*capacity:16;
+      grown=(uint64_t*)realloc(days,capacity*sizeof(uint64_t));
+      if(grown==NULL){
+        result=-1;
+        break;
+      }
+      days=grown;
+    }
+    days[day_count++]=day;
+  }
+  closedir(directory);
+  if(result==0)
+    qsort(days,day_count,sizeof(uint64_t),compare_days);
+  for(size_t i=0;result==0 && i<day_count;i++){
+    // A day with both files is listed twice
+    if(i>0 && days[i]==days[i-1])
+      continue;
+    result=read_day(output_folder,symbol,days[i],from_minute,to_minute,bars,
+                    count);
+  }
+  free(days);
+  if(result!=0){
+    free(*bars);
+    *bars=NULL;
+    *count=0;
+  }
+  return result;
+}
@@ -0,0 +1,261 @@
+#include "Config.h"
+#include "ColumnStore.h"
+#include "RecentHistory.h"
+#include "Publisher.h"
+#include "SharedState.h"
+#include "Inflater.h"
+#include "Journal.h"
+#include "Symbols.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int parse_arguments(int argc,char **argv,const char *default_api_key,
+                    ProgramConfig *config){
+  int option,symbol_count;
+  char *conversion_ptr;
+  // Defaults
+  memset(config,0,sizeof(ProgramConfig));
+  snprintf(config->api_key,API_KEY_MAX_LENGTH,"%s",default_api_key);
+  config->endpoint.host=FINNHUB_HOST;
+  config->endpoint.port=FINNHUB_PORT;
+  config->endpoint.use_ssl=true;
+  config->endpoint.allow_self_signed=false;
+  config->endpoint.deflate=false;
+  config->connections=1;
+  config->parsers=1;
+  config->replay_folder=NULL;
+  config->replay_speed=1;
+  config->generator_enabled=false;
+  generator_default_config(&config->generator);
+  config->synthetic_symbols=0;
+  config->overflow_policy=OVERFLOW_BLOCK;
+  config->queue_capacity=QUEUE_DEFAULT_CAPACITY;
+  config->huge_pages=false;
+  config->fixed_point=false;
+  config->journal_sync_ms=-1;
+  config->column_store=false;
+  config->history_minutes=0;
+  config->shared_state=false;
+  config->publisher=false;
+
+  while((option=getopt(argc,argv,"H:p:nkzc:P:r:x:g:G:d:y:o:Q:uFj:SR:mfh"))!=-1){
+    switch(option){
+    case 'H':
+      config->endpoint.host=optarg;
+      break;
+    case 'p':
+      config->endpoint.port=(int)strtol(optarg,&conversion_ptr,10);
+      if(*conversion_ptr!='\0' || config->endpoint.port<=0 ||
+         config->endpoint.port>65535){
+        printf("Invalid port: %s\n",optarg);
+        return -1;
+      }
+      break;
+    case 'n':
+      config->endpoint.use_ssl=false;
+      break;
+    case 'k':
+      config->endpoint.allow_self_signed=true;
+      break;
+    case 'z':
+      if(!inflater_supported()){
+        printf("Built without permessage-deflate support\n");
+        return -1;
+      }
+      config->endpoint.deflate=true;
+      break;
+    case 'c':
+      config->connections=(int)strtol(optarg,&conversion_ptr,10);
+      if(*conversion_ptr!='\0' || config->connections<1 ||
+         config->connections>WSS_MAX_CONNECTIONS){
+        printf("Invalid number of connections: %s\n",optarg);
+        return -1;
+      }
+      break;
+    case 'P':
+      config->parsers=(int)strtol(optarg,&conversion_ptr,10);
+      if(*conversion_ptr!='\0' || config->parsers<1 ||
+         config->parsers>WSS_MAX_PARSERS){
+        printf("Invalid number of parsers: %s\n",optarg);
+        return -1;
+      }
+      break;
+    case 'r':
+      config->replay_folder=optarg;
+      break;
+    case 'x':
+      config->replay_speed=strtod(optarg,&conversion_ptr);
+      if(*conversion_ptr!='\0' || config->replay_speed<0){
+        printf("Invalid replay speed: %s\n",optarg);
+        return -1;
+      }
+      break;
+    case 'g':
+      config->generator_enabled=true;
+      config->generator.rate=strtod(optarg,&conversion_ptr);
+      if(*conversion_ptr!='\0' || config->generator.rate<=0){
+        printf("Invalid generator rate: %s\n",optarg);
+        return -1;
+      }
+      break;
+    case 'G':
+      if(strcmp(optarg,"poisson")==0){
+        config->generator.process=ARRIVALS_POISSON;
+      }
+      else if(strcmp(optarg,"hawkes")==0){
+        config->generator.process=ARRIVALS_HAWKES;
+      }
+      else{
+        printf("Unknown arrival process: %s\n",optarg);
+        return -1;
+      }
+      break;
+    case 'd':
+      config->generator.duration=strtod(optarg,&conversion_ptr);
+      if(*conversion_ptr!='\0' || config->generator.duration<0){
+        printf("Invalid duration: %s\n",optarg);
+        return -1;
+      }
+      break;
+    case 'y':
+      config->synthetic_symbols=(int)strtol(optarg,&conversion_ptr,10);
+      if(*conversion_ptr!='\0' || config->synthetic_symbols<=0 ||
+         config->synthetic_symbols>WORK_ITEM_MAX_SYMBOLS){
+        printf("Invalid number of symbols: %s\n",optarg);
+        return -1;
+      }
+      break;
+    case 'o':
+      if(strcmp(optarg,"block")==0){
+        config->overflow_policy=OVERFLOW_BLOCK;
+      }
+      else if(strcmp(optarg,"drop-oldest")==0){
+        config->overflow_policy=OVERFLOW_DROP_OLDEST;
+      }
+      else if(strcmp(optarg,"drop-newest")==0){
+        config->overflow_policy=OVERFLOW_DROP_NEWEST;
+      }
+      else if(strcmp(optarg,"spill")==0){
+        config->overflow_policy=OVERFLOW_SPILL;
+      }
+      else{
+        printf("Unknown overflow policy: %s\n",optarg);
+        return -1;
+      }
+      break;
+    case 'Q':
+      config->queue_capacity=(int)strtol(optarg,&conversion_ptr,10);
+      if(*conversion_ptr!='\0' || config->queue_capacity<2 ||
+         config->queue_capacity>QUEUE_MAX_CAPACITY ||
+         (config->queue_capacity&(config->queue_capacity-1))!=0){
+        printf("Invalid queue capacity (a power of 2 up to %d): %s\n",
+               QUEUE_MAX_CAPACITY,optarg);
+        return -1;
+      }
+      break;
+    case 'u':
+      config->huge_pages=true;
+      break;
+    case 'F':
+      config->fixed_point=true;
+      break;
+    case 'j':
+      config->journal_sync_ms=(int)strtol(optarg,&conversion_ptr,10);
+      if(*conversion_ptr!='\0' || config->journal_sync_ms<0){
+        printf("Invalid journal sync interval: %s\n",optarg);
+        return -1;
+      }
+      break;
+    case 'S':
+      config->column_store=true;
+      break;
+    case 'R':
+      config->history_minutes=(int)strtol(optarg,&conversion_ptr,10);
+      if(*conversion_ptr!='\0' || config->history_minutes<=0){
+        printf("Invalid history length: %s\n",optarg);
+        return -1;
+      }
+      break;
+    case 'm':
+      config->shared_state=true;
+      break;
+    case 'f':
+      config->publisher=true;
+      break;
+    case 'h':
+    default:
+      return -1;
+    }
+  }
+  // The only positional argument is the api key
+  if(config->replay_folder!=NULL && config->generator_enabled){
+    printf("Replay and generator sources are exclusive\n");
+    return -1;
+  }
+  // Each connection's shard needs at least one symbol
+  symbol_count=config->synthetic_symbols>0?config->synthetic_symbols:
+                                            count_symbols(symbols_list);
+  if(config->connections>symbol_count){
+    printf("More connections than symbols: %d\n",symbol_count);
+    return -1;
+  }
+  if(optind<argc){
+    if(strlen(argv[optind])>=API_KEY_MAX_LENGTH){
+      printf("API key is too long\n");
+      return -1;
+    }
+    strcpy(config->api_key,argv[optind]);
+  }
+  return 0;
+}
+
+void print_usage(const char *program_name){
+  printf("Usage: %s [-H host] [-p port] [-n] [-k] [-z] [-c connections] "
+         "[-P parsers] [-r replay_folder] "
+         "[-g rate [-G poisson|hawkes] [-d duration]] [-x speed] "
+         "[-y symbols] [-o policy] [-Q capacity] [-u] [-F] [-j ms] [-S] "
+         "[-R minutes] [-m] [-f] [api_key]\n",
+         program_name);
+  printf("  -H host    Server to connect to (default %s)\n",FINNHUB_HOST);
+  printf("  -p port    Port of the server (default %d)\n",FINNHUB_PORT);
+  printf("  -n         Connect over plain WS instead of WSS\n");
+  printf("  -k         Accept self signed certificates (local mock server)\n");
+  printf("  -z         Offer permessage-deflate, inflating in the parsers\n");
+  printf("  -c count   Parallel connections, each subscribing to a share of "
+         "the symbols (default 1, max %d)\n",WSS_MAX_CONNECTIONS);
+  printf("  -P count   Parser threads of each connection (default 1, max %d)"
+         "\n",WSS_MAX_PARSERS);
+  printf("  -r folder  Replay the trade logs of folder instead of "
+         "connecting\n");
+  printf("  -g rate    Feed synthetic trades at a base rate (trades/s)\n");
+  printf("  -G process Arrivals of synthetic trades: poisson or hawkes\n");
+  printf("  -d secs    Event time length of synthetic trades (default "
+         "endless)\n");
+  printf("  -x speed   Offline source speed multiplier, 0 for max "
+         "(default 1)\n");
+  printf("  -y count   Track count synthetic symbols instead of the default\n");
+  printf("  -o policy  When the api queue is full: block (default), "
+         "drop-oldest,\n             drop-newest or spill (to %s)\n",
+         SPILL_FILE_PATH);
+  printf("  -Q count   Capacity of each queue, a power of 2 (default %d)\n",
+         QUEUE_DEFAULT_CAPACITY);
+  printf("  -u         Back the queues with huge pages when available\n");
+  printf("  -F         Fixed point prices and volumes, with the tick scales "
+         "of %s\n",TICK_SCALES_PATH);
+  printf("  -j ms      Journal live trades to %s, synced every ms "
+         "milliseconds,\n             and recover it at startup\n",
+         JOURNAL_PATH);
+  printf("  -S         Also store the closed minutes in per-day columns "
+         "(./%s)\n",COLUMN_STORE_FOLDER);
+  printf("  -R minutes Keep each symbol's last minutes in memory, queried on "
+         "%s\n",RECENT_HISTORY_SOCKET_PATH);
+  printf("  -m         Publish each symbol's live candle, last trade and "
+         "moving average\n             in shared memory (%s)\n",
+         SHARED_STATE_NAME);
+  printf("  -f         Fan out trades and closed minutes to subscribers of "
+         "%s\n",PUBLISHER_SOCKET_PATH);
+  return;
+}
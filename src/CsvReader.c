@@ -0,0 +1,266 @@
+#include "CsvReader.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Powers of 10 that are exact doubles
+static const double exact_powers_of_10[]={
+  1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,1e12,1e13,1e14,1e15,
+  1e16,1e17,1e18,1e19,1e20,1e21,1e22
+};
+#define EXACT_POWERS_COUNT 23
+// Largest mantissa that's an exact double
+#define EXACT_MANTISSA_MAX (1ULL<<53)
+
+static inline bool is_digit(char c){
+  return c>='0' && c<='9';
+}
+
+// Start of the page of a file offset
+static uint64_t page_start(uint64_t offset){
+  uint64_t page=(uint64_t)sysconf(_SC_PAGESIZE);
+  return offset-offset%page;
+}
+
+// Maps the window of the file that holds offset. Returns -1 on failure.
+static int map_window(CsvReader *reader,uint64_t offset){
+  uint64_t start=page_start(offset);
+  uint64_t length=reader->size-start;
+  void *window;
+  if(length>CSV_WINDOW_LENGTH)
+    length=CSV_WINDOW_LENGTH;
+  if(reader->window!=NULL)
+    munmap((void*)reader->window,reader->window_length);
+  reader->window=NULL;
+  window=mmap(NULL,length,PROT_READ,MAP_PRIVATE,reader->fd,(off_t)start);
+  if(window==MAP_FAILED){
+    printf("Error in mapping csv file\n");
+    return -1;
+  }
+  madvise(window,length,MADV_SEQUENTIAL);
+  reader->window=(const char*)window;
+  reader->window_offset=start;
+  reader->window_length=length;
+  return 0;
+}
+
+// Parses a field with strtoull/strtod. Returns the end of the field.
+static const char *parse_fallback(const char *p,const char *end,
+                                  CsvColumnType type,CsvValue *value){
+  char buffer[CSV_FIELD_LENGTH];
+  char *field=buffer,*field_end;
+  const char *comma=(const char*)memchr(p,',',end-p);
+  // The field and what follows it up to the next comma (strto* stop there)
+  size_t length=(comma!=NULL?comma:end)-p;
+  if(length>=CSV_FIELD_LENGTH){
+    field=(char*)malloc(length+1);
+    if(field==NULL){
+      value->integer=0;
+      return p;
+    }
+  }
+  memcpy(field,p,length);
+  field[length]='\0';
+  if(type==CSV_INTEGER)
+    value->integer=strtoull(field,&field_end,10);
+  else
+    value->real=strtod(field,&field_end);
+  p+=field_end-field;
+  if(field!=buffer)
+    free(field);
+  return p;
+}
+
+static const char *parse_integer(const char *p,const char *end,
+                                 CsvValue *value){
+  const char *start=p;
+  uint64_t result=0;
+  // 19 digits can't overflow
+  while(p<end && p-start<19 && is_digit(*p)){
+    result=result*10+(*p-'0');
+    p++;
+  }
+  if(p==start || (p<end && is_digit(*p)))
+    return parse_fallback(start,end,CSV_INTEGER,value);
+  value->integer=result;
+  return p;
+}
+
+// [-]digits[.digits] with a mantissa below 2^53 is a single division of
+// exact doubles, so it's rounded once, as strtod rounds. Anything else
+// (exponents, long mantissas, inf, nan) goes to strtod.
+static const char *parse_real(const char *p,const char *end,CsvValue *value){
+  const char *start=p;
+  uint64_t mantissa=0;
+  int digits=0,fraction_digits=0;
+  bool negative=false,any_digit=false;
+  double result;
+  if(p<end && *p=='-'){
+    negative=true;
+    p++;
+  }
+  for(;p<end && is_digit(*p);p++){
+    any_digit=true;
+    if(mantissa>0 || *p!='0')
+      digits++;
+    mantissa=mantissa*10+(*p-'0');
+  }
+  if(p<end && *p=='.'){
+    for(p++;p<end && is_digit(*p);p++){
+      any_digit=true;
+      if(mantissa>0 || *p!='0')
+        digits++;
+      mantissa=mantissa*10+(*p-'0');
+      fraction_digits++;
+    }
+  }
+  if(!any_digit || digits>19 || mantissa>EXACT_MANTISSA_MAX ||
+     fraction_digits>=EXACT_POWERS_COUNT ||
+     (p<end && (*p=='e' || *p=='E' || *p=='x' || *p=='X')))
+    return parse_fallback(start,end,CSV_REAL,value);
+  result=(double)mantissa/exact_powers_of_10[fraction_digits];
+  value->real=negative?-result:result;
+  return p;
+}
+
+// Parses the line [p,end) into values. Returns -1 if it isn't a row.
+static int parse_row(const CsvReader *reader,const char *p,const char *end,
+                     CsvValue *values){
+  if(p==end || (!is_digit(*p) && *p!='-'))
+    return -1;
+  for(int i=0;i<reader->column_count;i++){
+    if(i>0){
+      if(p==end || *p!=',')
+        return -1;
+      p++;
+    }
+    if(reader->types[i]==CSV_INTEGER)
+      p=parse_integer(p,end,&values[i]);
+    else
+      p=parse_real(p,end,&values[i]);
+  }
+  return 0;
+}
+
+
+int csv_open(CsvReader *reader,const char *path,int column_count,
+             const CsvColumnType *types){
+  struct stat info;
+  memset(reader,0,sizeof(CsvReader));
+  reader->fd=-1;
+  if(column_count<1 || column_count>CSV_MAX_COLUMNS){
+    printf("Error in csv columns: %d\n",column_count);
+    return -1;
+  }
+  reader->fd=open(path,O_RDONLY);
+  if(reader->fd<0 || fstat(reader->fd,&info)!=0){
+    printf("Error in opening: %s\n",path);
+    csv_close(reader);
+    return -1;
+  }
+  reader->size=(uint64_t)info.st_size;
+  reader->column_count=column_count;
+  memcpy(reader->types,types,column_count*sizeof(CsvColumnType));
+  return 0;
+}
+
+
+int csv_next(CsvReader *reader,CsvValue *values){
+  const char *line,*line_end,*window_end;
+  while(reader->position<reader->size){
+    if(reader->window==NULL ||
+       reader->position>=reader->window_offset+reader->window_length){
+      if(map_window(reader,reader->position)!=0)
+        return -1;
+    }
+    line=reader->window+(reader->position-reader->window_offset);
+    window_end=reader->window+reader->window_length;
+    line_end=(const char*)memchr(line,'\n',window_end-line);
+    if(line_end==NULL){
+      // The line goes on past the window: map the window that starts
+      // with it (unless it's already this one, or this is the last line)
+      if(reader->window_offset+reader->window_length<reader->size &&
+         reader->window_offset<page_start(reader->position)){
+        if(map_window(reader,reader->position)!=0)
+          return -1;
+        continue;
+      }
+      line_end=window_end;
+    }
+    reader->position+=line_end-line+1;
+    if(parse_row(reader,line,line_end,values)==0)
+      return 0;
+    reader->skipped++;
+  }
+  return -1;
+}
+
+
+int csv_columns_init(CsvColumns *columns,const CsvReader *reader,
+                     size_t capacity){
+  memset(columns,0,sizeof(CsvColumns));
+  columns->capacity=capacity;
+  for(int i=0;i<reader->column_count;i++){
+    if(reader->types[i]==CSV_INTEGER){
+      columns->integers[i]=(uint64_t*)malloc(capacity*sizeof(uint64_t));
+      if(columns->integers[i]==NULL)
+        break;
+    }
+    else{
+      columns->reals[i]=(double*)malloc(capacity*sizeof(double));
+      if(columns->reals[i]==NULL)
+        break;
+    }
+    if(i==reader->column_count-1)
+      return 0;
+  }
+  printf("Error in csv columns allocation\n");
+  csv_columns_free(columns);
+  return -1;
+}
+
+
+size_t csv_read_columns(CsvReader *reader,CsvColumns *columns){
+  CsvValue values[CSV_MAX_COLUMNS];
+  size_t rows=0;
+  while(rows<columns->capacity && csv_next(reader,values)==0){
+    for(int i=0;i<reader->column_count;i++){
+      if(reader->types[i]==CSV_INTEGER)
+        columns->integers[i][rows]=values[i].integer;
+      else
+        columns->reals[i][rows]=values[i].real;
+    }
+    rows++;
+  }
+  columns->rows=rows;
+  return rows;
+}
+
+
+void csv_columns_free(CsvColumns *columns){
+  for(int i=0;i<CSV_MAX_COLUMNS;i++){
+    free(columns->integers[i]);
+    free(columns->reals[i]);
+    columns->integers[i]=NULL;
+    columns->reals[i]=NULL;
+  }
+  columns->rows=0;
+  columns->capacity=0;
+  return;
+}
+
+
+void csv_close(CsvReader *reader){
+  if(reader->window!=NULL)
+    munmap((void*)reader->window,reader->window_length);
+  if(reader->fd>=0)
+    close(reader->fd);
+  reader->window=NULL;
+  reader->fd=-1;
+  return;
+}
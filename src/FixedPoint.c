@@ -0,0 +1,367 @@
+#include "FixedPoint.h"
+#include "Symbols.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Marks an empty candlestick (no price is that low)
+#define FIXED_CANDLESTICK_IS_EMPTY INT64_MIN
+
+const TickScale *tick_scales=NULL;
+
+static const int64_t powers_of_10[FIXED_MAX_DECIMALS+1]={
+  1LL,10LL,100LL,1000LL,10000LL,100000LL,1000000LL,10000000LL,100000000LL,
+  1000000000LL,10000000000LL,100000000000LL,1000000000000LL
+};
+
+
+// 128 bit arithmetic, on 64 bit halves
+
+static FixedWide wide_negate(FixedWide x){
+  x.low=~x.low+1;
+  x.high=~x.high+(x.low==0);
+  return x;
+}
+
+static FixedWide wide_product(int64_t a,int64_t b){
+  FixedWide product;
+  uint64_t x=a<0?-(uint64_t)a:(uint64_t)a;
+  uint64_t y=b<0?-(uint64_t)b:(uint64_t)b;
+  uint64_t x0=x&0xFFFFFFFF,x1=x>>32,y0=y&0xFFFFFFFF,y1=y>>32;
+  uint64_t p00=x0*y0,p01=x0*y1,p10=x1*y0,p11=x1*y1;
+  uint64_t middle=(p00>>32)+(p01&0xFFFFFFFF)+(p10&0xFFFFFFFF);
+  product.low=(middle<<32)|(p00&0xFFFFFFFF);
+  product.high=p11+(p01>>32)+(p10>>32)+(middle>>32);
+  if((a<0)!=(b<0))
+    product=wide_negate(product);
+  return product;
+}
+
+static void wide_add(FixedWide *sum,FixedWide x){
+  sum->low+=x.low;
+  sum->high+=x.high+(sum->low<x.low);
+  return;
+}
+
+static void wide_subtract(FixedWide *sum,FixedWide x){
+  wide_add(sum,wide_negate(x));
+  return;
+}
+
+// n/d rounded half away from zero (d>0, the quotient must fit 64 bits)
+static int64_t wide_divide(FixedWide n,int64_t d){
+  bool negative=(int64_t)n.high<0;
+  uint64_t quotient=0,remainder=0,bit;
+  if(negative)
+    n=wide_negate(n);
+  // Long division, one bit at a time: remainder<d<2^63 never overflows
+  for(int i=127;i>=0;i--){
+    bit=i>=64?(n.high>>(i-64))&1:(n.low>>i)&1;
+    remainder=(remainder<<1)|bit;
+    if(remainder>=(uint64_t)d){
+      remainder-=d;
+      if(i<64)
+        quotient|=1ULL<<i;
+    }
+  }
+  if(remainder>=(uint64_t)d-remainder)
+    quotient++;
+  return negative?-(int64_t)quotient:(int64_t)quotient;
+}
+
+
+// Parses a decimals field of the scales file
+static int parse_decimals(const char *field,char **end){
+  long decimals=strtol(field,end,10);
+  if(*end==field || decimals<0 || decimals>FIXED_MAX_DECIMALS)
+    return -1;
+  return (int)decimals;
+}
+
+int tick_scales_load(const char *path,int symbol_count){
+  TickScale *scales,fallback,scale;
+  char line[128],*comma,*end;
+  int line_number=0,symbol_index;
+  TickScale *parsed;
+  bool *explicit_scale;
+  FILE *file;
+
+  scales=(TickScale*)malloc(symbol_count*sizeof(TickScale));
+  parsed=(TickScale*)malloc(symbol_count*sizeof(TickScale));
+  explicit_scale=(bool*)calloc(symbol_count,sizeof(bool));
+  if(scales==NULL || parsed==NULL || explicit_scale==NULL){
+    printf("Error in tick scales allocation\n");
+    free(scales);
+    free(parsed);
+    free(explicit_scale);
+    return -1;
+  }
+  fallback.price_decimals=FIXED_DEFAULT_PRICE_DECIMALS;
+  fallback.volume_decimals=FIXED_DEFAULT_VOLUME_DECIMALS;
+
+  file=fopen(path,"r");
+  if(file!=NULL){
+    while(fgets(line,sizeof(line),file)!=NULL){
+      line_number++;
+      line[strcspn(line,"\r\n")]='\0';
+      if(line[0]=='\0' || line[0]=='#')
+        continue;
+      // Format: symbol,price_decimals,volume_decimals
+      comma=strchr(line,',');
+      if(comma==NULL)
+        goto invalid;
+      *comma='\0';
+      scale.price_decimals=parse_decimals(comma+1,&end);
+      if(scale.price_decimals<0 || *end!=',')
+        goto invalid;
+      scale.volume_decimals=parse_decimals(end+1,&end);
+      if(scale.volume_decimals<0 || *end!='\0')
+        goto invalid;
+      if(strcmp(line,"*")==0){
+        fallback=scale;
+        continue;
+      }
+      symbol_index=find_symbol_index(line);
+      if(symbol_index==SYMBOL_NOT_FOUND)
+        continue;
+      parsed[symbol_index]=scale;
+      explicit_scale[symbol_index]=true;
+    }
+    fclose(file);
+  }
+  // The default applies wherever it appears in the file
+  for(int i=0;i<symbol_count;i++)
+    scales[i]=explicit_scale[i]?parsed[i]:fallback;
+  free(parsed);
+  free(explicit_scale);
+  tick_scales_free();
+  tick_scales=scales;
+  return 0;
+
+invalid:
+  printf("Invalid tick scale at %s:%d\n",path,line_number);
+  fclose(file);
+  free(scales);
+  free(parsed);
+  free(explicit_scale);
+  return -1;
+}
+
+void tick_scales_free(){
+  free((TickScale*)tick_scales);
+  tick_scales=NULL;
+  return;
+}
+
+
+int64_t fixed_from_double(double value,int decimals){
+  double ticks=value*powers_of_10[decimals];
+  // llround is unspecified out of range: saturate, above the empty mark
+  if(isnan(ticks))
+    return 0;
+  if(ticks>=0x1p63)
+    return INT64_MAX;
+  if(ticks<=-0x1p63)
+    return -INT64_MAX;
+  return llround(ticks);
+}
+
+double fixed_to_double(int64_t value,int decimals){
+  return (double)value/powers_of_10[decimals];
+}
+
+int fixed_format(char *buffer,int64_t value,int decimals){
+  char digits[FIXED_FORMAT_LENGTH];
+  uint64_t magnitude=value<0?-(uint64_t)value:(uint64_t)value;
+  int digit_count=0,length=0;
+  // Least significant first, with at least one digit before the point
+  do{
+    digits[digit_count++]='0'+magnitude%10;
+    magnitude/=10;
+  }while(magnitude>0 || digit_count<=decimals);
+  if(value<0)
+    buffer[length++]='-';
+  while(digit_count>decimals)
+    buffer[length++]=digits[--digit_count];
+  if(decimals>0){
+    buffer[length++]='.';
+    while(digit_count>0)
+      buffer[length++]=digits[--digit_count];
+  }
+  buffer[length]='\0';
+  return length;
+}
+
+
+double write_fixed_trade_to_file(FixedTrade *trade,FILE **handlers,
+                                 pthread_mutex_t *file_mutexes,
+                                 uint64_t *file_lengths,uint64_t *line_offset,
+                                 uint32_t event_stamp,FILE *delay_file){
+  char price[FIXED_FORMAT_LENGTH],volume[FIXED_FORMAT_LENGTH];
+  const TickScale *scale=&tick_scales[trade->s_index];
+  double delay_us;
+  int i=trade->s_index,bytes;
+  // Format outside of the lock
+  fixed_format(price,trade->p,scale->price_decimals);
+  fixed_format(volume,trade->v,scale->volume_decimals);
+  pthread_mutex_lock(&file_mutexes[i]);
+  // Format: timestamp,p,v
+  bytes=fprintf(handlers[i],"%" PRIu64 ",%s,%s\n",trade->t,price,volume);
+  if(file_lengths!=NULL){
+    *line_offset=file_lengths[i];
+    if(bytes>0)
+      file_lengths[i]+=bytes;
+  }
+  delay_us=microseconds_since_stamp(event_stamp);
+  fprintf(delay_file,"%f\n",delay_us);
+  pthread_mutex_unlock(&file_mutexes[i]);
+  return delay_us;
+}
+
+
+void init_fixed_calculator_buffers(FixedCalculatorBuffer *buffers,
+                                   int symbol_count){
+  for(int i=0;i<symbol_count;i++){
+    memset(&buffers[i],0,sizeof(FixedCalculatorBuffer));
+    buffers[i].candlestick.open=FIXED_CANDLESTICK_IS_EMPTY;
+    buffers[i].candlestick.close=FIXED_CANDLESTICK_IS_EMPTY;
+  }
+  return;
+}
+
+void add_fixed_trade_to_buffers(FixedTrade *trade,
+                                FixedCalculatorBuffer *buffers){
+  FixedCandlestick *candlestick=&buffers[trade->s_index].candlestick;
+  if(candlestick->open>FIXED_CANDLESTICK_IS_EMPTY){
+    if(trade->p>candlestick->max)
+      candlestick->max=trade->p;
+    else if(trade->p<candlestick->min)
+      candlestick->min=trade->p;
+    candlestick->close=trade->p;
+  }
+  else{
+    candlestick->open=candlestick->close=trade->p;
+    candlestick->max=candlestick->min=trade->p;
+  }
+  candlestick->volume+=trade->v;
+  // A trade of 0 volume (forex) weighs as 1 volume unit, as with doubles
+  if(trade->v==0){
+    wide_add(&candlestick->weighted_price,
+             wide_product(trade->p,
+               powers_of_10[tick_scales[trade->s_index].volume_decimals]));
+  }
+  else{
+    wide_add(&candlestick->weighted_price,wide_product(trade->p,trade->v));
+  }
+  return;
+}
+
+void roll_fixed_moving_average(FixedCalculatorBuffer *buffer){
+  FixedCandlestick *candlestick=&buffer->candlestick;
+  FixedMovingAverageInfo *avg=&buffer->avg_info;
+  avg->total_15min_volume+=candlestick->volume-
+                           avg->minute_volumes[avg->oldest_index];
+  avg->minute_volumes[avg->oldest_index]=candlestick->volume;
+  wide_subtract(&avg->total_15min_weighted_price,
+                avg->weighted_prices[avg->oldest_index]);
+  wide_add(&avg->total_15min_weighted_price,candlestick->weighted_price);
+  avg->weighted_prices[avg->oldest_index]=candlestick->weighted_price;
+  avg->oldest_index=(avg->oldest_index+1)%15;
+  return;
+}
+
+void reset_fixed_candlestick(FixedCalculatorBuffer *buffer){
+  buffer->candlestick.open=FIXED_CANDLESTICK_IS_EMPTY;
+  buffer->candlestick.volume=0;
+  memset(&buffer->candlestick.weighted_price,0,sizeof(FixedWide));
+  return;
+}
+
+void write_fixed_minute_entries(uint64_t timestamp_minutes,
+                                uint32_t event_stamp,const TickScale *scale,
+                                FILE *candlestick_file,FILE *avg_file,
+                                FILE *delay_file,
+                                FixedCalculatorBuffer *buffer,MinuteBar *bar){
+  FixedCandlestick *candlestick=&buffer->candlestick;
+  FixedMovingAverageInfo *avg=&buffer->avg_info;
+  int64_t moving_average;
+  char average[FIXED_FORMAT_LENGTH],volume[FIXED_FORMAT_LENGTH];
+  char open[FIXED_FORMAT_LENGTH],max[FIXED_FORMAT_LENGTH];
+  char min[FIXED_FORMAT_LENGTH],close[FIXED_FORMAT_LENGTH];
+  roll_fixed_moving_average(buffer);
+  // Without volume the average is the close price, for continuity
+  if(avg->total_15min_volume==0){
+    moving_average=candlestick->close;
+  }
+  else{
+    moving_average=wide_divide(avg->total_15min_weighted_price,
+                               avg->total_15min_volume);
+  }
+  // Format: timestamp_minutes,moving_average,total_volume
+  // (before the first trade there's no close: -1, as with doubles)
+  fixed_format(average,moving_average>FIXED_CANDLESTICK_IS_EMPTY?
+                         moving_average:-powers_of_10[scale->price_decimals],
+               scale->price_decimals);
+  fixed_format(volume,avg->total_15min_volume,scale->volume_decimals);
+  fprintf(avg_file,"%" PRIu64 ",%s,%s\n",timestamp_minutes,average,volume);
+  log_delay(delay_file,event_stamp);
+  // Format: timestamp(min),open,high,low,close,volume
+  fixed_format(volume,candlestick->volume,scale->volume_decimals);
+  if(candlestick->open>FIXED_CANDLESTICK_IS_EMPTY){
+    fixed_format(open,candlestick->open,scale->price_decimals);
+    fixed_format(max,candlestick->max,scale->price_decimals);
+    fixed_format(min,candlestick->min,scale->price_decimals);
+    fixed_format(close,candlestick->close,scale->price_decimals);
+    fprintf(candlestick_file,"%" PRIu64 ",%s,%s,%s,%s,%s\n",
+            timestamp_minutes,open,max,min,close,volume);
+  }
+  // An empty minute repeats the last close, if there was any trade
+  else if(candlestick->close>FIXED_CANDLESTICK_IS_EMPTY){
+    fixed_format(close,candlestick->close,scale->price_decimals);
+    fprintf(candlestick_file,"%" PRIu64 ",%s,%s,%s,%s,%s\n",
+            timestamp_minutes,close,close,close,close,volume);
+  }
+  log_delay(delay_file,event_stamp);
+  if(bar!=NULL){
+    bar->t=timestamp_minutes;
+    bar->close=fixed_to_double(candlestick->close,scale->price_decimals);
+    bar->open=bar->close;
+    bar->high=bar->close;
+    bar->low=bar->close;
+    if(candlestick->open>FIXED_CANDLESTICK_IS_EMPTY){
+      bar->open=fixed_to_double(candlestick->open,scale->price_decimals);
+      bar->high=fixed_to_double(candlestick->max,scale->price_decimals);
+      bar->low=fixed_to_double(candlestick->min,scale->price_decimals);
+    }
+    // Before the first trade, as the double bar
+    else if(candlestick->close<=FIXED_CANDLESTICK_IS_EMPTY){
+      bar->open=CANDLESTICK_IS_EMPTY;
+      bar->high=CANDLESTICK_IS_EMPTY;
+      bar->low=CANDLESTICK_IS_EMPTY;
+      bar->close=CANDLESTICK_IS_EMPTY;
+    }
+    bar->volume=fixed_to_double(candlestick->volume,scale->volume_decimals);
+    bar->vwap=moving_average>FIXED_CANDLESTICK_IS_EMPTY?
+      fixed_to_double(moving_average,scale->price_decimals):bar->close;
+    bar->vwap_volume=fixed_to_double(avg->total_15min_volume,
+                                     scale->volume_decimals);
+  }
+  return;
+}
+
+void write_and_reset_fixed_buffers(uint64_t timestamp_minutes,
+                                   uint32_t event_stamp,int symbol_count,
+                                   FILE **candlestick_files,FILE **avg_files,
+                                   FILE *delay_file,
+                                   FixedCalculatorBuffer *buffers,
+                                   MinuteBar *bars){
+  for(int i=0;i<symbol_count;i++){
+    write_fixed_minute_entries(timestamp_minutes,event_stamp,&tick_scales[i],
+                               candlestick_files[i],avg_files[i],delay_file,
+                               &buffers[i],bars!=NULL?&bars[i]:NULL);
+    reset_fixed_candlestick(&buffers[i]);
+  }
+  return;
+}
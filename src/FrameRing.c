@@ -0,0 +1,161 @@
+#include "FrameRing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Copies bytes into the ring at a position, wrapping around its end
+static void ring_copy_in(FrameRing *ring,uint64_t position,const void *data,
+                         size_t length){
+  uint64_t offset=position&(ring->size-1);
+  size_t first=length<ring->size-offset?length:ring->size-offset;
+  memcpy(ring->buffer+offset,data,first);
+  memcpy(ring->buffer,(const char*)data+first,length-first);
+  return;
+}
+
+// Copies bytes out of the ring from a position, wrapping around its end
+static void ring_copy_out(const FrameRing *ring,uint64_t position,void *data,
+                          size_t length){
+  uint64_t offset=position&(ring->size-1);
+  size_t first=length<ring->size-offset?length:ring->size-offset;
+  memcpy(data,ring->buffer+offset,first);
+  memcpy((char*)data+first,ring->buffer,length-first);
+  return;
+}
+
+
+int frame_ring_init(FrameRing *ring,uint64_t size){
+  memset(ring,0,sizeof(FrameRing));
+  if(size<sizeof(FrameHeader) || (size&(size-1))!=0){
+    printf("Frame ring size must be a power of 2\n");
+    return -1;
+  }
+  ring->buffer=(char*)malloc(size);
+  if(ring->buffer==NULL){
+    printf("Error in frame ring allocation\n");
+    return -1;
+  }
+  ring->size=size;
+  pthread_mutex_init(&ring->mut,NULL);
+  pthread_cond_init(&ring->not_empty,NULL);
+  return 0;
+}
+
+
+int frame_ring_write(FrameRing *ring,const void *data,size_t length,
+                     bool final,uint32_t flags){
+  FrameHeader header;
+  uint64_t read,needed;
+
+  // Skip the rest of a message that didn't fit
+  if(ring->dropping){
+    ring->dropping=!final;
+    return -1;
+  }
+  if(!ring->receiving){
+    ring->receiving=true;
+    ring->pending_length=0;
+    ring->pending_flags=flags;
+    gettimeofday(&ring->pending_arrival,NULL);
+  }
+  // Only consumers move the read cursor, and only forward, so a stale
+  // value just underestimates the free space
+  pthread_mutex_lock(&ring->mut);
+  read=ring->read;
+  pthread_mutex_unlock(&ring->mut);
+  needed=sizeof(FrameHeader)+ring->pending_length+length;
+  if(ring->write+needed-read>ring->size || needed>UINT32_MAX){
+    ring->receiving=false;
+    ring->dropping=!final;
+    ring->dropped_frames++;
+    return -1;
+  }
+  // Write past the committed end, where consumers don't look
+  ring_copy_in(ring,ring->write+sizeof(FrameHeader)+ring->pending_length,
+               data,length);
+  ring->pending_length+=length;
+  if(!final)
+    return 0;
+
+  // Commit the message
+  header.length=(uint32_t)ring->pending_length;
+  header.flags=ring->pending_flags;
+  header.arrival_time=ring->pending_arrival;
+  ring_copy_in(ring,ring->write,&header,sizeof(FrameHeader));
+  ring->receiving=false;
+  ring->frames++;
+  pthread_mutex_lock(&ring->mut);
+  ring->write+=sizeof(FrameHeader)+header.length;
+  if(ring->write-ring->read>ring->high_water_mark)
+    ring->high_water_mark=ring->write-ring->read;
+  pthread_mutex_unlock(&ring->mut);
+  pthread_cond_signal(&ring->not_empty);
+  return 0;
+}
+
+
+void frame_ring_abort(FrameRing *ring){
+  ring->receiving=false;
+  ring->dropping=false;
+  return;
+}
+
+
+int frame_ring_read(FrameRing *ring,char **frame,size_t *capacity,
+                    size_t *length,struct timeval *arrival_time,
+                    uint32_t *flags){
+  FrameHeader header;
+  char *grown;
+  pthread_mutex_lock(&ring->mut);
+  while(ring->read==ring->write){
+    if(ring->closed){
+      pthread_mutex_unlock(&ring->mut);
+      // Let other consumers know that it's time to exit
+      pthread_cond_signal(&ring->not_empty);
+      return -1;
+    }
+    pthread_cond_wait(&ring->not_empty,&ring->mut);
+  }
+  ring_copy_out(ring,ring->read,&header,sizeof(FrameHeader));
+  // Keep room for a terminating null, parsers may need it
+  if(*capacity<(size_t)header.length+1){
+    grown=(char*)realloc(*frame,header.length+1);
+    if(grown==NULL){
+      // Skip the message rather than stall the ring
+      printf("Error in frame buffer allocation\n");
+      ring->read+=sizeof(FrameHeader)+header.length;
+      pthread_mutex_unlock(&ring->mut);
+      *length=0;
+      *flags=0;
+      return 0;
+    }
+    *frame=grown;
+    *capacity=header.length+1;
+  }
+  ring_copy_out(ring,ring->read+sizeof(FrameHeader),*frame,header.length);
+  ring->read+=sizeof(FrameHeader)+header.length;
+  pthread_mutex_unlock(&ring->mut);
+  (*frame)[header.length]='\0';
+  *length=header.length;
+  *arrival_time=header.arrival_time;
+  *flags=header.flags;
+  return 0;
+}
+
+
+void frame_ring_close(FrameRing *ring){
+  pthread_mutex_lock(&ring->mut);
+  ring->closed=true;
+  pthread_cond_broadcast(&ring->not_empty);
+  pthread_mutex_unlock(&ring->mut);
+  return;
+}
+
+
+void frame_ring_destroy(FrameRing *ring){
+  pthread_mutex_destroy(&ring->mut);
+  pthread_cond_destroy(&ring->not_empty);
+  free(ring->buffer);
+  ring->buffer=NULL;
+  return;
+}
@@ -0,0 +1,154 @@
+#include "Generator.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// xorshift64* step, returns a uniform double in (0,1)
+static double uniform(TradeGenerator *generator){
+  uint64_t x=generator->rng_state;
+  x^=x>>12;
+  x^=x<<25;
+  x^=x>>27;
+  generator->rng_state=x;
+  return ((x*2685821657736338717ULL>>11)+0.5)*(1.0/9007199254740992.0);
+}
+
+// Standard normal sample (Box-Muller)
+static double normal(TradeGenerator *generator){
+  return sqrt(-2*log(uniform(generator)))*cos(2*M_PI*uniform(generator));
+}
+
+// Picks a symbol according to the cumulative popularity weights
+static int pick_symbol(TradeGenerator *generator){
+  double target=uniform(generator)*
+                generator->popularity[generator->symbol_count-1];
+  int low=0,high=generator->symbol_count-1,middle;
+  while(low<high){
+    middle=(low+high)/2;
+    if(generator->popularity[middle]<target)
+      low=middle+1;
+    else
+      high=middle;
+  }
+  return low;
+}
+
+
+void generator_default_config(GeneratorConfig *config){
+  config->process=ARRIVALS_POISSON;
+  config->rate=1000;
+  // Branching ratio alpha/beta of 0.8, so the mean rate is 5x the base rate
+  config->hawkes_alpha=8;
+  config->hawkes_beta=10;
+  config->zipf_exponent=1;
+  config->volatility=0.001;
+  config->volume_min=1;
+  config->volume_tail=1.5;
+  config->duration=0;
+  config->seed=1;
+  return;
+}
+
+
+int generator_init(TradeGenerator *generator,const GeneratorConfig *config,
+                   int symbol_count,uint64_t start_ms){
+  memset(generator,0,sizeof(TradeGenerator));
+  if(config->rate<=0 || config->volume_min<=0 || config->volume_tail<=0 ||
+     (config->process==ARRIVALS_HAWKES &&
+      (config->hawkes_beta<=0 || config->hawkes_alpha>=config->hawkes_beta))){
+    printf("Invalid generator parameters\n");
+    return -1;
+  }
+  generator->config=*config;
+  generator->start_ms=start_ms;
+  // The xorshift state must never be 0
+  generator->rng_state=config->seed*0x9E3779B97F4A7C15ULL+1;
+  return generator_resize(generator,symbol_count);
+}
+
+
+int generator_resize(TradeGenerator *generator,int symbol_count){
+  double *prices,*last_times,*popularity;
+  double total=0;
+  if(symbol_count<1)
+    return -1;
+  prices=(double*)realloc(generator->prices,symbol_count*sizeof(double));
+  if(prices!=NULL)
+    generator->prices=prices;
+  last_times=(double*)realloc(generator->last_times,
+                              symbol_count*sizeof(double));
+  if(last_times!=NULL)
+    generator->last_times=last_times;
+  popularity=(double*)realloc(generator->popularity,
+                              symbol_count*sizeof(double));
+  if(popularity!=NULL)
+    generator->popularity=popularity;
+  if(prices==NULL || last_times==NULL || popularity==NULL){
+    printf("Error in generator allocation\n");
+    return -1;
+  }
+  // New symbols start at a random price
+  for(int i=generator->symbol_count;i<symbol_count;i++){
+    prices[i]=10+500*uniform(generator);
+    last_times[i]=generator->time;
+  }
+  // Zipf weights: symbol i is traded proportionally to 1/(i+1)^s
+  for(int i=0;i<symbol_count;i++){
+    total+=pow(i+1,-generator->config.zipf_exponent);
+    popularity[i]=total;
+  }
+  generator->symbol_count=symbol_count;
+  return 0;
+}
+
+
+int generator_next(void *source,Trade *trade){
+  TradeGenerator *generator=(TradeGenerator*)source;
+  GeneratorConfig *config=&generator->config;
+  double bound,wait,dt;
+  int i;
+
+  // Next arrival time
+  if(config->process==ARRIVALS_POISSON){
+    generator->time+=-log(uniform(generator))/config->rate;
+  }
+  else{
+    // Ogata's thinning: the intensity only decays between arrivals, so its
+    // current value bounds it until the next candidate
+    while(true){
+      bound=config->rate+generator->excitation;
+      wait=-log(uniform(generator))/bound;
+      generator->time+=wait;
+      generator->excitation*=exp(-config->hawkes_beta*wait);
+      if(uniform(generator)*bound<=config->rate+generator->excitation)
+        break;
+    }
+    generator->excitation+=config->hawkes_alpha;
+  }
+  if(config->duration>0 && generator->time>config->duration)
+    return -1;
+
+  // Symbol, price and volume of the trade
+  i=pick_symbol(generator);
+  dt=generator->time-generator->last_times[i];
+  generator->last_times[i]=generator->time;
+  generator->prices[i]*=exp(config->volatility*sqrt(dt)*normal(generator));
+  trade->s_index=i;
+  trade->p=round(generator->prices[i]*1e4)/1e4;
+  trade->v=floor(config->volume_min*
+                 pow(uniform(generator),-1/config->volume_tail));
+  trade->t=generator->start_ms+(uint64_t)(generator->time*1000);
+  return 0;
+}
+
+
+void generator_destroy(TradeGenerator *generator){
+  free(generator->prices);
+  free(generator->last_times);
+  free(generator->popularity);
+  generator->prices=generator->last_times=generator->popularity=NULL;
+  generator->symbol_count=0;
+  return;
+}
@@ -0,0 +1,124 @@
+#include "Inflater.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(WITH_PERMESSAGE_DEFLATE)
+#include <zlib.h>
+
+// Every message ends with an empty stored block, which the sender strips
+static const unsigned char message_tail[4]={0x00,0x00,0xff,0xff};
+
+bool inflater_supported(){
+  return true;
+}
+
+
+int inflater_init(Inflater *inflater){
+  z_stream *stream;
+  memset(inflater,0,sizeof(Inflater));
+  stream=(z_stream*)calloc(1,sizeof(z_stream));
+  if(stream==NULL)
+    return -1;
+  // Raw deflate (no zlib header), with the largest window
+  if(inflateInit2(stream,-MAX_WBITS)!=Z_OK){
+    printf("Error in inflater initialization\n");
+    free(stream);
+    return -1;
+  }
+  inflater->stream=stream;
+  return 0;
+}
+
+
+int inflater_inflate(Inflater *inflater,const char *message,size_t length,
+                     char **output,size_t *output_length){
+  z_stream *stream=(z_stream*)inflater->stream;
+  size_t produced=0,capacity;
+  char *grown;
+  int return_code=Z_OK;
+  bool tail_given=false;
+
+  // Without context takeover, each message starts from an empty window
+  inflateReset(stream);
+  stream->next_in=(Bytef*)message;
+  stream->avail_in=(uInt)length;
+  while(true){
+    // Keep room for a terminating null, parsers may need it
+    if(inflater->capacity<produced+2){
+      capacity=inflater->capacity==0?4096:2*inflater->capacity;
+      if(capacity>INFLATE_MAX_MESSAGE_LENGTH+1){
+        printf("Inflated message is too long\n");
+        return -1;
+      }
+      grown=(char*)realloc(inflater->output,capacity);
+      if(grown==NULL)
+        return -1;
+      inflater->output=grown;
+      inflater->capacity=capacity;
+    }
+    stream->next_out=(Bytef*)&inflater->output[produced];
+    stream->avail_out=(uInt)(inflater->capacity-produced-1);
+    return_code=inflate(stream,Z_SYNC_FLUSH);
+    produced=inflater->capacity-1-stream->avail_out;
+    if(return_code!=Z_OK && return_code!=Z_BUF_ERROR &&
+       return_code!=Z_STREAM_END){
+      printf("Error in message inflation: %s\n",
+             stream->msg!=NULL?stream->msg:"unknown");
+      return -1;
+    }
+    if(return_code==Z_STREAM_END)
+      break;
+    // Output space was left, so all given input was consumed
+    if(stream->avail_out>0 && stream->avail_in==0){
+      if(tail_given)
+        break;
+      stream->next_in=(Bytef*)message_tail;
+      stream->avail_in=sizeof(message_tail);
+      tail_given=true;
+    }
+  }
+  inflater->output[produced]='\0';
+  *output=inflater->output;
+  *output_length=produced;
+  return 0;
+}
+
+
+void inflater_destroy(Inflater *inflater){
+  if(inflater->stream!=NULL){
+    inflateEnd((z_stream*)inflater->stream);
+    free(inflater->stream);
+  }
+  free(inflater->output);
+  memset(inflater,0,sizeof(Inflater));
+  return;
+}
+
+#else
+
+bool inflater_supported(){
+  return false;
+}
+
+int inflater_init(Inflater *inflater){
+  memset(inflater,0,sizeof(Inflater));
+  return -1;
+}
+
+int inflater_inflate(Inflater *inflater,const char *message,size_t length,
+                     char **output,size_t *output_length){
+  (void)inflater;
+  (void)message;
+  (void)length;
+  (void)output;
+  (void)output_length;
+  printf("Built without permessage-deflate support\n");
+  return -1;
+}
+
+void inflater_destroy(Inflater *inflater){
+  (void)inflater;
+  return;
+}
+
+#endif
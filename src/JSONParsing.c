@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include "TradeProcessing.h"
+#include "Symbols.h"
 #include <inttypes.h>
 
 // Paths that are recognized by the parser
@@ -15,9 +16,26 @@ const char my_paths[][JSON_PATHS_MAX_LENGTH]={
   "data[].v"
 };
 
-void construct_parser(PCQueue *api_queue,struct lejp_ctx *ctx){
-  // Pass the api_queue to the user pointer
-  void *user=(void*)api_queue;
+// Adds the batched trades to the queue
+static void flush_batch(TradeParser *parser){
+  if(parser->batch_count>0){
+    queue_add_batch(parser->api_queue,parser->batch,parser->batch_count);
+    parser->batch_count=0;
+  }
+  return;
+}
+
+
+void construct_parser(PCQueue *api_queue,RecentTrades *recent_trades,
+                      TradeParser *parser){
+  // Pass the parser (and through it the api_queue) to the user pointer
+  void *user=(void*)parser;
+  parser->api_queue=api_queue;
+  parser->recent_trades=recent_trades;
+  parser->trade_is_valid=true;
+  parser->batch_count=0;
+  // Arrival time of the frame, unless the caller knows an earlier one
+  gettimeofday(&parser->arrival_time,NULL);
   // Make the paths argument passable
   static const char *path_pointers[]={
     my_paths[0],
@@ -26,95 +44,122 @@ void construct_parser(PCQueue *api_queue,struct lejp_ctx *ctx){
     my_paths[3],
     my_paths[4]
   };
-  lejp_construct(ctx,json_callback,user,path_pointers,
+  lejp_construct(&parser->ctx,json_callback,user,path_pointers,
                  (char)LWS_ARRAY_SIZE(my_paths));
   return;
 }
 
 
 signed char json_callback(struct lejp_ctx *ctx, char reason){
-  // This is the 1st stage queue of the implementation 
-  PCQueue *api_queue=(PCQueue*)ctx->user;
-
+  // The parser's state, including the 1st stage queue of the implementation
+  TradeParser *parser=(TradeParser*)ctx->user;
   // Object that tracks each incoming object
-  static WorkItem current_work_item;
+  Trade *current_trade=&parser->current_trade;
   // These handle str->number conversions.
-  static bool trade_is_valid=true;
+  bool *trade_is_valid=&parser->trade_is_valid;
   char *conversion_ptr;
+  int symbol_index;
 
 
   switch(reason){
-  // Started parsing, get timestamp
-  case LEJPCB_START:
-    gettimeofday(&current_work_item.event_time,NULL);
-    break;
   // Found an object of the data array, so assume it'll be valid
   case LEJPCB_OBJECT_START:
     if(strcmp(ctx->path,"data[]")==0){
-      trade_is_valid=true;
+      *trade_is_valid=true;
     }
     break;
   // Found the symbol
   case LEJPCB_VAL_STR_END:
     if(strcmp(ctx->path,"data[].s")==0){
       // Find which item it corresponds to
-      for(int i=0;symbols_list[i][0]>0;i++){
-        if(strcmp(symbols_list[i],ctx->buf)==0){
-          current_work_item.trade.s_index=i;
-          break;
-        }
+      symbol_index=find_symbol_index(ctx->buf);
+      if(symbol_index==SYMBOL_NOT_FOUND){
+        *trade_is_valid=false;
+      }
+      else{
+        current_trade->s_index=symbol_index;
       }
     }
     break;
   // Integer found (check all possible fields)
   case LEJPCB_VAL_NUM_INT:
     if(strcmp(ctx->path,"data[].t")==0){
-      current_work_item.trade.t=strtoull(ctx->buf,&conversion_ptr,10);
+      current_trade->t=strtoull(ctx->buf,&conversion_ptr,10);
       if(*conversion_ptr!='\0'){
         printf("Conversion problem\n");
-        trade_is_valid=false;
+        *trade_is_valid=false;
       }
     }
     else if(strcmp(ctx->path,"data[].v")==0){
-      current_work_item.trade.v=strtod(ctx->buf,&conversion_ptr);   
+      current_trade->v=strtod(ctx->buf,&conversion_ptr);   
       if(*conversion_ptr!='\0'){
         printf("False v\n");
-        trade_is_valid=false;
+        *trade_is_valid=false;
       }
     }
     else if(strcmp(ctx->path,"data[].p")==0){
-      current_work_item.trade.p=strtod(ctx->buf,&conversion_ptr);   
+      current_trade->p=strtod(ctx->buf,&conversion_ptr);   
       if(*conversion_ptr!='\0'){
-        trade_is_valid=false;
+        *trade_is_valid=false;
       }
     }
     break;
   // Float found (check all possible fields)
   case LEJPCB_VAL_NUM_FLOAT:
     if(strcmp(ctx->path,"data[].p")==0){
-      current_work_item.trade.p=strtod(ctx->buf,&conversion_ptr);   
+      current_trade->p=strtod(ctx->buf,&conversion_ptr);   
       if(*conversion_ptr!='\0'){
         printf("False p (float)\n");
-        trade_is_valid=false;
+        *trade_is_valid=false;
       }
     }
     else if(strcmp(ctx->path,"data[].v")==0){
-      current_work_item.trade.v=strtod(ctx->buf,&conversion_ptr);   
+      current_trade->v=strtod(ctx->buf,&conversion_ptr);   
       if(*conversion_ptr!='\0'){
         printf("False v\n");
-        trade_is_valid=false;
+        *trade_is_valid=false;
       }
     }
     break;
   // Object fully scanned
   case LEJPCB_OBJECT_END:
-    // If object was on data array it's a trade, add if valid
-    if(trade_is_valid && strcmp(ctx->path,"data[]")==0){
-      queue_add(api_queue,&current_work_item);
+    // If object was on data array it's a trade, add if valid and not
+    // repeated by the server after a reconnect
+    if(*trade_is_valid && strcmp(ctx->path,"data[]")==0 &&
+       (parser->recent_trades==NULL ||
+        !recent_trades_is_duplicate(parser->recent_trades,current_trade,
+                                    parser->arrival_time))){
+      work_item_from_trade(&parser->batch[parser->batch_count++],
+                           current_trade,parser->arrival_time);
+      if(parser->batch_count==PARSER_BATCH_SIZE)
+        flush_batch(parser);
     }
     break;
+  // Frame ended, add what was parsed
+  case LEJPCB_COMPLETE:
+  case LEJPCB_FAILED:
+    flush_batch(parser);
+    break;
   default:
     break;
   }
   return 0;
 }
+
+
+size_t format_trade_frame(const Trade *trades,int trades_count,
+                          const char symbols[][SYMBOLS_MAX_LENGTH],
+                          char *frame){
+  size_t length=0;
+  // Format: {"data":[{"c":null,"p":P,"s":"S","t":T,"v":V},...],"type":"trade"}
+  length+=sprintf(frame,"{\"data\":[");
+  for(int i=0;i<trades_count;i++){
+    length+=snprintf(frame+length,TRADE_JSON_MAX_LENGTH,
+                     "%s{\"c\":null,\"p\":%.10g,\"s\":\"%s\",\"t\":%" PRIu64
+                     ",\"v\":%.10g}",
+                     i>0?",":"",trades[i].p,symbols[trades[i].s_index],
+                     trades[i].t,trades[i].v);
+  }
+  length+=sprintf(frame+length,"],\"type\":\"trade\"}");
+  return length;
+}
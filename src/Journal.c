@@ -0,0 +1,519 @@
+#include "Journal.h"
+#include "FixedPoint.h"
+#include "Symbols.h"
+#include "SystemHandling.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+// Longest payload: the fixed part and a full symbol name
+#define JOURNAL_MAX_PAYLOAD (sizeof(JournalTrade)+SYMBOLS_MAX_LENGTH)
+#define JOURNAL_MAX_RECORD (sizeof(JournalRecordHeader)+JOURNAL_MAX_PAYLOAD)
+// Read from the end of a trade log, for its last complete line
+#define JOURNAL_LOG_TAIL_LENGTH 4096
+
+/**
+ * @brief A recovered trade, with where its line starts in its trade log.
+ */
+typedef struct{
+  Trade trade; //< The trade.
+  uint64_t log_offset; //< Offset of its line in the trade log.
+} RecoveredTrade;
+
+// Builds the record of a trade, returns its length
+static size_t encode_record(char *record,const Trade *trade,
+                            uint64_t log_offset){
+  JournalRecordHeader header;
+  JournalTrade payload;
+  size_t name_length=strnlen(symbols_list[trade->s_index],SYMBOLS_MAX_LENGTH);
+  payload.t=trade->t;
+  payload.p=trade->p;
+  payload.v=trade->v;
+  payload.log_offset=log_offset;
+  memcpy(record+sizeof(header),&payload,sizeof(payload));
+  memcpy(record+sizeof(header)+sizeof(payload),symbols_list[trade->s_index],
+         name_length);
+  header.length=sizeof(payload)+name_length;
+  header.checksum=fnv1a_32(FNV1A_32_SEED,record+sizeof(header),
+                           header.length);
+  memcpy(record,&header,sizeof(header));
+  return sizeof(header)+header.length;
+}
+
+// Writes everything, retrying short writes
+static int write_all(int fd,const char *data,size_t length){
+  ssize_t bytes;
+  while(length>0){
+    bytes=write(fd,data,length);
+    if(bytes<0 && errno==EINTR)
+      continue;
+    if(bytes<=0)
+      return -1;
+    data+=bytes;
+    length-=bytes;
+  }
+  return 0;
+}
+
+// Syncs the trade logs. Every journaled line was logged before its record,
+// so after this the journal file's records are all on disk in the logs
+static void sync_trade_logs(Journal *journal){
+  int failures=0;
+  for(int i=0;i<journal->log_count;i++){
+    pthread_mutex_lock(&journal->log_mutexes[i]);
+    if(fflush(journal->logs[i])!=0)
+      failures++;
+    pthread_mutex_unlock(&journal->log_mutexes[i]);
+    if(fdatasync(fileno(journal->logs[i]))!=0)
+      failures++;
+  }
+  if(failures>0)
+    printf("Error in syncing the trade logs of journal %s\n",journal->path);
+  return;
+}
+
+// Renames the journal to its .old file (dropping the previous one) and
+// starts a new one
+static void rotate(Journal *journal){
+  char old_path[FILENAME_MAX+8];
+  sync_trade_logs(journal);
+  snprintf(old_path,sizeof(old_path),"%s" JOURNAL_OLD_SUFFIX,journal->path);
+  close(journal->fd);
+  if(rename(journal->path,old_path)!=0)
+    printf("Error in rotating journal %s\n",journal->path);
+  journal->fd=open(journal->path,O_WRONLY|O_CREAT|O_APPEND,0644);
+  if(journal->fd<0)
+    printf("Error in reopening journal %s\n",journal->path);
+  journal->size=0;
+  return;
+}
+
+// Writes and syncs the filled buffer each interval, while writers fill
+// the other one
+static void *journal_flusher(void *arg){
+  Journal *journal=(Journal*)arg;
+  struct timespec deadline;
+  char *buffer;
+  size_t length;
+  bool checkpointed;
+
+  pthread_mutex_lock(&journal->mutex);
+  while(true){
+    while(journal->length==0 && !journal->checkpointed && !journal->closing)
+      pthread_cond_wait(&journal->wake,&journal->mutex);
+    if(journal->length==0 && !journal->checkpointed)
+      break;
+    // Let the group grow for an interval, unless a writer waits for space
+    clock_gettime(CLOCK_REALTIME,&deadline);
+    deadline.tv_sec+=journal->sync_interval_ms/1000;
+    deadline.tv_nsec+=(journal->sync_interval_ms%1000)*1000000L;
+    if(deadline.tv_nsec>=1000000000L){
+      deadline.tv_sec++;
+      deadline.tv_nsec-=1000000000L;
+    }
+    while(!journal->full && !journal->closing &&
+          pthread_cond_timedwait(&journal->wake,&journal->mutex,
+                                 &deadline)==0);
+    // Swap buffers, then write outside of the lock
+    buffer=journal->buffers[journal->active];
+    length=journal->length;
+    checkpointed=journal->checkpointed;
+    journal->active^=1;
+    journal->length=0;
+    journal->full=false;
+    journal->checkpointed=false;
+    pthread_cond_broadcast(&journal->swapped);
+    pthread_mutex_unlock(&journal->mutex);
+
+    if(length>0 && (journal->fd<0 || write_all(journal->fd,buffer,length)!=0 ||
+                    fdatasync(journal->fd)!=0)){
+      printf("Error in writing journal %s\n",journal->path);
+    }
+    journal->size+=length;
+    if(checkpointed || journal->size>=JOURNAL_MAX_LENGTH)
+      rotate(journal);
+
+    pthread_mutex_lock(&journal->mutex);
+    if(length>0)
+      journal->syncs++;
+  }
+  pthread_mutex_unlock(&journal->mutex);
+  return NULL;
+}
+
+
+int journal_open(Journal *journal,const char *path,int sync_interval_ms,
+                 FILE **logs,pthread_mutex_t *log_mutexes,int log_count){
+  struct stat info;
+  memset(journal,0,sizeof(Journal));
+  snprintf(journal->path,FILENAME_MAX,"%s",path);
+  journal->sync_interval_ms=sync_interval_ms;
+  journal->logs=logs;
+  journal->log_mutexes=log_mutexes;
+  journal->log_count=log_count;
+  journal->fd=open(path,O_WRONLY|O_CREAT|O_APPEND,0644);
+  if(journal->fd<0){
+    printf("Error in opening journal %s\n",path);
+    return -1;
+  }
+  if(fstat(journal->fd,&info)==0)
+    journal->size=info.st_size;
+  journal->buffers[0]=(char*)malloc(JOURNAL_BUFFER_LENGTH);
+  journal->buffers[1]=(char*)malloc(JOURNAL_BUFFER_LENGTH);
+  if(journal->buffers[0]==NULL || journal->buffers[1]==NULL){
+    free(journal->buffers[0]);
+    free(journal->buffers[1]);
+    close(journal->fd);
+    return -1;
+  }
+  pthread_mutex_init(&journal->mutex,NULL);
+  pthread_cond_init(&journal->wake,NULL);
+  pthread_cond_init(&journal->swapped,NULL);
+  pthread_create(&journal->flusher,NULL,journal_flusher,(void*)journal);
+  return 0;
+}
+
+
+void journal_append(Journal *journal,const Trade *trade,uint64_t log_offset){
+  char record[JOURNAL_MAX_RECORD];
+  // Build the record outside of the lock
+  size_t length=encode_record(record,trade,log_offset);
+
+  pthread_mutex_lock(&journal->mutex);
+  while(journal->length+length>JOURNAL_BUFFER_LENGTH){
+    journal->full=true;
+    pthread_cond_signal(&journal->wake);
+    pthread_cond_wait(&journal->swapped,&journal->mutex);
+  }
+  memcpy(journal->buffers[journal->active]+journal->length,record,length);
+  // The first record of a group starts the flusher's interval
+  if(journal->length==0)
+    pthread_cond_signal(&journal->wake);
+  journal->length+=length;
+  journal->records++;
+  pthread_mutex_unlock(&journal->mutex);
+  return;
+}
+
+
+void journal_checkpoint(Journal *journal){
+  pthread_mutex_lock(&journal->mutex);
+  journal->checkpointed=true;
+  pthread_cond_signal(&journal->wake);
+  pthread_mutex_unlock(&journal->mutex);
+  return;
+}
+
+
+void journal_close(Journal *journal){
+  pthread_mutex_lock(&journal->mutex);
+  journal->closing=true;
+  pthread_cond_signal(&journal->wake);
+  pthread_mutex_unlock(&journal->mutex);
+  pthread_join(journal->flusher,NULL);
+  printf("Journal: %" PRIu64 " trades in %" PRIu64 " group commits\n",
+         journal->records,journal->syncs);
+  // Only the calculator's open minute is left to recover
+  rotate(journal);
+  if(journal->fd>=0)
+    close(journal->fd);
+  pthread_mutex_destroy(&journal->mutex);
+  pthread_cond_destroy(&journal->wake);
+  pthread_cond_destroy(&journal->swapped);
+  free(journal->buffers[0]);
+  free(journal->buffers[1]);
+  return;
+}
+
+
+// Adds the valid records of a journal file to trades, up to its first
+// invalid one. Returns -1 on failure.
+static int read_journal(const char *path,RecoveredTrade **trades,
+                        size_t *count,size_t *capacity){
+  JournalRecordHeader header;
+  JournalTrade payload;
+  char name[SYMBOLS_MAX_LENGTH+1];
+  struct stat info;
+  char *data,*resized;
+  size_t offset=0,done;
+  ssize_t bytes;
+  int symbol_index,fd=open(path,O_RDONLY);
+  if(fd<0)
+    return errno==ENOENT?0:-1;
+  if(fstat(fd,&info)!=0){
+    close(fd);
+    return -1;
+  }
+  data=(char*)malloc(info.st_size+1);
+  if(data==NULL){
+    close(fd);
+    return -1;
+  }
+  for(done=0;done<(size_t)info.st_size;done+=bytes){
+    bytes=pread(fd,data+done,info.st_size-done,done);
+    if(bytes<=0)
+      break;
+  }
+  close(fd);
+
+  while(offset+sizeof(header)<=done){
+    memcpy(&header,data+offset,sizeof(header));
+    if(header.length<=sizeof(payload) || header.length>JOURNAL_MAX_PAYLOAD ||
+       offset+sizeof(header)+header.length>done ||
+       fnv1a_32(FNV1A_32_SEED,data+offset+sizeof(header),header.length)!=
+       header.checksum)
+      break;
+    memcpy(&payload,data+offset+sizeof(header),sizeof(payload));
+    memcpy(name,data+offset+sizeof(header)+sizeof(payload),
+           header.length-sizeof(payload));
+    name[header.length-sizeof(payload)]='\0';
+    offset+=sizeof(header)+header.length;
+    symbol_index=find_symbol_index(name);
+    if(symbol_index==SYMBOL_NOT_FOUND)
+      continue;
+    if(*count==*capacity){
+      *capacity=*capacity>0?2*(*capacity):1024;
+      resized=(char*)realloc(*trades,*capacity*sizeof(RecoveredTrade));
+      if(resized==NULL){
+        free(data);
+        return -1;
+      }
+      *trades=(RecoveredTrade*)resized;
+    }
+    (*trades)[*count].trade.t=payload.t;
+    (*trades)[*count].trade.p=payload.p;
+    (*trades)[*count].trade.v=payload.v;
+    (*trades)[*count].trade.s_index=symbol_index;
+    (*trades)[*count].log_offset=payload.log_offset;
+    (*count)++;
+  }
+  // What's left was cut short by the crash
+  if(offset<(size_t)info.st_size){
+    printf("Journal %s: dropping %zu bytes of a torn record\n",path,
+           (size_t)info.st_size-offset);
+  }
+  free(data);
+  return 0;
+}
+
+// Orders trades by symbol, then position in the trade log
+static int compare_symbol_offset(const void *a,const void *b){
+  const RecoveredTrade *x=(const RecoveredTrade*)a;
+  const RecoveredTrade *y=(const RecoveredTrade*)b;
+  if(x->trade.s_index!=y->trade.s_index)
+    return x->trade.s_index<y->trade.s_index?-1:1;
+  return (x->log_offset>y->log_offset)-(x->log_offset<y->log_offset);
+}
+
+// Orders trades by timestamp
+static int compare_time(const void *a,const void *b){
+  const Trade *x=(const Trade*)a,*y=(const Trade*)b;
+  return (x->t>y->t)-(x->t<y->t);
+}
+
+// Last newline of data, NULL if there's none
+static char *last_newline(char *data,size_t length){
+  while(length>0){
+    if(data[--length]=='\n')
+      return data+length;
+  }
+  return NULL;
+}
+
+// Cuts a trade log after its last complete line, and gets its new length.
+// Returns -1 if the log can't be read or cut.
+static int trim_trade_log(int fd,uint64_t *end){
+  size_t window=JOURNAL_LOG_TAIL_LENGTH,length,done;
+  char *tail=NULL,*resized,*newline;
+  struct stat info;
+  off_t offset;
+  ssize_t bytes;
+  *end=0;
+  if(fstat(fd,&info)!=0)
+    return -1;
+  if(info.st_size==0)
+    return 0;
+  // A torn tail can be longer than the window (e.g. a zero filled block
+  // after a power cut): double it until it holds a newline
+  while(true){
+    offset=(size_t)info.st_size>window?info.st_size-window:0;
+    length=info.st_size-offset;
+    resized=(char*)realloc(tail,length);
+    if(resized==NULL){
+      free(tail);
+      return -1;
+    }
+    tail=resized;
+    for(done=0;done<length;done+=bytes){
+      bytes=pread(fd,tail+done,length-done,offset+done);
+      if(bytes<=0){
+        free(tail);
+        return -1;
+      }
+    }
+    newline=last_newline(tail,length);
+    if(offset==0 || newline!=NULL)
+      break;
+    window*=2;
+  }
+  // A torn line is one without its newline
+  *end=newline!=NULL?offset+(newline-tail)+1:0;
+  free(tail);
+  if(*end<(uint64_t)info.st_size && ftruncate(fd,*end)!=0)
+    return -1;
+  return 0;
+}
+
+// Appends the journaled trades a symbol's trade log is missing (those whose
+// line starts at or past its end), in the order they were logged, and
+// updates their offsets to where their lines are now
+static void repair_trade_log(const char *output_folder,RecoveredTrade *trades,
+                             size_t count){
+  char path[FILEPATH_BUFFER_LENGTH];
+  char price[FIXED_FORMAT_LENGTH],volume[FIXED_FORMAT_LENGTH];
+  const TickScale *scale;
+  const Trade *trade;
+  uint64_t end;
+  size_t repaired=0;
+  FILE *log;
+  int i=trades[0].trade.s_index,fd,bytes;
+
+  snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/trade_logs/%s.csv",output_folder,
+           symbols_list[i]);
+  fd=open(path,O_RDWR|O_CREAT|O_APPEND,0644);
+  if(fd<0 || trim_trade_log(fd,&end)!=0 ||
+     (log=fdopen(fd,"a"))==NULL){
+    printf("Error in repairing trade log %s\n",path);
+    if(fd>=0)
+      close(fd);
+    return;
+  }
+  for(size_t j=0;j<count;j++){
+    if(trades[j].log_offset<end)
+      continue;
+    // Lines that are missing from both the log and the journal leave a gap
+    if(repaired==0 && trades[j].log_offset>end)
+      printf("Trade log %s: %" PRIu64 " bytes lost before the journaled "
+             "trades\n",path,trades[j].log_offset-end);
+    trades[j].log_offset=end;
+    // Same format as the writers
+    trade=&trades[j].trade;
+    if(tick_scales!=NULL){
+      scale=&tick_scales[i];
+      fixed_format(price,fixed_from_double(trade->p,scale->price_decimals),
+                   scale->price_decimals);
+      fixed_format(volume,fixed_from_double(trade->v,scale->volume_decimals),
+                   scale->volume_decimals);
+      bytes=fprintf(log,"%" PRIu64 ",%s,%s\n",trade->t,price,volume);
+    }
+    else{
+      bytes=fprintf(log,"%" PRIu64 ",%f,%f\n",trade->t,trade->p,trade->v);
+    }
+    if(bytes>0)
+      end+=bytes;
+    repaired++;
+  }
+  if(fflush(log)!=0 || fsync(fd)!=0)
+    printf("Error in repairing trade log %s\n",path);
+  fclose(log);
+  if(repaired>0)
+    printf("Trade log %s: restored %zu trades from the journal\n",path,
+           repaired);
+  return;
+}
+
+// Replaces the journal and its .old file with one journal of the trades
+static int rewrite_journal(const char *path,const char *old_path,
+                           const RecoveredTrade *trades,size_t count){
+  char temporary_path[FILENAME_MAX+8],record[JOURNAL_MAX_RECORD];
+  size_t length;
+  FILE *file;
+  int result=0;
+
+  // Write aside, then replace the journal at once
+  snprintf(temporary_path,sizeof(temporary_path),"%s.tmp",path);
+  file=fopen(temporary_path,"wb");
+  if(file==NULL)
+    return -1;
+  for(size_t j=0;j<count && result==0;j++){
+    length=encode_record(record,&trades[j].trade,trades[j].log_offset);
+    if(fwrite(record,length,1,file)!=1)
+      result=-1;
+  }
+  if(result!=0 || fflush(file)!=0 || fsync(fileno(file))!=0)
+    result=-1;
+  if(fclose(file)!=0)
+    result=-1;
+  // Its trades are in the new journal too (a crash in between only loses
+  // them for the calculator, they're already in the trade logs)
+  if(result==0 && unlink(old_path)!=0 && errno!=ENOENT)
+    result=-1;
+  if(result==0 && rename(temporary_path,path)!=0)
+    result=-1;
+  if(result!=0)
+    unlink(temporary_path);
+  return result;
+}
+
+
+int journal_recover(const char *path,const char *output_folder,
+                    Trade **trades,size_t *count){
+  char old_path[FILENAME_MAX+8],folder[FILEPATH_BUFFER_LENGTH];
+  RecoveredTrade *recovered=NULL;
+  size_t capacity=0,first;
+  *trades=NULL;
+  *count=0;
+  snprintf(old_path,sizeof(old_path),"%s" JOURNAL_OLD_SUFFIX,path);
+  if(read_journal(old_path,&recovered,count,&capacity)!=0 ||
+     read_journal(path,&recovered,count,&capacity)!=0){
+    printf("Error in reading journal %s\n",path);
+    free(recovered);
+    *count=0;
+    return -1;
+  }
+
+  // Repair each symbol's trade log
+  if(*count>0){
+    snprintf(folder,FILEPATH_BUFFER_LENGTH,"%s/trade_logs",output_folder);
+    if(ensure_directory_exists(folder)!=0){
+      printf("Error in creating directory: %s\n",folder);
+      free(recovered);
+      *count=0;
+      return -1;
+    }
+    qsort(recovered,*count,sizeof(RecoveredTrade),compare_symbol_offset);
+    for(size_t j=0;j<*count;j=first){
+      for(first=j+1;first<*count &&
+          recovered[first].trade.s_index==recovered[j].trade.s_index;
+          first++);
+      repair_trade_log(output_folder,&recovered[j],first-j);
+    }
+  }
+  // Also drops a torn tail, that the new records would follow
+  if(rewrite_journal(path,old_path,recovered,*count)!=0){
+    printf("Error in rewriting journal %s\n",path);
+    free(recovered);
+    *count=0;
+    return -1;
+  }
+
+  if(*count>0){
+    *trades=(Trade*)malloc(*count*sizeof(Trade));
+    if(*trades==NULL){
+      free(recovered);
+      *count=0;
+      return -1;
+    }
+    for(size_t j=0;j<*count;j++)
+      (*trades)[j]=recovered[j].trade;
+    qsort(*trades,*count,sizeof(Trade),compare_time);
+  }
+  free(recovered);
+  return 0;
+}
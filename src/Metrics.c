@@ -0,0 +1,193 @@
+#include "Metrics.h"
+#include <inttypes.h>
+#include <string.h>
+
+// Bucket of a value: exact below 2*SUB_BUCKETS, log-linear above
+static int bucket_index(uint64_t value){
+  int magnitude,shift;
+  if(value<2*HISTOGRAM_SUB_BUCKETS)
+    return (int)value;
+  magnitude=63-__builtin_clzll(value);
+  if(magnitude>HISTOGRAM_MAX_MAGNITUDE)
+    return HISTOGRAM_BUCKETS-1;
+  shift=magnitude-HISTOGRAM_SUB_BUCKET_BITS;
+  return shift*HISTOGRAM_SUB_BUCKETS+(int)(value>>shift);
+}
+
+uint64_t histogram_bucket_lower_bound(int index){
+  int shift;
+  if(index<2*HISTOGRAM_SUB_BUCKETS)
+    return index;
+  shift=index/HISTOGRAM_SUB_BUCKETS-1;
+  return (uint64_t)(index%HISTOGRAM_SUB_BUCKETS+HISTOGRAM_SUB_BUCKETS)<<shift;
+}
+
+
+void histogram_init(LatencyHistogram *histogram){
+  memset(histogram,0,sizeof(LatencyHistogram));
+  histogram->min=UINT64_MAX;
+  return;
+}
+
+void histogram_record(LatencyHistogram *histogram,double value_us){
+  uint64_t value=value_us>0?(uint64_t)value_us:0;
+  histogram->counts[bucket_index(value)]++;
+  histogram->total++;
+  histogram->sum+=value;
+  if(value<histogram->min)
+    histogram->min=value;
+  if(value>histogram->max)
+    histogram->max=value;
+  return;
+}
+
+void histogram_merge(LatencyHistogram *into,const LatencyHistogram *from){
+  for(int i=0;i<HISTOGRAM_BUCKETS;i++)
+    into->counts[i]+=from->counts[i];
+  into->total+=from->total;
+  into->sum+=from->sum;
+  if(from->min<into->min)
+    into->min=from->min;
+  if(from->max>into->max)
+    into->max=from->max;
+  return;
+}
+
+double histogram_percentile(const LatencyHistogram *histogram,
+                            double percentile){
+  uint64_t rank,seen=0;
+  uint64_t lower,upper;
+  if(histogram->total==0)
+    return 0;
+  // Rank of the sample, 1-based
+  rank=(uint64_t)(percentile/100*histogram->total+0.5);
+  if(rank<1)
+    rank=1;
+  for(int i=0;i<HISTOGRAM_BUCKETS;i++){
+    seen+=histogram->counts[i];
+    if(seen>=rank){
+      // Middle of the bucket, clamped to the exact extremes
+      lower=histogram_bucket_lower_bound(i);
+      upper=i+1<HISTOGRAM_BUCKETS?histogram_bucket_lower_bound(i+1):lower+1;
+      lower=(lower+upper-1)/2;
+      if(lower>histogram->max)
+        return histogram->max;
+      if(lower<histogram->min)
+        return histogram->min;
+      return lower;
+    }
+  }
+  return histogram->max;
+}
+
+void histogram_print(FILE *file,const char *name,
+                     const LatencyHistogram *histogram){
+  if(histogram->total==0){
+    fprintf(file,"%s: no samples\n",name);
+    return;
+  }
+  fprintf(file,"%s: %" PRIu64 " samples, mean %.1f us, p50 %.0f us, "
+          "p90 %.0f us, p99 %.0f us, p99.9 %.0f us, max %" PRIu64 " us\n",
+          name,histogram->total,histogram->sum/histogram->total,
+          histogram_percentile(histogram,50),
+          histogram_percentile(histogram,90),
+          histogram_percentile(histogram,99),
+          histogram_percentile(histogram,99.9),histogram->max);
+  return;
+}
+
+
+void stage_latencies_init(StageLatencies *latencies){
+  histogram_init(&latencies->dequeue);
+  histogram_init(&latencies->write);
+  histogram_init(&latencies->calculate);
+  histogram_init(&latencies->minute);
+  return;
+}
+
+void stage_latencies_merge(StageLatencies *into,const StageLatencies *from){
+  histogram_merge(&into->dequeue,&from->dequeue);
+  histogram_merge(&into->write,&from->write);
+  histogram_merge(&into->calculate,&from->calculate);
+  histogram_merge(&into->minute,&from->minute);
+  return;
+}
+
+void inflate_metrics_init(InflateMetrics *metrics){
+  metrics->compressed_messages=0;
+  metrics->compressed_bytes=0;
+  metrics->inflated_bytes=0;
+  metrics->plain_bytes=0;
+  histogram_init(&metrics->inflate_times);
+  return;
+}
+
+void inflate_metrics_merge(InflateMetrics *into,const InflateMetrics *from){
+  into->compressed_messages+=from->compressed_messages;
+  into->compressed_bytes+=from->compressed_bytes;
+  into->inflated_bytes+=from->inflated_bytes;
+  into->plain_bytes+=from->plain_bytes;
+  histogram_merge(&into->inflate_times,&from->inflate_times);
+  return;
+}
+
+void connection_metrics_init(ConnectionMetrics *metrics){
+  metrics->connects=0;
+  metrics->failed_attempts=0;
+  metrics->gaps=0;
+  metrics->duplicates=0;
+  metrics->resumed_sessions=0;
+  histogram_init(&metrics->gap_durations);
+  histogram_init(&metrics->handshakes);
+  histogram_init(&metrics->resumed_handshakes);
+  inflate_metrics_init(&metrics->inflate);
+  return;
+}
+
+void connection_metrics_merge(ConnectionMetrics *into,
+                              const ConnectionMetrics *from){
+  into->connects+=from->connects;
+  into->failed_attempts+=from->failed_attempts;
+  into->gaps+=from->gaps;
+  into->duplicates+=from->duplicates;
+  into->resumed_sessions+=from->resumed_sessions;
+  histogram_merge(&into->gap_durations,&from->gap_durations);
+  histogram_merge(&into->handshakes,&from->handshakes);
+  histogram_merge(&into->resumed_handshakes,&from->resumed_handshakes);
+  inflate_metrics_merge(&into->inflate,&from->inflate);
+  return;
+}
+
+void connection_metrics_print(FILE *file,const ConnectionMetrics *metrics){
+  fprintf(file,"Connections: %" PRIu64 " established (%" PRIu64 " resumed "
+          "TLS sessions), %" PRIu64 " failed attempts, %" PRIu64 " gaps, "
+          "%" PRIu64 " duplicates suppressed\n",metrics->connects,
+          metrics->resumed_sessions,metrics->failed_attempts,metrics->gaps,
+          metrics->duplicates);
+  histogram_print(file,"Gap duration",&metrics->gap_durations);
+  histogram_print(file,"Handshake",&metrics->handshakes);
+  histogram_print(file,"Resumed handshake",&metrics->resumed_handshakes);
+  if(metrics->inflate.compressed_messages>0){
+    fprintf(file,"Compression: %" PRIu64 " messages, %" PRIu64 " bytes "
+            "received for %" PRIu64 " inflated (ratio %.2f), %" PRIu64
+            " uncompressed bytes\n",metrics->inflate.compressed_messages,
+            metrics->inflate.compressed_bytes,metrics->inflate.inflated_bytes,
+            (double)metrics->inflate.inflated_bytes/
+            (metrics->inflate.compressed_bytes>0?
+             metrics->inflate.compressed_bytes:1),
+            metrics->inflate.plain_bytes);
+    histogram_print(file,"Inflate time",&metrics->inflate.inflate_times);
+  }
+  else{
+    fprintf(file,"Payload: %" PRIu64 " uncompressed bytes\n",
+            metrics->inflate.plain_bytes);
+  }
+  return;
+}
+
+double microseconds_since(struct timeval event_time){
+  struct timeval current_time;
+  gettimeofday(&current_time,NULL);
+  return (current_time.tv_sec-event_time.tv_sec)*1e6
+        +(current_time.tv_usec-event_time.tv_usec);
+}
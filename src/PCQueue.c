@@ -1,22 +1,171 @@
 #include "PCQueue.h"
+#include <inttypes.h>
 #include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
-PCQueue queue_init(){
-  PCQueue queue;
-  queue.head=queue.tail=0;
-  queue.empty=1;
-  queue.full=0;
-  queue.mut=(pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
-  pthread_mutex_init(queue.mut,NULL);
-  queue.not_full=(pthread_cond_t*)malloc(sizeof(pthread_cond_t));
-  pthread_cond_init(queue.not_full,NULL);
-  queue.not_empty=(pthread_cond_t*)malloc(sizeof(pthread_cond_t));
-  pthread_cond_init(queue.not_full,NULL);
-  queue.producer_lock=(pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
-  pthread_mutex_init(queue.producer_lock,NULL);
-  queue.exit_flag=0;
+// Bytes of a buffer mapping of size bytes
+static size_t huge_mapping_length(size_t size){
+  return (size+HUGE_PAGE_SIZE-1)&~(size_t)(HUGE_PAGE_SIZE-1);
+}
+
+static uint64_t elapsed_ns(struct timespec since,struct timespec now){
+  return (uint64_t)(now.tv_sec-since.tv_sec)*1000000000ULL+
+         now.tv_nsec-since.tv_nsec;
+}
+
+void work_item_from_trade(WorkItem *item,const Trade *trade,
+                          struct timeval arrival_time){
+  if(tick_scales!=NULL){
+    const TickScale *scale=&tick_scales[trade->s_index];
+    item->p_ticks=fixed_from_double(trade->p,scale->price_decimals);
+    item->v_ticks=fixed_from_double(trade->v,scale->volume_decimals);
+  }
+  else{
+    item->p=trade->p;
+    item->v=trade->v;
+  }
+  item->t=trade->t;
+  item->arrival_stamp=arrival_stamp(arrival_time);
+  item->s_index=trade->s_index;
+  item->type=WORK_ITEM_TRADE;
+  return;
+}
+
+void work_item_to_trade(const WorkItem *item,Trade *trade){
+  trade->p=item->p;
+  trade->v=item->v;
+  trade->t=item->t;
+  trade->s_index=item->s_index;
+  return;
+}
+
+void work_item_to_fixed_trade(const WorkItem *item,FixedTrade *trade){
+  trade->p=item->p_ticks;
+  trade->v=item->v_ticks;
+  trade->t=item->t;
+  trade->s_index=item->s_index;
+  return;
+}
 
-  return queue;
+void work_item_directive(WorkItem *item,uint64_t timestamp_minutes,
+                         struct timeval arrival_time){
+  memset(item,0,sizeof(WorkItem));
+  item->t=timestamp_minutes;
+  item->arrival_stamp=arrival_stamp(arrival_time);
+  item->type=WORK_ITEM_CALCULATE_MINUTE;
+  return;
+}
+
+int queue_init(PCQueue *queue,int capacity,bool huge_pages){
+  size_t size;
+  void *buffer=MAP_FAILED;
+  memset(queue,0,sizeof(PCQueue));
+  if(capacity<2 || capacity>QUEUE_MAX_CAPACITY ||
+     (capacity&(capacity-1))!=0){
+    printf("Queue capacity must be a power of 2 up to %d: %d\n",
+           QUEUE_MAX_CAPACITY,capacity);
+    return -1;
+  }
+  size=(size_t)capacity*sizeof(WorkItem);
+  if(huge_pages){
+    buffer=mmap(NULL,huge_mapping_length(size),PROT_READ|PROT_WRITE,
+                MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+    if(buffer==MAP_FAILED)
+      printf("No huge pages for the queue, using the heap\n");
+  }
+  if(buffer!=MAP_FAILED){
+    queue->buffer=(WorkItem*)buffer;
+    queue->huge_pages=true;
+  }
+  else{
+    // aligned_alloc needs a multiple of the alignment
+    size=(size+CACHE_LINE_SIZE-1)&~(size_t)(CACHE_LINE_SIZE-1);
+    queue->buffer=(WorkItem*)aligned_alloc(CACHE_LINE_SIZE,size);
+    if(queue->buffer==NULL){
+      printf("Error in queue allocation\n");
+      return -1;
+    }
+  }
+  queue->capacity=capacity;
+  queue->mask=capacity-1;
+  queue->head=queue->tail=0;
+  queue->empty=1;
+  queue->full=0;
+  queue->count=queue->high_water_mark=0;
+  clock_gettime(CLOCK_MONOTONIC,&queue->created);
+  queue->empty_since=queue->created;
+  queue->mut=(pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(queue->mut,NULL);
+  queue->not_full=(pthread_cond_t*)malloc(sizeof(pthread_cond_t));
+  pthread_cond_init(queue->not_full,NULL);
+  queue->not_empty=(pthread_cond_t*)malloc(sizeof(pthread_cond_t));
+  pthread_cond_init(queue->not_empty,NULL);
+  queue->producer_lock=(pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
+  pthread_mutex_init(queue->producer_lock,NULL);
+  queue->exit_flag=0;
+  queue->policy=OVERFLOW_BLOCK;
+
+  return 0;
+}
+
+int queue_set_overflow_policy(PCQueue *queue,OverflowPolicy policy,
+                              int symbol_count,const char *spill_path){
+  queue->policy=policy;
+  queue->symbol_count=symbol_count;
+  queue->symbol_drops=(uint64_t*)calloc(symbol_count,sizeof(uint64_t));
+  if(queue->symbol_drops==NULL){
+    printf("Error in drop counters allocation\n");
+    return -1;
+  }
+  if(policy==OVERFLOW_SPILL){
+    queue->spill_path=strdup(spill_path);
+    queue->spill_file=fopen(spill_path,"w+b");
+    if(queue->spill_path==NULL || queue->spill_file==NULL){
+      printf("Error in opening spill file %s\n",spill_path);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void queue_print_occupancy(PCQueue *queue,FILE *file,const char *name){
+  struct timespec now;
+  uint64_t lifetime,full_ns,empty_ns;
+  pthread_mutex_lock(queue->mut);
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  lifetime=elapsed_ns(queue->created,now);
+  if(lifetime==0)
+    lifetime=1;
+  // Include the current state
+  full_ns=queue->full_ns+(queue->full?elapsed_ns(queue->full_since,now):0);
+  empty_ns=queue->empty_ns+
+           (queue->empty?elapsed_ns(queue->empty_since,now):0);
+  fprintf(file,"%s: capacity %d%s, high water mark %d (%.1f%%), full "
+          "%.3f s (%.2f%%), empty %.3f s (%.2f%%)\n",name,queue->capacity,
+          queue->huge_pages?" on huge pages":"",queue->high_water_mark,
+          100.0*queue->high_water_mark/queue->capacity,full_ns/1e9,
+          100.0*full_ns/lifetime,empty_ns/1e9,100.0*empty_ns/lifetime);
+  pthread_mutex_unlock(queue->mut);
+  return;
+}
+
+void queue_print_overflow(PCQueue *queue,FILE *file,
+                          const char (*symbols)[SYMBOLS_MAX_LENGTH]){
+  pthread_mutex_lock(queue->mut);
+  fprintf(file,"Queue overflow: %" PRIu64 " trades dropped, %" PRIu64
+          " items spilled\n",queue->dropped,queue->spilled);
+  for(int i=0;i<queue->symbol_count && queue->dropped>0;i++){
+    if(queue->symbol_drops[i]>0)
+      fprintf(file,"  %s: %" PRIu64 " dropped\n",symbols[i],
+              queue->symbol_drops[i]);
+  }
+  pthread_mutex_unlock(queue->mut);
+  return;
 }
 
 void queue_destory(PCQueue *queue){
@@ -28,9 +177,166 @@ void queue_destory(PCQueue *queue){
   free(queue->not_empty);
   pthread_mutex_destroy(queue->producer_lock);
   free(queue->producer_lock);
+  if(queue->huge_pages)
+    munmap(queue->buffer,
+           huge_mapping_length((size_t)queue->capacity*sizeof(WorkItem)));
+  else
+    free(queue->buffer);
+  queue->buffer=NULL;
+  free(queue->symbol_drops);
+  if(queue->spill_file!=NULL){
+    fclose(queue->spill_file);
+    // Keep what wasn't read back, for inspection
+    if(queue->spill_read==queue->spill_write)
+      unlink(queue->spill_path);
+  }
+  free(queue->spill_path);
   return;
 }
 
+// Minute directives must never be dropped
+static bool is_directive(const WorkItem *item){
+  return item->type==WORK_ITEM_CALCULATE_MINUTE;
+}
+
+// Adds an item to the buffer, which isn't full (lock held)
+static void push_locked(PCQueue *queue,const WorkItem *item){
+  struct timespec now;
+  queue->buffer[queue->tail]=*item;
+  queue->tail=(queue->tail+1)&queue->mask;
+  if(++queue->count>queue->high_water_mark)
+    queue->high_water_mark=queue->count;
+  // Time the full/empty states, only on transitions
+  if(queue->empty || queue->tail==queue->head){
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    if(queue->empty)
+      queue->empty_ns+=elapsed_ns(queue->empty_since,now);
+    // Assert full signal if needed
+    if(queue->tail==queue->head){
+      queue->full=1;
+      queue->full_since=now;
+    }
+  }
+  queue->empty=0;
+  return;
+}
+
+// Removes the oldest item from the buffer, which isn't empty (lock held)
+static void pop_locked(PCQueue *queue,WorkItem *item){
+  struct timespec now;
+  *item=queue->buffer[queue->head];
+  queue->head=(queue->head+1)&queue->mask;
+  queue->count--;
+  if(queue->full || queue->tail==queue->head){
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    if(queue->full)
+      queue->full_ns+=elapsed_ns(queue->full_since,now);
+    // Assert empty signal if needed
+    if(queue->tail==queue->head){
+      queue->empty=1;
+      queue->empty_since=now;
+    }
+  }
+  queue->full=0;
+  return;
+}
+
+// Counts a dropped trade (lock held)
+static void count_drop(PCQueue *queue,const WorkItem *item){
+  queue->dropped++;
+  if(item->s_index<(uint32_t)queue->symbol_count)
+    queue->symbol_drops[item->s_index]++;
+  return;
+}
+
+// Appends an item to the spill file (lock held)
+static int spill_locked(PCQueue *queue,const WorkItem *item){
+  if(fwrite(item,sizeof(WorkItem),1,queue->spill_file)!=1)
+    return -1;
+  queue->spill_write++;
+  queue->spilled++;
+  return 0;
+}
+
+// Reads spilled items back while there's room (lock held). Once all are
+// read, the file is emptied.
+static void refill_locked(PCQueue *queue){
+  WorkItem chunk[SPILL_REFILL_CHUNK];
+  uint64_t pending;
+  ssize_t bytes;
+  int wanted,got;
+  if(queue->spill_read==queue->spill_write)
+    return;
+  fflush(queue->spill_file);
+  while(queue->spill_read<queue->spill_write && !queue->full){
+    pending=queue->spill_write-queue->spill_read;
+    wanted=queue->capacity-queue->count;
+    if(wanted>SPILL_REFILL_CHUNK)
+      wanted=SPILL_REFILL_CHUNK;
+    if((uint64_t)wanted>pending)
+      wanted=(int)pending;
+    bytes=pread(fileno(queue->spill_file),chunk,wanted*sizeof(WorkItem),
+                queue->spill_read*sizeof(WorkItem));
+    if(bytes<(ssize_t)sizeof(WorkItem)){
+      // Unreadable spill: count its trades as dropped and start over
+      printf("Error in reading back spilled items\n");
+      queue->dropped+=pending;
+      queue->spill_read=queue->spill_write;
+      break;
+    }
+    got=bytes/sizeof(WorkItem);
+    for(int i=0;i<got;i++)
+      push_locked(queue,&chunk[i]);
+    queue->spill_read+=got;
+  }
+  if(queue->spill_read==queue->spill_write){
+    queue->spill_read=queue->spill_write=0;
+    rewind(queue->spill_file);
+    if(ftruncate(fileno(queue->spill_file),0)!=0)
+      printf("Error in truncating the spill file\n");
+  }
+  return;
+}
+
+// Adds an item, applying the overflow policy if the queue is full (lock
+// held). Returns 1 if the producer must wait for space, else 0.
+static int add_locked(PCQueue *queue,const WorkItem *item){
+  // Spilled items go first, so later items follow them
+  if(queue->spill_read<queue->spill_write){
+    if(spill_locked(queue,item)==0)
+      return 0;
+  }
+  else if(!queue->full){
+    push_locked(queue,item);
+    return 0;
+  }
+  switch(queue->policy){
+  case OVERFLOW_SPILL:
+    if(queue->spill_read==queue->spill_write &&
+       spill_locked(queue,item)==0)
+      return 0;
+    break;
+  case OVERFLOW_DROP_OLDEST:
+    // The oldest is replaced, unless it's a directive. The queue stays
+    // full, head and tail move together.
+    if(!is_directive(&queue->buffer[queue->head])){
+      count_drop(queue,&queue->buffer[queue->head]);
+      queue->buffer[queue->tail]=*item;
+      queue->head=(queue->head+1)&queue->mask;
+      queue->tail=queue->head;
+      return 0;
+    }
+    break;
+  default:
+    break;
+  }
+  // Block, or drop the new trade
+  if(queue->policy==OVERFLOW_BLOCK || is_directive(item))
+    return 1;
+  count_drop(queue,item);
+  return 0;
+}
+
 int queue_add(PCQueue *queue, WorkItem *item){
   // Get queue access
   pthread_mutex_lock(queue->mut);
@@ -39,28 +345,49 @@ int queue_add(PCQueue *queue, WorkItem *item){
     pthread_mutex_unlock(queue->mut);
     return -1;
   }
-  // Wait until there is availability
-  while(queue->full){
+  // Add item, waiting until there is availability if needed
+  while(add_locked(queue,item)){
     pthread_cond_wait(queue->not_full,queue->mut);
   }
-  // Add item
-  queue->buffer[queue->tail]=*item;
-  queue->tail=(queue->tail+1)%QUEUE_SIZE;
-  // Assert full signal if needed
-  if(queue->tail==queue->head)
-    queue->full=1;
-  queue->empty=0;
   // Give queue access back 
   pthread_mutex_unlock(queue->mut);
   pthread_cond_signal(queue->not_empty);
   return 0;
 }
 
+int queue_add_batch(PCQueue *queue, WorkItem *items, int count){
+  int added=0;
+  // Get queue access
+  pthread_mutex_lock(queue->mut);
+  while(added<count){
+    // If exit order was given skip all inserts.
+    if(queue->exit_flag==1){
+      pthread_mutex_unlock(queue->mut);
+      return -1;
+    }
+    // Add as many items as fit (or overflow)
+    while(added<count && add_locked(queue,&items[added])==0)
+      added++;
+    // Multiple items may wake up multiple consumers
+    pthread_cond_broadcast(queue->not_empty);
+    // Wait until there is availability
+    if(added<count)
+      pthread_cond_wait(queue->not_full,queue->mut);
+  }
+  // Give queue access back 
+  pthread_mutex_unlock(queue->mut);
+  return 0;
+}
+
 int queue_remove(PCQueue *queue, WorkItem *item){
   // Get queue access 
   pthread_mutex_lock(queue->mut);
   // Wait until there is availability
   while(queue->empty){
+    // Read back spilled items before waiting or exiting
+    refill_locked(queue);
+    if(!queue->empty)
+      break;
     // If given order to exit, consume nothing
     if(queue->exit_flag==1){
       // Found empty queue and exit flag indicator so give queue access back
@@ -73,13 +400,10 @@ int queue_remove(PCQueue *queue, WorkItem *item){
     pthread_cond_wait(queue->not_empty,queue->mut);
   }
   // Remove item
-  *item=queue->buffer[queue->head];
-  queue->head=(queue->head+1)%QUEUE_SIZE;
-  // Assert empty signal if needed
-  if(queue->tail==queue->head){
-    queue->empty=1;
-  }
-  queue->full=0;
+  pop_locked(queue,item);
+  // Pressure subsided, read back spilled items
+  if(queue->count<=queue->capacity/2)
+    refill_locked(queue);
   // Give queue access back 
   pthread_mutex_unlock(queue->mut);
   pthread_cond_signal(queue->not_full);
@@ -0,0 +1,306 @@
+#include "Pipeline.h"
+#include "Checkpoint.h"
+#include "SystemHandling.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+// Opens the csv batch of folder_path/name
+static int open_output_batch(const char *folder_path,const char *name,
+                             int symbol_count,FILE **files){
+  char path[FILEPATH_BUFFER_LENGTH];
+  snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/%s",folder_path,name);
+  if(open_csv_batch(path,symbol_count,files)!=0){
+    printf("Error in opening csv batch\n");
+    return -1;
+  }
+  return 0;
+}
+
+
+int pipeline_open(Pipeline *pipeline,PCQueue *api_queue,int symbol_count,
+                  int writers_count,const char *output_folder){
+  char path[FILEPATH_BUFFER_LENGTH];
+  memset(pipeline,0,sizeof(Pipeline));
+  pipeline->api_queue=api_queue;
+  pipeline->symbol_count=symbol_count;
+  pipeline->writers_count=writers_count;
+  pipeline->output_folder=output_folder;
+
+  // Allocate everything first, so failures leave nothing open
+  pipeline->transaction_files=(FILE**)malloc(symbol_count*sizeof(FILE*));
+  pipeline->candlestick_files=(FILE**)malloc(symbol_count*sizeof(FILE*));
+  pipeline->avg_files=(FILE**)malloc(symbol_count*sizeof(FILE*));
+  pipeline->delay_writer_logs=(FILE**)malloc(writers_count*sizeof(FILE*));
+  pipeline->writing_mutexes=(pthread_mutex_t*)
+                            malloc(symbol_count*sizeof(pthread_mutex_t));
+  pipeline->calculator_buffers=(CalculatorBuffer*)
+                               malloc(symbol_count*sizeof(CalculatorBuffer));
+  if(tick_scales!=NULL){
+    pipeline->fixed_calculator_buffers=(FixedCalculatorBuffer*)
+      malloc(symbol_count*sizeof(FixedCalculatorBuffer));
+    if(pipeline->fixed_calculator_buffers==NULL){
+      printf("Error in pipeline allocation\n");
+      return -1;
+    }
+  }
+  pipeline->latencies=(StageLatencies*)
+                      malloc((writers_count+1)*sizeof(StageLatencies));
+  pipeline->writers=(pthread_t*)malloc(writers_count*sizeof(pthread_t));
+  pipeline->writer_args=(WriterArgs*)malloc(writers_count*sizeof(WriterArgs));
+  if(pipeline->transaction_files==NULL || pipeline->candlestick_files==NULL ||
+     pipeline->avg_files==NULL || pipeline->delay_writer_logs==NULL ||
+     pipeline->writing_mutexes==NULL || pipeline->calculator_buffers==NULL ||
+     pipeline->latencies==NULL || pipeline->writers==NULL ||
+     pipeline->writer_args==NULL){
+    printf("Error in pipeline allocation\n");
+    return -1;
+  }
+
+  // Create file systems
+  if(ensure_directory_exists(output_folder)!=0){
+    printf("Error in creating directory: %s\n",output_folder);
+    return -1;
+  }
+  snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/delays",output_folder);
+  if(open_delay_files(path,writers_count,pipeline->delay_writer_logs,
+                      &pipeline->delay_calculator_log)!=0){
+    printf("Error in delay file creation.\n");
+    return -1;
+  }
+  if(open_output_batch(output_folder,"trade_logs",symbol_count,
+                       pipeline->transaction_files)!=0 ||
+     open_output_batch(output_folder,"candlesticks",symbol_count,
+                       pipeline->candlestick_files)!=0 ||
+     open_output_batch(output_folder,"moving_avg",symbol_count,
+                       pipeline->avg_files)!=0){
+    return -1;
+  }
+  // Create file mutexes for correct file access
+  for(int i=0;i<symbol_count;i++){
+    pthread_mutex_init(&pipeline->writing_mutexes[i],NULL);
+  }
+  for(int i=0;i<=writers_count;i++){
+    stage_latencies_init(&pipeline->latencies[i]);
+  }
+  // Sized like the api queue
+  if(queue_init(&pipeline->calculation_queue,api_queue->capacity,
+                api_queue->huge_pages)!=0)
+    return -1;
+
+  // Prepare Writers
+  for(int i=0;i<writers_count;i++){
+    pipeline->writer_args[i].api_queue=api_queue;
+    pipeline->writer_args[i].transaction_files=pipeline->transaction_files;
+    pipeline->writer_args[i].symbol_count=symbol_count;
+    pipeline->writer_args[i].transaction_file_mutexes=
+      pipeline->writing_mutexes;
+    pipeline->writer_args[i].transaction_file_lengths=NULL;
+    pipeline->writer_args[i].calculation_queue=&pipeline->calculation_queue;
+    pipeline->writer_args[i].delay_log_file=pipeline->delay_writer_logs[i];
+    pipeline->writer_args[i].latencies=&pipeline->latencies[i];
+    pipeline->writer_args[i].journal=NULL;
+    pipeline->writer_args[i].publisher=NULL;
+  }
+  // Prepare Calculator
+  pipeline->calculator_args.calculation_queue=&pipeline->calculation_queue;
+  pipeline->calculator_args.symbol_count=symbol_count;
+  pipeline->calculator_args.candlestick_files=pipeline->candlestick_files;
+  pipeline->calculator_args.avg_files=pipeline->avg_files;
+  pipeline->calculator_args.calc_buffers=pipeline->calculator_buffers;
+  pipeline->calculator_args.fixed_calc_buffers=
+    pipeline->fixed_calculator_buffers;
+  pipeline->calculator_args.checkpoint_path=NULL;
+  pipeline->calculator_args.journal=NULL;
+  pipeline->calculator_args.bars=NULL;
+  pipeline->calculator_args.column_store=NULL;
+  pipeline->calculator_args.history=NULL;
+  pipeline->calculator_args.shared_state=NULL;
+  pipeline->calculator_args.publisher=NULL;
+  if(pipeline->fixed_calculator_buffers!=NULL)
+    init_fixed_calculator_buffers(pipeline->fixed_calculator_buffers,
+                                  symbol_count);
+  else
+    init_calculator_buffers(pipeline->calculator_buffers,symbol_count);
+  pipeline->calculator_args.delay_log_file=pipeline->delay_calculator_log;
+  pipeline->calculator_args.latencies=&pipeline->latencies[writers_count];
+  return 0;
+}
+
+
+int pipeline_enable_checkpoints(Pipeline *pipeline,const char *path,
+                                uint64_t current_minute,
+                                uint64_t *next_minute){
+  pipeline->calculator_args.checkpoint_path=path;
+  // Only one of the buffer arrays is used
+  CalculatorBuffer *buffers=pipeline->fixed_calculator_buffers!=NULL?NULL:
+    pipeline->calculator_buffers;
+  if(checkpoint_load(path,current_minute,pipeline->symbol_count,buffers,
+                     pipeline->fixed_calculator_buffers,next_minute)==1)
+    return 1;
+  return checkpoint_rebuild(pipeline->output_folder,current_minute,
+                            pipeline->symbol_count,buffers,
+                            pipeline->fixed_calculator_buffers,next_minute);
+}
+
+
+int pipeline_enable_journal(Pipeline *pipeline,Journal *journal,
+                            const char *path,int sync_interval_ms){
+  struct stat info;
+  // Records hold where their lines start, so the logs' lengths are tracked
+  pipeline->trade_log_lengths=(uint64_t*)malloc(pipeline->symbol_count*
+                                                sizeof(uint64_t));
+  if(pipeline->trade_log_lengths==NULL){
+    printf("Error in pipeline allocation\n");
+    return -1;
+  }
+  for(int i=0;i<pipeline->symbol_count;i++){
+    if(fstat(fileno(pipeline->transaction_files[i]),&info)!=0){
+      printf("Error in reading the trade log of %s\n",symbols_list[i]);
+      return -1;
+    }
+    pipeline->trade_log_lengths[i]=info.st_size;
+  }
+  if(journal_open(journal,path,sync_interval_ms,pipeline->transaction_files,
+                  pipeline->writing_mutexes,pipeline->symbol_count)!=0)
+    return -1;
+  for(int i=0;i<pipeline->writers_count;i++){
+    pipeline->writer_args[i].transaction_file_lengths=
+      pipeline->trade_log_lengths;
+    pipeline->writer_args[i].journal=journal;
+  }
+  if(pipeline->calculator_args.checkpoint_path!=NULL)
+    pipeline->calculator_args.journal=journal;
+  return 0;
+}
+
+
+// The calculator fills the bars array once any stage needs it
+static int keep_bars(Pipeline *pipeline){
+  if(pipeline->bars==NULL){
+    pipeline->bars=(MinuteBar*)malloc(pipeline->symbol_count*
+                                      sizeof(MinuteBar));
+    if(pipeline->bars==NULL){
+      printf("Error in pipeline allocation\n");
+      return -1;
+    }
+    pipeline->calculator_args.bars=pipeline->bars;
+  }
+  return 0;
+}
+
+int pipeline_enable_column_store(Pipeline *pipeline){
+  if(keep_bars(pipeline)!=0 ||
+     column_store_open(&pipeline->column_store,pipeline->output_folder,
+                       pipeline->symbol_count)!=0)
+    return -1;
+  pipeline->calculator_args.column_store=&pipeline->column_store;
+  return 0;
+}
+
+int pipeline_enable_history(Pipeline *pipeline,RecentHistory *history){
+  if(keep_bars(pipeline)!=0)
+    return -1;
+  pipeline->calculator_args.history=history;
+  return 0;
+}
+
+int pipeline_enable_shared_state(Pipeline *pipeline,SharedState *state){
+  if(keep_bars(pipeline)!=0)
+    return -1;
+  pipeline->calculator_args.shared_state=state;
+  return 0;
+}
+
+int pipeline_enable_publisher(Pipeline *pipeline,Publisher *publisher){
+  if(keep_bars(pipeline)!=0)
+    return -1;
+  for(int i=0;i<pipeline->writers_count;i++)
+    pipeline->writer_args[i].publisher=publisher;
+  pipeline->calculator_args.publisher=publisher;
+  return 0;
+}
+
+
+uint64_t pipeline_replay(Pipeline *pipeline,const Trade *trades,size_t count,
+                         uint64_t from_minute,uint64_t current_minute){
+  struct timeval now;
+  WorkItem item;
+  uint64_t minute=from_minute,trade_minute;
+  size_t replayed=0;
+  gettimeofday(&now,NULL);
+  for(size_t i=0;i<count;i++){
+    trade_minute=trades[i].t/60000;
+    if(trade_minute<from_minute || trade_minute>current_minute)
+      continue;
+    // Close the minutes before the trade's, as the live directives would
+    while(minute<trade_minute){
+      work_item_directive(&item,minute,now);
+      queue_add(&pipeline->calculation_queue,&item);
+      minute++;
+    }
+    work_item_from_trade(&item,&trades[i],now);
+    queue_add(&pipeline->calculation_queue,&item);
+    replayed++;
+  }
+  if(replayed>0)
+    printf("Replayed %zu journaled trades into the calculator\n",replayed);
+  return minute;
+}
+
+
+void pipeline_start(Pipeline *pipeline){
+  for(int i=0;i<pipeline->writers_count;i++)
+    pthread_create(&pipeline->writers[i],NULL,Writer,
+                   (void*)&pipeline->writer_args[i]);
+  pthread_create(&pipeline->calculator,NULL,Calculator,
+                 (void*)&pipeline->calculator_args);
+  return;
+}
+
+
+void pipeline_join(Pipeline *pipeline){
+  for(int i=0;i<pipeline->writers_count;i++)
+    pthread_join(pipeline->writers[i],NULL);
+  pthread_join(pipeline->calculator,NULL);
+  return;
+}
+
+
+void pipeline_latencies(const Pipeline *pipeline,StageLatencies *total){
+  stage_latencies_init(total);
+  for(int i=0;i<=pipeline->writers_count;i++)
+    stage_latencies_merge(total,&pipeline->latencies[i]);
+  return;
+}
+
+
+void pipeline_close(Pipeline *pipeline){
+  // Close files
+  close_csv_batch(pipeline->transaction_files,pipeline->symbol_count);
+  close_csv_batch(pipeline->candlestick_files,pipeline->symbol_count);
+  close_csv_batch(pipeline->avg_files,pipeline->symbol_count);
+  close_delay_files(pipeline->delay_writer_logs,
+                    &pipeline->delay_calculator_log,pipeline->writers_count);
+  // Destroy mutexes
+  for(int i=0;i<pipeline->symbol_count;i++){
+    pthread_mutex_destroy(&pipeline->writing_mutexes[i]);
+  }
+  if(pipeline->calculator_args.column_store!=NULL)
+    column_store_close(pipeline->calculator_args.column_store);
+  queue_destory(&pipeline->calculation_queue);
+  free(pipeline->transaction_files);
+  free(pipeline->candlestick_files);
+  free(pipeline->avg_files);
+  free(pipeline->delay_writer_logs);
+  free(pipeline->writing_mutexes);
+  free(pipeline->trade_log_lengths);
+  free(pipeline->calculator_buffers);
+  free(pipeline->fixed_calculator_buffers);
+  free(pipeline->bars);
+  free(pipeline->latencies);
+  free(pipeline->writers);
+  free(pipeline->writer_args);
+  return;
+}
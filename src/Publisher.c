@@ -0,0 +1,346 @@
+#include "Publisher.h"
+#include "SystemHandling.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Longest line of a message
+#define PUBLISHER_LINE_LENGTH 512
+// Lines of closed minutes are published in batches of up to this many bytes
+#define PUBLISHER_BATCH_LENGTH 8192
+// Period of the slow consumer check while some subscriber has a backlog
+#define PUBLISHER_CHECK_MS 100
+
+
+// Appends whole lines to the ring, waking the thread if it waits
+static void publish(Publisher *publisher,const char *lines,size_t length,
+                    int line_count){
+  size_t offset,first;
+  bool wake;
+  pthread_mutex_lock(&publisher->mutex);
+  offset=publisher->head%PUBLISHER_RING_LENGTH;
+  first=length<PUBLISHER_RING_LENGTH-offset?length:
+                                            PUBLISHER_RING_LENGTH-offset;
+  memcpy(publisher->ring+offset,lines,first);
+  memcpy(publisher->ring,lines+first,length-first);
+  publisher->head+=length;
+  publisher->messages+=line_count;
+  wake=publisher->waiting;
+  publisher->waiting=false;
+  pthread_mutex_unlock(&publisher->mutex);
+  if(wake && write(publisher->wake_fds[1],"",1)!=1)
+    printf("Error in waking the publisher\n");
+  return;
+}
+
+
+void publisher_trade(Publisher *publisher,const Trade *trade){
+  char line[PUBLISHER_LINE_LENGTH];
+  int length;
+  // No subscriber, nothing to format
+  if(atomic_load_explicit(&publisher->subscriber_count,
+                          memory_order_relaxed)==0)
+    return;
+  length=snprintf(line,PUBLISHER_LINE_LENGTH,"T,%s,%" PRIu64 ",%f,%f\n",
+                  symbols_list[trade->s_index],trade->t,trade->p,trade->v);
+  if(length>0 && length<PUBLISHER_LINE_LENGTH)
+    publish(publisher,line,length,1);
+  return;
+}
+
+
+void publisher_fixed_trade(Publisher *publisher,const FixedTrade *trade){
+  char line[PUBLISHER_LINE_LENGTH];
+  char price[FIXED_FORMAT_LENGTH],volume[FIXED_FORMAT_LENGTH];
+  const TickScale *scale=&tick_scales[trade->s_index];
+  int length;
+  if(atomic_load_explicit(&publisher->subscriber_count,
+                          memory_order_relaxed)==0)
+    return;
+  fixed_format(price,trade->p,scale->price_decimals);
+  fixed_format(volume,trade->v,scale->volume_decimals);
+  length=snprintf(line,PUBLISHER_LINE_LENGTH,"T,%s,%" PRIu64 ",%s,%s\n",
+                  symbols_list[trade->s_index],trade->t,price,volume);
+  if(length>0 && length<PUBLISHER_LINE_LENGTH)
+    publish(publisher,line,length,1);
+  return;
+}
+
+
+void publisher_minute(Publisher *publisher,const MinuteBar *bars,
+                      int symbol_count){
+  char batch[PUBLISHER_BATCH_LENGTH];
+  size_t length=0;
+  int line,line_count=0;
+  if(atomic_load_explicit(&publisher->subscriber_count,
+                          memory_order_relaxed)==0)
+    return;
+  for(int i=0;i<symbol_count;i++){
+    // No candlestick before the symbol's first trade
+    if(bars[i].open<=CANDLESTICK_IS_EMPTY)
+      continue;
+    if(PUBLISHER_BATCH_LENGTH-length<PUBLISHER_LINE_LENGTH){
+      publish(publisher,batch,length,line_count);
+      length=0;
+      line_count=0;
+    }
+    line=snprintf(batch+length,PUBLISHER_LINE_LENGTH,
+                  "C,%s,%" PRIu64 ",%f,%f,%f,%f,%f,%f,%f\n",symbols_list[i],
+                  bars[i].t,bars[i].open,bars[i].high,bars[i].low,
+                  bars[i].close,bars[i].volume,bars[i].vwap,
+                  bars[i].vwap_volume);
+    if(line>0 && line<PUBLISHER_LINE_LENGTH){
+      length+=line;
+      line_count++;
+    }
+  }
+  if(length>0)
+    publish(publisher,batch,length,line_count);
+  return;
+}
+
+
+static void drop_subscriber(Publisher *publisher,Subscriber *subscriber){
+  close(subscriber->fd);
+  subscriber->fd=-1;
+  free(subscriber->chunk);
+  subscriber->chunk=NULL;
+  atomic_fetch_sub_explicit(&publisher->subscriber_count,1,
+                            memory_order_relaxed);
+  return;
+}
+
+static void accept_subscriber(Publisher *publisher){
+  Subscriber *subscriber;
+  int fd=accept(publisher->listen_fd,NULL,NULL);
+  if(fd<0)
+    return;
+  for(int i=0;i<PUBLISHER_MAX_SUBSCRIBERS;i++){
+    subscriber=&publisher->subscribers[i];
+    if(subscriber->fd>=0)
+      continue;
+    subscriber->chunk=(char*)malloc(PUBLISHER_CHUNK_LENGTH);
+    if(subscriber->chunk==NULL)
+      break;
+    subscriber->fd=fd;
+    subscriber->chunk_length=0;
+    subscriber->chunk_sent=0;
+    // It gets the lines published from now on
+    pthread_mutex_lock(&publisher->mutex);
+    subscriber->cursor=publisher->head;
+    pthread_mutex_unlock(&publisher->mutex);
+    atomic_fetch_add_explicit(&publisher->subscriber_count,1,
+                              memory_order_relaxed);
+    publisher->subscriptions++;
+    return;
+  }
+  close(fd);
+  return;
+}
+
+// Whether a subscriber has bytes left to send, given the ring's head
+static bool has_backlog(const Subscriber *subscriber,uint64_t head){
+  return subscriber->chunk_sent<subscriber->chunk_length ||
+         subscriber->cursor<head;
+}
+
+// Sends what the socket takes of a subscriber's chunk, copying the next
+// one first if it was all sent
+static void send_chunk(Publisher *publisher,Subscriber *subscriber){
+  size_t offset,length=0,first;
+  uint64_t backlog;
+  ssize_t sent;
+  bool overwritten=false;
+  // Copy the next chunk under the lock, so producers can't overwrite it
+  if(subscriber->chunk_sent==subscriber->chunk_length){
+    pthread_mutex_lock(&publisher->mutex);
+    backlog=publisher->head-subscriber->cursor;
+    if(backlog>PUBLISHER_RING_LENGTH){
+      overwritten=true;
+    }
+    else{
+      length=backlog<PUBLISHER_CHUNK_LENGTH?backlog:PUBLISHER_CHUNK_LENGTH;
+      offset=subscriber->cursor%PUBLISHER_RING_LENGTH;
+      first=length<PUBLISHER_RING_LENGTH-offset?length:
+                                                PUBLISHER_RING_LENGTH-offset;
+      memcpy(subscriber->chunk,publisher->ring+offset,first);
+      memcpy(subscriber->chunk+first,publisher->ring,length-first);
+    }
+    pthread_mutex_unlock(&publisher->mutex);
+    if(overwritten){
+      publisher->slow_disconnects++;
+      drop_subscriber(publisher,subscriber);
+      return;
+    }
+    subscriber->cursor+=length;
+    subscriber->chunk_length=length;
+    subscriber->chunk_sent=0;
+    if(length==0)
+      return;
+  }
+  sent=send(subscriber->fd,subscriber->chunk+subscriber->chunk_sent,
+            subscriber->chunk_length-subscriber->chunk_sent,
+            MSG_DONTWAIT|MSG_NOSIGNAL);
+  if(sent<0 && (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR))
+    return;
+  if(sent<0){
+    drop_subscriber(publisher,subscriber);
+    return;
+  }
+  subscriber->chunk_sent+=sent;
+  return;
+}
+
+// Sends the backlog up to head, until the socket takes no more
+static void send_backlog(Publisher *publisher,Subscriber *subscriber,
+                         uint64_t head){
+  uint64_t cursor;
+  size_t chunk_sent;
+  while(subscriber->fd>=0 && has_backlog(subscriber,head)){
+    cursor=subscriber->cursor;
+    chunk_sent=subscriber->chunk_sent;
+    send_chunk(publisher,subscriber);
+    if(subscriber->cursor==cursor && subscriber->chunk_sent==chunk_sent)
+      return;
+  }
+  return;
+}
+
+// Sends the backlogs the sockets take without waiting, before exiting
+static void flush_backlogs(Publisher *publisher,uint64_t head){
+  for(int i=0;i<PUBLISHER_MAX_SUBSCRIBERS;i++){
+    if(publisher->subscribers[i].fd>=0)
+      send_backlog(publisher,&publisher->subscribers[i],head);
+  }
+  return;
+}
+
+static void* publisher_routine(void *arg){
+  Publisher *publisher=(Publisher*)arg;
+  struct pollfd fds[PUBLISHER_MAX_SUBSCRIBERS+2];
+  Subscriber *polled[PUBLISHER_MAX_SUBSCRIBERS];
+  char drain[64];
+  Subscriber *subscriber;
+  uint64_t head;
+  int count;
+  bool caught_up,pending;
+  while(true){
+    pthread_mutex_lock(&publisher->mutex);
+    if(publisher->closing){
+      head=publisher->head;
+      pthread_mutex_unlock(&publisher->mutex);
+      flush_backlogs(publisher,head);
+      break;
+    }
+    head=publisher->head;
+    caught_up=false;
+    pending=false;
+    for(int i=0;i<PUBLISHER_MAX_SUBSCRIBERS;i++){
+      subscriber=&publisher->subscribers[i];
+      if(subscriber->fd<0)
+        continue;
+      // Its unsent lines were overwritten, even if its socket is full
+      if(head-subscriber->cursor>PUBLISHER_RING_LENGTH){
+        publisher->slow_disconnects++;
+        drop_subscriber(publisher,subscriber);
+        continue;
+      }
+      if(has_backlog(subscriber,head))
+        pending=true;
+      else
+        caught_up=true;
+    }
+    // Producers wake the thread when a subscriber has nothing left to
+    // send (the others wake it once their socket takes more)
+    publisher->waiting=caught_up || !pending;
+    pthread_mutex_unlock(&publisher->mutex);
+
+    fds[0].fd=publisher->wake_fds[0];
+    fds[0].events=POLLIN;
+    fds[1].fd=publisher->listen_fd;
+    fds[1].events=POLLIN;
+    count=0;
+    for(int i=0;i<PUBLISHER_MAX_SUBSCRIBERS;i++){
+      if(publisher->subscribers[i].fd<0)
+        continue;
+      fds[2+count].fd=publisher->subscribers[i].fd;
+      fds[2+count].events=POLLIN;
+      if(has_backlog(&publisher->subscribers[i],head))
+        fds[2+count].events|=POLLOUT;
+      polled[count++]=&publisher->subscribers[i];
+    }
+    if(poll(fds,2+count,pending?PUBLISHER_CHECK_MS:-1)<0){
+      if(errno==EINTR)
+        continue;
+      printf("Error in publisher poll\n");
+      break;
+    }
+    if(fds[0].revents&POLLIN){
+      if(read(publisher->wake_fds[0],drain,sizeof(drain))<0)
+        printf("Error in publisher wake\n");
+    }
+    for(int i=0;i<count;i++){
+      // Subscribers only read: input is discarded, a hang up drops them
+      if(fds[2+i].revents&(POLLIN|POLLHUP|POLLERR)){
+        if(recv(polled[i]->fd,drain,sizeof(drain),MSG_DONTWAIT)<=0){
+          drop_subscriber(publisher,polled[i]);
+          continue;
+        }
+      }
+      if(fds[2+i].revents&POLLOUT)
+        send_backlog(publisher,polled[i],head);
+    }
+    if(fds[1].revents&POLLIN)
+      accept_subscriber(publisher);
+  }
+  return NULL;
+}
+
+
+int publisher_start(Publisher *publisher,const char *path){
+  memset(publisher,0,sizeof(Publisher));
+  for(int i=0;i<PUBLISHER_MAX_SUBSCRIBERS;i++)
+    publisher->subscribers[i].fd=-1;
+  atomic_init(&publisher->subscriber_count,0);
+  snprintf(publisher->path,FILENAME_MAX,"%s",path);
+  if(open_unix_listener(path,PUBLISHER_MAX_SUBSCRIBERS,&publisher->listen_fd,
+                        publisher->wake_fds)!=0){
+    printf("Error in publisher socket creation: %s\n",path);
+    return -1;
+  }
+  publisher->ring=(char*)malloc(PUBLISHER_RING_LENGTH);
+  if(publisher->ring==NULL){
+    printf("Error in publisher allocation\n");
+    close_unix_listener(path,publisher->listen_fd,publisher->wake_fds);
+    return -1;
+  }
+  pthread_mutex_init(&publisher->mutex,NULL);
+  pthread_create(&publisher->thread,NULL,publisher_routine,(void*)publisher);
+  return 0;
+}
+
+
+void publisher_stop(Publisher *publisher){
+  pthread_mutex_lock(&publisher->mutex);
+  publisher->closing=true;
+  pthread_mutex_unlock(&publisher->mutex);
+  if(write(publisher->wake_fds[1],"",1)!=1)
+    printf("Error in waking the publisher\n");
+  pthread_join(publisher->thread,NULL);
+  for(int i=0;i<PUBLISHER_MAX_SUBSCRIBERS;i++){
+    if(publisher->subscribers[i].fd>=0)
+      drop_subscriber(publisher,&publisher->subscribers[i]);
+  }
+  close_unix_listener(publisher->path,publisher->listen_fd,
+                      publisher->wake_fds);
+  pthread_mutex_destroy(&publisher->mutex);
+  free(publisher->ring);
+  printf("Publisher: %" PRIu64 " messages, %" PRIu64 " subscribers, %" PRIu64
+         " dropped as slow\n",publisher->messages,publisher->subscriptions,
+         publisher->slow_disconnects);
+  return;
+}
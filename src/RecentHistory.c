@@ -0,0 +1,286 @@
+#include "RecentHistory.h"
+#include "Symbols.h"
+#include "SystemHandling.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// Bytes of a reply sent at once
+#define HISTORY_REPLY_LENGTH 8192
+// A client that doesn't read its reply for this long is dropped
+#define HISTORY_SEND_TIMEOUT_MS 1000
+
+
+int recent_history_init(RecentHistory *history,int symbol_count,
+                        size_t capacity){
+  memset(history,0,sizeof(RecentHistory));
+  history->symbol_count=symbol_count;
+  history->capacity=capacity;
+  history->rings=(HistoryRing*)aligned_alloc(CACHE_LINE_SIZE,symbol_count*
+                                             sizeof(HistoryRing));
+  history->bars=(MinuteBar*)malloc(symbol_count*capacity*sizeof(MinuteBar));
+  if(history->rings==NULL || history->bars==NULL || capacity==0){
+    printf("Error in recent history allocation\n");
+    recent_history_destroy(history);
+    return -1;
+  }
+  for(int i=0;i<symbol_count;i++){
+    atomic_init(&history->rings[i].sequence,0);
+    history->rings[i].pushed=0;
+  }
+  return 0;
+}
+
+
+void recent_history_push(RecentHistory *history,const MinuteBar *bars){
+  HistoryRing *ring;
+  unsigned sequence;
+  for(int i=0;i<history->symbol_count;i++){
+    // No candlestick before the symbol's first trade
+    if(bars[i].open<=CANDLESTICK_IS_EMPTY)
+      continue;
+    ring=&history->rings[i];
+    sequence=atomic_load_explicit(&ring->sequence,memory_order_relaxed);
+    atomic_store_explicit(&ring->sequence,sequence+1,memory_order_relaxed);
+    // The odd sequence is visible before any of the writes
+    atomic_thread_fence(memory_order_release);
+    history->bars[i*history->capacity+ring->pushed%history->capacity]=bars[i];
+    ring->pushed++;
+    atomic_store_explicit(&ring->sequence,sequence+2,memory_order_release);
+  }
+  return;
+}
+
+
+size_t recent_history_read(RecentHistory *history,int symbol,size_t count,
+                           MinuteBar *bars){
+  HistoryRing *ring=&history->rings[symbol];
+  const MinuteBar *ring_bars=&history->bars[symbol*history->capacity];
+  unsigned before,after;
+  uint64_t pushed,first;
+  size_t copied;
+  if(count>history->capacity)
+    count=history->capacity;
+  while(true){
+    before=atomic_load_explicit(&ring->sequence,memory_order_acquire);
+    if(before&1){
+      sched_yield();
+      continue;
+    }
+    pushed=ring->pushed;
+    copied=pushed<count?pushed:count;
+    first=pushed-copied;
+    for(size_t i=0;i<copied;i++)
+      bars[i]=ring_bars[(first+i)%history->capacity];
+    // The copies are done before the sequence is checked again
+    atomic_thread_fence(memory_order_acquire);
+    after=atomic_load_explicit(&ring->sequence,memory_order_relaxed);
+    if(before==after)
+      return copied;
+  }
+}
+
+
+void recent_history_destroy(RecentHistory *history){
+  free(history->rings);
+  free(history->bars);
+  history->rings=NULL;
+  history->bars=NULL;
+  return;
+}
+
+
+// Writes all of a reply, or fails after the send timeout
+static int send_all(int fd,const char *data,size_t length){
+  ssize_t sent;
+  while(length>0){
+    sent=send(fd,data,length,MSG_NOSIGNAL);
+    if(sent<0 && errno==EINTR)
+      continue;
+    if(sent<=0)
+      return -1;
+    data+=sent;
+    length-=sent;
+  }
+  return 0;
+}
+
+// Formats a bar as a csv line. Returns its length (as snprintf).
+static int format_bar(char *line,size_t size,const MinuteBar *bar){
+  return snprintf(line,size,"%" PRIu64 ",%f,%f,%f,%f,%f,%f,%f\n",bar->t,
+                  bar->open,bar->high,bar->low,bar->close,bar->volume,
+                  bar->vwap,bar->vwap_volume);
+}
+
+// Answers a request line. Returns -1 if the client must be dropped.
+static int answer(HistoryServer *server,int fd,char *request){
+  char reply[HISTORY_REPLY_LENGTH];
+  char *count_start=strchr(request,' ');
+  unsigned long long count=0;
+  MinuteBar *bars;
+  size_t copied,length=0;
+  int index=SYMBOL_NOT_FOUND,line;
+  if(count_start!=NULL){
+    *count_start='\0';
+    count=strtoull(count_start+1,NULL,10);
+    index=find_symbol_index(request);
+  }
+  if(count==0)
+    return send_all(fd,"ERROR usage: SYMBOL COUNT\n\n",27);
+  if(index==SYMBOL_NOT_FOUND)
+    return send_all(fd,"ERROR unknown symbol\n\n",22);
+  if(count>server->history->capacity)
+    count=server->history->capacity;
+  bars=(MinuteBar*)malloc(count*sizeof(MinuteBar));
+  if(bars==NULL)
+    return send_all(fd,"ERROR out of memory\n\n",21);
+  copied=recent_history_read(server->history,index,count,bars);
+  server->queries++;
+  // Lines are sent a full buffer at a time
+  for(size_t i=0;i<copied;i++){
+    line=format_bar(reply+length,sizeof(reply)-length,&bars[i]);
+    if((size_t)line>=sizeof(reply)-length){
+      if(send_all(fd,reply,length)!=0){
+        free(bars);
+        return -1;
+      }
+      length=0;
+      line=format_bar(reply,sizeof(reply),&bars[i]);
+    }
+    length+=(size_t)line<sizeof(reply)?(size_t)line:sizeof(reply)-1;
+  }
+  free(bars);
+  if(send_all(fd,reply,length)!=0)
+    return -1;
+  return send_all(fd,"\n",1);
+}
+
+static void drop_client(HistoryServer *server,int client){
+  close(server->client_fds[client]);
+  server->client_fds[client]=-1;
+  server->request_lengths[client]=0;
+  return;
+}
+
+static void accept_client(HistoryServer *server){
+  struct timeval timeout={HISTORY_SEND_TIMEOUT_MS/1000,
+                          (HISTORY_SEND_TIMEOUT_MS%1000)*1000};
+  int fd=accept(server->listen_fd,NULL,NULL);
+  if(fd<0)
+    return;
+  for(int i=0;i<HISTORY_MAX_CLIENTS;i++){
+    if(server->client_fds[i]<0){
+      setsockopt(fd,SOL_SOCKET,SO_SNDTIMEO,&timeout,sizeof(timeout));
+      server->client_fds[i]=fd;
+      server->request_lengths[i]=0;
+      return;
+    }
+  }
+  send_all(fd,"ERROR too many clients\n\n",24);
+  close(fd);
+  return;
+}
+
+// Reads what a client sent and answers its complete lines
+static void serve_client(HistoryServer *server,int client){
+  char *request=server->requests[client],*line_end;
+  size_t *length=&server->request_lengths[client];
+  ssize_t received=recv(server->client_fds[client],request+*length,
+                        HISTORY_REQUEST_LENGTH-1-*length,0);
+  if(received<=0){
+    drop_client(server,client);
+    return;
+  }
+  *length+=received;
+  request[*length]='\0';
+  while((line_end=strchr(request,'\n'))!=NULL){
+    *line_end='\0';
+    if(answer(server,server->client_fds[client],request)!=0){
+      drop_client(server,client);
+      return;
+    }
+    *length-=line_end+1-request;
+    memmove(request,line_end+1,*length+1);
+  }
+  // A line that doesn't fit isn't a request
+  if(*length==HISTORY_REQUEST_LENGTH-1)
+    drop_client(server,client);
+  return;
+}
+
+static void* history_server_routine(void *arg){
+  HistoryServer *server=(HistoryServer*)arg;
+  struct pollfd fds[HISTORY_MAX_CLIENTS+2];
+  int clients[HISTORY_MAX_CLIENTS];
+  int count,client_count;
+  while(true){
+    fds[0].fd=server->wake_fds[0];
+    fds[0].events=POLLIN;
+    fds[1].fd=server->listen_fd;
+    fds[1].events=POLLIN;
+    count=2;
+    client_count=0;
+    for(int i=0;i<HISTORY_MAX_CLIENTS;i++){
+      if(server->client_fds[i]<0)
+        continue;
+      fds[count].fd=server->client_fds[i];
+      fds[count].events=POLLIN;
+      clients[client_count++]=i;
+      count++;
+    }
+    if(poll(fds,count,-1)<0){
+      if(errno==EINTR)
+        continue;
+      printf("Error in history server poll\n");
+      break;
+    }
+    if(fds[0].revents!=0)
+      break;
+    for(int i=0;i<client_count;i++){
+      if(fds[2+i].revents!=0)
+        serve_client(server,clients[i]);
+    }
+    if(fds[1].revents&POLLIN)
+      accept_client(server);
+  }
+  return NULL;
+}
+
+
+int history_server_start(HistoryServer *server,RecentHistory *history,
+                         const char *path){
+  memset(server,0,sizeof(HistoryServer));
+  server->history=history;
+  for(int i=0;i<HISTORY_MAX_CLIENTS;i++)
+    server->client_fds[i]=-1;
+  snprintf(server->path,FILENAME_MAX,"%s",path);
+  if(open_unix_listener(path,HISTORY_MAX_CLIENTS,&server->listen_fd,
+                        server->wake_fds)!=0){
+    printf("Error in history socket creation: %s\n",path);
+    return -1;
+  }
+  pthread_create(&server->thread,NULL,history_server_routine,(void*)server);
+  return 0;
+}
+
+
+void history_server_stop(HistoryServer *server){
+  char wake=1;
+  if(write(server->wake_fds[1],&wake,1)!=1)
+    printf("Error in waking the history server\n");
+  pthread_join(server->thread,NULL);
+  for(int i=0;i<HISTORY_MAX_CLIENTS;i++){
+    if(server->client_fds[i]>=0)
+      drop_client(server,i);
+  }
+  close_unix_listener(server->path,server->listen_fd,server->wake_fds);
+  printf("History server: %" PRIu64 " queries\n",server->queries);
+  return;
+}
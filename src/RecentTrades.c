@@ -0,0 +1,100 @@
+#include "RecentTrades.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Mixes the trade's fields into a non zero fingerprint
+static uint64_t fingerprint(const Trade *trade){
+  uint64_t p_bits,v_bits,hash;
+  memcpy(&p_bits,&trade->p,sizeof(uint64_t));
+  memcpy(&v_bits,&trade->v,sizeof(uint64_t));
+  hash=trade->s_index;
+  hash=(hash^trade->t)*0x9E3779B97F4A7C15ULL;
+  hash=(hash^(hash>>29)^p_bits)*0xBF58476D1CE4E5B9ULL;
+  hash=(hash^(hash>>32)^v_bits)*0x94D049BB133111EBULL;
+  hash^=hash>>31;
+  return hash!=0?hash:1;
+}
+
+// Finds the fingerprint's slot in a table: its own, or the empty one
+// where it would be inserted
+static uint64_t find_slot(const uint64_t *table,uint64_t slots,uint64_t key){
+  uint64_t i=key&(slots-1);
+  while(table[i]!=0 && table[i]!=key)
+    i=(i+1)&(slots-1);
+  return i;
+}
+
+
+int recent_trades_init(RecentTrades *recent,uint64_t capacity){
+  memset(recent,0,sizeof(RecentTrades));
+  if(capacity==0 || (capacity&(capacity-1))!=0){
+    printf("Recent trades capacity must be a power of 2\n");
+    return -1;
+  }
+  // Tables are at most half full, for short probes
+  recent->slots=2*capacity;
+  recent->capacity=capacity;
+  for(int g=0;g<2;g++){
+    recent->generations[g]=(uint64_t*)calloc(recent->slots,sizeof(uint64_t));
+    if(recent->generations[g]==NULL){
+      printf("Error in recent trades allocation\n");
+      return -1;
+    }
+  }
+  pthread_mutex_init(&recent->mut,NULL);
+  return 0;
+}
+
+
+void recent_trades_suppress_until(RecentTrades *recent,uint64_t until_ms){
+  pthread_mutex_lock(&recent->mut);
+  recent->suppress_until_ms=until_ms;
+  pthread_mutex_unlock(&recent->mut);
+  return;
+}
+
+
+bool recent_trades_is_duplicate(RecentTrades *recent,const Trade *trade,
+                                struct timeval arrival_time){
+  uint64_t key=fingerprint(trade);
+  uint64_t arrival_ms=(uint64_t)arrival_time.tv_sec*1000+
+                      arrival_time.tv_usec/1000;
+  uint64_t *current,*previous,slot;
+  bool seen;
+
+  pthread_mutex_lock(&recent->mut);
+  current=recent->generations[recent->current];
+  previous=recent->generations[1-recent->current];
+  slot=find_slot(current,recent->slots,key);
+  seen=current[slot]==key ||
+       previous[find_slot(previous,recent->slots,key)]==key;
+  if(seen && arrival_ms<=recent->suppress_until_ms){
+    recent->duplicates++;
+    pthread_mutex_unlock(&recent->mut);
+    return true;
+  }
+  // Remember the trade, retiring the older generation when full
+  if(current[slot]!=key){
+    if(recent->count==recent->capacity){
+      memset(previous,0,recent->slots*sizeof(uint64_t));
+      recent->current=1-recent->current;
+      recent->count=0;
+      current=previous;
+      slot=find_slot(current,recent->slots,key);
+    }
+    current[slot]=key;
+    recent->count++;
+  }
+  pthread_mutex_unlock(&recent->mut);
+  return false;
+}
+
+
+void recent_trades_destroy(RecentTrades *recent){
+  free(recent->generations[0]);
+  free(recent->generations[1]);
+  recent->generations[0]=recent->generations[1]=NULL;
+  pthread_mutex_destroy(&recent->mut);
+  return;
+}
@@ -0,0 +1,207 @@
+#include "Replay.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "SystemHandling.h"
+
+// Columns of a trade log: timestamp,p,v
+static const CsvColumnType trade_columns[3]={CSV_INTEGER,CSV_REAL,CSV_REAL};
+
+// Reads the next valid trade of a cursor's log. Returns -1 at end of file.
+static int read_next_trade(ReplayCursor *cursor,int s_index){
+  CsvValue values[3];
+  if(csv_next(&cursor->reader,values)!=0)
+    return -1;
+  cursor->next.t=values[0].integer;
+  cursor->next.p=values[1].real;
+  cursor->next.v=values[2].real;
+  cursor->next.s_index=s_index;
+  return 0;
+}
+
+// Heap ordering: earliest timestamp first, ties broken by symbol index
+static int cursor_before(ReplayMerger *merger,int a,int b){
+  uint64_t ta=merger->cursors[a].next.t;
+  uint64_t tb=merger->cursors[b].next.t;
+  return (ta<tb) || (ta==tb && a<b);
+}
+
+static void sift_down(ReplayMerger *merger,int position){
+  int *heap=merger->heap;
+  int smallest,left,right,temp;
+  while(true){
+    smallest=position;
+    left=2*position+1;
+    right=left+1;
+    if(left<merger->heap_size &&
+       cursor_before(merger,heap[left],heap[smallest]))
+      smallest=left;
+    if(right<merger->heap_size &&
+       cursor_before(merger,heap[right],heap[smallest]))
+      smallest=right;
+    if(smallest==position)
+      return;
+    temp=heap[position];
+    heap[position]=heap[smallest];
+    heap[smallest]=temp;
+    position=smallest;
+  }
+}
+
+
+int replay_open(const char *folder_path,
+                const char symbols[][SYMBOLS_MAX_LENGTH],int symbol_count,
+                ReplayMerger *merger){
+  char buffer[FILEPATH_BUFFER_LENGTH];
+  merger->symbol_count=symbol_count;
+  merger->heap_size=0;
+  merger->cursors=(ReplayCursor*)calloc(symbol_count,sizeof(ReplayCursor));
+  merger->heap=(int*)malloc(symbol_count*sizeof(int));
+  for(int i=0;merger->cursors!=NULL && i<symbol_count;i++)
+    merger->cursors[i].reader.fd=-1;
+  if(merger->cursors==NULL || merger->heap==NULL){
+    printf("Error in replay allocation\n");
+    replay_close(merger);
+    return -1;
+  }
+  for(int i=0;i<symbol_count;i++){
+    snprintf(buffer,FILEPATH_BUFFER_LENGTH,"%s/%s.csv",folder_path,
+             symbols[i]);
+    if(access(buffer,F_OK)!=0){
+      printf("No trade log for %s, skipping\n",symbols[i]);
+      continue;
+    }
+    if(csv_open(&merger->cursors[i].reader,buffer,3,trade_columns)!=0)
+      continue;
+    // Only logs with at least one trade enter the heap
+    if(read_next_trade(&merger->cursors[i],i)==0){
+      merger->heap[merger->heap_size++]=i;
+    }
+  }
+  if(merger->heap_size==0){
+    printf("No trades found in: %s\n",folder_path);
+    replay_close(merger);
+    return -1;
+  }
+  // Heapify
+  for(int i=merger->heap_size/2-1;i>=0;i--){
+    sift_down(merger,i);
+  }
+  return 0;
+}
+
+
+int replay_next(ReplayMerger *merger,Trade *trade){
+  if(merger->heap_size==0){
+    return -1;
+  }
+  int top=merger->heap[0];
+  *trade=merger->cursors[top].next;
+  // Advance the cursor, or drop it from the heap if it's exhausted
+  if(read_next_trade(&merger->cursors[top],top)!=0){
+    merger->heap[0]=merger->heap[--merger->heap_size];
+  }
+  sift_down(merger,0);
+  return 0;
+}
+
+
+void replay_close(ReplayMerger *merger){
+  if(merger->cursors!=NULL){
+    for(int i=0;i<merger->symbol_count;i++){
+      csv_close(&merger->cursors[i].reader);
+    }
+  }
+  free(merger->cursors);
+  free(merger->heap);
+  merger->cursors=NULL;
+  merger->heap=NULL;
+  merger->heap_size=0;
+  return;
+}
+
+
+// Sleeps until event time t_ms is reached, relative to the replay's start.
+// Returns -1 if the queue was ordered to exit while waiting.
+static int wait_for_event_time(PCQueue *queue,struct timespec start,
+                               uint64_t first_t_ms,uint64_t t_ms,double speed){
+  // Logs are in arrival order: a trade older than the first one is due now
+  if(speed<=0 || t_ms<=first_t_ms){
+    return 0;
+  }
+  double offset_s=(double)(t_ms-first_t_ms)/1e3/speed;
+  struct timespec target=start;
+  target.tv_sec+=(time_t)offset_s;
+  target.tv_nsec+=(long)((offset_s-(time_t)offset_s)*1e9);
+  if(target.tv_nsec>=1000000000L){
+    target.tv_sec++;
+    target.tv_nsec-=1000000000L;
+  }
+  // Interrupted sleeps (e.g. by SIGINT) check for exit before resuming
+  while(clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&target,NULL)!=0){
+    if(queue->exit_flag==1)
+      return -1;
+  }
+  return 0;
+}
+
+// Same directive that send_due_directives produces on each minute
+static int add_minute_directive(PCQueue *queue,uint64_t timestamp_minutes){
+  WorkItem directive_item;
+  struct timeval now;
+  gettimeofday(&now,NULL);
+  work_item_directive(&directive_item,timestamp_minutes,now);
+  return queue_add(queue,&directive_item);
+}
+
+
+long feed_queue(TradeSource next_trade,void *source,PCQueue *queue,
+                double speed){
+  WorkItem item;
+  Trade trade;
+  struct timeval arrival_time;
+  struct timespec start;
+  uint64_t first_t=0,current_minute=0,trade_minute;
+  long trades_count=0;
+
+  clock_gettime(CLOCK_MONOTONIC,&start);
+  while(next_trade(source,&trade)==0){
+    trade_minute=trade.t/60000;
+    if(trades_count==0){
+      first_t=trade.t;
+      current_minute=trade_minute;
+    }
+    // Close every minute that ended before this trade
+    while(current_minute<trade_minute){
+      if(wait_for_event_time(queue,start,first_t,(current_minute+1)*60000,
+                             speed)!=0 ||
+         add_minute_directive(queue,current_minute)!=0)
+        return -1;
+      current_minute++;
+    }
+    if(wait_for_event_time(queue,start,first_t,trade.t,speed)!=0)
+      return -1;
+    // Arrival time is the injection time, as with a live frame
+    gettimeofday(&arrival_time,NULL);
+    work_item_from_trade(&item,&trade,arrival_time);
+    if(queue_add(queue,&item)!=0)
+      return -1;
+    trades_count++;
+  }
+  // Close the last minute of the logs
+  if(trades_count>0 && add_minute_directive(queue,current_minute)!=0)
+    return -1;
+  return trades_count;
+}
+
+
+// Adapter of the merger to a TradeSource
+static int merger_source(void *source,Trade *trade){
+  return replay_next((ReplayMerger*)source,trade);
+}
+
+long replay_to_queue(ReplayMerger *merger,PCQueue *queue,double speed){
+  return feed_queue(merger_source,merger,queue,speed);
+}
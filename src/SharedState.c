@@ -0,0 +1,164 @@
+#include "SharedState.h"
+#include "Symbols.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Offsets are rounded up to whole cache lines
+static uint64_t align_offset(uint64_t offset){
+  return (offset+SHARED_STATE_ALIGNMENT-1)&
+         ~(uint64_t)(SHARED_STATE_ALIGNMENT-1);
+}
+
+// Starts a write of a symbol's record: the sequence becomes odd first
+static SharedSymbolState *begin_write(SharedState *state,int symbol){
+  SharedSymbol *record=&state->symbols[symbol];
+  unsigned sequence=atomic_load_explicit(&record->sequence,
+                                         memory_order_relaxed);
+  atomic_store_explicit(&record->sequence,sequence+1,memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  return &record->state;
+}
+
+// Ends the write: the sequence is even again once the record is written
+static void end_write(SharedState *state,int symbol){
+  SharedSymbol *record=&state->symbols[symbol];
+  unsigned sequence=atomic_load_explicit(&record->sequence,
+                                         memory_order_relaxed);
+  atomic_store_explicit(&record->sequence,sequence+1,memory_order_release);
+  return;
+}
+
+
+int shared_state_create(SharedState *state,const char *name,int symbol_count){
+  SharedStateHeader header;
+  char *segment;
+  int fd;
+  memset(state,0,sizeof(SharedState));
+  memset(&header,0,sizeof(header));
+  header.magic=SHARED_STATE_MAGIC;
+  header.version=SHARED_STATE_VERSION;
+  header.symbol_count=symbol_count;
+  header.record_size=sizeof(SharedSymbol);
+  header.names_offset=align_offset(sizeof(SharedStateHeader));
+  header.records_offset=align_offset(header.names_offset+
+                                     symbol_count*SYMBOLS_MAX_LENGTH);
+  header.segment_size=header.records_offset+
+                      symbol_count*sizeof(SharedSymbol);
+  // Readers of a previous run keep their mapping, new ones get this one
+  shm_unlink(name);
+  fd=shm_open(name,O_CREAT|O_EXCL|O_RDWR,0644);
+  if(fd<0){
+    printf("Error in creating shared memory: %s\n",name);
+    return -1;
+  }
+  if(ftruncate(fd,header.segment_size)!=0){
+    printf("Error in sizing shared memory: %s\n",name);
+    close(fd);
+    shm_unlink(name);
+    return -1;
+  }
+  segment=(char*)mmap(NULL,header.segment_size,PROT_READ|PROT_WRITE,
+                      MAP_SHARED,fd,0);
+  close(fd);
+  if(segment==MAP_FAILED){
+    printf("Error in mapping shared memory: %s\n",name);
+    shm_unlink(name);
+    return -1;
+  }
+  // The new segment is zeroed: every sequence starts at 0
+  memcpy(segment,&header,sizeof(header));
+  for(int i=0;i<symbol_count;i++)
+    strncpy(segment+header.names_offset+i*SYMBOLS_MAX_LENGTH,symbols_list[i],
+            SYMBOLS_MAX_LENGTH-1);
+  state->header=(SharedStateHeader*)segment;
+  state->symbols=(SharedSymbol*)(segment+header.records_offset);
+  state->symbol_count=symbol_count;
+  for(int i=0;i<symbol_count;i++){
+    state->symbols[i].state.candle.open=CANDLESTICK_IS_EMPTY;
+    state->symbols[i].state.candle.high=CANDLESTICK_IS_EMPTY;
+    state->symbols[i].state.candle.low=CANDLESTICK_IS_EMPTY;
+    state->symbols[i].state.candle.close=CANDLESTICK_IS_EMPTY;
+    state->symbols[i].state.candle.vwap=CANDLESTICK_IS_EMPTY;
+  }
+  atomic_store_explicit(&state->header->live,1,memory_order_release);
+  return 0;
+}
+
+
+void shared_state_trade(SharedState *state,const Trade *trade,
+                        const Candlestick *candlestick){
+  SharedSymbolState *published=begin_write(state,trade->s_index);
+  if(published->candle.t==0)
+    published->candle.t=trade->t/60000;
+  published->candle.open=candlestick->open;
+  published->candle.high=candlestick->max;
+  published->candle.low=candlestick->min;
+  published->candle.close=candlestick->close;
+  published->candle.volume=candlestick->volume;
+  published->trade_t=trade->t;
+  published->trade_p=trade->p;
+  published->trade_v=trade->v;
+  published->trades++;
+  end_write(state,trade->s_index);
+  return;
+}
+
+
+void shared_state_fixed_trade(SharedState *state,const FixedTrade *trade,
+                              const FixedCandlestick *candlestick){
+  const TickScale *scale=&tick_scales[trade->s_index];
+  SharedSymbolState *published=begin_write(state,trade->s_index);
+  if(published->candle.t==0)
+    published->candle.t=trade->t/60000;
+  published->candle.open=fixed_to_double(candlestick->open,
+                                         scale->price_decimals);
+  published->candle.high=fixed_to_double(candlestick->max,
+                                         scale->price_decimals);
+  published->candle.low=fixed_to_double(candlestick->min,
+                                        scale->price_decimals);
+  published->candle.close=fixed_to_double(candlestick->close,
+                                          scale->price_decimals);
+  published->candle.volume=fixed_to_double(candlestick->volume,
+                                           scale->volume_decimals);
+  published->trade_t=trade->t;
+  published->trade_p=fixed_to_double(trade->p,scale->price_decimals);
+  published->trade_v=fixed_to_double(trade->v,scale->volume_decimals);
+  published->trades++;
+  end_write(state,trade->s_index);
+  return;
+}
+
+
+void shared_state_minute(SharedState *state,const MinuteBar *bars){
+  SharedSymbolState *published;
+  for(int i=0;i<state->symbol_count;i++){
+    published=begin_write(state,i);
+    // The next minute starts empty, at the last close
+    published->candle.t=bars[i].t+1;
+    published->candle.open=CANDLESTICK_IS_EMPTY;
+    published->candle.high=CANDLESTICK_IS_EMPTY;
+    published->candle.low=CANDLESTICK_IS_EMPTY;
+    published->candle.close=bars[i].close;
+    published->candle.volume=0;
+    // No moving average before the symbol's first trade
+    published->candle.vwap=bars[i].open>CANDLESTICK_IS_EMPTY?
+                           bars[i].vwap:CANDLESTICK_IS_EMPTY;
+    published->candle.vwap_volume=bars[i].vwap_volume;
+    end_write(state,i);
+  }
+  return;
+}
+
+
+void shared_state_close(SharedState *state,const char *name){
+  if(state->header==NULL)
+    return;
+  atomic_store_explicit(&state->header->live,0,memory_order_release);
+  munmap(state->header,state->header->segment_size);
+  shm_unlink(name);
+  state->header=NULL;
+  state->symbols=NULL;
+  return;
+}
@@ -0,0 +1,95 @@
+#include "SharedStateReader.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+int shared_state_attach(SharedStateReader *reader,const char *name){
+  const SharedStateHeader *header;
+  struct stat info;
+  void *segment;
+  int fd;
+  memset(reader,0,sizeof(SharedStateReader));
+  fd=shm_open(name,O_RDONLY,0);
+  if(fd<0)
+    return -1;
+  if(fstat(fd,&info)!=0 || (size_t)info.st_size<sizeof(SharedStateHeader)){
+    close(fd);
+    return -1;
+  }
+  // Records are read under their lock, which is only written by the writer
+  segment=mmap(NULL,info.st_size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if(segment==MAP_FAILED)
+    return -1;
+  header=(const SharedStateHeader*)segment;
+  if(header->magic!=SHARED_STATE_MAGIC ||
+     header->version!=SHARED_STATE_VERSION ||
+     header->record_size!=sizeof(SharedSymbol) ||
+     header->segment_size>(uint64_t)info.st_size ||
+     header->records_offset+(uint64_t)header->symbol_count*
+     sizeof(SharedSymbol)>header->segment_size ||
+     header->names_offset+(uint64_t)header->symbol_count*SYMBOLS_MAX_LENGTH>
+     header->records_offset){
+    munmap(segment,info.st_size);
+    return -1;
+  }
+  reader->header=header;
+  reader->names=(const char*)segment+header->names_offset;
+  reader->symbols=(SharedSymbol*)((char*)segment+header->records_offset);
+  reader->symbol_count=header->symbol_count;
+  reader->size=info.st_size;
+  return 0;
+}
+
+
+int shared_state_find(const SharedStateReader *reader,const char *symbol){
+  for(int i=0;i<reader->symbol_count;i++){
+    if(strncmp(reader->names+i*SYMBOLS_MAX_LENGTH,symbol,
+               SYMBOLS_MAX_LENGTH)==0)
+      return i;
+  }
+  return -1;
+}
+
+
+int shared_state_read(const SharedStateReader *reader,int index,
+                      SharedSymbolState *state){
+  SharedSymbol *record;
+  unsigned before,after;
+  if(reader->header==NULL || index<0 || index>=reader->symbol_count)
+    return -1;
+  record=&reader->symbols[index];
+  while(true){
+    before=atomic_load_explicit(&record->sequence,memory_order_acquire);
+    if(before&1){
+      sched_yield();
+      continue;
+    }
+    memcpy(state,&record->state,sizeof(SharedSymbolState));
+    // The copy is done before the sequence is checked again
+    atomic_thread_fence(memory_order_acquire);
+    after=atomic_load_explicit(&record->sequence,memory_order_relaxed);
+    if(before==after)
+      return 0;
+  }
+}
+
+
+bool shared_state_live(const SharedStateReader *reader){
+  return reader->header!=NULL &&
+         atomic_load_explicit(&((SharedStateHeader*)reader->header)->live,
+                              memory_order_acquire)==1;
+}
+
+
+void shared_state_detach(SharedStateReader *reader){
+  if(reader->header!=NULL)
+    munmap((void*)reader->header,reader->size);
+  memset(reader,0,sizeof(SharedStateReader));
+  return;
+}
@@ -0,0 +1,111 @@
+#include "Symbols.h"
+#include "SystemHandling.h"
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+// Open addressing hash index: each slot holds a symbol index + 1 (0 is empty)
+static int *index_slots=NULL;
+static uint32_t index_mask=0;
+
+// FNV-1a hash of a symbol name
+static uint32_t hash_symbol(const char *symbol){
+  return fnv1a_32(FNV1A_32_SEED,symbol,strlen(symbol));
+}
+
+
+int count_symbols(const char symbols[][SYMBOLS_MAX_LENGTH]){
+  int count=0;
+  while(symbols[count][0]!='\0')
+    count++;
+  return count;
+}
+
+
+char (*create_synthetic_symbols(int symbol_count))[SYMBOLS_MAX_LENGTH]{
+  char (*symbols)[SYMBOLS_MAX_LENGTH]=calloc(symbol_count+1,
+                                             SYMBOLS_MAX_LENGTH);
+  if(symbols==NULL)
+    return NULL;
+  for(int i=0;i<symbol_count;i++){
+    snprintf(symbols[i],SYMBOLS_MAX_LENGTH,"SYN%05d",i);
+  }
+  // Last entry stays "" as the list terminator
+  return symbols;
+}
+
+
+char (*list_folder_symbols(const char *folder_path,
+                           int *symbol_count))[SYMBOLS_MAX_LENGTH]{
+  DIR *dir;
+  struct dirent *entry;
+  size_t len;
+  int capacity=64;
+  char (*symbols)[SYMBOLS_MAX_LENGTH],(*resized)[SYMBOLS_MAX_LENGTH];
+  *symbol_count=0;
+  dir=opendir(folder_path);
+  if(dir==NULL){
+    printf("Error in opening: %s\n",folder_path);
+    return NULL;
+  }
+  symbols=calloc(capacity+1,SYMBOLS_MAX_LENGTH);
+  while(symbols!=NULL && (entry=readdir(dir))!=NULL){
+    len=strlen(entry->d_name);
+    if(len<=4 || len-4>=SYMBOLS_MAX_LENGTH ||
+       strcmp(entry->d_name+len-4,".csv")!=0)
+      continue;
+    if(*symbol_count==capacity){
+      capacity*=2;
+      resized=realloc(symbols,(capacity+1)*SYMBOLS_MAX_LENGTH);
+      if(resized==NULL){
+        free(symbols);
+        symbols=NULL;
+        break;
+      }
+      symbols=resized;
+    }
+    memcpy(symbols[*symbol_count],entry->d_name,len-4);
+    symbols[*symbol_count][len-4]='\0';
+    (*symbol_count)++;
+  }
+  closedir(dir);
+  if(symbols==NULL){
+    printf("Error in symbol list allocation\n");
+    return NULL;
+  }
+  // Terminate the list
+  symbols[*symbol_count][0]='\0';
+  return symbols;
+}
+
+
+int build_symbol_index(int symbol_count){
+  uint32_t slot_count=1;
+  uint32_t slot;
+  // Keep the load factor under 1/2
+  while(slot_count<2*(uint32_t)symbol_count)
+    slot_count<<=1;
+  free(index_slots);
+  index_slots=(int*)calloc(slot_count,sizeof(int));
+  if(index_slots==NULL)
+    return -1;
+  index_mask=slot_count-1;
+  for(int i=0;i<symbol_count;i++){
+    slot=hash_symbol(symbols_list[i])&index_mask;
+    while(index_slots[slot]!=0)
+      slot=(slot+1)&index_mask;
+    index_slots[slot]=i+1;
+  }
+  return 0;
+}
+
+
+int find_symbol_index(const char *symbol){
+  uint32_t slot=hash_symbol(symbol)&index_mask;
+  while(index_slots[slot]!=0){
+    if(strcmp(symbols_list[index_slots[slot]-1],symbol)==0)
+      return index_slots[slot]-1;
+    slot=(slot+1)&index_mask;
+  }
+  return SYMBOL_NOT_FOUND;
+}
@@ -1,5 +1,8 @@
 #include "SystemHandling.h"
 #include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,7 +21,7 @@ int open_csv_batch(const char *folder_path,int symbols_count,
              symbols_list[i]);
     file_handlers[i]=fopen(buffer,"a");
     // For any error return -1
-    if(file_handlers==NULL){
+    if(file_handlers[i]==NULL){
       printf("Error in opening file: %s\n",buffer);
       return -1;
     }
@@ -39,7 +42,7 @@ int open_delay_files(const char *folder_path,int writers_count,
                      FILE** delay_writers_logs,FILE** delay_calc_logs){
   char buffer[FILEPATH_BUFFER_LENGTH];
   // Make sure directory exists
-  if(ensure_directory_exists("./delays")!=0){
+  if(ensure_directory_exists(folder_path)!=0){
     printf("Error in delay folder creation...\n");
     exit(-1);
   }
@@ -82,3 +85,77 @@ int ensure_directory_exists(const char *dir_name){
   }
   return 0;
 }
+
+
+int ensure_open_files_limit(int needed){
+  struct rlimit limit;
+  if(getrlimit(RLIMIT_NOFILE,&limit)!=0){
+    return -1;
+  }
+  if(limit.rlim_cur>=(rlim_t)needed){
+    return 0;
+  }
+  // Raise the soft limit, if the hard limit allows it
+  if(limit.rlim_max!=RLIM_INFINITY && limit.rlim_max<(rlim_t)needed){
+    return -1;
+  }
+  limit.rlim_cur=needed;
+  return setrlimit(RLIMIT_NOFILE,&limit);
+}
+
+
+int open_unix_listener(const char *path,int backlog,int *listen_fd,
+                       int wake_fds[2]){
+  struct sockaddr_un address;
+  *listen_fd=-1;
+  wake_fds[0]=-1;
+  wake_fds[1]=-1;
+  memset(&address,0,sizeof(address));
+  address.sun_family=AF_UNIX;
+  if(strlen(path)>=sizeof(address.sun_path))
+    return -1;
+  strcpy(address.sun_path,path);
+  // A socket left by a previous run
+  unlink(path);
+  *listen_fd=socket(AF_UNIX,SOCK_STREAM,0);
+  if(*listen_fd<0 ||
+     bind(*listen_fd,(struct sockaddr*)&address,sizeof(address))!=0 ||
+     listen(*listen_fd,backlog)!=0 ||
+     pipe(wake_fds)!=0){
+    if(*listen_fd>=0)
+      close(*listen_fd);
+    *listen_fd=-1;
+    unlink(path);
+    return -1;
+  }
+  return 0;
+}
+
+
+void close_unix_listener(const char *path,int listen_fd,int wake_fds[2]){
+  close(listen_fd);
+  close(wake_fds[0]);
+  close(wake_fds[1]);
+  unlink(path);
+  return;
+}
+
+
+uint64_t fnv1a_64(uint64_t hash,const void *data,size_t length){
+  const unsigned char *bytes=(const unsigned char*)data;
+  for(size_t i=0;i<length;i++){
+    hash^=bytes[i];
+    hash*=1099511628211ULL;
+  }
+  return hash;
+}
+
+
+uint32_t fnv1a_32(uint32_t hash,const void *data,size_t length){
+  const unsigned char *bytes=(const unsigned char*)data;
+  for(size_t i=0;i<length;i++){
+    hash^=bytes[i];
+    hash*=16777619U;
+  }
+  return hash;
+}
@@ -2,41 +2,86 @@
 #include "PCQueue.h"
 #include "TradeProcessing.h"
 #include "WSSHandling.h"
+#include "Replay.h"
+#include "JSONParsing.h"
+#include "Inflater.h"
+#include "Checkpoint.h"
+#include "Journal.h"
+#include <inttypes.h>
+#include <stdlib.h>
 #include <string.h>
 
 void* WSSClient(void* arg){
   // Decode args.
   WSSClientArgs *args=(WSSClientArgs*)arg;
-  bool* connection_closed_flag=args->connection_closed_flag;
-  char* api_key=args->api_key;
-  // Object for connection to API
-  WSS_Objects wss;
+  // State of the connection, used by its callbacks
+  WSSConnection connection;
+  memset(&connection,0,sizeof(WSSConnection));
+  connection.index=args->index;
+  connection.connection_count=args->connection_count;
+  connection.symbol_count=args->symbol_count;
+  connection.api_key=args->api_key;
+  connection.endpoint=args->endpoint;
+  connection.gaps_log=args->gaps_log;
+  connection.metrics=args->metrics;
+  // Parsers of the connection's frames
+  pthread_t parsers[WSS_MAX_PARSERS];
+  FrameParserArgs parser_args[WSS_MAX_PARSERS];
+  if(frame_ring_init(&connection.ring,FRAME_RING_SIZE)!=0){
+    return NULL;
+  }
+  if(recent_trades_init(&connection.recent_trades,
+                        RECENT_TRADES_CAPACITY)!=0){
+    frame_ring_destroy(&connection.ring);
+    return NULL;
+  }
+  for(int i=0;i<args->parser_count;i++){
+    parser_args[i].ring=&connection.ring;
+    parser_args[i].recent_trades=&connection.recent_trades;
+    parser_args[i].api_queue=&api_queue;
+    inflate_metrics_init(&parser_args[i].metrics);
+    pthread_create(&parsers[i],NULL,FrameParser,(void*)&parser_args[i]);
+  }
   
   // Exit only of the exit flag is asserted manually
   while(api_queue.exit_flag==0){
-    // Try to setup the connection
-    printf("Attempting to connect...\n");
-    wss=finnhub_connection_setup(api_key);
-    // If the initialization failed, try again after a second
-    if(wss.ctx==NULL || wss.wsi==NULL){
+    // Try to setup the context, it's kept across reconnects
+    if(wss_context_setup(&connection)!=0){
+      // Close the minutes that end without a context
+      send_due_directives();
       sleep(1);
       continue;
     }
-    // Start connection
-    *connection_closed_flag=false;
-    while(*connection_closed_flag==false){
-      // Service normally
-      if(lws_service(wss.ctx,0)<0){
+    finnhub_connect(&connection);
+    // Sleeps until there is socket activity, a timer fires or exit is
+    // requested (timeout is ignored by lws). Reconnects are scheduled by
+    // the callbacks, so the loop only ends on exit or context failure.
+    while(api_queue.exit_flag==0){
+      if(lws_service(connection.ctx,0)<0){
         printf("Error in lws_service\n");
-      }
-      // Break if exiting gracefully
-      if(api_queue.exit_flag==1){
-        break;  
+        break;
       }
     }
     // Cleanup
-    lws_context_destroy(wss.ctx);
+    connection.stopping=true;
+    lws_context_destroy(connection.ctx);
+    connection.ctx=NULL;
+  }
+  // Let the parsers finish the received frames
+  frame_ring_close(&connection.ring);
+  for(int i=0;i<args->parser_count;i++){
+    pthread_join(parsers[i],NULL);
+    inflate_metrics_merge(&connection.metrics->inflate,
+                          &parser_args[i].metrics);
   }
+  printf("Connection %d: %" PRIu64 " frames, %" PRIu64 " dropped, ring high "
+         "water mark %" PRIu64 " of %" PRIu64 " bytes\n",connection.index,
+         connection.ring.frames,connection.ring.dropped_frames,
+         connection.ring.high_water_mark,connection.ring.size);
+  frame_ring_destroy(&connection.ring);
+  connection.metrics->duplicates+=connection.recent_trades.duplicates;
+  recent_trades_destroy(&connection.recent_trades);
+  free(connection.tls_session);
   // If the queue is empty, signal consumers.
   pthread_mutex_lock(api_queue.mut);
   if(api_queue.empty){
@@ -48,6 +93,128 @@ void* WSSClient(void* arg){
   return NULL;
 }
 
+void* FrameParser(void* arg){
+  // Decode args.
+  FrameParserArgs *args=(FrameParserArgs*)arg;
+  TradeParser parser;
+  Inflater inflater;
+  bool can_inflate=inflater_init(&inflater)==0;
+  char *frame=NULL,*message;
+  size_t capacity=0,length,message_length;
+  struct timeval arrival_time,inflate_start;
+  uint32_t flags;
+  int return_code;
+
+  while(frame_ring_read(args->ring,&frame,&capacity,&length,
+                        &arrival_time,&flags)==0){
+    message=frame;
+    message_length=length;
+    // Inflate compressed messages here, off the network thread
+    if(flags&FRAME_FLAG_COMPRESSED){
+      gettimeofday(&inflate_start,NULL);
+      if(!can_inflate ||
+         inflater_inflate(&inflater,frame,length,&message,
+                          &message_length)!=0){
+        printf("Dropped a message that couldn't be inflated\n");
+        continue;
+      }
+      histogram_record(&args->metrics.inflate_times,
+                       microseconds_since(inflate_start));
+      args->metrics.compressed_messages++;
+      args->metrics.compressed_bytes+=length;
+      args->metrics.inflated_bytes+=message_length;
+    }
+    else{
+      args->metrics.plain_bytes+=length;
+    }
+    construct_parser(args->api_queue,args->recent_trades,&parser);
+    // The trades arrived when the frame was received, not now
+    parser.arrival_time=arrival_time;
+    return_code=lejp_parse(&parser.ctx,(unsigned char*)message,
+                           message_length);
+    // Check if stream was successful
+    if(return_code<0 && return_code!=LEJP_CONTINUE){
+      printf("Error in stream parsing: %s\n",
+             lejp_error_to_string(return_code));
+    }
+    lejp_destruct(&parser.ctx);
+  }
+  free(frame);
+  if(can_inflate)
+    inflater_destroy(&inflater);
+  return NULL;
+}
+
+void* Replayer(void* arg){
+  // Decode args.
+  ReplayerArgs *args=(ReplayerArgs*)arg;
+  PCQueue *api_queue=args->api_queue;
+  ReplayMerger merger;
+  struct timeval start,end;
+  double elapsed_time;
+  long trades_count;
+
+  if(replay_open(args->replay_folder,symbols_list,args->symbol_count,
+                 &merger)==0){
+    printf("Replaying: %s\n",args->replay_folder);
+    gettimeofday(&start,NULL);
+    trades_count=replay_to_queue(&merger,api_queue,args->speed);
+    gettimeofday(&end,NULL);
+    replay_close(&merger);
+    elapsed_time=(end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)/1e6;
+    if(trades_count<0){
+      printf("Replay interrupted\n");
+    }
+    else{
+      printf("Replayed %ld trades in %f s (%f trades/s)\n",trades_count,
+             elapsed_time,trades_count/elapsed_time);
+    }
+  }
+  // Order the pipeline to exit and wake up the consumers.
+  pthread_mutex_lock(api_queue->mut);
+  api_queue->exit_flag=1;
+  pthread_cond_broadcast(api_queue->not_empty);
+  pthread_mutex_unlock(api_queue->mut);
+
+  printf("Replayer returning..\n");
+  return NULL;
+}
+
+void* Generator(void* arg){
+  // Decode args.
+  GeneratorArgs *args=(GeneratorArgs*)arg;
+  PCQueue *api_queue=args->api_queue;
+  TradeGenerator generator;
+  struct timeval start,end;
+  double elapsed_time;
+  long trades_count;
+
+  gettimeofday(&start,NULL);
+  if(generator_init(&generator,args->config,args->symbol_count,
+                    (uint64_t)start.tv_sec*1000+start.tv_usec/1000)==0){
+    printf("Generating trades for %d symbols\n",args->symbol_count);
+    trades_count=feed_queue(generator_next,&generator,api_queue,args->speed);
+    gettimeofday(&end,NULL);
+    generator_destroy(&generator);
+    elapsed_time=(end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)/1e6;
+    if(trades_count<0){
+      printf("Generator interrupted\n");
+    }
+    else{
+      printf("Generated %ld trades in %f s (%f trades/s)\n",trades_count,
+             elapsed_time,trades_count/elapsed_time);
+    }
+  }
+  // Order the pipeline to exit and wake up the consumers.
+  pthread_mutex_lock(api_queue->mut);
+  api_queue->exit_flag=1;
+  pthread_cond_broadcast(api_queue->not_empty);
+  pthread_mutex_unlock(api_queue->mut);
+
+  printf("Generator returning..\n");
+  return NULL;
+}
+
 void* Writer(void* arg){
   // Decode args
   WriterArgs *args=(WriterArgs*)arg;
@@ -56,10 +223,17 @@ void* Writer(void* arg){
   FILE **transaction_files=args->transaction_files;
   FILE *delay_log_file=args->delay_log_file;
   pthread_mutex_t *file_mutexes=args->transaction_file_mutexes;
+  uint64_t *file_lengths=args->transaction_file_lengths;
   int symbol_count=args->symbol_count;
+  StageLatencies *latencies=args->latencies;
+  double delay_us;
+  uint64_t log_offset=0;
 
   
   WorkItem current_work_item;
+  Trade trade;
+  FixedTrade fixed_trade;
+  const TickScale *scale;
   while(true){
     // Get trade
     if(queue_remove(api_queue,&current_work_item)==-1){
@@ -69,11 +243,41 @@ void* Writer(void* arg){
       break; 
     } 
     // If it's an actual trade and not a directive
-    if(current_work_item.trade.v>DIRECTIVE_CALCULATE_MINUTE){
-      // Write the trade to the file
-      write_trade_to_file(&current_work_item.trade,transaction_files,
-                          file_mutexes,current_work_item.event_time,
-                          delay_log_file);
+    if(current_work_item.type==WORK_ITEM_TRADE){
+      histogram_record(&latencies->dequeue,microseconds_since_stamp(
+                         current_work_item.arrival_stamp));
+      // Journal the trade with where its line starts in the trade log (the
+      // line is only buffered, it reaches the disk after the journal)
+      if(tick_scales!=NULL){
+        work_item_to_fixed_trade(&current_work_item,&fixed_trade);
+        delay_us=write_fixed_trade_to_file(&fixed_trade,transaction_files,
+                                           file_mutexes,file_lengths,
+                                           &log_offset,
+                                           current_work_item.arrival_stamp,
+                                           delay_log_file);
+        if(args->journal!=NULL){
+          scale=&tick_scales[fixed_trade.s_index];
+          trade.p=fixed_to_double(fixed_trade.p,scale->price_decimals);
+          trade.v=fixed_to_double(fixed_trade.v,scale->volume_decimals);
+          trade.t=fixed_trade.t;
+          trade.s_index=fixed_trade.s_index;
+          journal_append(args->journal,&trade,log_offset);
+        }
+        if(args->publisher!=NULL)
+          publisher_fixed_trade(args->publisher,&fixed_trade);
+      }
+      else{
+        work_item_to_trade(&current_work_item,&trade);
+        delay_us=write_trade_to_file(&trade,transaction_files,file_mutexes,
+                                     file_lengths,&log_offset,
+                                     current_work_item.arrival_stamp,
+                                     delay_log_file);
+        if(args->journal!=NULL)
+          journal_append(args->journal,&trade,log_offset);
+        if(args->publisher!=NULL)
+          publisher_trade(args->publisher,&trade);
+      }
+      histogram_record(&latencies->write,delay_us);
     }
     // Add work item to calculation queue 
     queue_add(calculation_queue,&current_work_item);
@@ -84,6 +288,32 @@ void* Writer(void* arg){
   return NULL;
 }
 
+// Hands the bars of a closed minute to the enabled consumers (history,
+// live state, subscribers and column store) and checkpoints the minute
+static void hand_off_minute(CalculatorArgs *args,uint64_t minute){
+  if(args->history!=NULL)
+    recent_history_push(args->history,args->bars);
+  if(args->shared_state!=NULL)
+    shared_state_minute(args->shared_state,args->bars);
+  if(args->publisher!=NULL)
+    publisher_minute(args->publisher,args->bars,args->symbol_count);
+  if(args->column_store!=NULL &&
+     column_store_append(args->column_store,args->bars)!=0){
+    printf("Error in storing minute %" PRIu64 " columns\n",minute);
+  }
+  // Persist the state of each closed minute. The journaled trades the
+  // snapshot covers are then rotated out
+  if(args->checkpoint_path!=NULL){
+    if(checkpoint_save(args->checkpoint_path,minute+1,args->symbol_count,
+                       args->fixed_calc_buffers!=NULL?NULL:
+                       args->calc_buffers,args->fixed_calc_buffers)!=0)
+      printf("Error in saving checkpoint %s\n",args->checkpoint_path);
+    else if(args->journal!=NULL)
+      journal_checkpoint(args->journal);
+  }
+  return;
+}
+
 void* Calculator(void* arg){
   // Decode arguments
   CalculatorArgs *args=(CalculatorArgs*)arg;
@@ -92,11 +322,14 @@ void* Calculator(void* arg){
   FILE **avg_files=args->avg_files;
   FILE *delay_log_file=args->delay_log_file;
   CalculatorBuffer *buffers=args->calc_buffers;
+  FixedCalculatorBuffer *fixed_buffers=args->fixed_calc_buffers;
   int symbol_count=args->symbol_count;
-  // Initialize calculation buffers 
-  init_calculator_buffers(buffers,symbol_count);
+  StageLatencies *latencies=args->latencies;
+  // Buffers are initialized (or restored) by pipeline_open
   
   WorkItem current_work_item;
+  Trade trade;
+  FixedTrade fixed_trade;
   while(true){
     // Get item (or exit if flag is set)
     if(queue_remove(calculation_queue,&current_work_item)==-1){
@@ -105,15 +338,41 @@ void* Calculator(void* arg){
     }
     // Check if item is actual trade of a directive 
     // Actual trade 
-    if(current_work_item.trade.v>DIRECTIVE_CALCULATE_MINUTE){
-      add_trade_to_buffers(&current_work_item.trade,buffers);
+    if(current_work_item.type==WORK_ITEM_TRADE){
+      if(fixed_buffers!=NULL){
+        work_item_to_fixed_trade(&current_work_item,&fixed_trade);
+        add_fixed_trade_to_buffers(&fixed_trade,fixed_buffers);
+        if(args->shared_state!=NULL)
+          shared_state_fixed_trade(args->shared_state,&fixed_trade,
+                                   &fixed_buffers[fixed_trade.s_index].
+                                   candlestick);
+      }
+      else{
+        work_item_to_trade(&current_work_item,&trade);
+        add_trade_to_buffers(&trade,buffers);
+        if(args->shared_state!=NULL)
+          shared_state_trade(args->shared_state,&trade,
+                             &buffers[trade.s_index].candlestick);
+      }
+      histogram_record(&latencies->calculate,microseconds_since_stamp(
+                         current_work_item.arrival_stamp));
     }
     // Else calculate minute
     else{
-      write_and_reset_buffers(current_work_item.trade.t,
-                              current_work_item.event_time,symbol_count,
-                              candlestick_files,avg_files,
-                              delay_log_file,buffers);
+      if(fixed_buffers!=NULL)
+        write_and_reset_fixed_buffers(current_work_item.t,
+                                      current_work_item.arrival_stamp,
+                                      symbol_count,candlestick_files,
+                                      avg_files,delay_log_file,fixed_buffers,
+                                      args->bars);
+      else
+        write_and_reset_buffers(current_work_item.t,
+                                current_work_item.arrival_stamp,symbol_count,
+                                candlestick_files,avg_files,
+                                delay_log_file,buffers,args->bars);
+      histogram_record(&latencies->minute,microseconds_since_stamp(
+                         current_work_item.arrival_stamp));
+      hand_off_minute(args,current_work_item.t);
     }
   }
   printf("Calculator returning..\n");
@@ -7,28 +7,49 @@
 #include <unistd.h>
 
 
-void write_trade_to_file(Trade *trade,FILE** handlers,
-                         pthread_mutex_t *file_mutexes,
-                         struct timeval event_time,
-                         FILE *delay_file){
+uint32_t arrival_stamp(struct timeval time){
+  return (uint32_t)((uint64_t)time.tv_sec*1000000+time.tv_usec);
+}
+
+double microseconds_since_stamp(uint32_t stamp){
   struct timeval current_time;
+  gettimeofday(&current_time,NULL);
+  // The difference wraps like the stamps do
+  return (int32_t)(arrival_stamp(current_time)-stamp);
+}
+
+void log_delay(FILE *delay_file,uint32_t stamp){
+  if(delay_file!=NULL)
+    fprintf(delay_file,"%f\n",microseconds_since_stamp(stamp));
+  return;
+}
+
+
+double write_trade_to_file(Trade *trade,FILE** handlers,
+                           pthread_mutex_t *file_mutexes,
+                           uint64_t *file_lengths,uint64_t *line_offset,
+                           uint32_t event_stamp,
+                           FILE *delay_file){
   double delay_us;
-  int i=trade->s_index;
+  int i=trade->s_index,bytes;
   // Get file access 
   pthread_mutex_lock(&file_mutexes[i]);
   // Write to file
   // Format: timestamp,p,v
-  fprintf(handlers[i],"%" PRIu64 ",%f,%f\n",trade->t,trade->p,
-          trade->v);
+  bytes=fprintf(handlers[i],"%" PRIu64 ",%f,%f\n",trade->t,trade->p,
+                trade->v);
+  if(file_lengths!=NULL){
+    *line_offset=file_lengths[i];
+    if(bytes>0)
+      file_lengths[i]+=bytes;
+  }
   // Get time delay
-  gettimeofday(&current_time,NULL);
-  delay_us=(current_time.tv_sec-event_time.tv_sec)*1e6
-          +(current_time.tv_usec-event_time.tv_usec);
+  delay_us=microseconds_since_stamp(event_stamp);
   // Write to delay log file.
   fprintf(delay_file,"%f\n",delay_us);
   // Give up file acess
   pthread_mutex_unlock(&file_mutexes[i]);
-  return;
+  return delay_us;
 }
 
 // Calculator methods
@@ -38,7 +59,7 @@ void write_trade_to_file(Trade *trade,FILE** handlers,
 void init_calculator_buffers(CalculatorBuffer *buffers,int symbol_count){
   for(int i=0;i<symbol_count;i++){
     // Init volume buffers to 0
-    memset(&buffers[i].avg_info,0,sizeof(CalculatorBuffer));
+    memset(&buffers[i],0,sizeof(CalculatorBuffer));
     buffers[i].candlestick.open=CANDLESTICK_IS_EMPTY;
     buffers[i].candlestick.close=CANDLESTICK_IS_EMPTY;
   }
@@ -77,76 +98,105 @@ void add_trade_to_buffers(Trade *trade,
 }
 
 
+void roll_moving_average(CalculatorBuffer *buffer){
+  Candlestick *candlestick=&buffer->candlestick;
+  MovingAverageInfo *avg=&buffer->avg_info;
+  // Handle total volume
+  avg->total_15min_volume=avg->total_15min_volume
+                                    -avg->minute_volumes[avg->oldest_index]
+                                    +candlestick->volume;
+  avg->minute_volumes[avg->oldest_index]=candlestick->volume;
+  // Handle weighted_price
+  avg->total_15min_weighted_price=avg->total_15min_weighted_price 
+                                    -avg->weighted_prices[avg->oldest_index]
+                                    +candlestick->weighted_price;
+  avg->weighted_prices[avg->oldest_index]=candlestick->weighted_price;
+  // Change index 
+  avg->oldest_index=(avg->oldest_index+1)%15;
+  return;
+}
+
+
+void reset_candlestick(CalculatorBuffer *buffer){
+  buffer->candlestick.open=CANDLESTICK_IS_EMPTY;
+  buffer->candlestick.volume=0;
+  buffer->candlestick.weighted_price=0;
+  return;
+}
+
+
+void write_minute_entries(uint64_t timestamp_minutes,uint32_t event_stamp,
+                          FILE *candlestick_file,FILE *avg_file,
+                          FILE *delay_file,CalculatorBuffer *buffer,
+                          MinuteBar *bar){
+  // For clarity, assign these pointers.
+  Candlestick *candlestick=&buffer->candlestick;
+  MovingAverageInfo *avg=&buffer->avg_info;
+  double moving_average;
+  roll_moving_average(buffer);
+  // If there was no volume, set the moving average to close price 
+  // of candlestick for continuity
+  if(avg->total_15min_volume==0){
+    moving_average=candlestick->close;
+  }
+  else{
+    moving_average=avg->total_15min_weighted_price/avg->total_15min_volume;
+  }
+  // Format: timestamp_minutes,moving_average,total_volume
+  fprintf(avg_file,"%" PRIu64 ",%f,%f\n",timestamp_minutes,
+          moving_average,
+          avg->total_15min_volume);
+  log_delay(delay_file,event_stamp);
+  // Handle candlestick
+  // Format of file is timestamp(min),open,high,low,close,volume
+  // If candlestick isn't empty 
+  if(candlestick->open>CANDLESTICK_IS_EMPTY){
+    fprintf(candlestick_file,"%" PRIu64 ",%f,%f,%f,%f,%f\n",
+            timestamp_minutes,
+            candlestick->open,candlestick->max,
+            candlestick->min,candlestick->close,candlestick->volume);
+  }
+  // If candlestick is empty get the close price from last minute, but
+  // if close price is also -1 just skip the whole entry 
+  // (there wasn't any trades since start)
+  else if(candlestick->close>CANDLESTICK_IS_EMPTY){
+    fprintf(candlestick_file,"%" PRIu64 ",%f,%f,%f,%f,%f\n",
+            timestamp_minutes,
+            candlestick->close,candlestick->close,
+            candlestick->close,candlestick->close,candlestick->volume);
+  }
+  log_delay(delay_file,event_stamp);
+  if(bar!=NULL){
+    bar->t=timestamp_minutes;
+    bar->open=candlestick->open;
+    bar->high=candlestick->max;
+    bar->low=candlestick->min;
+    bar->close=candlestick->close;
+    // An empty minute is the last close, as in the file
+    if(candlestick->open<=CANDLESTICK_IS_EMPTY){
+      bar->open=candlestick->close;
+      bar->high=candlestick->close;
+      bar->low=candlestick->close;
+    }
+    bar->volume=candlestick->volume;
+    bar->vwap=moving_average;
+    bar->vwap_volume=avg->total_15min_volume;
+  }
+  return;
+}
+
+
 void write_and_reset_buffers(uint64_t timestamp_minutes,
-                             struct timeval event_time,int symbol_count,
+                             uint32_t event_stamp,int symbol_count,
                              FILE **candlestick_files, FILE **avg_files,
                              FILE *delay_file,
-                             CalculatorBuffer *buffers){
+                             CalculatorBuffer *buffers,MinuteBar *bars){
   // For each symbol 
-  Candlestick *candlestick;
-  MovingAverageInfo *avg;
-  double moving_average;
-  double delay_us;
-  struct timeval current_time;
   for(int i=0;i<symbol_count;i++){
-    // For clarity, assign these pointers.
-    candlestick=&buffers[i].candlestick;
-    avg=&buffers[i].avg_info;
-    // Handle total volume
-    avg->total_15min_volume=avg->total_15min_volume
-                                      -avg->minute_volumes[avg->oldest_index]
-                                      +candlestick->volume;
-    avg->minute_volumes[avg->oldest_index]=candlestick->volume;
-    // Handle weighted_price
-    avg->total_15min_weighted_price=avg->total_15min_weighted_price 
-                                      -avg->weighted_prices[avg->oldest_index]
-                                      +candlestick->weighted_price;
-    avg->weighted_prices[avg->oldest_index]=candlestick->weighted_price;
-    // Change index 
-    avg->oldest_index=(avg->oldest_index+1)%15;
-    // If there was no volume, set the moving average to close price 
-    // of candlestick for continuity
-    if(avg->total_15min_volume==0){
-      moving_average=candlestick->close;
-    }
-    else{
-      moving_average=avg->total_15min_weighted_price/avg->total_15min_volume;
-    }
-    // Format: timestamp_minutes,moving_average,total_volume,delay_us
-    fprintf(avg_files[i],"%" PRIu64 ",%f,%f\n",timestamp_minutes,
-            moving_average,
-            avg->total_15min_volume);
-    // Get delay from event timestamp
-    gettimeofday(&current_time,NULL);
-    delay_us=(current_time.tv_sec-event_time.tv_sec)*1e6
-            +(current_time.tv_usec-event_time.tv_usec);
-    fprintf(delay_file,"%f\n",delay_us);
-    // Handle candlestick
-    // Format of file is timestamp(min),open,high,low,close,volume
-    // If candlestick isn't empty 
-    if(candlestick->open>CANDLESTICK_IS_EMPTY){
-      fprintf(candlestick_files[i],"%" PRIu64 ",%f,%f,%f,%f,%f\n",
-              timestamp_minutes,
-              candlestick->open,candlestick->max,
-              candlestick->min,candlestick->close,candlestick->volume);
-    }
-    // If candlestick is empty get the close price from last minute, but
-    // if close price is also -1 just skip the whole entry 
-    // (there wasn't any trades since start)
-    else if(candlestick->close>CANDLESTICK_IS_EMPTY){
-      fprintf(candlestick_files[i],"%" PRIu64 ",%f,%f,%f,%f,%f\n",
-              timestamp_minutes,
-              candlestick->close,candlestick->close,
-              candlestick->close,candlestick->close,candlestick->volume);
-    }
-    // Get delay from event timestamp
-    gettimeofday(&current_time,NULL);
-    delay_us=(current_time.tv_sec-event_time.tv_sec)*1e6
-            +(current_time.tv_usec-event_time.tv_usec);
-    fprintf(delay_file,"%f\n",delay_us);
-    // Reset the candlestick
-    candlestick->open=CANDLESTICK_IS_EMPTY;
-    candlestick->volume=0;
+    write_minute_entries(timestamp_minutes,event_stamp,candlestick_files[i],
+                         avg_files[i],delay_file,&buffers[i],
+                         bars!=NULL?&bars[i]:NULL);
+    reset_candlestick(&buffers[i]);
   }
   return;
 }
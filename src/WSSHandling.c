@@ -1,74 +1,348 @@
 #include "WSSHandling.h"
-#include "JSONParsing.h"
 #include "PCQueue.h"
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <signal.h>
 #include <libwebsockets.h>
 #include <time.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#if defined(LWS_OPENSSL_SUPPORT)
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#endif
+
+// Eventfd written to by close_connection_interrupt, so that the service
+// loops wake up on exit requests (-1 until created). Created once for all
+// the connections, whose threads set up their contexts concurrently.
+static int exit_event_fd=-1;
+static pthread_once_t exit_event_once=PTHREAD_ONCE_INIT;
+// Minute whose directive is due next (0 until the first connection).
+// Shared by all connections and guarded by the api_queue's producer_lock.
+static uint64_t next_directive_minute=0;
+static int directives_sent=0;
+
+#if defined(LWS_OPENSSL_SUPPORT)
+// CA store parsed once and shared by the TLS contexts of all connections
+// (X509_STORE lookups are thread safe). NULL if it couldn't be loaded.
+static X509_STORE *ca_store=NULL;
+static pthread_once_t ca_store_once=PTHREAD_ONCE_INIT;
+
+static void load_ca_store(){
+  ca_store=X509_STORE_new();
+  if(ca_store!=NULL &&
+     X509_STORE_load_locations(ca_store,WSS_CA_STORE_PATH,NULL)!=1){
+    printf("Error in loading %s\n",WSS_CA_STORE_PATH);
+    X509_STORE_free(ca_store);
+    ca_store=NULL;
+  }
+  return;
+}
+#endif
+
+static void minute_timer_callback(lws_sorted_usec_list_t *sul);
+static void reconnect_timer_callback(lws_sorted_usec_list_t *sul);
+
+// Schedules the connection's minute timer just after the next minute starts
+static void schedule_minute_timer(WSSConnection *connection){
+  struct timeval current_time;
+  lws_usec_t wait_us;
+  gettimeofday(&current_time,NULL);
+  wait_us=(60-current_time.tv_sec%60)*LWS_US_PER_SEC-current_time.tv_usec
+          +MINUTE_TIMER_SLACK_US;
+  lws_sul_schedule(connection->ctx,0,&connection->minute_timer,
+                   minute_timer_callback,wait_us);
+  return;
+}
+
+// Closes the minute(s) that ended and waits for the next one
+static void minute_timer_callback(lws_sorted_usec_list_t *sul){
+  WSSConnection *connection=lws_container_of(sul,WSSConnection,minute_timer);
+  send_due_directives();
+  schedule_minute_timer(connection);
+  return;
+}
+
+// Gets a uniform integer in [0,bound] (xorshift64*)
+static uint64_t jitter(WSSConnection *connection,uint64_t bound){
+  uint64_t x=connection->rng_state;
+  x^=x>>12;
+  x^=x<<25;
+  x^=x>>27;
+  connection->rng_state=x;
+  return (x*2685821657736338717ULL>>11)%(bound+1);
+}
 
+// Schedules the next connection attempt. The delay doubles after each
+// failure up to RECONNECT_BACKOFF_MAX_MS and half of it is random, so
+// connections that were lost together don't retry together.
+static void schedule_reconnect(WSSConnection *connection){
+  uint64_t delay_ms=RECONNECT_BACKOFF_BASE_MS;
+  for(int i=0;i<connection->backoff_exponent &&
+              delay_ms<RECONNECT_BACKOFF_MAX_MS;i++)
+    delay_ms*=2;
+  if(delay_ms>RECONNECT_BACKOFF_MAX_MS)
+    delay_ms=RECONNECT_BACKOFF_MAX_MS;
+  delay_ms=delay_ms/2+jitter(connection,delay_ms/2);
+  connection->backoff_exponent++;
+  printf("Connection %d reconnecting in %" PRIu64 " ms\n",connection->index,
+         delay_ms);
+  lws_sul_schedule(connection->ctx,0,&connection->reconnect_timer,
+                   reconnect_timer_callback,delay_ms*LWS_US_PER_MS);
+  return;
+}
 
+static void reconnect_timer_callback(lws_sorted_usec_list_t *sul){
+  WSSConnection *connection=lws_container_of(sul,WSSConnection,
+                                             reconnect_timer);
+  finnhub_connect(connection);
+  return;
+}
+
+// Handles the end of a connection attempt or of an established connection.
+// Both the failed connect call and the lws callbacks may report the same
+// attempt, only the first counts.
+static void connection_lost(WSSConnection *connection){
+  if(!connection->connecting)
+    return;
+  connection->connecting=false;
+  if(connection->established){
+    connection->established=false;
+    gettimeofday(&connection->gap_start,NULL);
+  }
+  else{
+    connection->metrics->failed_attempts++;
+  }
+  // A partially received frame is lost with the connection
+  frame_ring_abort(&connection->ring);
+  if(api_queue.exit_flag==0 && !connection->stopping)
+    schedule_reconnect(connection);
+  return;
+}
+
+// Index of the symbol after i on the connection's shard (i=-1 for the
+// first one), -1 past the shard's last one
+static int next_shard_symbol(const WSSConnection *connection,int i){
+  i=i<0?connection->index:i+connection->connection_count;
+  return i<connection->symbol_count?i:-1;
+}
+
+// Logs the gap that a reconnection ended, once for each symbol of the
+// connection's shard, and suppresses the trades the server repeats
+static void record_gap(WSSConnection *connection){
+  struct timeval gap_end;
+  uint64_t start_ms,end_ms;
+  if(connection->gap_start.tv_sec==0)
+    return;
+  gettimeofday(&gap_end,NULL);
+  start_ms=(uint64_t)connection->gap_start.tv_sec*1000+
+           connection->gap_start.tv_usec/1000;
+  end_ms=(uint64_t)gap_end.tv_sec*1000+gap_end.tv_usec/1000;
+  connection->metrics->gaps++;
+  histogram_record(&connection->metrics->gap_durations,
+                   microseconds_since(connection->gap_start));
+  printf("Connection %d recovered from a %" PRIu64 " ms gap\n",
+         connection->index,end_ms-start_ms);
+  if(connection->gaps_log!=NULL){
+    for(int i=next_shard_symbol(connection,-1);i>=0;
+        i=next_shard_symbol(connection,i)){
+      fprintf(connection->gaps_log,"%s,%" PRIu64 ",%" PRIu64 "\n",
+              symbols_list[i],start_ms,end_ms);
+    }
+    fflush(connection->gaps_log);
+  }
+  recent_trades_suppress_until(&connection->recent_trades,
+                               end_ms+RECONNECT_DEDUP_WINDOW_MS);
+  connection->gap_start.tv_sec=0;
+  connection->gap_start.tv_usec=0;
+  return;
+}
+
+#if defined(LWS_WITH_TLS_SESSIONS)
+// Keeps a copy of the context's serialized TLS session
+static int copy_tls_session(struct lws_context *ctx,
+                            struct lws_tls_session_dump *info){
+  WSSConnection *connection=(WSSConnection*)info->opaque;
+  void *session=realloc(connection->tls_session,info->blob_len);
+  (void)ctx;
+  if(session==NULL)
+    return 1;
+  memcpy(session,info->blob,info->blob_len);
+  connection->tls_session=session;
+  connection->tls_session_length=info->blob_len;
+  return 0;
+}
+
+// Hands a copy of the kept TLS session to the context (lws frees it)
+static int restore_tls_session(struct lws_context *ctx,
+                               struct lws_tls_session_dump *info){
+  WSSConnection *connection=(WSSConnection*)info->opaque;
+  (void)ctx;
+  info->blob=malloc(connection->tls_session_length);
+  if(info->blob==NULL)
+    return 1;
+  memcpy(info->blob,connection->tls_session,connection->tls_session_length);
+  info->blob_len=connection->tls_session_length;
+  return 0;
+}
+#endif
+
+// Records the connect time of an established connection and, for a full
+// TLS handshake, keeps its session for contexts created later
+static void record_handshake(WSSConnection *connection,struct lws *wsi){
+  bool resumed=false;
+#if defined(LWS_WITH_TLS_SESSIONS)
+  if(connection->endpoint->use_ssl){
+    resumed=lws_tls_session_is_reused(wsi)!=0;
+    if(!resumed){
+      lws_tls_session_dump_save(lws_get_vhost(wsi),connection->endpoint->host,
+                                (uint16_t)connection->endpoint->port,
+                                copy_tls_session,connection);
+    }
+  }
+#else
+  (void)wsi;
+#endif
+  if(resumed){
+    connection->metrics->resumed_sessions++;
+    histogram_record(&connection->metrics->resumed_handshakes,
+                     microseconds_since(connection->attempt_start));
+  }
+  else{
+    histogram_record(&connection->metrics->handshakes,
+                     microseconds_since(connection->attempt_start));
+  }
+  return;
+}
+
+static void create_exit_event(){
+  exit_event_fd=eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+  return;
+}
+
+// Adopts a duplicate of the exit eventfd into the context, so that writes
+// to it wake up lws_service. The duplicate is closed with the context.
+// Since all connections poll the same counter, it's never read: once exit
+// is requested it stays readable and wakes up every connection.
+static int adopt_exit_event(struct lws_context *ctx,const char *protocol){
+  lws_sock_file_fd_type descriptor;
+  pthread_once(&exit_event_once,create_exit_event);
+  if(exit_event_fd<0)
+    return -1;
+  descriptor.filefd=dup(exit_event_fd);
+  if(descriptor.filefd<0)
+    return -1;
+  if(lws_adopt_descriptor_vhost(lws_get_vhost_by_name(ctx,"default"),
+                                LWS_ADOPT_RAW_FILE_DESC,descriptor,protocol,
+                                NULL)==NULL){
+    close(descriptor.filefd);
+    return -1;
+  }
+  return 0;
+}
 
 
 // Main callback function of the WSS connection
 int lws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *user,
                  void *in, size_t len){
   //printf("Reason: %d\n",reason);
-  // The json parser context.
-  static struct lejp_ctx json_ctx;
-  int return_code=0;
+  // The connection's state (and json parser) is the context's user data.
+  WSSConnection *connection=(WSSConnection*)
+                            lws_context_user(lws_get_context(wsi));
 
 
   switch(reason){
+    // HANDSHAKE REQUEST: offer compression if enabled
+    case LWS_CALLBACK_CLIENT_APPEND_HANDSHAKE_HEADER:
+      if(connection->endpoint->deflate){
+        char **position=(char**)in;
+        int written=snprintf(*position,len,"Sec-WebSocket-Extensions: "
+                             WSS_DEFLATE_OFFER "\r\n");
+        if(written<0 || (size_t)written>=len)
+          return -1;
+        *position+=written;
+      }
+      break;
+    // HANDSHAKE RESPONSE: check whether the server compresses
+    case LWS_CALLBACK_CLIENT_FILTER_PRE_ESTABLISH:
+      connection->deflate_active=false;
+      if(connection->endpoint->deflate){
+        char extensions[TEMP_BUFFER_LENGTH];
+        if(lws_hdr_copy(wsi,extensions,sizeof(extensions),
+                        WSI_TOKEN_EXTENSIONS)>0 &&
+           strstr(extensions,"permessage-deflate")!=NULL){
+          // Parallel inflation needs independent messages
+          if(strstr(extensions,"server_no_context_takeover")==NULL){
+            printf("Server compresses with context takeover\n");
+            return -1;
+          }
+          connection->deflate_active=true;
+        }
+        printf("Connection %d: permessage-deflate %s\n",connection->index,
+               connection->deflate_active?"negotiated":"declined");
+      }
+      break;
     // INITIAL CONNECTION
     case LWS_CALLBACK_CLIENT_ESTABLISHED:
-      printf("Connection established\n");
-      // Construct the parser
-      construct_parser(&api_queue, &json_ctx);
-      // Subscribe to everything configured
-      if(subscribe_to_symbols(wsi)!=0){
+      printf("Connection %d established\n",connection->index);
+      // Subscribe to the connection's shard of the symbols
+      if(subscribe_to_symbols(wsi,connection)!=0){
         // If there was error in subscribing, try again...
-        printf("Error in subscription, exiting...\n");
-        connection_closed=true;
-        lejp_destruct(&json_ctx);
+        printf("Error in subscription, reconnecting...\n");
         return -1;
       }
+      connection->established=true;
+      connection->backoff_exponent=0;
+      connection->metrics->connects++;
+      record_handshake(connection,wsi);
+      record_gap(connection);
       break;
     // AT EACH RECEPTION OF DATA
     case LWS_CALLBACK_CLIENT_RECEIVE:
       //printf("%.*s\n",(int)len,(char*)in);
-      // Exclusive access to producer end for whole parse.
-      pthread_mutex_lock(api_queue.producer_lock);
-      // Parse the received stream.
-      return_code=lejp_parse(&json_ctx,(unsigned char*)in,len);
-      // Check if stream was successful
-      if(return_code<0 && return_code!=LEJP_CONTINUE){
-        printf("Error in stream parsing: %s\n",
-               lejp_error_to_string(return_code));
+      // Only copy the bytes, the parser threads parse them. This never
+      // blocks, so socket reads never wait for parsing or the queue.
+      if(frame_ring_write(&connection->ring,in,len,
+                          lws_is_final_fragment(wsi),
+                          connection->deflate_active &&
+                          (lws_get_reserved_bits(wsi)&WSS_RSV1_COMPRESSED)?
+                          FRAME_FLAG_COMPRESSED:0)!=0 &&
+         connection->ring.dropped_frames%FRAME_DROP_REPORT_INTERVAL==1){
+        printf("Connection %d dropped %" PRIu64 " frames, parsers are "
+               "behind\n",connection->index,
+               connection->ring.dropped_frames);
       }
-      // Unlock the mutex for minute events.
-      pthread_mutex_unlock(api_queue.producer_lock);
-      // Reset parser
-      construct_parser(&api_queue, &json_ctx);
       break;
     // IF CONNECTION WAD CLOSED
     case LWS_CALLBACK_CLIENT_CLOSED:
-      printf("Connection closing...\n");
-      // Assert flag
-      connection_closed=true;
+      printf("Connection %d closing...\n",connection->index);
       // If it was intended, exit gracefully
       if(api_queue.exit_flag==1){
         printf("Signaling all threads\n");
         pthread_cond_signal(api_queue.not_empty);
         lws_close_reason(wsi,LWS_CLOSE_STATUS_NORMAL,NULL,0);
       }
-      lejp_destruct(&json_ctx);
+      // Otherwise, reconnect on the same context
+      connection_lost(connection);
       return -1;
       break;
     case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
-      printf("Connection error\n");
-      connection_closed=true;
+      printf("Connection %d error: %s\n",connection->index,
+             in!=NULL?(char*)in:"unknown");
+      connection_lost(connection);
+      break;
+#if defined(LWS_OPENSSL_SUPPORT)
+    // TLS CONTEXT CREATION (user is the client SSL_CTX): use the shared store
+    case LWS_CALLBACK_OPENSSL_LOAD_EXTRA_CLIENT_VERIFY_CERTS:
+      if(ca_store!=NULL)
+        SSL_CTX_set1_cert_store((SSL_CTX*)user,ca_store);
+      break;
+#endif
+    // EXIT REQUEST (the service loop checks the exit flag once woken up)
+    case LWS_CALLBACK_RAW_RX_FILE:
       break;
     default:
       break;
@@ -76,23 +350,15 @@ int lws_callback(struct lws *wsi, enum lws_callback_reasons reason, void *user,
   return 0;
 }
 
-// If any structure wasn't created correctly, return NULL
-WSS_Objects finnhub_connection_setup(char* api_key){
-  // Context/connection info 
-  struct lws_context_creation_info ctx_info;
-  struct lws_client_connect_info conn_info;
-  // The result
-  WSS_Objects result;
-  result.ctx=NULL;
-  result.wsi=NULL;
-  // Protocol for WSS connetion
-  static struct lws_protocols protocols[]={
-      {"finnhub-protocol",lws_callback,0,0,0,NULL,0},
-      {NULL,NULL,0,0,0,NULL,0}
-    };
-  // Buffer for api key configuration 
-  static char api_key_buffer[TEMP_BUFFER_LENGTH+1];
+// Protocol for WSS connetion
+static struct lws_protocols protocols[]={
+    {"finnhub-protocol",lws_callback,0,0,0,NULL,0},
+    {NULL,NULL,0,0,0,NULL,0}
+  };
 
+int wss_context_setup(WSSConnection *connection){
+  // Context info
+  struct lws_context_creation_info ctx_info;
 
   // Initialize context
   memset(&ctx_info, 0, sizeof(ctx_info));
@@ -101,46 +367,97 @@ WSS_Objects finnhub_connection_setup(char* api_key){
   ctx_info.options=LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
   ctx_info.uid=-1;
   ctx_info.gid=-1;
-  ctx_info.ssl_ca_filepath="./ca-certificates.crt";
+  // The CA store is parsed once, instead of by every context
+#if defined(LWS_OPENSSL_SUPPORT)
+  pthread_once(&ca_store_once,load_ca_store);
+  if(ca_store==NULL)
+    ctx_info.ssl_ca_filepath=WSS_CA_STORE_PATH;
+#else
+  ctx_info.ssl_ca_filepath=WSS_CA_STORE_PATH;
+#endif
+  ctx_info.user=connection;
   struct lws_context *ctx=lws_create_context(&ctx_info); 
   if(ctx==NULL){
     printf("Error in context creation\n");
-    return result;
+    return -1;
   }
+  // Wake up the service loop on exit requests and at each minute start
+  if(adopt_exit_event(ctx,protocols[0].name)!=0){
+    printf("Error in exit event setup\n");
+    lws_context_destroy(ctx);
+    return -1;
+  }
+  connection->ctx=ctx;
+  connection->stopping=false;
+#if defined(LWS_WITH_TLS_SESSIONS)
+  // Resume the session of the previous context
+  if(connection->tls_session!=NULL &&
+     lws_tls_session_dump_load(lws_get_vhost_by_name(ctx,"default"),
+                               connection->endpoint->host,
+                               (uint16_t)connection->endpoint->port,
+                               restore_tls_session,connection)!=0){
+    printf("Connection %d can't resume its TLS session\n",connection->index);
+  }
+#endif
+  memset(&connection->minute_timer,0,sizeof(connection->minute_timer));
+  memset(&connection->reconnect_timer,0,sizeof(connection->reconnect_timer));
+  schedule_minute_timer(connection);
+  // Seed the backoff jitter differently for each connection (never 0)
+  if(connection->rng_state==0){
+    connection->rng_state=((uint64_t)time(NULL)^(uint64_t)connection->index)
+                          *0x9E3779B97F4A7C15ULL+1;
+  }
+  // Bind interrupt to exit flag switch
+  signal(SIGINT,close_connection_interrupt); 
+  return 0;
+}
+
+void finnhub_connect(WSSConnection *connection){
+  // Connection info
+  struct lws_client_connect_info conn_info;
+  WSSEndpoint *endpoint=connection->endpoint;
+  // Buffer for api key configuration (copied by lws)
+  char api_key_buffer[TEMP_BUFFER_LENGTH+1];
 
+  printf("Connection %d attempting to connect...\n",connection->index);
   // Initialize connection info
   memset(&conn_info,0,sizeof(conn_info));
-  conn_info.context=ctx;
-  conn_info.ssl_connection=LCCSCF_USE_SSL;
-  conn_info.address="ws.finnhub.io";
-  conn_info.port=443; // Default WSS port
+  conn_info.context=connection->ctx;
+  if(endpoint->use_ssl){
+    conn_info.ssl_connection=LCCSCF_USE_SSL;
+    if(endpoint->allow_self_signed){
+      conn_info.ssl_connection|=LCCSCF_ALLOW_SELFSIGNED|
+                                LCCSCF_SKIP_SERVER_CERT_HOSTNAME_CHECK;
+    }
+  }
+  conn_info.address=endpoint->host;
+  conn_info.port=endpoint->port;
   // Copy API key to path
-  snprintf(api_key_buffer,TEMP_BUFFER_LENGTH,"/?token=%s",api_key);
+  snprintf(api_key_buffer,TEMP_BUFFER_LENGTH,"/?token=%s",
+           connection->api_key);
   conn_info.path=api_key_buffer;
   conn_info.host=conn_info.address;
   conn_info.origin=conn_info.address;
   conn_info.protocol=protocols[0].name;
   conn_info.ietf_version_or_minus_one = -1;
-  struct lws *wsi=lws_client_connect_via_info(&conn_info);
-  if(wsi==NULL){
+  // lws is built without extensions: compressed messages are passed
+  // through with their reserved bit and inflated by the parsers
+  conn_info.allow_reserved_bits=endpoint->deflate;
+  // Errors may be reported by the callback before this returns
+  gettimeofday(&connection->attempt_start,NULL);
+  connection->connecting=true;
+  if(lws_client_connect_via_info(&conn_info)==NULL){
     printf("Connection failed\n");
-    // Deallocate the context that was created.
-    lws_context_destroy(result.ctx);
-    result.ctx=NULL;
-    return result;
+    connection_lost(connection);
   }
-  // Bind interrupt to exit flag switch
-  signal(SIGINT,close_connection_interrupt); 
-  // Return the ctx for the lws_service routine
-  result.ctx=ctx;
-  result.wsi=wsi;
-  return result; 
+  return;
 }
 
-int subscribe_to_symbols(struct lws *wsi){
+int subscribe_to_symbols(struct lws *wsi,const WSSConnection *connection){
   char buffer[TEMP_BUFFER_LENGTH];
-  // For each symbol in symbols_list
-  for(int i=0;strlen(symbols_list[i])>0;i++){
+  // For each symbol in symbols_list, of this connection's shard
+  for(int i=next_shard_symbol(connection,-1);i>=0;
+      i=next_shard_symbol(connection,i)){
     // Create subscribe message
     snprintf(buffer, TEMP_BUFFER_LENGTH,
              "{\"type\":\"subscribe\",\"symbol\":\"%s\"}",
@@ -178,80 +495,63 @@ void close_connection_interrupt(int sig){
     //pthread_cond_signal(api_queue.not_empty);
     // Release the queue
     pthread_mutex_unlock(api_queue.mut);
+    request_service_wakeup();
   }
   return;
 }
 
-void setup_timer(){
-  struct itimerval timer;
-  struct timeval current_time;
-  // Setup alarm sig to routine
-  if (signal(SIGALRM, send_directive_to_queue) == SIG_ERR) {
-        perror("Error installing signal handler");
-        exit(EXIT_FAILURE);
-    }
-  // Calculate initial delay 
-  gettimeofday(&current_time,NULL);
-  timer.it_value.tv_sec=59-current_time.tv_sec%60; 
-  timer.it_value.tv_usec=(int)1e6-current_time.tv_usec;
-  // Set up interval
-  timer.it_interval.tv_sec=60;
-  timer.it_interval.tv_usec=0;
-  
-  // Init timer
-  if(setitimer(ITIMER_REAL,&timer,NULL)==-1){
-    perror("Error in timer setup: ");
-    exit(1);
+void request_service_wakeup(){
+  uint64_t request=1;
+  ssize_t written;
+  // write() is async signal safe. It only fails if the counter is full,
+  // when a wakeup is pending anyway.
+  if(exit_event_fd>=0){
+    written=write(exit_event_fd,&request,sizeof(request));
+    (void)written;
   }
   return;
 }
 
-// Function that executes at every minute
-void send_directive_to_queue(int signum){
-  static int minute_counter=0;
-  static int hour_counter=0;
-  // Count to 48 hours
-  minute_counter++;
-  hour_counter+=(minute_counter/60);
-  minute_counter=minute_counter%60;
-  if(minute_counter==1){
-    printf("Hour %d\n",hour_counter);
-  }
+void resume_directives_from(uint64_t minute){
+  pthread_mutex_lock(api_queue.producer_lock);
+  next_directive_minute=minute;
+  pthread_mutex_unlock(api_queue.producer_lock);
+  return;
+}
 
+void send_due_directives(){
   struct timeval current_time;
-  gettimeofday(&current_time,NULL);
-
-  // Prepare directive
+  uint64_t current_minute;
   WorkItem directive_item;
-  directive_item.event_time=current_time;
-  directive_item.trade.t=current_time.tv_sec/60-1;
-  directive_item.trade.v=DIRECTIVE_CALCULATE_MINUTE;
 
-  // Get queue access 
+  // Get queue access, every connection may call this
   pthread_mutex_lock(api_queue.producer_lock);
-  // Add directive
-  queue_add(&api_queue,&directive_item);
-  // If time limit was reached, exit
-  if(hour_counter==PROGRAM_MAX_HOUR_LIMIT){
-    printf("Hour limit was reached..\n");
-    api_queue.exit_flag=true;
+  gettimeofday(&current_time,NULL);
+  current_minute=current_time.tv_sec/60;
+  // The first minute is only closed when it ends
+  if(next_directive_minute==0){
+    next_directive_minute=current_minute;
+  }
+  // Close every minute that ended, including those missed while reconnecting
+  while(next_directive_minute<current_minute){
+    // Count to 48 hours
+    directives_sent++;
+    if(directives_sent%60==1){
+      printf("Hour %d\n",directives_sent/60);
+    }
+    // Prepare directive
+    work_item_directive(&directive_item,next_directive_minute,current_time);
+    // Add directive
+    queue_add(&api_queue,&directive_item);
+    next_directive_minute++;
+    // If time limit was reached, exit
+    if(directives_sent==PROGRAM_MAX_HOUR_LIMIT*60){
+      printf("Hour limit was reached..\n");
+      api_queue.exit_flag=true;
+      request_service_wakeup();
+    }
   }
   // Give access back
   pthread_mutex_unlock(api_queue.producer_lock);
   return;
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
@@ -6,6 +6,9 @@
  * Configuration:
  * Hardcoded configuration parameters include the API Key of the user 
  * and the list of symbols that are tracked by the estimator.
+ * Runtime parameters (see Config.h) can select an offline source instead
+ * of the live connection: a replay of recorded trade logs or the synthetic
+ * trade generator, optionally over thousands of synthetic symbols.
 */
 #include <bits/types/struct_rusage.h>
 #include <openssl/evp.h>
@@ -16,22 +19,32 @@
 #include <sys/stat.h>
 #include <sys/resource.h>
 #include <unistd.h>
+#include <signal.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "PCQueue.h"
 #include "ThreadRoutines.h"
 #include "TradeProcessing.h"
 #include "WSSHandling.h"
 #include "SystemHandling.h"
+#include "Config.h"
+#include "Symbols.h"
+#include "Generator.h"
+#include "Metrics.h"
+#include "Pipeline.h"
+#include "Checkpoint.h"
+#include "Journal.h"
 
 
 // CONFIGURATION HARDCODED PARAMETERS
 
 #define WRITERS_COUNT 2
-#define SYMBOL_COUNT LWS_ARRAY_SIZE(symbols_list)-1
 #define API_KEY "XXXXXXXX"
 
 // Array of symbols for subscription (null terminated)
-const char symbols_list[][SYMBOLS_MAX_LENGTH]={
+const char default_symbols_list[][SYMBOLS_MAX_LENGTH]={
   "AAPL",
   "NIO",
   "INTC",
@@ -55,13 +68,11 @@ const char symbols_list[][SYMBOLS_MAX_LENGTH]={
   "OANDA:USD_CAD",
   ""
 };
-// The API key for Finnhub
-char api_key[60];
-
+// The active symbol list, default or synthetic (see Symbols.h)
+const char (*symbols_list)[SYMBOLS_MAX_LENGTH]=default_symbols_list;
 
 // Flag used for exiting gracefully from the WSS connection
 bool exit_wss_connection=false;
-bool connection_closed=false;
 
 
 // The api queue
@@ -74,107 +85,230 @@ int main(int argc, char** argv){
   double program_elapsed_time;
   gettimeofday(&program_start,NULL);
 
-  // Handle api key configuration
-  if(argc==2){
-    strcpy(api_key,argv[1]);
+  // Handle runtime configuration
+  ProgramConfig config;
+  if(parse_arguments(argc,argv,API_KEY,&config)!=0){
+    print_usage(argv[0]);
+    exit(-1);
   }
-  else{
-    strcpy(api_key,API_KEY);
+  if(config.replay_folder!=NULL){
+    // Replayed logs must not be the ones the writers append to
+    char replay_path[PATH_MAX],output_path[PATH_MAX];
+    if(realpath(config.replay_folder,replay_path)==NULL){
+      printf("Replay folder not found: %s\n",config.replay_folder);
+      exit(-1);
+    }
+    if(realpath("./trade_logs",output_path)!=NULL &&
+       strcmp(replay_path,output_path)==0){
+      printf("Replay folder can't be the output folder ./trade_logs\n");
+      exit(-1);
+    }
+  }
+  else if(!config.generator_enabled){
+    printf("Api_key: %s\n",config.api_key);
+  }
+
+  // Select the symbol universe
+  if(config.synthetic_symbols>0){
+    symbols_list=create_synthetic_symbols(config.synthetic_symbols);
+    if(symbols_list==NULL){
+      printf("Error in synthetic symbols creation\n");
+      exit(-1);
+    }
+  }
+  int symbol_count=count_symbols(symbols_list);
+  if(build_symbol_index(symbol_count)!=0){
+    printf("Error in symbol index creation\n");
+    exit(-1);
+  }
+  if(config.fixed_point && tick_scales_load(TICK_SCALES_PATH,symbol_count)!=0){
+    exit(-1);
+  }
+  // 3 csv files per symbol (and the column store's rows), plus the delay
+  // logs and connections
+  int files_per_symbol=config.column_store?4:3;
+  if(ensure_open_files_limit(files_per_symbol*symbol_count+WRITERS_COUNT+64)
+     !=0){
+    printf("Not enough file descriptors for %d symbols\n",symbol_count);
+    exit(-1);
   }
-  printf("Api_key: %s\n",api_key);
 
   // Init queues
-  api_queue=queue_init();
-  PCQueue calculation_queue=queue_init();
-
-  // Prepare WSS Client
-  pthread_t wss_client;
-  WSSClientArgs wss_connector_args;
-  wss_connector_args.api_key=api_key;
-  wss_connector_args.connection_closed_flag=&connection_closed;
-
-
-  // Prepare delay log files
-  FILE *delay_writer_logs[WRITERS_COUNT];
-  FILE *delay_calculator_logs;
-  if(open_delay_files("./delays",WRITERS_COUNT,delay_writer_logs,
-                      &delay_calculator_logs)!=0){
-    printf("Error in delay file creation.\n");
+  if(queue_init(&api_queue,config.queue_capacity,config.huge_pages)!=0){
+    exit(-1);
+  }
+  if(queue_set_overflow_policy(&api_queue,config.overflow_policy,symbol_count,
+                               SPILL_FILE_PATH)!=0){
     exit(-1);
   }
 
+  // Prepare producers (WSS Clients, Replayer or Generator)
+  pthread_t producer;
+  pthread_t wss_connectors[WSS_MAX_CONNECTIONS];
+  WSSClientArgs wss_connector_args[WSS_MAX_CONNECTIONS];
+  ConnectionMetrics connection_metrics[WSS_MAX_CONNECTIONS];
+  FILE *gaps_log=NULL;
+  if(config.replay_folder==NULL && !config.generator_enabled){
+    // Gaps are appended across runs: symbol,start_ms,end_ms
+    gaps_log=fopen("./gaps.csv","a");
+    if(gaps_log==NULL){
+      printf("Error in gaps log creation\n");
+      exit(-1);
+    }
+  }
+  for(int i=0;i<config.connections;i++){
+    connection_metrics_init(&connection_metrics[i]);
+    wss_connector_args[i].api_key=config.api_key;
+    wss_connector_args[i].endpoint=&config.endpoint;
+    wss_connector_args[i].index=i;
+    wss_connector_args[i].connection_count=config.connections;
+    wss_connector_args[i].symbol_count=symbol_count;
+    wss_connector_args[i].parser_count=config.parsers;
+    wss_connector_args[i].gaps_log=gaps_log;
+    wss_connector_args[i].metrics=&connection_metrics[i];
+  }
+  ReplayerArgs replayer_args;
+  replayer_args.api_queue=&api_queue;
+  replayer_args.replay_folder=config.replay_folder;
+  replayer_args.speed=config.replay_speed;
+  replayer_args.symbol_count=symbol_count;
+  GeneratorArgs generator_args;
+  generator_args.api_queue=&api_queue;
+  generator_args.config=&config.generator;
+  generator_args.speed=config.replay_speed;
+  generator_args.symbol_count=symbol_count;
+
+  // The previous run's journal repairs the trade logs before they're opened
+  bool live=config.replay_folder==NULL && !config.generator_enabled;
+  bool journal_enabled=live && config.journal_sync_ms>=0;
+  Journal journal;
+  Trade *journaled_trades=NULL;
+  size_t journaled_count=0;
+  if(journal_enabled &&
+     journal_recover(JOURNAL_PATH,".",&journaled_trades,&journaled_count)!=0){
+    exit(-1);
+  }
 
-  // Prepare Writers
-  // Create file systems
-  FILE *transaction_files[SYMBOL_COUNT];
-  if(open_csv_batch("./trade_logs",SYMBOL_COUNT,transaction_files)!=0){
-    printf("Error in opening csv batch\n");
+  // Prepare Writers and Calculator, with their files
+  Pipeline pipeline;
+  if(pipeline_open(&pipeline,&api_queue,symbol_count,WRITERS_COUNT,".")!=0){
+    printf("Error in pipeline creation\n");
     exit(-1);
   }
-  // Create file mutexes for correct file access
-  pthread_mutex_t writing_mutexes[SYMBOL_COUNT];
-  for(int i=0;i<SYMBOL_COUNT;i++){
-    pthread_mutex_init(&writing_mutexes[i],NULL);
-  }
-  pthread_t writer[WRITERS_COUNT];
-  WriterArgs writer_args[WRITERS_COUNT];
-  for(int i=0;i<WRITERS_COUNT;i++){
-    writer_args[i].api_queue=&api_queue;
-    writer_args[i].transaction_files=transaction_files;
-    writer_args[i].symbol_count=SYMBOL_COUNT;
-    writer_args[i].transaction_file_mutexes=writing_mutexes;
-    writer_args[i].calculation_queue=&calculation_queue;
-    writer_args[i].delay_log_file=delay_writer_logs[i];
-  }
-
-  // Initialize Calculator 
-  // Create file systems
-  FILE *candlestick_files[SYMBOL_COUNT];
-  if(open_csv_batch("./candlesticks",SYMBOL_COUNT,candlestick_files)!=0){
-    printf("Error in opening csv batch\n");
+  // Live minutes are wall clock minutes, so a recent snapshot continues
+  // the moving averages across restarts
+  struct timeval now;
+  uint64_t next_minute;
+  bool restored=false;
+  gettimeofday(&now,NULL);
+  next_minute=now.tv_sec/60;
+  if(live){
+    restored=pipeline_enable_checkpoints(&pipeline,CHECKPOINT_PATH,
+                                         now.tv_sec/60,&next_minute)==1;
+  }
+  if(journal_enabled &&
+     pipeline_enable_journal(&pipeline,&journal,JOURNAL_PATH,
+                             config.journal_sync_ms)!=0){
     exit(-1);
   }
-  FILE *avg_files[SYMBOL_COUNT];
-  if(open_csv_batch("./moving_avg",SYMBOL_COUNT,avg_files)!=0){
-    printf("Error in opening csv batch\n");
+  if(config.column_store && pipeline_enable_column_store(&pipeline)!=0){
+    exit(-1);
+  }
+  RecentHistory history;
+  HistoryServer history_server;
+  if(config.history_minutes>0){
+    if(recent_history_init(&history,symbol_count,config.history_minutes)!=0 ||
+       pipeline_enable_history(&pipeline,&history)!=0 ||
+       history_server_start(&history_server,&history,
+                            RECENT_HISTORY_SOCKET_PATH)!=0){
+      exit(-1);
+    }
+  }
+  SharedState shared_state;
+  if(config.shared_state &&
+     (shared_state_create(&shared_state,SHARED_STATE_NAME,symbol_count)!=0 ||
+      pipeline_enable_shared_state(&pipeline,&shared_state)!=0)){
+    exit(-1);
+  }
+  Publisher publisher;
+  if(config.publisher &&
+     (publisher_start(&publisher,PUBLISHER_SOCKET_PATH)!=0 ||
+      pipeline_enable_publisher(&pipeline,&publisher)!=0)){
     exit(-1);
   }
-  pthread_t calculator;
-  CalculatorArgs calculator_args;
-  CalculatorBuffer calculator_buffers[SYMBOL_COUNT];
-  calculator_args.calculation_queue=&calculation_queue;
-  calculator_args.symbol_count=SYMBOL_COUNT;
-  calculator_args.candlestick_files=candlestick_files;
-  calculator_args.avg_files=avg_files;
-  calculator_args.calc_buffers=calculator_buffers;
-  calculator_args.delay_log_file=delay_calculator_logs;
 
   // Start threads
-  pthread_create(&wss_client, NULL, WSSClient, (void*)&wss_connector_args);
-  for(int i=0;i<WRITERS_COUNT;i++)
-    pthread_create(&writer[i], NULL, Writer, (void*)&writer_args[i]);
-  pthread_create(&calculator,NULL,Calculator,(void*)&calculator_args);
-  setup_timer();
-
-  pthread_join(wss_client, NULL);
-  for(int i=0;i<WRITERS_COUNT;i++)
-    pthread_join(writer[i],NULL);
-  pthread_join(calculator,NULL);
-  printf("Threads complete\n");
+  pipeline_start(&pipeline);
+  // The journaled trades of the minutes that weren't closed go to the
+  // calculator before any new one
+  if(journaled_count>0){
+    next_minute=pipeline_replay(&pipeline,journaled_trades,journaled_count,
+                                next_minute,now.tv_sec/60);
+    restored=true;
+  }
+  free(journaled_trades);
+  if(restored)
+    resume_directives_from(next_minute);
+  // Offline sources synthesize their own minute directives, the WSS client
+  // sends them from its service loop
+  if(config.replay_folder!=NULL){
+    signal(SIGINT,close_connection_interrupt);
+    pthread_create(&producer, NULL, Replayer, (void*)&replayer_args);
+  }
+  else if(config.generator_enabled){
+    signal(SIGINT,close_connection_interrupt);
+    pthread_create(&producer, NULL, Generator, (void*)&generator_args);
+  }
+  else{
+    for(int i=0;i<config.connections;i++)
+      pthread_create(&wss_connectors[i], NULL, WSSClient,
+                     (void*)&wss_connector_args[i]);
+  }
 
+  if(config.replay_folder!=NULL || config.generator_enabled){
+    pthread_join(producer, NULL);
+  }
+  else{
+    for(int i=0;i<config.connections;i++)
+      pthread_join(wss_connectors[i], NULL);
+  }
+  pipeline_join(&pipeline);
+  if(journal_enabled)
+    journal_close(&journal);
+  if(config.history_minutes>0){
+    history_server_stop(&history_server);
+    recent_history_destroy(&history);
+  }
+  if(config.shared_state)
+    shared_state_close(&shared_state,SHARED_STATE_NAME);
+  if(config.publisher)
+    publisher_stop(&publisher);
+  printf("Threads complete\n");
 
-  // Cleanup
+  // Report the delays of each stage
+  StageLatencies latencies;
+  pipeline_latencies(&pipeline,&latencies);
+  histogram_print(stdout,"Dequeue delay",&latencies.dequeue);
+  histogram_print(stdout,"Write delay",&latencies.write);
+  histogram_print(stdout,"Calculation delay",&latencies.calculate);
+  histogram_print(stdout,"Minute delay",&latencies.minute);
+  queue_print_occupancy(&api_queue,stdout,"api");
+  queue_print_occupancy(&pipeline.calculation_queue,stdout,"calculation");
+  if(config.overflow_policy!=OVERFLOW_BLOCK){
+    queue_print_overflow(&api_queue,stdout,symbols_list);
+  }
+  if(gaps_log!=NULL){
+    for(int i=1;i<config.connections;i++)
+      connection_metrics_merge(&connection_metrics[0],&connection_metrics[i]);
+    connection_metrics_print(stdout,&connection_metrics[0]);
+    fclose(gaps_log);
+  }
 
-  // Close files
-  close_csv_batch(transaction_files,SYMBOL_COUNT);
-  close_csv_batch(candlestick_files,SYMBOL_COUNT);
-  close_csv_batch(avg_files,SYMBOL_COUNT);
-  close_delay_files(delay_writer_logs,&delay_calculator_logs,WRITERS_COUNT);
 
-  // Destroy mutexes
-  for(int i=0;i<SYMBOL_COUNT;i++){
-    pthread_mutex_destroy(&writing_mutexes[i]);
-  }
+  // Cleanup
+  pipeline_close(&pipeline);
+  tick_scales_free();
+  queue_destory(&api_queue);
 
   // Get final time
   gettimeofday(&program_end,NULL);
@@ -0,0 +1,180 @@
+/**
+ * Converter and query tool of the column store (see ColumnStore.h).
+ *
+ * convert: reads output_folder/candlesticks/X.csv and moving_avg/X.csv of
+ * each symbol together (both are in minute order) and merges their
+ * minutes into the per-day partitions of output_folder/columns/X/, a day
+ * at a time. Minutes already in the store are replaced, so converting
+ * again is harmless. Run it while ./main isn't writing that folder, as it
+ * also seals the rows files of the days it touches.
+ *
+ * query: prints a symbol's bars of a range of minutes (since Epoch) as csv.
+ *
+ * Usage: ./columns convert output_folder [symbols...]
+ *        ./columns query output_folder symbol from_minute to_minute
+ *
+ * Without symbols, convert takes those of output_folder/candlesticks.
+*/
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ColumnStore.h"
+#include "CsvReader.h"
+#include "Symbols.h"
+#include "SystemHandling.h"
+
+// Not used, SystemHandling refers to it
+const char (*symbols_list)[SYMBOLS_MAX_LENGTH];
+
+
+// Converts the csv files of a symbol. Returns the bars stored, or -1.
+static int64_t convert_symbol(const char *output_folder,const char *symbol){
+  char path[FILEPATH_BUFFER_LENGTH];
+  const CsvColumnType candle_types[6]={CSV_INTEGER,CSV_REAL,CSV_REAL,
+                                       CSV_REAL,CSV_REAL,CSV_REAL};
+  const CsvColumnType avg_types[3]={CSV_INTEGER,CSV_REAL,CSV_REAL};
+  CsvReader candles,averages;
+  CsvValue candle[6],average[3];
+  MinuteBar *bars,*bar;
+  uint64_t day=UINT64_MAX;
+  int64_t stored=0;
+  size_t count=0;
+  int has_average,error=0;
+
+  snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/candlesticks/%s.csv",
+           output_folder,symbol);
+  if(csv_open(&candles,path,6,candle_types)!=0)
+    return -1;
+  snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/moving_avg/%s.csv",output_folder,
+           symbol);
+  if(csv_open(&averages,path,3,avg_types)!=0){
+    csv_close(&candles);
+    return -1;
+  }
+  bars=(MinuteBar*)malloc(MINUTES_PER_DAY*sizeof(MinuteBar));
+  if(bars==NULL){
+    printf("Error in bars allocation\n");
+    csv_close(&candles);
+    csv_close(&averages);
+    return -1;
+  }
+  has_average=csv_next(&averages,average)==0;
+  while(csv_next(&candles,candle)==0){
+    // A day is stored once the next one starts (or the file ends)
+    if(candle[0].integer/MINUTES_PER_DAY!=day || count==MINUTES_PER_DAY){
+      if(count>0 && column_store_merge(output_folder,symbol,day,bars,
+                                       count)!=0){
+        error=1;
+        break;
+      }
+      stored+=count;
+      count=0;
+      day=candle[0].integer/MINUTES_PER_DAY;
+    }
+    while(has_average && average[0].integer<candle[0].integer)
+      has_average=csv_next(&averages,average)==0;
+    bar=&bars[count++];
+    bar->t=candle[0].integer;
+    bar->open=candle[1].real;
+    bar->high=candle[2].real;
+    bar->low=candle[3].real;
+    bar->close=candle[4].real;
+    bar->volume=candle[5].real;
+    // A minute without its moving average row (a truncated file)
+    if(has_average && average[0].integer==candle[0].integer){
+      bar->vwap=average[1].real;
+      bar->vwap_volume=average[2].real;
+    }
+    else{
+      bar->vwap=NAN;
+      bar->vwap_volume=NAN;
+    }
+  }
+  if(error==0 && count>0){
+    if(column_store_merge(output_folder,symbol,day,bars,count)!=0)
+      error=1;
+    else
+      stored+=count;
+  }
+  free(bars);
+  csv_close(&candles);
+  csv_close(&averages);
+  return error?-1:stored;
+}
+
+static int convert(const char *output_folder,int symbol_count,
+                   char **symbols){
+  char path[FILEPATH_BUFFER_LENGTH];
+  char (*listed)[SYMBOLS_MAX_LENGTH]=NULL;
+  const char *symbol;
+  int64_t stored;
+  int errors=0;
+  if(symbol_count==0){
+    snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/candlesticks",output_folder);
+    listed=list_folder_symbols(path,&symbol_count);
+    if(listed==NULL){
+      printf("No candlesticks in %s\n",path);
+      return -1;
+    }
+  }
+  for(int i=0;i<symbol_count;i++){
+    symbol=listed!=NULL?listed[i]:symbols[i];
+    snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/%s/%s",output_folder,
+             COLUMN_STORE_FOLDER,symbol);
+    if(ensure_directory_exists(path)!=0){
+      printf("Error in creating directory: %s\n",path);
+      errors++;
+      continue;
+    }
+    stored=convert_symbol(output_folder,symbol);
+    if(stored<0){
+      printf("%s: conversion failed\n",symbol);
+      errors++;
+    }
+    else
+      printf("%s: %" PRId64 " minutes\n",symbol,stored);
+  }
+  free(listed);
+  return errors>0?-1:0;
+}
+
+static int query(const char *output_folder,const char *symbol,
+                 uint64_t from_minute,uint64_t to_minute){
+  MinuteBar *bars;
+  size_t count;
+  if(column_store_read(output_folder,symbol,from_minute,to_minute,&bars,
+                       &count)!=0){
+    printf("Error in reading %s columns\n",symbol);
+    return -1;
+  }
+  printf("t,open,high,low,close,volume,vwap,vwap_volume\n");
+  for(size_t i=0;i<count;i++)
+    printf("%" PRIu64 ",%f,%f,%f,%f,%f,%f,%f\n",bars[i].t,bars[i].open,
+           bars[i].high,bars[i].low,bars[i].close,bars[i].volume,
+           bars[i].vwap,bars[i].vwap_volume);
+  free(bars);
+  return 0;
+}
+
+
+int main(int argc,char **argv){
+  char path[FILEPATH_BUFFER_LENGTH];
+  if(argc>=3 && strcmp(argv[1],"convert")==0){
+    snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/%s",argv[2],COLUMN_STORE_FOLDER);
+    if(ensure_directory_exists(path)!=0){
+      printf("Error in creating directory: %s\n",path);
+      return -1;
+    }
+    return convert(argv[2],argc-3,argv+3);
+  }
+  if(argc==6 && strcmp(argv[1],"query")==0)
+    return query(argv[2],argv[3],strtoull(argv[4],NULL,10),
+                 strtoull(argv[5],NULL,10));
+  printf("Usage: %s convert output_folder [symbols...]\n"
+         "       %s query output_folder symbol from_minute to_minute\n",
+         argv[0],argv[0]);
+  return -1;
+}
@@ -0,0 +1,268 @@
+/**
+ * Statistics of the delay logs (output_folder/delays/X.csv), computed in
+ * one pass with memory that doesn't grow with the samples, so a long run
+ * can be analyzed on the Pi (create_plots.py used to load every sample).
+ *
+ * For each file it prints the count, mean, standard deviation, extremes
+ * and percentiles of the delays. Percentiles come from the log-linear
+ * histogram the pipeline reports its latencies with (exact below 64 us,
+ * within ~3% above). The samples are also split in windows of consecutive
+ * samples: the delay logs have no timestamps, but calculator.csv has 2
+ * lines per symbol each minute, so -n 2*symbols makes each window a
+ * minute. Windows whose p99 is above factor times the file's p99 are
+ * reported as outliers, consecutive ones merged into a range. Only a few
+ * bytes per window are kept.
+ *
+ * Usage: ./delaystats [-n window_samples] [-k factor] [-o stats_folder]
+ *                     delay_files...
+ *
+ * With -o, for each X.csv it writes stats_folder/X_hist.csv (the non empty
+ * buckets of the histogram: lower_us,upper_us,count) and
+ * stats_folder/X_series.csv (a row per window:
+ * first_sample,count,mean,p50,p99,max), which create_plots.py plots.
+*/
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "CsvReader.h"
+#include "Metrics.h"
+#include "Symbols.h"
+#include "SystemHandling.h"
+
+#define DELAYSTATS_DEFAULT_WINDOW 1000
+#define DELAYSTATS_DEFAULT_FACTOR 2.0
+// Outlier ranges printed for each file
+#define DELAYSTATS_MAX_OUTLIERS 20
+
+/**
+ * @brief Summary of a window, kept for the outliers.
+ */
+typedef struct{
+  uint64_t first_sample; //< Index of the window's first sample.
+  double p99; //< 99th percentile of the window.
+  uint64_t max; //< Largest sample of the window.
+} WindowSummary;
+
+/**
+ * @brief Running statistics of a delay log.
+ */
+typedef struct{
+  LatencyHistogram all; //< All samples.
+  LatencyHistogram window; //< Samples of the current window.
+  double mean; //< Running mean (Welford).
+  double m2; //< Sum of squared deviations from the mean (Welford).
+  double min; //< Smallest sample, as logged.
+  double max; //< Largest sample, as logged.
+  WindowSummary *windows; //< Summary of each window.
+  size_t window_count; //< Number of windows.
+  size_t window_capacity; //< Windows allocated.
+  FILE *series; //< Rows of the windows (NULL without -o).
+} DelayStats;
+
+// Not used, SystemHandling refers to it
+const char (*symbols_list)[SYMBOLS_MAX_LENGTH];
+
+static DelayStats stats;
+
+
+// Summarizes the current window and starts the next one
+static int close_window(uint64_t first_sample){
+  WindowSummary *summary;
+  LatencyHistogram *window=&stats.window;
+  if(window->total==0)
+    return 0;
+  if(stats.window_count==stats.window_capacity){
+    stats.window_capacity=stats.window_capacity>0?2*stats.window_capacity:64;
+    summary=(WindowSummary*)realloc(stats.windows,
+                                    stats.window_capacity*
+                                    sizeof(WindowSummary));
+    if(summary==NULL){
+      printf("Error in window allocation\n");
+      return -1;
+    }
+    stats.windows=summary;
+  }
+  summary=&stats.windows[stats.window_count++];
+  summary->first_sample=first_sample;
+  summary->p99=histogram_percentile(window,99);
+  summary->max=window->max;
+  if(stats.series!=NULL)
+    fprintf(stats.series,"%" PRIu64 ",%" PRIu64 ",%.1f,%.0f,%.0f,%" PRIu64
+            "\n",first_sample,window->total,window->sum/window->total,
+            histogram_percentile(window,50),summary->p99,window->max);
+  histogram_init(window);
+  return 0;
+}
+
+// Writes the non empty buckets of the histogram
+static int write_histogram(const char *path){
+  uint64_t lower,upper;
+  FILE *file=fopen(path,"w");
+  if(file==NULL){
+    printf("Error in opening file: %s\n",path);
+    return -1;
+  }
+  fprintf(file,"lower_us,upper_us,count\n");
+  for(int i=0;i<HISTOGRAM_BUCKETS;i++){
+    if(stats.all.counts[i]==0)
+      continue;
+    lower=histogram_bucket_lower_bound(i);
+    upper=i+1<HISTOGRAM_BUCKETS?histogram_bucket_lower_bound(i+1):lower+1;
+    fprintf(file,"%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",lower,upper,
+            stats.all.counts[i]);
+  }
+  return fclose(file);
+}
+
+// Prints the ranges of consecutive windows with a p99 above threshold
+static void print_outliers(double factor){
+  double threshold=factor*histogram_percentile(&stats.all,99);
+  uint64_t last_sample,max;
+  size_t first;
+  int ranges=0;
+  for(size_t i=0;i<stats.window_count;i++){
+    if(stats.windows[i].p99<=threshold)
+      continue;
+    first=i;
+    max=stats.windows[i].max;
+    while(i+1<stats.window_count && stats.windows[i+1].p99>threshold){
+      i++;
+      if(stats.windows[i].max>max)
+        max=stats.windows[i].max;
+    }
+    ranges++;
+    if(ranges>DELAYSTATS_MAX_OUTLIERS)
+      continue;
+    last_sample=i+1<stats.window_count?stats.windows[i+1].first_sample:
+                                       stats.all.total;
+    printf("  outlier: samples %" PRIu64 "-%" PRIu64 " (%zu windows), "
+           "max %" PRIu64 " us\n",stats.windows[first].first_sample,
+           last_sample-1,i-first+1,max);
+  }
+  printf("  %d outlier ranges of %zu windows (p99 above %.0f us)\n",ranges,
+         stats.window_count,threshold);
+  return;
+}
+
+// Reads a delay log and prints (and writes) its statistics
+static int process_file(const char *path,const char *stats_folder,
+                        uint64_t window_samples,double factor){
+  char output[FILEPATH_BUFFER_LENGTH],name[FILEPATH_BUFFER_LENGTH];
+  const CsvColumnType types[1]={CSV_REAL};
+  const char *basename=strrchr(path,'/');
+  CsvReader reader;
+  CsvValue value;
+  uint64_t window_start=0;
+  double delta;
+  int error=0;
+
+  basename=basename!=NULL?basename+1:path;
+  snprintf(name,FILEPATH_BUFFER_LENGTH,"%s",basename);
+  if(strlen(name)>4 && strcmp(name+strlen(name)-4,".csv")==0)
+    name[strlen(name)-4]='\0';
+  if(csv_open(&reader,path,1,types)!=0)
+    return -1;
+  histogram_init(&stats.all);
+  histogram_init(&stats.window);
+  stats.mean=0;
+  stats.m2=0;
+  stats.window_count=0;
+  stats.series=NULL;
+  if(stats_folder!=NULL){
+    snprintf(output,FILEPATH_BUFFER_LENGTH,"%s/%s_series.csv",stats_folder,
+             name);
+    stats.series=fopen(output,"w");
+    if(stats.series==NULL){
+      printf("Error in opening file: %s\n",output);
+      csv_close(&reader);
+      return -1;
+    }
+    fprintf(stats.series,"first_sample,count,mean,p50,p99,max\n");
+  }
+
+  while(csv_next(&reader,&value)==0){
+    if(stats.all.total==0 || value.real<stats.min)
+      stats.min=value.real;
+    if(stats.all.total==0 || value.real>stats.max)
+      stats.max=value.real;
+    histogram_record(&stats.all,value.real);
+    histogram_record(&stats.window,value.real);
+    delta=value.real-stats.mean;
+    stats.mean+=delta/stats.all.total;
+    stats.m2+=delta*(value.real-stats.mean);
+    if(stats.window.total==window_samples){
+      if(close_window(window_start)!=0){
+        error=1;
+        break;
+      }
+      window_start=stats.all.total;
+    }
+  }
+  if(error==0 && close_window(window_start)!=0)
+    error=1;
+  csv_close(&reader);
+  if(stats.series!=NULL && fclose(stats.series)!=0)
+    error=1;
+
+  if(stats.all.total==0){
+    printf("%s: no samples\n",basename);
+    return error?-1:0;
+  }
+  histogram_print(stdout,basename,&stats.all);
+  printf("  mean %f us, std %f us, min %f us, max %f us, p99.99 %.0f us\n",
+         stats.mean,sqrt(stats.m2/stats.all.total),stats.min,stats.max,
+         histogram_percentile(&stats.all,99.99));
+  print_outliers(factor);
+  if(stats_folder!=NULL){
+    snprintf(output,FILEPATH_BUFFER_LENGTH,"%s/%s_hist.csv",stats_folder,
+             name);
+    if(write_histogram(output)!=0)
+      error=1;
+  }
+  return error?-1:0;
+}
+
+
+int main(int argc,char **argv){
+  const char *stats_folder=NULL;
+  uint64_t window_samples=DELAYSTATS_DEFAULT_WINDOW;
+  double factor=DELAYSTATS_DEFAULT_FACTOR;
+  int option,errors=0;
+
+  while((option=getopt(argc,argv,"n:k:o:"))!=-1){
+    switch(option){
+    case 'n':
+      window_samples=strtoull(optarg,NULL,10);
+      break;
+    case 'k':
+      factor=atof(optarg);
+      break;
+    case 'o':
+      stats_folder=optarg;
+      break;
+    default:
+      printf("Usage: %s [-n window_samples] [-k factor] [-o stats_folder] "
+             "delay_files...\n",argv[0]);
+      return -1;
+    }
+  }
+  if(optind>=argc || window_samples==0){
+    printf("Usage: %s [-n window_samples] [-k factor] [-o stats_folder] "
+           "delay_files...\n",argv[0]);
+    return -1;
+  }
+  if(stats_folder!=NULL && ensure_directory_exists(stats_folder)!=0){
+    printf("Error in creating directory: %s\n",stats_folder);
+    return -1;
+  }
+  for(int i=optind;i<argc;i++){
+    if(process_file(argv[i],stats_folder,window_samples,factor)!=0)
+      errors++;
+  }
+  free(stats.windows);
+  return errors>0?-1:0;
+}
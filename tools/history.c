@@ -0,0 +1,81 @@
+/**
+ * Client of the recent history socket of ./main -R (see RecentHistory.h):
+ * prints a symbol's last minutes as csv.
+ *
+ * Usage: ./history [-s socket] symbol [count]
+ *
+ * count defaults to 60, the socket to RECENT_HISTORY_SOCKET_PATH. The same
+ * requests can be sent by hand: printf 'NVDA 60\n' | nc -U ./history.sock
+*/
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "RecentHistory.h"
+
+#define HISTORY_DEFAULT_COUNT 60
+
+
+int main(int argc,char **argv){
+  const char *path=RECENT_HISTORY_SOCKET_PATH;
+  char request[HISTORY_REQUEST_LENGTH],reply[4096];
+  struct sockaddr_un address;
+  unsigned long count=HISTORY_DEFAULT_COUNT;
+  ssize_t received;
+  size_t length;
+  bool first_read=true,line_start=true,done=false,error=false;
+  int option,fd;
+
+  while((option=getopt(argc,argv,"s:"))!=-1){
+    if(option!='s'){
+      printf("Usage: %s [-s socket] symbol [count]\n",argv[0]);
+      return -1;
+    }
+    path=optarg;
+  }
+  if(optind>=argc || argc-optind>2){
+    printf("Usage: %s [-s socket] symbol [count]\n",argv[0]);
+    return -1;
+  }
+  if(argc-optind==2)
+    count=strtoul(argv[optind+1],NULL,10);
+  length=snprintf(request,HISTORY_REQUEST_LENGTH,"%s %lu\n",argv[optind],
+                  count);
+  memset(&address,0,sizeof(address));
+  address.sun_family=AF_UNIX;
+  snprintf(address.sun_path,sizeof(address.sun_path),"%s",path);
+  fd=socket(AF_UNIX,SOCK_STREAM,0);
+  if(fd<0 || connect(fd,(struct sockaddr*)&address,sizeof(address))!=0){
+    printf("Error in connecting to %s\n",path);
+    return -1;
+  }
+  if(length>=HISTORY_REQUEST_LENGTH ||
+     write(fd,request,length)!=(ssize_t)length){
+    printf("Error in sending the request\n");
+    close(fd);
+    return -1;
+  }
+  // The reply ends with an empty line
+  while(!done && (received=read(fd,reply,sizeof(reply)))>0){
+    if(first_read && received>=5 && strncmp(reply,"ERROR",5)==0)
+      error=true;
+    else if(first_read)
+      printf("t,open,high,low,close,volume,vwap,vwap_volume\n");
+    first_read=false;
+    for(ssize_t i=0;i<received;i++){
+      if(reply[i]=='\n' && line_start){
+        received=i;
+        done=true;
+        break;
+      }
+      line_start=reply[i]=='\n';
+    }
+    fwrite(reply,1,received,stdout);
+  }
+  close(fd);
+  return error || !done?-1:0;
+}
@@ -0,0 +1,108 @@
+/**
+ * Example reader of the live state of ./main -m (see SharedStateReader.h),
+ * linked with the sharedstate_reader library alone.
+ *
+ * Prints the state of the given symbols every interval, as csv lines
+ * symbol,minute,open,high,low,close,volume,vwap,trade_t,trade_p,trade_v,
+ * trades (reattaching when a new run replaces the segment). With -b it
+ * instead times shared_state_read on the first symbol and exits.
+ *
+ * Usage: ./livestate [-i interval_ms] [-b] symbols...
+*/
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "SharedStateReader.h"
+
+#define LIVESTATE_DEFAULT_INTERVAL_MS 1000
+#define LIVESTATE_BENCH_READS 10000000
+
+static double seconds_now(void){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return now.tv_sec+now.tv_nsec/1e9;
+}
+
+// Times reads of a symbol
+static int bench(const SharedStateReader *reader,int index){
+  SharedSymbolState state;
+  double start=seconds_now(),elapsed;
+  uint64_t checksum=0;
+  for(int i=0;i<LIVESTATE_BENCH_READS;i++){
+    shared_state_read(reader,index,&state);
+    checksum+=state.trades;
+  }
+  elapsed=seconds_now()-start;
+  printf("%d reads in %.3f s: %.1f ns per read (trades %llu)\n",
+         LIVESTATE_BENCH_READS,elapsed,elapsed*1e9/LIVESTATE_BENCH_READS,
+         (unsigned long long)(checksum/LIVESTATE_BENCH_READS));
+  return 0;
+}
+
+
+int main(int argc,char **argv){
+  SharedStateReader reader;
+  SharedSymbolState state;
+  int interval_ms=LIVESTATE_DEFAULT_INTERVAL_MS,option,index;
+  bool benchmark=false;
+
+  while((option=getopt(argc,argv,"i:b"))!=-1){
+    switch(option){
+    case 'i':
+      interval_ms=atoi(optarg);
+      break;
+    case 'b':
+      benchmark=true;
+      break;
+    default:
+      printf("Usage: %s [-i interval_ms] [-b] symbols...\n",argv[0]);
+      return -1;
+    }
+  }
+  if(optind>=argc || interval_ms<=0){
+    printf("Usage: %s [-i interval_ms] [-b] symbols...\n",argv[0]);
+    return -1;
+  }
+  if(shared_state_attach(&reader,SHARED_STATE_NAME)!=0){
+    printf("No live state at %s (is ./main -m running?)\n",SHARED_STATE_NAME);
+    return -1;
+  }
+  if(benchmark){
+    index=shared_state_find(&reader,argv[optind]);
+    if(index<0){
+      printf("%s isn't published\n",argv[optind]);
+      return -1;
+    }
+    return bench(&reader,index);
+  }
+
+  printf("symbol,minute,open,high,low,close,volume,vwap,trade_t,trade_p,"
+         "trade_v,trades\n");
+  while(true){
+    // A new run: its segment replaces the old one
+    if(!shared_state_live(&reader)){
+      shared_state_detach(&reader);
+      if(shared_state_attach(&reader,SHARED_STATE_NAME)!=0){
+        usleep(interval_ms*1000);
+        continue;
+      }
+    }
+    for(int i=optind;i<argc;i++){
+      index=shared_state_find(&reader,argv[i]);
+      if(index<0 || shared_state_read(&reader,index,&state)!=0)
+        continue;
+      printf("%s,%llu,%f,%f,%f,%f,%f,%f,%llu,%f,%f,%llu\n",argv[i],
+             (unsigned long long)state.candle.t,state.candle.open,
+             state.candle.high,state.candle.low,state.candle.close,
+             state.candle.volume,state.candle.vwap,
+             (unsigned long long)state.trade_t,state.trade_p,state.trade_v,
+             (unsigned long long)state.trades);
+    }
+    fflush(stdout);
+    usleep(interval_ms*1000);
+  }
+  return 0;
+}
@@ -0,0 +1,486 @@
+/**
+ * Local mock of Finnhub's WSS endpoint, for load testing the ingest path
+ * (lws receive + json parsing) without touching the real API.
+ *
+ * Accepts the subscribe messages that subscribe_to_symbols sends and streams
+ * trade frames of the subscribed symbols, at a configurable frame rate and
+ * number of trades per frame. Trades are either synthetic (from the trade
+ * generator, see Generator.h) or recorded (merged from a trade_logs folder,
+ * as the replay does).
+ *
+ * Usage: ./mock_server [-p port] [-b batch_size] [-f frames_per_sec]
+ *                      [-g rate [-G poisson|hawkes]]
+ *                      [-r trade_logs_folder [-l]] [-c cert -K key]
+ *                      [-D seconds]
+ *
+ * Each connection streams the recording of its own symbols from the start,
+ * independently of the others, as Finnhub does for several clients (or the
+ * shards of one). Recorded trades are paced by the frame rate. Synthetic
+ * trades are sent when their event time comes, batched up to batch_size
+ * per frame. A frame rate of 0 streams as fast as the client reads, in both
+ * cases.
+ *
+ * With -D, every connection is dropped after the given time, to exercise
+ * the client's reconnects (backoff, TLS session resumption, gap logging).
+*/
+#include <libwebsockets.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Generator.h"
+#include "JSONParsing.h"
+#include "Replay.h"
+#include "Symbols.h"
+#include "TradeProcessing.h"
+
+#define MOCK_DEFAULT_PORT 8765
+#define MOCK_MAX_SYMBOLS 8192
+#define MOCK_MAX_BATCH 1000
+#define MOCK_MESSAGE_LENGTH 256
+#define TICK_INTERVAL_US 1000 // Pacing resolution of the frame rate
+
+
+/**
+ * @brief Represents all configuration of the mock server.
+ */
+typedef struct{
+  int port; //< Listening port.
+  double frame_rate; //< Frames per second per connection (0 for max).
+  int batch_size; //< Trades per frame.
+  GeneratorConfig generator; //< Parameters of synthetic trades.
+  const char *replay_folder; //< If not NULL, stream recorded trades.
+  bool loop; //< Restart the recorded trades when exhausted.
+  const char *cert_path; //< If not NULL, serve over TLS.
+  const char *key_path; //< Private key of the certificate.
+  int drop_after; //< Seconds until each connection is dropped (0 never).
+} MockConfig;
+
+/**
+ * @brief Represents the state of a single client connection.
+ */
+typedef struct{
+  bool subscribed[MOCK_MAX_SYMBOLS]; //< Subscription flag of each symbol.
+  int subscriptions[MOCK_MAX_SYMBOLS]; //< Indexes of subscribed symbols.
+  int subscription_count; //< Number of subscribed symbols.
+  struct timespec stream_start; //< Time of the first subscription.
+  uint64_t frames_sent; //< Frames sent since stream_start.
+  unsigned char *frame_buffer; //< LWS_PRE padded buffer of a frame.
+  TradeGenerator generator; //< Source of synthetic trades.
+  Trade pending; //< Generated trade whose event time hasn't come yet.
+  bool has_pending; //< Whether pending holds a trade.
+  ReplayMerger merger; //< Source of recorded trades of the subscriptions.
+  bool merger_open; //< Whether merger is open.
+  bool subscriptions_changed; //< The merger must be reopened.
+  bool replay_exhausted; //< All recorded trades were sent.
+  uint64_t replay_t; //< Timestamp of the last recorded trade sent.
+} SessionData;
+
+
+static MockConfig config;
+// Known symbols. For recorded trades, those with a log in replay_folder.
+static char (*symbol_names)[SYMBOLS_MAX_LENGTH];
+static int symbol_count=0;
+// Service loop objects
+static struct lws_context *context;
+static lws_sorted_usec_list_t tick_sul;
+static volatile sig_atomic_t interrupted=0;
+// Statistics, printed every second
+static uint64_t total_frames=0,total_trades=0;
+static uint64_t ticks=0;
+
+
+static double elapsed_since(struct timespec start){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return (now.tv_sec-start.tv_sec)+(now.tv_nsec-start.tv_nsec)/1e9;
+}
+
+static uint64_t now_ms(){
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME,&now);
+  return (uint64_t)now.tv_sec*1000+now.tv_nsec/1000000;
+}
+
+static int find_symbol(const char *symbol){
+  for(int i=0;i<symbol_count;i++){
+    if(strcmp(symbol_names[i],symbol)==0)
+      return i;
+  }
+  return -1;
+}
+
+// Opens the merger of a session's subscriptions, whose symbol indexes are
+// positions on the subscription list
+static int open_session_replay(SessionData *session){
+  char (*names)[SYMBOLS_MAX_LENGTH];
+  int result;
+  names=malloc(session->subscription_count*SYMBOLS_MAX_LENGTH);
+  if(names==NULL)
+    return -1;
+  for(int i=0;i<session->subscription_count;i++)
+    strcpy(names[i],symbol_names[session->subscriptions[i]]);
+  result=replay_open(config.replay_folder,
+                     (const char (*)[SYMBOLS_MAX_LENGTH])names,
+                     session->subscription_count,&session->merger);
+  free(names);
+  session->merger_open=result==0;
+  return result;
+}
+
+// Gets the next trade for a session. Returns -1 if there isn't any (yet).
+static int next_trade(SessionData *session,Trade *trade){
+  if(config.replay_folder==NULL){
+    // Synthetic: generator symbols are positions on the subscription list
+    if(session->generator.symbol_count!=session->subscription_count &&
+       generator_resize(&session->generator,session->subscription_count)!=0)
+      return -1;
+    if(!session->has_pending){
+      if(generator_next(&session->generator,&session->pending)!=0)
+        return -1;
+      session->has_pending=true;
+    }
+    if(config.frame_rate>0 && session->pending.t>now_ms())
+      return -1;
+    *trade=session->pending;
+    trade->s_index=session->subscriptions[trade->s_index];
+    session->has_pending=false;
+    return 0;
+  }
+  // Recorded: the subscriptions changed, reopen their merger where the
+  // stream is (the trades of the new symbols start after the last sent)
+  if(session->subscriptions_changed){
+    session->subscriptions_changed=false;
+    session->has_pending=false;
+    if(session->merger_open)
+      replay_close(&session->merger);
+    session->merger_open=false;
+    if(open_session_replay(session)!=0)
+      return -1;
+    do{
+      if(replay_next(&session->merger,&session->pending)!=0)
+        return -1;
+    }while(session->replay_t>0 && session->pending.t<=session->replay_t);
+    session->has_pending=true;
+  }
+  while(!session->replay_exhausted){
+    if(session->has_pending){
+      *trade=session->pending;
+      session->has_pending=false;
+    }
+    else if(!session->merger_open || replay_next(&session->merger,trade)!=0){
+      if(session->merger_open)
+        replay_close(&session->merger);
+      session->merger_open=false;
+      if(!config.loop || open_session_replay(session)!=0){
+        session->replay_exhausted=true;
+        printf("Recorded trades exhausted\n");
+      }
+      continue;
+    }
+    session->replay_t=trade->t;
+    trade->s_index=session->subscriptions[trade->s_index];
+    return 0;
+  }
+  return -1;
+}
+
+// Writes a trade frame in Finnhub's format. Returns its length (0 if empty).
+static size_t build_frame(SessionData *session,char *frame,
+                          int *trades_in_frame){
+  static Trade trades[MOCK_MAX_BATCH];
+  int trades_count=0;
+  while(trades_count<config.batch_size &&
+        next_trade(session,&trades[trades_count])==0)
+    trades_count++;
+  *trades_in_frame=trades_count;
+  if(trades_count==0)
+    return 0;
+  total_trades+=trades_count;
+  return format_trade_frame(trades,trades_count,
+                            (const char (*)[SYMBOLS_MAX_LENGTH])symbol_names,
+                            frame);
+}
+
+// Handles a subscribe/unsubscribe message of a client
+static void handle_message(SessionData *session,const char *in,size_t len){
+  char message[MOCK_MESSAGE_LENGTH];
+  char symbol[SYMBOLS_MAX_LENGTH];
+  char *start,*end;
+  int i;
+  if(len>=MOCK_MESSAGE_LENGTH)
+    return;
+  memcpy(message,in,len);
+  message[len]='\0';
+  // Expected: {"type":"subscribe","symbol":"X"}
+  start=strstr(message,"\"symbol\":\"");
+  if(start==NULL)
+    return;
+  start+=strlen("\"symbol\":\"");
+  end=strchr(start,'"');
+  if(end==NULL || end-start>=SYMBOLS_MAX_LENGTH)
+    return;
+  memcpy(symbol,start,end-start);
+  symbol[end-start]='\0';
+
+  i=find_symbol(symbol);
+  // Synthetic symbols are created on demand
+  if(i<0 && config.replay_folder==NULL && symbol_count<MOCK_MAX_SYMBOLS){
+    i=symbol_count++;
+    strcpy(symbol_names[i],symbol);
+  }
+  if(i<0){
+    printf("Unknown symbol: %s\n",symbol);
+    return;
+  }
+  if(strstr(message,"\"type\":\"unsubscribe\"")!=NULL){
+    if(!session->subscribed[i])
+      return;
+    session->subscribed[i]=false;
+    for(int k=0;k<session->subscription_count;k++){
+      if(session->subscriptions[k]==i){
+        session->subscriptions[k]=
+          session->subscriptions[--session->subscription_count];
+        break;
+      }
+    }
+    session->subscriptions_changed=config.replay_folder!=NULL;
+    return;
+  }
+  if(session->subscribed[i])
+    return;
+  session->subscribed[i]=true;
+  session->subscriptions[session->subscription_count++]=i;
+  session->subscriptions_changed=config.replay_folder!=NULL;
+  // Start streaming at the first subscription
+  if(session->subscription_count==1){
+    clock_gettime(CLOCK_MONOTONIC,&session->stream_start);
+    session->frames_sent=0;
+    if(config.replay_folder==NULL && session->generator.symbol_count==0)
+      generator_init(&session->generator,&config.generator,1,now_ms());
+  }
+  return;
+}
+
+
+static int mock_callback(struct lws *wsi,enum lws_callback_reasons reason,
+                         void *user,void *in,size_t len){
+  SessionData *session=(SessionData*)user;
+  uint64_t frames_due=UINT64_MAX;
+  size_t frame_length;
+  int trades_in_frame;
+  bool behind;
+
+  switch(reason){
+  case LWS_CALLBACK_ESTABLISHED:
+    printf("Client connected\n");
+    memset(session,0,sizeof(SessionData));
+    session->frame_buffer=(unsigned char*)malloc(LWS_PRE+FRAME_JSON_OVERHEAD+
+                                config.batch_size*TRADE_JSON_MAX_LENGTH);
+    if(session->frame_buffer==NULL)
+      return -1;
+    if(config.drop_after>0)
+      lws_set_timeout(wsi,PENDING_TIMEOUT_USER_OK,config.drop_after);
+    break;
+  case LWS_CALLBACK_RECEIVE:
+    handle_message(session,(const char*)in,len);
+    break;
+  case LWS_CALLBACK_SERVER_WRITEABLE:
+    if(session->subscription_count==0)
+      break;
+    // Recorded frames that should have been sent by now, given the rate
+    if(config.replay_folder!=NULL && config.frame_rate>0){
+      frames_due=(uint64_t)(elapsed_since(session->stream_start)*
+                            config.frame_rate)+1;
+      if(session->frames_sent>=frames_due)
+        break;
+    }
+    frame_length=build_frame(session,(char*)&session->frame_buffer[LWS_PRE],
+                             &trades_in_frame);
+    if(frame_length==0)
+      break;
+    if(lws_write(wsi,&session->frame_buffer[LWS_PRE],frame_length,
+                 LWS_WRITE_TEXT)<(int)frame_length){
+      printf("Error on lws_write\n");
+      return -1;
+    }
+    session->frames_sent++;
+    total_frames++;
+    // Keep writing while behind schedule (a full synthetic frame means more
+    // trades may be due)
+    if(config.replay_folder!=NULL)
+      behind=session->frames_sent<frames_due;
+    else
+      behind=config.frame_rate==0 || trades_in_frame==config.batch_size;
+    if(behind)
+      lws_callback_on_writable(wsi);
+    break;
+  case LWS_CALLBACK_CLOSED:
+    printf("Client disconnected\n");
+    free(session->frame_buffer);
+    session->frame_buffer=NULL;
+    generator_destroy(&session->generator);
+    if(session->merger_open)
+      replay_close(&session->merger);
+    session->merger_open=false;
+    break;
+  default:
+    break;
+  }
+  return 0;
+}
+
+static struct lws_protocols protocols[]={
+  {"finnhub-protocol",mock_callback,sizeof(SessionData),4096,0,NULL,0},
+  {NULL,NULL,0,0,0,NULL,0}
+};
+
+
+// Wakes up all connections at each tick, so they can keep up with the rate
+static void tick(lws_sorted_usec_list_t *sul){
+  static uint64_t last_frames=0,last_trades=0;
+  lws_callback_on_writable_all_protocol(context,&protocols[0]);
+  // Print throughput each second
+  if(++ticks%(1000000/TICK_INTERVAL_US)==0 && total_frames>last_frames){
+    printf("%" PRIu64 " frames/s, %" PRIu64 " trades/s\n",
+           total_frames-last_frames,total_trades-last_trades);
+    last_frames=total_frames;
+    last_trades=total_trades;
+  }
+  lws_sul_schedule(context,0,sul,tick,TICK_INTERVAL_US);
+  return;
+}
+
+static void interrupt_handler(int sig){
+  (void)sig;
+  interrupted=1;
+  return;
+}
+
+static void print_mock_usage(const char *program_name){
+  printf("Usage: %s [-p port] [-b batch_size] [-f frames_per_sec] "
+         "[-g rate [-G poisson|hawkes]] [-r trade_logs_folder [-l]] "
+         "[-c cert -K key] [-D seconds]\n",program_name);
+  printf("  -p port    Listening port (default %d)\n",MOCK_DEFAULT_PORT);
+  printf("  -b size    Max trades per frame (default 1, max %d)\n",
+         MOCK_MAX_BATCH);
+  printf("  -f rate    Recorded frames per second, 0 for max (default 10)\n");
+  printf("  -g rate    Base rate of synthetic trades/s (default 1000)\n");
+  printf("  -G process Arrivals of synthetic trades: poisson or hawkes\n");
+  printf("  -r folder  Stream recorded trade logs instead of synthetic ones\n");
+  printf("  -l         Loop the recorded trade logs\n");
+  printf("  -c/-K      Certificate and key, to serve over TLS\n");
+  printf("  -D secs    Drop each connection after secs (test reconnects)\n");
+  return;
+}
+
+
+int main(int argc,char **argv){
+  struct lws_context_creation_info info;
+  int option;
+
+  // Configuration defaults
+  memset(&config,0,sizeof(config));
+  config.port=MOCK_DEFAULT_PORT;
+  config.frame_rate=10;
+  config.batch_size=1;
+  generator_default_config(&config.generator);
+  config.generator.seed=time(NULL);
+  while((option=getopt(argc,argv,"p:f:b:g:G:r:lc:K:D:h"))!=-1){
+    switch(option){
+    case 'p':
+      config.port=atoi(optarg);
+      break;
+    case 'f':
+      config.frame_rate=atof(optarg);
+      break;
+    case 'b':
+      config.batch_size=atoi(optarg);
+      break;
+    case 'g':
+      config.generator.rate=atof(optarg);
+      break;
+    case 'G':
+      config.generator.process=strcmp(optarg,"hawkes")==0?ARRIVALS_HAWKES:
+                                                          ARRIVALS_POISSON;
+      break;
+    case 'r':
+      config.replay_folder=optarg;
+      break;
+    case 'l':
+      config.loop=true;
+      break;
+    case 'c':
+      config.cert_path=optarg;
+      break;
+    case 'K':
+      config.key_path=optarg;
+      break;
+    case 'D':
+      config.drop_after=atoi(optarg);
+      break;
+    default:
+      print_mock_usage(argv[0]);
+      return -1;
+    }
+  }
+  if(config.port<=0 || config.frame_rate<0 || config.batch_size<1 ||
+     config.generator.rate<=0 || config.drop_after<0 ||
+     config.batch_size>MOCK_MAX_BATCH ||
+     (config.cert_path==NULL)!=(config.key_path==NULL)){
+    print_mock_usage(argv[0]);
+    return -1;
+  }
+
+  // Prepare the recorded source, each session merges its own symbols
+  if(config.replay_folder!=NULL){
+    symbol_names=list_folder_symbols(config.replay_folder,&symbol_count);
+    if(symbol_names==NULL || symbol_count>MOCK_MAX_SYMBOLS){
+      return -1;
+    }
+  }
+  else{
+    // Synthetic symbols are registered as clients subscribe to them
+    symbol_names=calloc(MOCK_MAX_SYMBOLS,SYMBOLS_MAX_LENGTH);
+    if(symbol_names==NULL)
+      return -1;
+  }
+
+  // Create the server's context
+  lws_set_log_level(LLL_ERR|LLL_WARN,NULL);
+  memset(&info,0,sizeof(info));
+  info.port=config.port;
+  info.protocols=protocols;
+  info.uid=-1;
+  info.gid=-1;
+  if(config.cert_path!=NULL){
+    info.options=LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+    info.ssl_cert_filepath=config.cert_path;
+    info.ssl_private_key_filepath=config.key_path;
+  }
+  context=lws_create_context(&info);
+  if(context==NULL){
+    printf("Error in context creation\n");
+    return -1;
+  }
+  printf("Mock server listening on port %d (%s)\n",config.port,
+         config.cert_path!=NULL?"wss":"ws");
+
+  signal(SIGINT,interrupt_handler);
+  lws_sul_schedule(context,0,&tick_sul,tick,TICK_INTERVAL_US);
+  while(!interrupted){
+    if(lws_service(context,0)<0)
+      break;
+  }
+
+  // Cleanup
+  lws_context_destroy(context);
+  free(symbol_names);
+  printf("\nSent %" PRIu64 " frames, %" PRIu64 " trades\n",total_frames,
+         total_trades);
+  return 0;
+}
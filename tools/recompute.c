@@ -0,0 +1,422 @@
+/**
+ * Offline recomputation of the candlesticks and moving averages from
+ * recorded trade logs, to validate or regenerate the calculator's outputs.
+ *
+ * The output is the one the Calculator writes when the logs are replayed
+ * (./main -r trade_logs_folder -x 0): a row per symbol and minute, from
+ * the minute of the earliest trade of all logs to the latest one. A trade
+ * that was logged after a later one falls into the later one's minute,
+ * as the replay closes minutes in log order. (With several writers, the
+ * live pipeline may also pass a trade at a minute's edge to the calculator
+ * after the directive; this is the result of a single writer.)
+ *
+ * Symbols are independent, so they're recomputed in parallel: each log is
+ * read in batches of columns by the CsvReader and a pool of threads takes
+ * one symbol per task. Tasks are dealt largest log first to per-thread
+ * deques, and idle threads steal from the back of the others' deques, so a
+ * few busy symbols don't leave threads idle. A first pass finds the minutes
+ * of each log, the second one aggregates the trades and writes the files.
+ *
+ * Usage: ./recompute [-t threads] [-F] trade_logs_folder output_folder
+ *
+ * Writes output_folder/candlesticks/X.csv and output_folder/moving_avg/X.csv
+ * for each trade log X.csv (replacing them). With -F prices are fixed
+ * point, with the scales of TICK_SCALES_PATH, as with ./main -F.
+*/
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "CsvReader.h"
+#include "FixedPoint.h"
+#include "Symbols.h"
+#include "SystemHandling.h"
+#include "TradeProcessing.h"
+
+#define RECOMPUTE_MAX_THREADS 64
+// Trades parsed at a time
+#define RECOMPUTE_BATCH_ROWS 4096
+// Output buffer of each csv file
+#define RECOMPUTE_FILE_BUFFER (256*1024)
+
+// Symbols of the recomputed logs
+const char (*symbols_list)[SYMBOLS_MAX_LENGTH];
+
+/**
+ * @brief A symbol's trade log and its minutes.
+ */
+typedef struct{
+  uint64_t length; //< Bytes of the log.
+  bool has_trades; //< The log has a valid trade.
+  uint64_t first_minute; //< Minute of the first trade.
+  uint64_t last_minute; //< Latest minute of the trades.
+  long trades; //< Trades aggregated.
+  int error; //< The symbol's outputs couldn't be written.
+} SymbolLog;
+
+/**
+ * @brief Symbols left to a thread, taken from head by it and from tail by
+ * the thieves.
+ */
+typedef struct{
+  pthread_mutex_t lock; //< Guards head and tail.
+  int *tasks; //< Symbol indexes.
+  int head; //< Next task of the owner.
+  int tail; //< One past the last task.
+} TaskDeque;
+
+/**
+ * @brief State shared by the pool's threads, for one pass.
+ */
+typedef struct{
+  TaskDeque *deques; //< One per thread.
+  int thread_count; //< Number of threads.
+  void (*run)(int symbol); //< The pass' task.
+} ThreadPool;
+
+/**
+ * @brief Arguments of a pool thread.
+ */
+typedef struct{
+  ThreadPool *pool; //< The pool.
+  int index; //< Index of the thread's deque.
+} WorkerArgs;
+
+static SymbolLog *logs;
+static const char *logs_folder,*results_folder;
+static uint64_t first_minute,last_minute;
+
+
+// Columns of a trade log: timestamp,p,v
+static const CsvColumnType trade_columns[3]={CSV_INTEGER,CSV_REAL,CSV_REAL};
+
+// Opens a symbol's trade log and the columns of its batches
+static int open_log(int symbol,CsvReader *reader,CsvColumns *columns){
+  char path[FILEPATH_BUFFER_LENGTH];
+  snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/%s.csv",logs_folder,
+           symbols_list[symbol]);
+  if(csv_open(reader,path,3,trade_columns)!=0)
+    return -1;
+  if(csv_columns_init(columns,reader,RECOMPUTE_BATCH_ROWS)!=0){
+    csv_close(reader);
+    return -1;
+  }
+  return 0;
+}
+
+// Pass 1: finds the first and latest minutes of a log
+static void scan_log(int symbol){
+  SymbolLog *log=&logs[symbol];
+  CsvReader reader;
+  CsvColumns columns;
+  uint64_t trade_minute;
+  if(open_log(symbol,&reader,&columns)!=0){
+    log->error=1;
+    return;
+  }
+  log->length=reader.size;
+  while(csv_read_columns(&reader,&columns)>0){
+    for(size_t i=0;i<columns.rows;i++){
+      trade_minute=columns.integers[0][i]/60000;
+      if(!log->has_trades){
+        log->has_trades=true;
+        log->first_minute=trade_minute;
+        log->last_minute=trade_minute;
+      }
+      else if(trade_minute>log->last_minute){
+        log->last_minute=trade_minute;
+      }
+    }
+  }
+  csv_columns_free(&columns);
+  csv_close(&reader);
+  return;
+}
+
+// Opens root/name/X.csv for writing
+static FILE *open_output(const char *root,const char *name,int symbol){
+  char path[FILEPATH_BUFFER_LENGTH];
+  FILE *file;
+  snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/%s/%s.csv",root,name,
+           symbols_list[symbol]);
+  file=fopen(path,"w");
+  if(file==NULL)
+    printf("Error in opening file: %s\n",path);
+  else
+    setvbuf(file,NULL,_IOFBF,RECOMPUTE_FILE_BUFFER);
+  return file;
+}
+
+// Pass 2: aggregates a log's trades minute by minute, as the calculator
+static void recompute_log(int symbol){
+  SymbolLog *log=&logs[symbol];
+  CsvReader reader;
+  CsvColumns columns;
+  size_t row=0;
+  FILE *candlestick_file,*avg_file;
+  CalculatorBuffer buffer;
+  FixedCalculatorBuffer fixed_buffer;
+  FixedTrade fixed_trade;
+  const TickScale *scale=tick_scales!=NULL?&tick_scales[symbol]:NULL;
+  uint64_t minute,trade_minute,open_minute=first_minute;
+  Trade trade;
+  bool pending=false;
+
+  if(open_log(symbol,&reader,&columns)!=0){
+    log->error=1;
+    return;
+  }
+  candlestick_file=open_output(results_folder,"candlesticks",symbol);
+  avg_file=open_output(results_folder,"moving_avg",symbol);
+  if(candlestick_file==NULL || avg_file==NULL){
+    log->error=1;
+    if(candlestick_file!=NULL)
+      fclose(candlestick_file);
+    if(avg_file!=NULL)
+      fclose(avg_file);
+    csv_columns_free(&columns);
+    csv_close(&reader);
+    return;
+  }
+  init_calculator_buffers(&buffer,1);
+  init_fixed_calculator_buffers(&fixed_buffer,1);
+  trade.s_index=0;
+  for(minute=first_minute;minute<=last_minute;minute++){
+    // Add the trades of the minute (and the late ones logged in it)
+    while(true){
+      if(!pending){
+        if(row==columns.rows){
+          row=0;
+          if(csv_read_columns(&reader,&columns)==0)
+            break;
+        }
+        trade.t=columns.integers[0][row];
+        trade.p=columns.reals[1][row];
+        trade.v=columns.reals[2][row];
+        row++;
+        trade_minute=trade.t/60000;
+        if(trade_minute>open_minute)
+          open_minute=trade_minute;
+        pending=true;
+      }
+      if(open_minute>minute)
+        break;
+      if(scale!=NULL){
+        fixed_trade.p=fixed_from_double(trade.p,scale->price_decimals);
+        fixed_trade.v=fixed_from_double(trade.v,scale->volume_decimals);
+        fixed_trade.t=trade.t;
+        fixed_trade.s_index=0;
+        add_fixed_trade_to_buffers(&fixed_trade,&fixed_buffer);
+      }
+      else{
+        add_trade_to_buffers(&trade,&buffer);
+      }
+      log->trades++;
+      pending=false;
+    }
+    if(scale!=NULL){
+      write_fixed_minute_entries(minute,0,scale,candlestick_file,avg_file,
+                                 NULL,&fixed_buffer,NULL);
+      reset_fixed_candlestick(&fixed_buffer);
+    }
+    else{
+      write_minute_entries(minute,0,candlestick_file,avg_file,NULL,&buffer,
+                           NULL);
+      reset_candlestick(&buffer);
+    }
+  }
+  csv_columns_free(&columns);
+  csv_close(&reader);
+  if(fclose(candlestick_file)!=0 || fclose(avg_file)!=0)
+    log->error=1;
+  return;
+}
+
+
+// Takes a task of the thread's own deque, or steals one. -1 when all are
+// taken.
+static int take_task(ThreadPool *pool,int index){
+  TaskDeque *deque=&pool->deques[index];
+  int task=-1;
+  pthread_mutex_lock(&deque->lock);
+  if(deque->head<deque->tail)
+    task=deque->tasks[deque->head++];
+  pthread_mutex_unlock(&deque->lock);
+  // Steal the smallest task of another thread
+  for(int i=1;task<0 && i<pool->thread_count;i++){
+    deque=&pool->deques[(index+i)%pool->thread_count];
+    pthread_mutex_lock(&deque->lock);
+    if(deque->head<deque->tail)
+      task=deque->tasks[--deque->tail];
+    pthread_mutex_unlock(&deque->lock);
+  }
+  return task;
+}
+
+static void *worker(void *arg){
+  WorkerArgs *args=(WorkerArgs*)arg;
+  int task;
+  while((task=take_task(args->pool,args->index))>=0)
+    args->pool->run(task);
+  return NULL;
+}
+
+// Orders symbols by the length of their log, largest first
+static int compare_log_length(const void *a,const void *b){
+  uint64_t x=logs[*(const int*)a].length,y=logs[*(const int*)b].length;
+  return (x<y)-(x>y);
+}
+
+// Runs a task for each symbol, on thread_count threads
+static int run_pass(void (*run)(int symbol),int symbol_count,
+                    int thread_count){
+  pthread_t threads[RECOMPUTE_MAX_THREADS];
+  WorkerArgs args[RECOMPUTE_MAX_THREADS];
+  ThreadPool pool;
+  int *order=(int*)malloc(symbol_count*sizeof(int));
+  int *tasks=(int*)malloc(symbol_count*sizeof(int));
+  TaskDeque *deques=(TaskDeque*)calloc(thread_count,sizeof(TaskDeque));
+  if(order==NULL || tasks==NULL || deques==NULL){
+    free(order);
+    free(tasks);
+    free(deques);
+    return -1;
+  }
+  // Deal the tasks round robin, largest first, so each deque gets a share
+  // of the large logs. Each deque's tasks are contiguous in tasks.
+  for(int i=0;i<symbol_count;i++)
+    order[i]=i;
+  qsort(order,symbol_count,sizeof(int),compare_log_length);
+  for(int t=0,position=0;t<thread_count;t++){
+    pthread_mutex_init(&deques[t].lock,NULL);
+    deques[t].tasks=&tasks[position];
+    deques[t].head=0;
+    for(int i=t;i<symbol_count;i+=thread_count)
+      tasks[position+deques[t].tail++]=order[i];
+    position+=deques[t].tail;
+  }
+  pool.deques=deques;
+  pool.thread_count=thread_count;
+  pool.run=run;
+  for(int t=0;t<thread_count;t++){
+    args[t].pool=&pool;
+    args[t].index=t;
+    pthread_create(&threads[t],NULL,worker,(void*)&args[t]);
+  }
+  for(int t=0;t<thread_count;t++){
+    pthread_join(threads[t],NULL);
+    pthread_mutex_destroy(&deques[t].lock);
+  }
+  free(order);
+  free(tasks);
+  free(deques);
+  return 0;
+}
+
+
+int main(int argc,char **argv){
+  char path[FILEPATH_BUFFER_LENGTH];
+  struct timeval start,end;
+  int symbol_count,option,errors=0;
+  int thread_count=(int)sysconf(_SC_NPROCESSORS_ONLN);
+  bool fixed_point=false,has_trades=false;
+  long trades=0;
+
+  while((option=getopt(argc,argv,"t:F"))!=-1){
+    switch(option){
+    case 't':
+      thread_count=atoi(optarg);
+      break;
+    case 'F':
+      fixed_point=true;
+      break;
+    default:
+      printf("Usage: %s [-t threads] [-F] trade_logs_folder output_folder\n",
+             argv[0]);
+      return -1;
+    }
+  }
+  if(argc-optind!=2){
+    printf("Usage: %s [-t threads] [-F] trade_logs_folder output_folder\n",
+           argv[0]);
+    return -1;
+  }
+  if(thread_count<1)
+    thread_count=1;
+  if(thread_count>RECOMPUTE_MAX_THREADS)
+    thread_count=RECOMPUTE_MAX_THREADS;
+  gettimeofday(&start,NULL);
+
+  // Symbols: those of the logs
+  symbols_list=list_folder_symbols(argv[optind],&symbol_count);
+  if(symbols_list==NULL || symbol_count==0){
+    printf("No trade logs in %s\n",argv[optind]);
+    return -1;
+  }
+  if(fixed_point && (build_symbol_index(symbol_count)!=0 ||
+                     tick_scales_load(TICK_SCALES_PATH,symbol_count)!=0)){
+    printf("Error in tick scales setup\n");
+    return -1;
+  }
+  if(thread_count>symbol_count)
+    thread_count=symbol_count;
+  logs=(SymbolLog*)calloc(symbol_count,sizeof(SymbolLog));
+  if(logs==NULL)
+    return -1;
+
+  // Pass 1: the minutes of all logs
+  logs_folder=argv[optind];
+  if(run_pass(scan_log,symbol_count,thread_count)!=0)
+    return -1;
+  for(int i=0;i<symbol_count;i++){
+    errors+=logs[i].error;
+    if(!logs[i].has_trades)
+      continue;
+    if(!has_trades || logs[i].first_minute<first_minute)
+      first_minute=logs[i].first_minute;
+    if(!has_trades || logs[i].last_minute>last_minute)
+      last_minute=logs[i].last_minute;
+    has_trades=true;
+  }
+  if(errors>0 || !has_trades){
+    printf(errors>0?"Error in reading the logs\n":"No trades in the logs\n");
+    return -1;
+  }
+
+  // Pass 2: the outputs
+  results_folder=argv[optind+1];
+  snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/candlesticks",results_folder);
+  if(ensure_directory_exists(results_folder)!=0 ||
+     ensure_directory_exists(path)!=0){
+    printf("Error in creating directory: %s\n",path);
+    return -1;
+  }
+  snprintf(path,FILEPATH_BUFFER_LENGTH,"%s/moving_avg",results_folder);
+  if(ensure_directory_exists(path)!=0){
+    printf("Error in creating directory: %s\n",path);
+    return -1;
+  }
+  if(run_pass(recompute_log,symbol_count,thread_count)!=0)
+    return -1;
+  for(int i=0;i<symbol_count;i++){
+    errors+=logs[i].error;
+    trades+=logs[i].trades;
+  }
+  gettimeofday(&end,NULL);
+  printf("Recomputed %d symbols, %ld trades, minutes %" PRIu64 " to %" PRIu64
+         " on %d threads in %f s\n",symbol_count,trades,first_minute,
+         last_minute,thread_count,
+         (end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)/1e6);
+  if(errors>0){
+    printf("%d symbols couldn't be recomputed\n",errors);
+    return -1;
+  }
+  free(logs);
+  tick_scales_free();
+  return 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * Example subscriber of the feed of ./main -f (see Publisher.h), with no
+ * dependency on the rest of the project.
+ *
+ * Prints the T (trade) and C (closed minute) lines of the given symbols,
+ * or of all of them, as they're published. The publisher drops
+ * subscribers that fall too far behind, so the lines are read in large
+ * blocks and printed with a buffered stdout.
+ *
+ * Usage: ./subscribe [-s socket] [symbols...]
+*/
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SUBSCRIBE_DEFAULT_SOCKET "./feed.sock"
+#define SUBSCRIBE_BUFFER_LENGTH (64*1024)
+#define SUBSCRIBE_LINE_LENGTH 256
+
+// Whether the symbol of a line (its second field) is one of the requested
+static bool wanted(const char *line,char **symbols,int symbol_count){
+  const char *symbol=strchr(line,','),*end;
+  if(symbol_count==0)
+    return true;
+  if(symbol==NULL)
+    return false;
+  symbol++;
+  end=strchr(symbol,',');
+  if(end==NULL)
+    return false;
+  for(int i=0;i<symbol_count;i++){
+    if(strlen(symbols[i])==(size_t)(end-symbol) &&
+       strncmp(symbols[i],symbol,end-symbol)==0)
+      return true;
+  }
+  return false;
+}
+
+
+int main(int argc,char **argv){
+  const char *path=SUBSCRIBE_DEFAULT_SOCKET;
+  struct sockaddr_un address;
+  static char buffer[SUBSCRIBE_BUFFER_LENGTH];
+  char line[SUBSCRIBE_LINE_LENGTH];
+  size_t line_length=0;
+  ssize_t received;
+  int fd,option;
+
+  while((option=getopt(argc,argv,"s:"))!=-1){
+    switch(option){
+    case 's':
+      path=optarg;
+      break;
+    default:
+      printf("Usage: %s [-s socket] [symbols...]\n",argv[0]);
+      return -1;
+    }
+  }
+  if(strlen(path)>=sizeof(address.sun_path)){
+    printf("Socket path too long: %s\n",path);
+    return -1;
+  }
+  memset(&address,0,sizeof(address));
+  address.sun_family=AF_UNIX;
+  strcpy(address.sun_path,path);
+  fd=socket(AF_UNIX,SOCK_STREAM,0);
+  if(fd<0 || connect(fd,(struct sockaddr*)&address,sizeof(address))!=0){
+    printf("Couldn't connect to %s (is ./main -f running?)\n",path);
+    return -1;
+  }
+
+  while((received=recv(fd,buffer,sizeof(buffer),0))>0){
+    for(ssize_t i=0;i<received;i++){
+      if(buffer[i]!='\n'){
+        // Lines are short, a longer one is cut
+        if(line_length<sizeof(line)-1)
+          line[line_length++]=buffer[i];
+        continue;
+      }
+      line[line_length]='\0';
+      if(wanted(line,argv+optind,argc-optind))
+        puts(line);
+      line_length=0;
+    }
+  }
+  fflush(stdout);
+  close(fd);
+  if(received<0){
+    printf("Connection to %s lost\n",path);
+    return -1;
+  }
+  return 0;
+}